@@ -255,9 +255,9 @@ if (($TMUX & 8)) ; then
 		echo "Coverage report generation..."
 		COVERAGE_OUT=$OUT_DOC/coverage.txt
 		$MAKE -j $MJOBS CC=$GCC PROFILING=1 2>/dev/null >/dev/null
-		for f in schar scommon sdata senc shash smap smset shmap \
-			 shset ssearch ssort sstring sstringo stree svector \
-			 stest ; do
+		for f in sarena sbtree schar scommon sdata sdimage senc shash smap \
+			 smset shmap srope shset snum ssearch ssort sstats sstring \
+			 sstringo stree svector svmem stest ; do
 			gcov $f.c >/dev/null 2>/dev/null
 		done
 		rm -f $COVERAGE_OUT 2>/dev/null
@@ -13,13 +13,17 @@ extern "C" {
  * Released under the BSD 3-Clause License (see the doc/LICENSE)
  */
 
+#include "sarena.h"
 #include "sbitset.h"
 #include "shmap.h"
 #include "shset.h"
 #include "smap.h"
 #include "smset.h"
+#include "srope.h"
+#include "sstats.h"
 #include "sstring.h"
 #include "svector.h"
+#include "svmem.h"
 
 #ifdef __cplusplus
 } /* extern "C" { */
@@ -0,0 +1,299 @@
+/*
+ * sarena.c
+ *
+ * Region (arena) allocator.
+ *
+ * Observations:
+ * - Every block has a header with its size (rounded to SA_ALIGN), so
+ *   resizing knows how many bytes to copy. The lowest bit marks blocks
+ *   having their own chunk ("big" blocks, i.e. bigger than 1/4 of the
+ *   chunk size), which are resized with realloc() and released on free.
+ * - Chunks are taken with the global allocator (s_malloc/s_free).
+ *
+ * Copyright (c) 2015-2020 F. Aragon. All rights reserved.
+ * Released under the BSD 3-Clause License (see the doc/LICENSE)
+ */
+
+#include "sarena.h"
+#include "saux/scommon.h"
+
+/*
+ * Constants
+ */
+
+#define SA_ALIGN 8	/* block alignment (bytes) */
+#define SA_HDR SA_ALIGN /* block header size (bytes) */
+#define SA_BIG 1	/* block header flag: block with its own chunk */
+#define SA_CHUNK_MIN 256
+
+/*
+ * Internal functions
+ */
+
+S_INLINE uint8_t *sa_chunk_data(struct SArenaChunk *c)
+{
+	return (uint8_t *)(c + 1);
+}
+
+S_INLINE size_t *sa_blk_hdr(void *p)
+{
+	return (size_t *)((uint8_t *)p - SA_HDR);
+}
+
+S_INLINE struct SArenaChunk *sa_big_chunk(void *p)
+{
+	return (struct SArenaChunk *)((uint8_t *)p - SA_HDR) - 1;
+}
+
+S_INLINE srt_bool sa_is_big(const srt_arena *a, size_t rs)
+{
+	return rs > a->chunk_size / 4 ? S_TRUE : S_FALSE;
+}
+
+/* Checks if the block is the most recent allocation of the current chunk */
+S_INLINE srt_bool sa_is_top(const srt_arena *a, void *p, size_t rs)
+{
+	uint8_t *top;
+	RETURN_IF(!a->cur, S_FALSE);
+	top = sa_chunk_data(a->cur) + a->cur->used;
+	return (uint8_t *)p + rs == top ? S_TRUE : S_FALSE;
+}
+
+/* Size rounded to the alignment (0: overflow) */
+static size_t sa_round(size_t size)
+{
+	size_t rs = (size + SA_ALIGN - 1) & ~(size_t)(SA_ALIGN - 1),
+	       extra = SA_HDR + sizeof(struct SArenaChunk);
+	RETURN_IF(rs < size || s_size_t_overflow(rs, extra), 0);
+	return rs > 0 ? rs : SA_ALIGN;
+}
+
+static struct SArenaChunk *sa_chunk_alloc(srt_arena *a, size_t size)
+{
+	struct SArenaChunk *c =
+		(struct SArenaChunk *)s_malloc(sizeof(*c) + size);
+	RETURN_IF(!c, NULL);
+	c->prev = c->next = NULL;
+	c->size = size;
+	c->used = 0;
+	a->nchunks++;
+	a->alloc_size += sizeof(*c) + size;
+	return c;
+}
+
+static void sa_chunk_free(srt_arena *a, struct SArenaChunk *c)
+{
+	a->nchunks--;
+	a->alloc_size -= sizeof(*c) + c->size;
+	s_free(c);
+}
+
+static void sa_big_link(srt_arena *a, struct SArenaChunk *c)
+{
+	if (c->prev)
+		c->prev->next = c;
+	else
+		a->big = c;
+	if (c->next)
+		c->next->prev = c;
+}
+
+static void *sa_alloc_big(srt_arena *a, size_t rs)
+{
+	size_t *h;
+	struct SArenaChunk *c = sa_chunk_alloc(a, SA_HDR + rs);
+	RETURN_IF(!c, NULL);
+	c->used = c->size;
+	c->next = a->big;
+	sa_big_link(a, c);
+	h = (size_t *)sa_chunk_data(c);
+	*h = rs | SA_BIG;
+	return (uint8_t *)h + SA_HDR;
+}
+
+static void *sa_realloc_big(srt_arena *a, void *p, size_t rs)
+{
+	struct SArenaChunk *c = sa_big_chunk(p), *c2;
+	size_t os = c->size;
+	c2 = (struct SArenaChunk *)s_realloc(c, sizeof(*c) + SA_HDR + rs);
+	RETURN_IF(!c2, NULL);
+	c2->size = c2->used = SA_HDR + rs;
+	a->alloc_size += c2->size - os;
+	sa_big_link(a, c2);
+	*(size_t *)sa_chunk_data(c2) = rs | SA_BIG;
+	return sa_chunk_data(c2) + SA_HDR;
+}
+
+static void *sa_f_alloc(void *context, size_t size)
+{
+	return sa_malloc((srt_arena *)context, size);
+}
+
+static void *sa_f_realloc(void *context, void *ptr, size_t size)
+{
+	return sa_realloc((srt_arena *)context, ptr, size);
+}
+
+static void sa_f_free(void *context, void *ptr)
+{
+	sa_free_ptr((srt_arena *)context, ptr);
+}
+
+/*
+ * Allocation
+ */
+
+srt_arena *sa_alloc(size_t chunk_size)
+{
+	srt_arena *a = (srt_arena *)s_malloc(sizeof(srt_arena));
+	RETURN_IF(!a, NULL);
+	a->a.f_alloc = sa_f_alloc;
+	a->a.f_realloc = sa_f_realloc;
+	a->a.f_free = sa_f_free;
+	a->a.context = a;
+	a->cur = a->big = NULL;
+	a->chunk_size = !chunk_size ? SA_CHUNK_SIZE
+				    : S_MAX(chunk_size, SA_CHUNK_MIN);
+	a->nchunks = 0;
+	a->alloc_size = sizeof(srt_arena);
+	return a;
+}
+
+void sa_free_aux(srt_arena **a, ...)
+{
+	va_list ap;
+	srt_arena **next;
+	va_start(ap, a);
+	next = a;
+	while (!s_varg_tail_ptr_tag(next)) { /* last element tag */
+		if (next && *next) {
+			sa_reset(*next);
+			if ((*next)->cur)
+				s_free((*next)->cur);
+			sd_allocator_release(&(*next)->a);
+			s_free(*next);
+			*next = NULL;
+		}
+		next = (srt_arena **)va_arg(ap, srt_arena **);
+	}
+	va_end(ap);
+}
+
+void sa_reset(srt_arena *a)
+{
+	struct SArenaChunk *c, *c_next;
+	if (!a)
+		return;
+	for (c = a->big; c; c = c_next) {
+		c_next = c->next;
+		sa_chunk_free(a, c);
+	}
+	a->big = NULL;
+	if (a->cur) { /* BEHAVIOR: keep the current chunk for reuse */
+		for (c = a->cur->next; c; c = c_next) {
+			c_next = c->next;
+			sa_chunk_free(a, c);
+		}
+		a->cur->next = NULL;
+		a->cur->used = 0;
+	}
+}
+
+const srt_allocator *sa_allocator(srt_arena *a)
+{
+	return a ? &a->a : NULL;
+}
+
+/*
+ * Raw memory
+ */
+
+void *sa_malloc(srt_arena *a, size_t size)
+{
+	size_t rs;
+	uint8_t *p;
+	struct SArenaChunk *c;
+	RETURN_IF(!a, NULL);
+	rs = sa_round(size);
+	RETURN_IF(!rs, NULL); /* overflow */
+	if (sa_is_big(a, rs))
+		return sa_alloc_big(a, rs);
+	if (!a->cur || a->cur->size - a->cur->used < SA_HDR + rs) {
+		c = sa_chunk_alloc(a, a->chunk_size);
+		RETURN_IF(!c, NULL);
+		c->next = a->cur;
+		a->cur = c;
+	}
+	p = sa_chunk_data(a->cur) + a->cur->used;
+	*(size_t *)p = rs;
+	a->cur->used += SA_HDR + rs;
+	return p + SA_HDR;
+}
+
+void *sa_realloc(srt_arena *a, void *ptr, size_t size)
+{
+	size_t h, os, rs;
+	void *p2;
+	struct SArenaChunk *c;
+	RETURN_IF(!a, NULL);
+	RETURN_IF(!ptr, sa_malloc(a, size));
+	rs = sa_round(size);
+	RETURN_IF(!rs, NULL); /* overflow */
+	h = *sa_blk_hdr(ptr);
+	os = h & ~(size_t)SA_BIG;
+	if ((h & SA_BIG) != 0)
+		return sa_realloc_big(a, ptr, rs);
+	if (sa_is_top(a, ptr, os)) { /* in-place resize */
+		if (rs <= os
+		    || (!sa_is_big(a, rs)
+			&& a->cur->size - a->cur->used >= rs - os)) {
+			a->cur->used = a->cur->used - os + rs;
+			*sa_blk_hdr(ptr) = rs;
+			return ptr;
+		}
+	} else if (rs <= os) {
+		return ptr; /* BEHAVIOR: shrink not released */
+	}
+	c = sa_is_top(a, ptr, os) ? a->cur : NULL;
+	p2 = sa_malloc(a, size);
+	RETURN_IF(!p2, NULL);
+	memcpy(p2, ptr, os);
+	if (c) /* release the previous block, if on top */
+		c->used -= SA_HDR + os;
+	return p2;
+}
+
+void sa_free_ptr(srt_arena *a, void *ptr)
+{
+	size_t h;
+	struct SArenaChunk *c;
+	if (!a || !ptr)
+		return;
+	h = *sa_blk_hdr(ptr);
+	if ((h & SA_BIG) != 0) {
+		c = sa_big_chunk(ptr);
+		if (c->prev)
+			c->prev->next = c->next;
+		else
+			a->big = c->next;
+		if (c->next)
+			c->next->prev = c->prev;
+		sa_chunk_free(a, c);
+	} else if (sa_is_top(a, ptr, h)) {
+		a->cur->used -= SA_HDR + h;
+	}
+}
+
+/*
+ * Accessors
+ */
+
+size_t sa_nchunks(const srt_arena *a)
+{
+	return a ? a->nchunks : 0;
+}
+
+size_t sa_alloc_size(const srt_arena *a)
+{
+	return a ? a->alloc_size : 0;
+}
@@ -0,0 +1,104 @@
+#ifndef SARENA_H
+#define SARENA_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * sarena.h
+ *
+ * #SHORTDOC region (arena) allocator
+ *
+ * #DOC Arena functions, for short-lived objects (e.g. request-scoped work).
+ * #DOC Memory is taken from big chunks using a bump pointer, so allocation
+ * #DOC is just a pointer increment. The most recent allocation can grow and
+ * #DOC shrink in place, and releasing individual blocks is a no-op (except
+ * #DOC for the most recent one, and for blocks too big for a chunk, which
+ * #DOC get their own chunk). All the memory is released at once with
+ * #DOC sa_reset() or sa_free(), in O(chunks) time.
+ * #DOC
+ * #DOC The arena is used by containers through the allocator interface
+ * #DOC (sa_allocator()), e.g.: ss_alloc_a(sa_allocator(a), 0). Containers
+ * #DOC allocated from the arena must not be used after the arena reset.
+ *
+ * Copyright (c) 2015-2020 F. Aragon. All rights reserved.
+ * Released under the BSD 3-Clause License (see the doc/LICENSE)
+ */
+
+#include "saux/sdata.h"
+
+/*
+ * Structures
+ */
+
+#ifndef SA_CHUNK_SIZE
+#define SA_CHUNK_SIZE 65536 /* default chunk size (bytes) */
+#endif
+
+struct SArenaChunk {
+	struct SArenaChunk *prev, *next;
+	size_t size; /* data area size (bytes) */
+	size_t used; /* bump pointer offset (bytes) */
+};
+
+struct SArena {
+	srt_allocator a; /* allocator interface (context: the arena) */
+	struct SArenaChunk *cur; /* current chunk (linked to older ones) */
+	struct SArenaChunk *big; /* chunks with one block (big allocations) */
+	size_t chunk_size, nchunks, alloc_size;
+};
+
+typedef struct SArena srt_arena; /* Opaque structure (accessors are provided) */
+
+/*
+ * Allocation
+ */
+
+/*
+#API: |Free one or more arenas (releasing all its memory)|arena;more arenas (optional)|-|O(n)|1;2|
+void sa_free(srt_arena **a, ...)
+*/
+#ifdef S_USE_VA_ARGS
+#define sa_free(...) sa_free_aux(__VA_ARGS__, S_INVALID_PTR_VARG_TAIL)
+#else
+#define sa_free(a) sa_free_aux(a, S_INVALID_PTR_VARG_TAIL)
+#endif
+void sa_free_aux(srt_arena **a, ...);
+
+/* #API: |Allocate arena (heap)|chunk size (bytes, 0 for SA_CHUNK_SIZE)|arena (NULL: not enough memory)|O(1)|1;2| */
+srt_arena *sa_alloc(size_t chunk_size);
+
+/* #API: |Release all arena allocations (keeping one chunk for reuse)|arena||O(n)|1;2| */
+void sa_reset(srt_arena *a);
+
+/* #API: |Get the allocator interface, for allocating containers from the arena (e.g. ss_alloc_a(), sv_alloc_a(), shm_alloc_a())|arena|allocator (NULL for NULL arena, i.e. global allocator)|O(1)|1;2| */
+const srt_allocator *sa_allocator(srt_arena *a);
+
+/*
+ * Raw memory
+ */
+
+/* #API: |Allocate memory block|arena;size (bytes)|block (NULL: not enough memory)|O(1)|1;2| */
+void *sa_malloc(srt_arena *a, size_t size);
+
+/* #API: |Resize memory block (in place if it is the most recent allocation)|arena;block (NULL for allocating a new one);size (bytes)|block (NULL: not enough memory, keeping the original block)|O(1) in place, O(n) otherwise|1;2| */
+void *sa_realloc(srt_arena *a, void *ptr, size_t size);
+
+/* #API: |Release memory block (no-op, except for the most recent allocation and big blocks)|arena;block||O(1)|1;2| */
+void sa_free_ptr(srt_arena *a, void *ptr);
+
+/*
+ * Accessors
+ */
+
+/* #API: |Number of chunks|arena|number of chunks|O(1)|1;2| */
+size_t sa_nchunks(const srt_arena *a);
+
+/* #API: |Get allocated space (bytes requested to the system)|arena|allocated space (bytes)|O(1)|1;2| */
+size_t sa_alloc_size(const srt_arena *a);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* #ifndef SARENA_H */
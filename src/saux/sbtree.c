@@ -0,0 +1,597 @@
+/*
+ * sbtree.c
+ *
+ * B+tree index (integer key to node index).
+ *
+ * Observations:
+ * - Using indexes instead of pointers (linear space addressing), as the
+ *   red-black tree, so copies are a memcpy() and the index can be grown
+ *   with a single realloc().
+ * - Inner nodes and leaves have the same size, so any node slot can hold
+ *   any node type.
+ *
+ * Copyright (c) 2015-2020 F. Aragon. All rights reserved.
+ * Released under the BSD 3-Clause License (see the doc/LICENSE)
+ */
+
+#include "sbtree.h"
+#include "../sstats.h"
+#include "scommon.h"
+
+/*
+ * Internal functions
+ */
+
+S_INLINE union SBTNode *sbt_node(srt_btree *b, srt_tndx n)
+{
+	return (union SBTNode *)((uint8_t *)b + b->d.header_size) + n;
+}
+
+S_INLINE const union SBTNode *sbt_node_r(const srt_btree *b, srt_tndx n)
+{
+	return (const union SBTNode *)((const uint8_t *)b + b->d.header_size)
+	       + n;
+}
+
+/*
+ * In-node search: branch-free linear scan, so the compiler can vectorize
+ * it (for the node sizes used, it is faster than a binary search)
+ */
+
+/* Number of keys lower than k */
+S_INLINE uint32_t sbt_lt(const int64_t *ks, uint32_t n, int64_t k)
+{
+	uint32_t i, r = 0;
+	for (i = 0; i < n; i++)
+		r += ks[i] < k ? 1 : 0;
+	return r;
+}
+
+/* Number of keys lower or equal than k */
+S_INLINE uint32_t sbt_le(const int64_t *ks, uint32_t n, int64_t k)
+{
+	uint32_t i, r = 0;
+	for (i = 0; i < n; i++)
+		r += ks[i] <= k ? 1 : 0;
+	return r;
+}
+
+/* Leaf where the key is or should be (optional path tracking) */
+static srt_tndx sbt_leaf_of(const srt_btree *b, int64_t k, srt_tndx *path,
+			    uint32_t *ppos)
+{
+	uint32_t h, j;
+	srt_tndx n = b->root;
+	const struct SBTInner *in;
+	for (h = b->height; h > 0; h--) {
+		in = &sbt_node_r(b, n)->i;
+		j = sbt_le(in->k, in->cnt, k);
+		if (path) {
+			path[h] = n;
+			ppos[h] = j;
+		}
+		n = in->c[j];
+	}
+	return n;
+}
+
+/* Make room for n extra nodes (node pointers are invalidated) */
+static srt_bool sbt_reserve(srt_btree **b, size_t n)
+{
+	size_t ns = (*b)->d.size + n;
+	return sd_reserve((srt_data **)b, ns, 0) >= ns ? S_TRUE : S_FALSE;
+}
+
+/* Node allocation (space already reserved) */
+S_INLINE srt_tndx sbt_new_node(srt_btree *b)
+{
+	return (srt_tndx)b->d.size++;
+}
+
+/* Insert into full leaf, propagating the split upwards */
+static void sbt_split(srt_btree *b, srt_tndx leaf, uint32_t p, int64_t k,
+		      srt_tndx x, const srt_tndx *path, const uint32_t *ppos)
+{
+	int64_t sep, tk[SBT_INNER_N + 1 > SBT_LEAF_N + 1 ? SBT_INNER_N + 1
+							 : SBT_LEAF_N + 1];
+	srt_tndx r, child, tx[SBT_INNER_N + 2 > SBT_LEAF_N + 1
+				      ? SBT_INNER_N + 2
+				      : SBT_LEAF_N + 1];
+	uint32_t h, j, nl, n;
+	struct SBTLeaf *l, *lr;
+	struct SBTInner *in, *ir;
+	/* Leaf split: N + 1 elements, left keeps the lower half */
+	l = &sbt_node(b, leaf)->l;
+	n = SBT_LEAF_N;
+	memcpy(tk, l->k, p * sizeof(int64_t));
+	memcpy(tk + p + 1, l->k + p, (n - p) * sizeof(int64_t));
+	memcpy(tx, l->x, p * sizeof(srt_tndx));
+	memcpy(tx + p + 1, l->x + p, (n - p) * sizeof(srt_tndx));
+	tk[p] = k;
+	tx[p] = x;
+	nl = (n + 1) / 2;
+	r = sbt_new_node(b);
+	lr = &sbt_node(b, r)->l;
+	l->cnt = nl;
+	memcpy(l->k, tk, nl * sizeof(int64_t));
+	memcpy(l->x, tx, nl * sizeof(srt_tndx));
+	lr->cnt = n + 1 - nl;
+	memcpy(lr->k, tk + nl, lr->cnt * sizeof(int64_t));
+	memcpy(lr->x, tx + nl, lr->cnt * sizeof(srt_tndx));
+	lr->next = l->next;
+	l->next = r;
+	sep = lr->k[0];
+	child = r;
+	/* Insert the new child into the parent, splitting it if full */
+	for (h = 1; h <= b->height; h++) {
+		in = &sbt_node(b, path[h])->i;
+		j = ppos[h];
+		if (in->cnt < SBT_INNER_N) {
+			memmove(in->k + j + 1, in->k + j,
+				(in->cnt - j) * sizeof(int64_t));
+			memmove(in->c + j + 2, in->c + j + 1,
+				(in->cnt - j) * sizeof(srt_tndx));
+			in->k[j] = sep;
+			in->c[j + 1] = child;
+			in->cnt++;
+			return;
+		}
+		n = SBT_INNER_N;
+		memcpy(tk, in->k, j * sizeof(int64_t));
+		memcpy(tk + j + 1, in->k + j, (n - j) * sizeof(int64_t));
+		memcpy(tx, in->c, (j + 1) * sizeof(srt_tndx));
+		memcpy(tx + j + 2, in->c + j + 1, (n - j) * sizeof(srt_tndx));
+		tk[j] = sep;
+		tx[j + 1] = child;
+		/* N + 1 keys: left keeps nl, the next one is promoted */
+		nl = (n + 1) / 2;
+		r = sbt_new_node(b);
+		ir = &sbt_node(b, r)->i;
+		ir->reserved = 0;
+		in->cnt = nl;
+		memcpy(in->k, tk, nl * sizeof(int64_t));
+		memcpy(in->c, tx, (nl + 1) * sizeof(srt_tndx));
+		ir->cnt = n - nl;
+		memcpy(ir->k, tk + nl + 1, ir->cnt * sizeof(int64_t));
+		memcpy(ir->c, tx + nl + 1, (ir->cnt + 1) * sizeof(srt_tndx));
+		sep = tk[nl];
+		child = r;
+	}
+	/* Root split */
+	r = sbt_new_node(b);
+	in = &sbt_node(b, r)->i;
+	in->cnt = 1;
+	in->reserved = 0;
+	in->k[0] = sep;
+	in->c[0] = b->root;
+	in->c[1] = child;
+	b->root = r;
+	b->height++;
+}
+
+/* Lowest key of the subtree (level 0: leaf) */
+static int64_t sbt_min_key(const srt_btree *b, srt_tndx n, uint32_t level)
+{
+	for (; level > 0; level--)
+		n = sbt_node_r(b, n)->i.c[0];
+	return sbt_node_r(b, n)->l.k[0];
+}
+
+/* Build packed index from other index (bulk load) */
+static srt_btree *sbt_build(const srt_btree *src)
+{
+	int64_t k;
+	size_t i, lo, hi, nleaves;
+	uint32_t level, pos;
+	srt_tndx leaf, prev, p;
+	struct SBTLeaf *l;
+	struct SBTInner *in;
+	const struct SBTLeaf *ls;
+	srt_btree *b = sbt_alloc(src->d.alloc_id, src->nelems);
+	RETURN_IF(!b || !src->nelems, b);
+	nleaves = (src->nelems + SBT_LEAF_N - 1) / SBT_LEAF_N;
+	if (!sbt_reserve(&b, nleaves + nleaves / SBT_INNER_N
+				     + SBT_MAX_HEIGHT)) {
+		sbt_free(&b);
+		return NULL;
+	}
+	/* Leaves, full (nodes 0 to nleaves - 1) */
+	prev = ST_NIL;
+	l = NULL;
+	for (leaf = src->first; leaf != ST_NIL; leaf = ls->next) {
+		ls = &sbt_node_r(src, leaf)->l;
+		for (pos = 0; pos < ls->cnt; pos++) {
+			if (!l || l->cnt == SBT_LEAF_N) {
+				p = sbt_new_node(b);
+				l = &sbt_node(b, p)->l;
+				l->cnt = 0;
+				l->next = ST_NIL;
+				if (prev != ST_NIL)
+					sbt_node(b, prev)->l.next = p;
+				prev = p;
+			}
+			l->k[l->cnt] = ls->k[pos];
+			l->x[l->cnt++] = ls->x[pos];
+		}
+	}
+	/* Inner levels */
+	lo = 0;
+	hi = b->d.size;
+	for (level = 0; hi - lo > 1; level++) {
+		for (i = lo; i < hi;) {
+			p = sbt_new_node(b);
+			in = &sbt_node(b, p)->i;
+			in->cnt = 0;
+			in->reserved = 0;
+			in->c[0] = (srt_tndx)i++;
+			for (; in->cnt < SBT_INNER_N && i < hi; i++) {
+				k = sbt_min_key(b, (srt_tndx)i, level);
+				in->k[in->cnt++] = k;
+				in->c[in->cnt] = (srt_tndx)i;
+			}
+		}
+		lo = hi;
+		hi = b->d.size;
+	}
+	b->root = (srt_tndx)lo;
+	b->first = 0;
+	b->height = level;
+	b->nelems = src->nelems;
+	return b;
+}
+
+/*
+ * Allocation
+ */
+
+srt_btree *sbt_alloc(uint8_t alloc_id, size_t init_elems)
+{
+	srt_btree *b = (srt_btree *)sd_alloc_a(alloc_id, sizeof(srt_btree),
+					       SBT_NODE_SIZE,
+					       init_elems / SBT_LEAF_N + 1,
+					       S_FALSE, 0);
+	RETURN_IF(!b || (srt_data *)b == sd_void, NULL);
+	sd_set_ctype((srt_data *)b, SD_CT_MAP);
+	sst_on_alloc((srt_data *)b);
+	sbt_clear(b);
+	return b;
+}
+
+void sbt_free(srt_btree **b)
+{
+	if (b && *b)
+		sd_free((srt_data **)b);
+}
+
+void sbt_clear(srt_btree *b)
+{
+	if (b) {
+		b->d.size = 0;
+		b->nelems = 0;
+		b->root = b->first = ST_NIL;
+		b->height = 0;
+	}
+}
+
+srt_bool sbt_cpy(srt_btree **b, const srt_btree *src)
+{
+	RETURN_IF(!b || !*b || !src, S_FALSE);
+	sbt_clear(*b);
+	RETURN_IF(!sbt_reserve(b, src->d.size), S_FALSE);
+	memcpy(sbt_node(*b, 0), sbt_node_r(src, 0),
+	       src->d.size * SBT_NODE_SIZE);
+	(*b)->d.size = src->d.size;
+	(*b)->nelems = src->nelems;
+	(*b)->root = src->root;
+	(*b)->first = src->first;
+	(*b)->height = src->height;
+	return S_TRUE;
+}
+
+/*
+ * Operations
+ */
+
+srt_tndx sbt_locate(const srt_btree *b, int64_t k)
+{
+	uint32_t p;
+	const struct SBTLeaf *l;
+	RETURN_IF(!b || !b->nelems, ST_NIL);
+	l = &sbt_node_r(b, sbt_leaf_of(b, k, NULL, NULL))->l;
+	p = sbt_lt(l->k, l->cnt, k);
+	return p < l->cnt && l->k[p] == k ? l->x[p] : ST_NIL;
+}
+
+srt_bool sbt_insert(srt_btree **b, int64_t k, srt_tndx x, srt_tndx *xo)
+{
+	uint32_t p, ppos[SBT_MAX_HEIGHT + 1];
+	srt_tndx leaf, path[SBT_MAX_HEIGHT + 1];
+	struct SBTLeaf *l;
+	RETURN_IF(!b || !*b || !xo, S_FALSE);
+	if ((*b)->root == ST_NIL) { /* empty index */
+		RETURN_IF(!sbt_reserve(b, 1), S_FALSE);
+		leaf = sbt_new_node(*b);
+		l = &sbt_node(*b, leaf)->l;
+		l->cnt = 1;
+		l->next = ST_NIL;
+		l->k[0] = k;
+		l->x[0] = x;
+		(*b)->root = (*b)->first = leaf;
+		(*b)->height = 0;
+		(*b)->nelems = 1;
+		*xo = x;
+		return S_TRUE;
+	}
+	leaf = sbt_leaf_of(*b, k, path, ppos);
+	l = &sbt_node(*b, leaf)->l;
+	p = sbt_lt(l->k, l->cnt, k);
+	if (p < l->cnt && l->k[p] == k) { /* already in the index */
+		*xo = l->x[p];
+		return S_TRUE;
+	}
+	if (l->cnt < SBT_LEAF_N) {
+		memmove(l->k + p + 1, l->k + p, (l->cnt - p) * sizeof(int64_t));
+		memmove(l->x + p + 1, l->x + p,
+			(l->cnt - p) * sizeof(srt_tndx));
+		l->k[p] = k;
+		l->x[p] = x;
+		l->cnt++;
+	} else {
+		/* Room for splitting the whole path, plus a new root */
+		RETURN_IF((*b)->height >= SBT_MAX_HEIGHT
+				  || !sbt_reserve(b, (*b)->height + 2),
+			  S_FALSE);
+		sbt_split(*b, leaf, p, k, x, path, ppos);
+	}
+	(*b)->nelems++;
+	*xo = x;
+	return S_TRUE;
+}
+
+srt_bool sbt_set(srt_btree *b, int64_t k, srt_tndx x)
+{
+	uint32_t p;
+	struct SBTLeaf *l;
+	RETURN_IF(!b || !b->nelems, S_FALSE);
+	l = &sbt_node(b, sbt_leaf_of(b, k, NULL, NULL))->l;
+	p = sbt_lt(l->k, l->cnt, k);
+	RETURN_IF(p >= l->cnt || l->k[p] != k, S_FALSE);
+	l->x[p] = x;
+	return S_TRUE;
+}
+
+srt_tndx sbt_delete(srt_btree **b, int64_t k)
+{
+	uint32_t p;
+	srt_tndx x;
+	srt_btree *b2;
+	struct SBTLeaf *l;
+	RETURN_IF(!b || !*b || !(*b)->nelems, ST_NIL);
+	l = &sbt_node(*b, sbt_leaf_of(*b, k, NULL, NULL))->l;
+	p = sbt_lt(l->k, l->cnt, k);
+	RETURN_IF(p >= l->cnt || l->k[p] != k, ST_NIL);
+	x = l->x[p];
+	l->cnt--;
+	memmove(l->k + p, l->k + p + 1, (l->cnt - p) * sizeof(int64_t));
+	memmove(l->x + p, l->x + p + 1, (l->cnt - p) * sizeof(srt_tndx));
+	if (!--(*b)->nelems) {
+		sbt_clear(*b);
+	} else if ((*b)->d.size > 2
+		   && (*b)->nelems
+			      < (*b)->d.size * SBT_LEAF_N / SBT_REBUILD_DIV) {
+		/* BEHAVIOR: if not enough memory, the sparse index is kept */
+		b2 = sbt_build(*b);
+		if (b2) {
+			sbt_free(b);
+			*b = b2;
+		}
+	}
+	return x;
+}
+
+/*
+ * Scan
+ */
+
+void sbt_scan_lb(const srt_btree *b, int64_t k, struct SBTScan *s)
+{
+	const struct SBTLeaf *l;
+	if (!s)
+		return;
+	s->b = b;
+	s->leaf = ST_NIL;
+	s->pos = 0;
+	if (b && b->nelems) {
+		s->leaf = sbt_leaf_of(b, k, NULL, NULL);
+		l = &sbt_node_r(b, s->leaf)->l;
+		s->pos = sbt_lt(l->k, l->cnt, k);
+	}
+}
+
+srt_bool sbt_scan_next(struct SBTScan *s, srt_tndx *x)
+{
+	const struct SBTLeaf *l;
+	while (s->leaf != ST_NIL) {
+		l = &sbt_node_r(s->b, s->leaf)->l;
+		if (s->pos < l->cnt) {
+			*x = l->x[s->pos++];
+			return S_TRUE;
+		}
+		s->leaf = l->next;
+		s->pos = 0;
+	}
+	return S_FALSE;
+}
+
+/*
+ * Other
+ */
+
+/*
+ * Path-based navigation (forward and backward, no leaf links required)
+ */
+
+/* Descend from level h to the leaf, through the first or last children */
+static void sbt_path_down(const srt_btree *b, struct SBTPath *p, uint32_t h,
+			  srt_bool last)
+{
+	const union SBTNode *nd;
+	for (; h > 0; h--) {
+		nd = sbt_node_r(b, p->n[h]);
+		p->pos[h] = last ? nd->i.cnt : 0;
+		p->n[h - 1] = nd->i.c[p->pos[h]];
+	}
+	p->pos[0] = last ? sbt_node_r(b, p->n[0])->l.cnt : 0;
+}
+
+/* Current element, skipping forward leaf ends (and empty leaves) */
+static srt_tndx sbt_path_fwd(const srt_btree *b, struct SBTPath *p)
+{
+	uint32_t h;
+	const struct SBTLeaf *l;
+	for (;;) {
+		l = &sbt_node_r(b, p->n[0])->l;
+		if (p->pos[0] < l->cnt)
+			return l->x[p->pos[0]];
+		for (h = 1; h <= b->height
+			    && p->pos[h] >= sbt_node_r(b, p->n[h])->i.cnt;
+		     h++)
+			;
+		if (h > b->height)
+			break;
+		p->pos[h]++;
+		p->n[h - 1] = sbt_node_r(b, p->n[h])->i.c[p->pos[h]];
+		sbt_path_down(b, p, h - 1, S_FALSE);
+	}
+	p->valid = S_FALSE;
+	return ST_NIL;
+}
+
+/* Element before the current position (leaf position minus one) */
+static srt_tndx sbt_path_bwd(const srt_btree *b, struct SBTPath *p)
+{
+	uint32_t h;
+	for (;;) {
+		if (p->pos[0] > 0)
+			return sbt_node_r(b, p->n[0])->l.x[--p->pos[0]];
+		for (h = 1; h <= b->height && !p->pos[h]; h++)
+			;
+		if (h > b->height)
+			break;
+		p->pos[h]--;
+		p->n[h - 1] = sbt_node_r(b, p->n[h])->i.c[p->pos[h]];
+		sbt_path_down(b, p, h - 1, S_TRUE);
+	}
+	p->valid = S_FALSE;
+	return ST_NIL;
+}
+
+srt_tndx sbt_path_bound(const srt_btree *b, int64_t k, srt_bool upper,
+			struct SBTPath *p)
+{
+	const struct SBTLeaf *l;
+	RETURN_IF(!p, ST_NIL);
+	p->valid = S_FALSE;
+	RETURN_IF(!b || !b->nelems, ST_NIL);
+	p->n[0] = sbt_leaf_of(b, k, p->n, p->pos);
+	l = &sbt_node_r(b, p->n[0])->l;
+	p->pos[0] = upper ? sbt_le(l->k, l->cnt, k) : sbt_lt(l->k, l->cnt, k);
+	p->valid = S_TRUE;
+	return sbt_path_fwd(b, p);
+}
+
+srt_tndx sbt_path_first(const srt_btree *b, struct SBTPath *p)
+{
+	RETURN_IF(!p, ST_NIL);
+	p->valid = S_FALSE;
+	RETURN_IF(!b || !b->nelems, ST_NIL);
+	p->n[b->height] = b->root;
+	sbt_path_down(b, p, b->height, S_FALSE);
+	p->valid = S_TRUE;
+	return sbt_path_fwd(b, p);
+}
+
+srt_tndx sbt_path_last(const srt_btree *b, struct SBTPath *p)
+{
+	RETURN_IF(!p, ST_NIL);
+	p->valid = S_FALSE;
+	RETURN_IF(!b || !b->nelems, ST_NIL);
+	p->n[b->height] = b->root;
+	sbt_path_down(b, p, b->height, S_TRUE);
+	p->valid = S_TRUE;
+	return sbt_path_bwd(b, p);
+}
+
+srt_tndx sbt_path_next(const srt_btree *b, struct SBTPath *p)
+{
+	RETURN_IF(!b || !p || !p->valid, ST_NIL);
+	p->pos[0]++;
+	return sbt_path_fwd(b, p);
+}
+
+srt_tndx sbt_path_prev(const srt_btree *b, struct SBTPath *p)
+{
+	RETURN_IF(!b || !p || !p->valid, ST_NIL);
+	return sbt_path_bwd(b, p);
+}
+
+/*
+ * Key space split
+ */
+
+static void sbt_enum_inner_r(const srt_btree *b, srt_tndx n, uint32_t h,
+			     uint32_t levels, void (*f)(int64_t, void *),
+			     void *context)
+{
+	uint32_t i;
+	const struct SBTInner *in;
+	if (!h || !levels)
+		return; /* leaf, or level limit */
+	in = &sbt_node_r(b, n)->i;
+	for (i = 0; i <= in->cnt; i++) {
+		sbt_enum_inner_r(b, in->c[i], h - 1, levels - 1, f, context);
+		if (i < in->cnt)
+			f(in->k[i], context);
+	}
+}
+
+void sbt_enum_inner(const srt_btree *b, uint32_t levels,
+		    void (*f)(int64_t k, void *context), void *context)
+{
+	if (b && b->nelems && f)
+		sbt_enum_inner_r(b, b->root, b->height, levels, f, context);
+}
+
+void sbt_renumber(srt_btree *b, const srt_tndx *newpos)
+{
+	uint32_t i;
+	srt_tndx n;
+	struct SBTLeaf *l;
+	if (!b || !b->nelems || !newpos)
+		return;
+	for (n = b->first; n != ST_NIL; n = l->next) {
+		l = &sbt_node(b, n)->l;
+		for (i = 0; i < l->cnt; i++)
+			l->x[i] = newpos[l->x[i]];
+	}
+}
+
+srt_bool sbt_assert(const srt_btree *b)
+{
+	size_t n = 0;
+	uint32_t i;
+	srt_tndx leaf;
+	int64_t prev = 0;
+	const struct SBTLeaf *l;
+	RETURN_IF(!b, S_FALSE);
+	for (leaf = b->first; leaf != ST_NIL; leaf = l->next) {
+		RETURN_IF(leaf >= b->d.size, S_FALSE);
+		l = &sbt_node_r(b, leaf)->l;
+		for (i = 0; i < l->cnt; i++, n++) {
+			RETURN_IF(n > 0 && l->k[i] <= prev, S_FALSE);
+			RETURN_IF(sbt_locate(b, l->k[i]) != l->x[i], S_FALSE);
+			prev = l->k[i];
+		}
+	}
+	return n == b->nelems ? S_TRUE : S_FALSE;
+}
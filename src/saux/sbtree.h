@@ -0,0 +1,158 @@
+#ifndef SBTREE_H
+#define SBTREE_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * sbtree.h
+ *
+ * #SHORTDOC B+tree index (integer key to node index)
+ *
+ * #DOC B+tree index, mapping 64-bit integer keys to 32-bit node indexes,
+ * #DOC used as alternative ordering backend for integer-key maps and sets
+ * #DOC (see sm_alloc_btree()). Nodes are fixed-size (SBT_NODE_SIZE bytes,
+ * #DOC i.e. a few cache lines), stored in a linear space and addressed by
+ * #DOC index, like the red-black tree nodes, with the keys packed together
+ * #DOC so the in-node search is a branch-free linear scan that compilers
+ * #DOC vectorize. Leaves are linked, for range scans.
+ *
+ * Copyright (c) 2015-2020 F. Aragon. All rights reserved.
+ * Released under the BSD 3-Clause License (see the doc/LICENSE)
+ *
+ * Observations:
+ * - This is not intended for direct use, but as base for the B+tree map
+ *   backend.
+ * - Deletion is lazy (no node merge): when the leaf occupancy drops below
+ *   1/SBT_REBUILD_DIV, the index is rebuilt, so the amortized cost is
+ *   O(log n) and the memory stays proportional to the number of elements.
+ */
+
+#include "stree.h"
+
+/*
+ * Structures and types
+ */
+
+#ifndef SBT_NODE_SIZE
+#define SBT_NODE_SIZE 256 /* 4 64-byte cache lines */
+#endif
+
+#define SBT_LEAF_N ((SBT_NODE_SIZE - 8) / 12)
+#define SBT_INNER_N ((SBT_NODE_SIZE - 12) / 12)
+#define SBT_MAX_HEIGHT 16
+#define SBT_REBUILD_DIV 4
+
+struct SBTLeaf {
+	uint32_t cnt;
+	srt_tndx next; /* next leaf (ST_NIL: last) */
+	int64_t k[SBT_LEAF_N];
+	srt_tndx x[SBT_LEAF_N];
+};
+
+struct SBTInner {
+	uint32_t cnt; /* number of keys (children: cnt + 1) */
+	uint32_t reserved;
+	int64_t k[SBT_INNER_N]; /* k[i]: lowest key of the child i + 1 */
+	srt_tndx c[SBT_INNER_N + 1];
+};
+
+union SBTNode {
+	struct SBTLeaf l;
+	struct SBTInner i;
+	uint8_t b[SBT_NODE_SIZE];
+};
+
+struct S_BTree {
+	struct SDataFull d; /* d.size: nodes in use */
+	size_t nelems;
+	srt_tndx root, first; /* root node, first leaf */
+	uint32_t height;      /* 0: the root is a leaf */
+};
+
+typedef struct S_BTree srt_btree;
+
+struct SBTScan {
+	const srt_btree *b;
+	srt_tndx leaf;
+	uint32_t pos;
+};
+
+struct SBTPath {
+	srt_tndx n[SBT_MAX_HEIGHT + 1];   /* node per level (0: leaf) */
+	uint32_t pos[SBT_MAX_HEIGHT + 1]; /* child (inner) or element (leaf) */
+	srt_bool valid;
+};
+
+/*
+ * Functions
+ */
+
+/* #NOTAPI: |Allocate B+tree index|allocator id; space preallocated to store n elements|index (NULL: not enough memory)|O(1)|1;2| */
+srt_btree *sbt_alloc(uint8_t alloc_id, size_t init_elems);
+
+/* #NOTAPI: |Free B+tree index|index|-|O(1)|1;2| */
+void sbt_free(srt_btree **b);
+
+/* #NOTAPI: |Reset B+tree index|index|-|O(1)|1;2| */
+void sbt_clear(srt_btree *b);
+
+/* #NOTAPI: |Overwrite B+tree index with a copy|output index; input index|S_TRUE: OK; S_FALSE: not enough memory|O(n)|1;2| */
+srt_bool sbt_cpy(srt_btree **b, const srt_btree *src);
+
+/* #NOTAPI: |Locate key|index; key|node index (ST_NIL: not found)|O(log n)|1;2| */
+srt_tndx sbt_locate(const srt_btree *b, int64_t k);
+
+/* #NOTAPI: |Insert key, if not already in the index|index; key; node index; output node index (x if inserted, or the one already associated to the key)|S_TRUE: OK; S_FALSE: not enough memory|O(log n)|1;2| */
+srt_bool sbt_insert(srt_btree **b, int64_t k, srt_tndx x, srt_tndx *xo);
+
+/* #NOTAPI: |Change the node index associated to a key|index; key; node index|S_TRUE: OK; S_FALSE: not found|O(log n)|1;2| */
+srt_bool sbt_set(srt_btree *b, int64_t k, srt_tndx x);
+
+/* #NOTAPI: |Delete key|index; key|node index associated to the key (ST_NIL: not found)|O(log n)|1;2| */
+srt_tndx sbt_delete(srt_btree **b, int64_t k);
+
+/* #NOTAPI: |Start in-order scan from the first key >= k|index; key; scan context|-|O(log n)|1;2| */
+void sbt_scan_lb(const srt_btree *b, int64_t k, struct SBTScan *s);
+
+/* #NOTAPI: |Get next scan element|scan context; output node index|S_TRUE: OK; S_FALSE: no more elements|O(1)|1;2| */
+srt_bool sbt_scan_next(struct SBTScan *s, srt_tndx *x);
+
+/* #NOTAPI: |Locate first key not lower (lower bound) or greater (upper bound) than k|index; key; S_FALSE: lower bound, S_TRUE: upper bound; output path|node index (ST_NIL: not found)|O(log n)|1;2| */
+srt_tndx sbt_path_bound(const srt_btree *b, int64_t k, srt_bool upper, struct SBTPath *p);
+
+/* #NOTAPI: |Locate first key|index; output path|node index (ST_NIL: empty index)|O(log n)|1;2| */
+srt_tndx sbt_path_first(const srt_btree *b, struct SBTPath *p);
+
+/* #NOTAPI: |Locate last key|index; output path|node index (ST_NIL: empty index)|O(log n)|1;2| */
+srt_tndx sbt_path_last(const srt_btree *b, struct SBTPath *p);
+
+/* #NOTAPI: |Move to the next key|index; path|node index (ST_NIL: no more keys)|O(1) amortized|1;2| */
+srt_tndx sbt_path_next(const srt_btree *b, struct SBTPath *p);
+
+/* #NOTAPI: |Move to the previous key|index; path|node index (ST_NIL: no more keys)|O(1) amortized|1;2| */
+srt_tndx sbt_path_prev(const srt_btree *b, struct SBTPath *p);
+
+/* #NOTAPI: |Enumerate the inner node keys of the top levels, in order (used for splitting the key space)|index; number of inner levels (from the root); callback; callback context|-|O(fanout ^ levels)|1;2| */
+void sbt_enum_inner(const srt_btree *b, uint32_t levels, void (*f)(int64_t k, void *context), void *context);
+
+/* #NOTAPI: |Change all node indexes (after moving the nodes)|index; new node index for every node index|-|O(n)|1;2| */
+void sbt_renumber(srt_btree *b, const srt_tndx *newpos);
+
+/* #NOTAPI: |Index check (debug purposes)|index|S_TRUE: OK; S_FALSE: broken ordering or counters|O(n)|1;2| */
+srt_bool sbt_assert(const srt_btree *b);
+
+/*
+ * Inlined functions
+ */
+
+S_INLINE size_t sbt_size(const srt_btree *b)
+{
+	return b ? b->nelems : 0;
+}
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* #ifndef SBTREE_H */
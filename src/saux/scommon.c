@@ -299,3 +299,126 @@ void s_memset16(void *o, const void *s, size_t n2)
 	if (n2 % 2)
 		memcpy((uint8_t *)o + n4 * 4, s, 2);
 }
+
+/*
+ * Small allocation cache
+ */
+
+#ifdef S_ALLOC_CACHE
+
+#define S_AC_HDR 8	     /* block header (keeps 8-byte alignment) */
+#define S_AC_MIN_BITS 4	     /* smallest size class: 16 bytes */
+#define S_AC_CLASSES 6	     /* 16, 32, 64, 128, 256, 512 */
+#define S_AC_MAX_CACHED 64   /* cached blocks per size class and thread */
+#define S_AC_SYS 0xff	     /* header tag: block not cached */
+
+struct SAllocCache {
+	void *head[S_AC_CLASSES];
+	size_t count[S_AC_CLASSES];
+};
+
+static S_TLS struct SAllocCache s_ac;
+
+S_INLINE size_t s_ac_class_size(unsigned c)
+{
+	return (size_t)1 << (c + S_AC_MIN_BITS);
+}
+
+S_INLINE unsigned s_ac_class(size_t size)
+{
+	unsigned c = 0;
+	RETURN_IF(size > S_ALLOC_CACHE_MAX, S_AC_SYS);
+	while (s_ac_class_size(c) < size)
+		c++;
+	return c;
+}
+
+void *s_cache_malloc(size_t size)
+{
+	uint8_t *b;
+	unsigned c = s_ac_class(size);
+	if (c != S_AC_SYS && s_ac.head[c]) {
+		b = (uint8_t *)s_ac.head[c];
+		s_ac.head[c] = *(void **)b;
+		s_ac.count[c]--;
+		return b;
+	}
+	if (c != S_AC_SYS)
+		size = s_ac_class_size(c);
+	RETURN_IF(s_size_t_overflow(size, S_AC_HDR), NULL);
+	b = (uint8_t *)_s_malloc(S_AC_HDR + size);
+	RETURN_IF(!b, NULL);
+	*b = (uint8_t)c;
+	return b + S_AC_HDR;
+}
+
+void *s_cache_calloc(size_t nmemb, size_t size)
+{
+	void *p;
+	RETURN_IF(size && nmemb > S_SIZET_MAX / size, NULL);
+	p = s_cache_malloc(nmemb * size);
+	if (p)
+		memset(p, 0, nmemb * size);
+	return p;
+}
+
+void *s_cache_realloc(void *ptr, size_t size)
+{
+	uint8_t *b, *b2;
+	void *p2;
+	unsigned c;
+	RETURN_IF(!ptr, s_cache_malloc(size));
+	b = (uint8_t *)ptr - S_AC_HDR;
+	c = *b;
+	if (c == S_AC_SYS) {
+		RETURN_IF(s_size_t_overflow(size, S_AC_HDR), NULL);
+		b2 = (uint8_t *)_s_realloc(b, S_AC_HDR + size);
+		return b2 ? b2 + S_AC_HDR : NULL;
+	}
+	if (size <= s_ac_class_size(c))
+		return ptr; /* in-place resize, within the size class */
+	p2 = s_cache_malloc(size);
+	RETURN_IF(!p2, NULL);
+	memcpy(p2, ptr, s_ac_class_size(c));
+	s_cache_free(ptr);
+	return p2;
+}
+
+void s_cache_free(void *ptr)
+{
+	uint8_t *b;
+	unsigned c;
+	if (!ptr)
+		return;
+	b = (uint8_t *)ptr - S_AC_HDR;
+	c = *b;
+	if (c == S_AC_SYS || s_ac.count[c] >= S_AC_MAX_CACHED) {
+		_s_free(b);
+		return;
+	}
+	*(void **)ptr = s_ac.head[c];
+	s_ac.head[c] = ptr;
+	s_ac.count[c]++;
+}
+
+void s_alloc_cache_flush(void)
+{
+	unsigned c;
+	void *p, *next;
+	for (c = 0; c < S_AC_CLASSES; c++) {
+		for (p = s_ac.head[c]; p; p = next) {
+			next = *(void **)p;
+			_s_free((uint8_t *)p - S_AC_HDR);
+		}
+		s_ac.head[c] = NULL;
+		s_ac.count[c] = 0;
+	}
+}
+
+#else
+
+void s_alloc_cache_flush(void)
+{
+}
+
+#endif
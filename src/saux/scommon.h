@@ -132,6 +132,53 @@ extern "C" {
 #define S_LIKELY(expr) S_EXPECT((expr) != 0, 1)
 #define S_UNLIKELY(expr) S_EXPECT((expr) != 0, 0)
 
+/*
+ * Atomic counters (reference counting) and pointer compare-and-swap. If no
+ * atomic support is available, S_NO_ATOMICS is defined, and plain (non
+ * thread-safe) operations are used.
+ */
+
+typedef long srt_atomic;
+
+#if defined(__clang__)                                                        \
+	|| defined(__GNUC__)                                                   \
+		   && (__GNUC__ > 4 || __GNUC__ == 4 && __GNUC_MINOR__ >= 7)
+#define S_ATOMIC_ADD(p, v) __atomic_add_fetch(p, v, __ATOMIC_ACQ_REL)
+#define S_ATOMIC_LOAD(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define S_ATOMIC_CAS_PTR(p, o, n) __sync_bool_compare_and_swap(p, o, n)
+#elif defined(__GNUC__) && (__GNUC__ > 4 || __GNUC__ == 4 && __GNUC_MINOR__ >= 1)
+#define S_ATOMIC_ADD(p, v) __sync_add_and_fetch(p, v)
+#define S_ATOMIC_LOAD(p) __sync_add_and_fetch(p, 0)
+#define S_ATOMIC_CAS_PTR(p, o, n) __sync_bool_compare_and_swap(p, o, n)
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#define S_ATOMIC_ADD(p, v)                                                     \
+	(_InterlockedExchangeAdd((volatile long *)(p), (long)(v)) + (long)(v))
+#define S_ATOMIC_LOAD(p) _InterlockedExchangeAdd((volatile long *)(p), 0)
+#define S_ATOMIC_CAS_PTR(p, o, n)                                              \
+	(_InterlockedCompareExchangePointer((void *volatile *)(p),             \
+					    (void *)(n), (void *)(o))          \
+	 == (void *)(o))
+#else
+#define S_NO_ATOMICS
+#define S_ATOMIC_ADD(p, v) (*(p) += (v))
+#define S_ATOMIC_LOAD(p) (*(p))
+#define S_ATOMIC_CAS_PTR(p, o, n) (*(p) == (o) ? (*(p) = (n), 1) : 0)
+#endif
+
+/*
+ * Thread-local storage (S_TLS is not defined if not available)
+ */
+
+#if defined(_MSC_VER)
+#define S_TLS __declspec(thread)
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L               \
+	&& !defined(__STDC_NO_THREADS__)
+#define S_TLS _Thread_local
+#elif defined(__GNUC__) || defined(__clang__)
+#define S_TLS __thread
+#endif
+
 #if defined(S_C99_SUPPORT) || defined(__TINYC__)
 #define S_MODERN_COMPILER
 #ifndef S_NO_VARGS
@@ -309,11 +356,38 @@ S_INLINE srt_bool s_varg_tail_ptr_tag(const void *p)
 	return p == S_INVALID_PTR_VARG_TAIL ? S_TRUE : S_FALSE;
 }
 
+	/*
+	 * Small allocation cache (optional, define S_ENABLE_ALLOC_CACHE)
+	 *
+	 * Per-thread free lists for blocks up to S_ALLOC_CACHE_MAX bytes,
+	 * keyed by power-of-two size class (16 to 512 bytes). Resizing within
+	 * the size class is done in place. Every block has a small header
+	 * with its size class. Blocks can be released from any thread. Call
+	 * s_alloc_cache_flush() before a thread exits, for releasing the
+	 * blocks cached by that thread.
+	 */
+
+#if defined(S_ENABLE_ALLOC_CACHE) && defined(S_TLS)                            \
+	&& !defined(S_MAX_MALLOC_SIZE) && !defined(S_DEBUG_ALLOC)
+
+#define S_ALLOC_CACHE
+#define S_ALLOC_CACHE_MAX 512
+
+void *s_cache_malloc(size_t size);
+void *s_cache_calloc(size_t nmemb, size_t size);
+void *s_cache_realloc(void *ptr, size_t size);
+void s_cache_free(void *ptr);
+
+#define s_malloc s_cache_malloc
+#define s_calloc s_cache_calloc
+#define s_realloc s_cache_realloc
+#define s_free s_cache_free
+
 	/*
 	 * Artificial memory allocation limits (tests/debug)
 	 */
 
-#if defined(S_MAX_MALLOC_SIZE) && !defined(S_DEBUG_ALLOC)
+#elif defined(S_MAX_MALLOC_SIZE) && !defined(S_DEBUG_ALLOC)
 
 S_INLINE void *s_malloc(size_t size)
 {
@@ -603,6 +677,7 @@ unsigned slog2_64(uint64_t i);
 unsigned slog2_ceil_32(uint32_t i);
 unsigned slog2_ceil(uint64_t i);
 uint64_t snextpow2(uint64_t i); /* round to next power of 2 */
+void s_alloc_cache_flush(void);
 
 S_INLINE unsigned slog2(uint64_t i)
 {
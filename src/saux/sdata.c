@@ -8,6 +8,7 @@
  */
 
 #include "sdata.h"
+#include "../sstats.h"
 #include "scommon.h"
 
 /*
@@ -28,19 +29,99 @@
 static srt_data sd_void0 = EMPTY_SDataFull;
 srt_data *sd_void = &sd_void0;
 
+/*
+ * Allocator table (id 0: global allocator, NULL for the default one)
+ */
+
+static const srt_allocator *sd_allocators[SD_MAX_ALLOCATORS];
+
+void sd_set_allocator(const srt_allocator *a)
+{
+	sd_allocators[0] = a;
+}
+
+const srt_allocator *sd_allocator(uint8_t alloc_id)
+{
+	return alloc_id < SD_MAX_ALLOCATORS ? sd_allocators[alloc_id] : NULL;
+}
+
+int sd_allocator_id(const srt_allocator *a)
+{
+	int i;
+	RETURN_IF(!a, 0);
+	/*
+	 * Registered allocators always get their own slot, even if they are
+	 * the global allocator too, so containers don't follow later global
+	 * allocator changes.
+	 */
+	for (i = 1; i < SD_MAX_ALLOCATORS; i++)
+		if (sd_allocators[i] == a)
+			return i;
+	/*
+	 * Slot claim: lock-free. Concurrent registrations of the same
+	 * allocator could take two slots (harmless, same allocator).
+	 */
+	for (i = 1; i < SD_MAX_ALLOCATORS; i++)
+		if (!sd_allocators[i]
+		    && S_ATOMIC_CAS_PTR(&sd_allocators[i],
+					(const srt_allocator *)NULL, a))
+			return i;
+	S_ERROR("allocator table full");
+	return -1;
+}
+
+void sd_allocator_release(const srt_allocator *a)
+{
+	int i;
+	for (i = 1; i < SD_MAX_ALLOCATORS; i++)
+		if (sd_allocators[i] == a)
+			(void)S_ATOMIC_CAS_PTR(&sd_allocators[i], a,
+					       (const srt_allocator *)NULL);
+}
+
+void *sd_mem_alloc(uint8_t alloc_id, size_t size)
+{
+	const srt_allocator *a = sd_allocators[alloc_id];
+	return a ? a->f_alloc(a->context, size) : s_malloc(size);
+}
+
+void *sd_mem_realloc(uint8_t alloc_id, void *ptr, size_t size)
+{
+	const srt_allocator *a = sd_allocators[alloc_id];
+	return a ? a->f_realloc(a->context, ptr, size) : s_realloc(ptr, size);
+}
+
+void sd_mem_free(uint8_t alloc_id, void *ptr)
+{
+	const srt_allocator *a = sd_allocators[alloc_id];
+	if (a)
+		a->f_free(a->context, ptr);
+	else
+		s_free(ptr);
+}
+
 /*
  * Allocation
  */
 
-srt_data *sd_alloc(size_t header_size, size_t elem_size, size_t initial_reserve,
-		   srt_bool dyn_st, size_t extra_tail_bytes)
+srt_data *sd_alloc_a(uint8_t alloc_id, size_t header_size, size_t elem_size,
+		     size_t initial_reserve, srt_bool dyn_st,
+		     size_t extra_tail_bytes)
 {
+	/* Non-default allocator requires full mode (id stored in header) */
+	srt_bool small_ok = dyn_st && !alloc_id ? S_TRUE : S_FALSE;
 	size_t alloc_size = sd_alloc_size_raw(header_size, elem_size,
-					      initial_reserve, dyn_st);
-	srt_data *d = (srt_data *)s_malloc(alloc_size + extra_tail_bytes);
+					      initial_reserve, small_ok);
+	srt_data *d = (srt_data *)sd_mem_alloc(alloc_id,
+					       alloc_size + extra_tail_bytes);
 	if (d) {
 		sd_reset(d, header_size, elem_size, initial_reserve, S_FALSE,
-			 dyn_st);
+			 small_ok);
+		if (alloc_id) {
+			d->alloc_id = alloc_id;
+			if (dyn_st)
+				d->f.st_mode = SData_DynFull;
+		}
 		S_PROFILE_ALLOC_CALL;
 	} else {
 		S_ERROR("not enough memory");
@@ -49,6 +130,13 @@ srt_data *sd_alloc(size_t header_size, size_t elem_size, size_t initial_reserve,
 	return d;
 }
 
+srt_data *sd_alloc(size_t header_size, size_t elem_size, size_t initial_reserve,
+		   srt_bool dyn_st, size_t extra_tail_bytes)
+{
+	return sd_alloc_a(0, header_size, elem_size, initial_reserve, dyn_st,
+			  extra_tail_bytes);
+}
+
 srt_data *sd_alloc_into_ext_buf(void *buffer, size_t max_size,
 				size_t header_size, size_t elem_size,
 				srt_bool dyn_st)
@@ -66,9 +154,11 @@ void sd_free(srt_data **d)
 		/*
 		 * Request for freeing external buffers are ignored
 		 */
-		S_ASSERT(!(*d)->f.ext_buffer);
-		if (!(*d)->f.ext_buffer)
-			s_free(*d);
+		S_ASSERT(!(*d)->f.ext_buffer || sd_spill_enabled(*d));
+		if (!(*d)->f.ext_buffer) {
+			sst_on_free(*d);
+			sd_mem_free(sd_alloc_id(*d), *d);
+		}
 		*d = NULL;
 	}
 }
@@ -99,6 +189,9 @@ void sd_reset(srt_data *d, size_t header_size, size_t elem_size,
 			d->header_size = header_size;
 			d->elem_size = elem_size;
 			d->sub_type = 0;
+			d->alloc_id = 0;
+			d->grow_policy = SD_GROW_DEFAULT;
+			d->ctype = SD_CT_OTHER;
 		} else {
 			((struct SDataSmall *)d)->aux = 0;
 		}
@@ -118,41 +211,96 @@ size_t sd_grow(srt_data **d, size_t extra_size, size_t extra_tail_bytes)
 	return new_size >= (size + extra_size) ? (new_size - size) : 0;
 }
 
-S_INLINE size_t sd_reserve_aux(srt_data **d, size_t max_size,
-			       size_t full_header_size, size_t extra_tail_bytes)
+/* Number of elements to allocate, after applying the growth policy */
+static size_t sd_grow_target(const srt_data *d, size_t max_size)
 {
-#ifdef SD_ENABLE_HEURISTIC_GROWTH
 	size_t inc;
+	switch (sd_grow_policy(d) & SD_GROW_MODE_MASK) {
+	case SD_GROW_EXACT:
+		inc = 0;
+		break;
+	case SD_GROW_DOUBLE:
+		inc = max_size;
+		break;
+	case SD_GROW_HALF:
+		inc = S_MIN(max_size / 2, SD_GROW_MAX_INC);
+		break;
+	case SD_GROW_LINEAR:
+		inc = SD_GROW_LINEAR_INC;
+		break;
+	default:
+#ifdef SD_ENABLE_HEURISTIC_GROWTH
+		inc = s_size_t_pct(max_size, SD_GROW_PCT);
+		inc = S_MIN(inc, SD_GROW_MAX_INC);
+#else
+		inc = 0;
 #endif
+		break;
+	}
+	return s_size_t_add(max_size, inc, max_size);
+}
+
+/* Number of elements filling the allocation rounded to SD_PAGE_SIZE */
+static size_t sd_page_round(size_t header_size, size_t elem_size,
+			    size_t max_size, size_t extra_tail_bytes)
+{
+	size_t as = header_size + elem_size * max_size + extra_tail_bytes,
+	       as_pg = (as + SD_PAGE_SIZE - 1) & ~(size_t)(SD_PAGE_SIZE - 1);
+	RETURN_IF(as_pg < as, max_size); /* overflow */
+	return (as_pg - header_size - extra_tail_bytes) / elem_size;
+}
+
+/* Change from small to full container (the buffer must have room for it) */
+static void sdx_small_to_full(srt_data *d, size_t full_header_size)
+{
+	char *p = (char *)d;
+	size_t size = ((struct SDataSmall *)d)->size,
+	       max_size = ((struct SDataSmall *)d)->max_size;
+	memmove(p + full_header_size, p + sizeof(struct SDataSmall), size);
+	d->f.st_mode = SData_DynFull;
+	d->header_size = full_header_size;
+	d->sub_type = 0;
+	d->alloc_id = 0;
+	d->grow_policy = SD_GROW_DEFAULT;
+	d->ctype = SD_CT_STRING;
+	d->elem_size = 1;
+	d->size = size;
+	d->max_size = max_size;
+}
+
+S_INLINE size_t sd_reserve_aux(srt_data **d, size_t max_size,
+			       size_t full_header_size, size_t extra_tail_bytes)
+{
 	int chg;
-	srt_bool is_dyn;
-	size_t curr_hdr_size, next_hdr_size;
-	size_t curr_max_size, elem_size, as, size;
+	srt_bool is_small, spill;
+	size_t curr_max_size, elem_size, as, as0, req;
 	srt_data *d_next;
-	char *p;
 	RETURN_IF(!d || !*d || (*d)->f.st_mode == SData_VoidData, 0);
 	curr_max_size = sdx_max_size(*d);
 	if (curr_max_size < max_size) {
-		if ((*d)->f.ext_buffer) {
+		spill = (*d)->f.ext_buffer;
+		if (spill && !sd_spill_enabled(*d)) {
 			S_ERROR("out of memory on fixed-size "
 				"allocated space");
 			sd_set_alloc_errors(*d);
 			return curr_max_size;
 		}
-#ifdef SD_ENABLE_HEURISTIC_GROWTH
-		inc = s_size_t_pct(max_size, SD_GROW_PCT);
-		inc = S_MIN(inc, SD_GROW_MAX_INC);
-		if (!s_size_t_overflow(max_size, inc))
-			max_size += inc;
-#endif
-		is_dyn = sdx_dyn_st(*d);
-		chg = sdx_chk_st_change(*d, max_size);
-		curr_hdr_size = sdx_header_size(*d);
-		next_hdr_size = chg > 0 ? full_header_size : curr_hdr_size;
 		elem_size = sdx_elem_size(*d);
+		is_small = (*d)->f.st_mode == SData_DynSmall ? S_TRUE : S_FALSE;
+		as0 = sdx_alloc_size(*d);
+		req = sd_alloc_size_raw(full_header_size, elem_size, max_size,
+					is_small);
+		max_size = sd_grow_target(*d, max_size);
+		if ((sd_grow_policy(*d) & SD_GROW_PAGE) != 0)
+			max_size = sd_page_round(full_header_size, elem_size,
+						 max_size, extra_tail_bytes);
+		chg = sdx_chk_st_change(*d, max_size);
 		as = sd_alloc_size_raw(full_header_size, elem_size, max_size,
-				       is_dyn);
-		d_next = (srt_data *)s_realloc(*d, as + extra_tail_bytes);
+				       is_small);
+		as += extra_tail_bytes;
+		d_next = spill ? sd_spill(d, as)
+			       : (srt_data *)sd_mem_realloc(sd_alloc_id(*d),
+							    *d, as);
 		if (!d_next) {
 			S_ERROR("sd_reserve: not enough memory");
 			sd_set_alloc_errors(*d);
@@ -160,21 +308,32 @@ S_INLINE size_t sd_reserve_aux(srt_data **d, size_t max_size,
 		}
 		*d = d_next;
 		S_PROFILE_ALLOC_CALL;
-		if (chg > 0) { /* Change from small to full container*/
-			size = ((struct SDataSmall *)d_next)->size;
-			p = (char *)d_next;
-			memmove(p + next_hdr_size, p + curr_hdr_size, size);
-			d_next->f.st_mode = SData_DynFull;
-			d_next->header_size = full_header_size;
-			d_next->sub_type = 0;
-			d_next->elem_size = 1;
-			d_next->size = size;
-		}
+		if (chg > 0) /* Change from small to full container */
+			sdx_small_to_full(d_next, full_header_size);
 		sdx_set_max_size(*d, max_size);
+		if (spill)
+			sst_on_alloc(*d);
+		else
+			sst_on_resize(*d, as0, req);
 	}
 	return sdx_max_size(*d);
 }
 
+srt_data *sd_spill(srt_data **d, size_t alloc_size)
+{
+	size_t as0;
+	srt_data *d_next;
+	RETURN_IF(!d || !*d || !sdx_full_st(*d) || !(*d)->f.ext_buffer, NULL);
+	as0 = sdx_alloc_size(*d);
+	d_next = (srt_data *)sd_mem_alloc(0, alloc_size);
+	RETURN_IF(!d_next, NULL); /* BEHAVIOR: the external buffer is kept */
+	memcpy(d_next, *d, S_MIN(as0, alloc_size));
+	d_next->f.ext_buffer = 0;
+	d_next->alloc_id = 0;
+	*d = d_next;
+	return d_next;
+}
+
 size_t sd_reserve(srt_data **d, size_t max_size, size_t extra_tail_bytes)
 {
 	RETURN_IF(!d || !*d, 0);
@@ -188,9 +347,37 @@ size_t sdx_reserve(srt_data **d, size_t max_size, size_t full_header_size,
 	return sd_reserve_aux(d, max_size, full_header_size, extra_tail_bytes);
 }
 
+srt_bool sdx_set_grow_policy(srt_data **d, int policy, size_t full_header_size,
+			     size_t extra_tail_bytes)
+{
+	size_t as, as0;
+	srt_data *d_next;
+	RETURN_IF(!d || !*d || (*d)->f.st_mode == SData_VoidData, S_FALSE);
+	if ((*d)->f.st_mode == SData_DynSmall && policy != SD_GROW_DEFAULT) {
+		/* BEHAVIOR: small external buffers can not hold the policy */
+		RETURN_IF((*d)->f.ext_buffer, S_FALSE);
+		/* The policy requires the full header */
+		as0 = sdx_alloc_size(*d);
+		as = sd_alloc_size_raw(full_header_size, 1, sdx_max_size(*d),
+				       S_FALSE);
+		d_next = (srt_data *)sd_mem_realloc(0, *d,
+						    as + extra_tail_bytes);
+		if (!d_next) {
+			S_ERROR("sdx_set_grow_policy: not enough memory");
+			sd_set_alloc_errors(*d);
+			return S_FALSE;
+		}
+		*d = d_next;
+		sdx_small_to_full(*d, full_header_size);
+		sst_on_resize(*d, as0, as);
+	}
+	sd_set_grow_policy(*d, policy);
+	return S_TRUE;
+}
+
 srt_data *sd_shrink(srt_data **d, size_t extra_tail_bytes)
 {
-	size_t max_size, new_max_size, as;
+	size_t max_size, new_max_size, as, as0;
 	srt_data *d_next;
 	ASSERT_RETURN_IF(!d || !(*d), sd_void); /* BEHAVIOR */
 	RETURN_IF((*d)->f.ext_buffer, *d);      /* non-shrinkable */
@@ -198,15 +385,42 @@ srt_data *sd_shrink(srt_data **d, size_t extra_tail_bytes)
 	max_size = sd_max_size(*d);
 	new_max_size = (*d)->size;
 	if (new_max_size < max_size) {
+		as0 = sd_alloc_size(*d);
 		as = sd_alloc_size_raw((*d)->header_size, (*d)->elem_size,
 				       new_max_size, S_FALSE);
-		d_next = (srt_data *)s_realloc(*d, as + extra_tail_bytes);
+		d_next = (srt_data *)sd_mem_realloc((*d)->alloc_id, *d,
+						    as + extra_tail_bytes);
 		if (d_next) {
 			*d = d_next;
 			(*d)->max_size = new_max_size;
+			sst_on_resize(*d, as0, as);
 		} else {
 			S_ERROR("sd_shrink: warning realloc error");
 		}
 	}
 	return *d;
 }
+
+srt_bool sd_auto_shrink(srt_data **d, size_t extra_tail_bytes)
+{
+	size_t new_max_size, as, as0;
+	srt_data *d_next;
+	RETURN_IF(!d || !sdx_full_st(*d) || (*d)->f.ext_buffer
+			  || ((*d)->grow_policy & SD_GROW_SHRINK) == 0,
+		  S_FALSE);
+	as0 = sd_alloc_size(*d);
+	/* Hysteresis: shrink below 1/SD_SHRINK_DIV usage, to 1/2 usage */
+	RETURN_IF(as0 <= SD_PAGE_SIZE
+			  || (*d)->size >= (*d)->max_size / SD_SHRINK_DIV,
+		  S_FALSE);
+	new_max_size = (*d)->size * 2;
+	as = sd_alloc_size_raw((*d)->header_size, (*d)->elem_size,
+			       new_max_size, S_FALSE);
+	d_next = (srt_data *)sd_mem_realloc((*d)->alloc_id, *d,
+					    as + extra_tail_bytes);
+	RETURN_IF(!d_next, S_FALSE); /* BEHAVIOR: keep the current block */
+	*d = d_next;
+	(*d)->max_size = new_max_size;
+	sst_on_resize(*d, as0, as);
+	return S_TRUE;
+}
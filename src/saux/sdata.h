@@ -29,6 +29,80 @@ extern "C" {
 #define SD_ENABLE_HEURISTIC_GROWTH
 #endif
 
+/*
+ * Per-container growth policy (overrides the default heuristic)
+ *
+ * SD_GROW_DEFAULT: SD_GROW_PCT increment, capped to SD_GROW_MAX_INC elements
+ *		    (exact size if SD_DISABLE_HEURISTIC_GROWTH is defined)
+ * SD_GROW_EXACT: no pre-allocation (one resize per size increase)
+ * SD_GROW_DOUBLE: 100% increment, not capped (e.g. log buffers)
+ * SD_GROW_HALF: 50% increment, capped to SD_GROW_MAX_INC elements
+ * SD_GROW_LINEAR: SD_GROW_LINEAR_INC elements increment (e.g. huge vectors)
+ * SD_GROW_PAGE: flag, combinable with the above (e.g. SD_GROW_DOUBLE |
+ *		 SD_GROW_PAGE), rounding the allocation to SD_PAGE_SIZE
+ * SD_GROW_SHRINK: flag, combinable with the above, enabling the automatic
+ *		   shrink with hysteresis: when usage drops below 1/4 of the
+ *		   capacity (SD_SHRINK_DIV), capacity is reduced to twice the
+ *		   size, so growing again requires doubling the size. Only
+ *		   blocks bigger than SD_PAGE_SIZE are shrunk. Applied by
+ *		   strings, vectors, and hash maps (see sd_auto_shrink()).
+ *		   Hash maps also halve the bucket table on delete, rehashing
+ *		   all elements in that call: O(n) for that delete, O(1)
+ *		   amortized, as at least half of the elements are deleted
+ *		   between two halvings
+ * SD_GROW_SPILL: flag, combinable with the above, for containers using a
+ *		  stack or external buffer (e.g. sv_alloca()): on overflow,
+ *		  instead of failing, the container is moved to the heap, and
+ *		  from that point on it grows as any other heap container.
+ *		  The container must be released with the *_free() function,
+ *		  as any heap container (it is ignored if not spilled).
+ *		  Small strings can not hold the policy: use ss_alloca_spill()
+ */
+
+enum eSD_GrowPolicy {
+	SD_GROW_DEFAULT = 0,
+	SD_GROW_EXACT = 1,
+	SD_GROW_DOUBLE = 2,
+	SD_GROW_HALF = 3,
+	SD_GROW_LINEAR = 4,
+	SD_GROW_PAGE = 0x10,
+	SD_GROW_SHRINK = 0x20,
+	SD_GROW_SPILL = 0x40
+};
+
+#define SD_GROW_MODE_MASK 0x0f
+
+/*
+ * Container type, for the allocation stats (see sstats.h)
+ *
+ * SD_CT_OTHER: other (e.g. rope)
+ * SD_CT_STRING: string
+ * SD_CT_VECTOR: vector and bitset
+ * SD_CT_MAP: tree map and set
+ * SD_CT_HMAP: hash map and set
+ */
+
+enum eSD_CType {
+	SD_CT_OTHER = 0,
+	SD_CT_STRING = 1,
+	SD_CT_VECTOR = 2,
+	SD_CT_MAP = 3,
+	SD_CT_HMAP = 4,
+	SD_CT_NumTypes = 5
+};
+
+#ifndef SD_SHRINK_DIV
+#define SD_SHRINK_DIV 4
+#endif
+
+#ifndef SD_GROW_LINEAR_INC
+#define SD_GROW_LINEAR_INC 65536
+#endif
+
+#ifndef SD_PAGE_SIZE
+#define SD_PAGE_SIZE 4096
+#endif
+
 /*
  * Macros
  */
@@ -60,10 +134,6 @@ extern "C" {
 	{                                                                      \
 		return stpfix##_size((const srt_data *)c);                     \
 	}                                                                      \
-	S_INLINE void pfix##_set_size(t *c, size_t s)                          \
-	{                                                                      \
-		stpfix##_set_size((srt_data *)c, s);                           \
-	}                                                                      \
 	S_INLINE size_t pfix##_max_size(const t *c)                            \
 	{                                                                      \
 		return stpfix##_max_size((const srt_data *)c);                 \
@@ -99,6 +169,12 @@ extern "C" {
 		return stpfix##_size((const srt_data *)c);                     \
 	}
 
+#define SD_BUILDFUNCS_SET_SIZE(pfix, t, stpfix)                                \
+	S_INLINE void pfix##_set_size(t *c, size_t s)                          \
+	{                                                                      \
+		stpfix##_set_size((srt_data *)c, s);                           \
+	}
+
 #define SD_BUILDFUNCS_ST2(pfix, t, stpfix)                                     \
 	S_INLINE uint8_t *pfix##_get_buffer(t *c)                              \
 	{                                                                      \
@@ -109,18 +185,28 @@ extern "C" {
 		return stpfix##_get_buffer_r((const srt_data *)c);             \
 	}
 
+/* pfix##_set_size() is not generated (e.g. shared strings check it) */
 #define SD_BUILDFUNCS_DYN_ST(pfix, t, tail_bytes)                              \
 	SD_BUILDFUNCS_ST(pfix, t, sdx)                                         \
 	SD_BUILDFUNCS_COMMON(pfix, t, tail_bytes)
 
 #define SD_BUILDFUNCS_FULL_ST(pfix, t, tail_bytes)                             \
 	SD_BUILDFUNCS_ST(pfix, t, sd)                                          \
+	SD_BUILDFUNCS_SET_SIZE(pfix, t, sd)                                    \
 	SD_BUILDFUNCS_ST2(pfix, t, sd)                                         \
 	SD_BUILDFUNCS_COMMON(pfix, t, tail_bytes)                              \
 	S_INLINE size_t pfix##_grow(t **c, size_t extra_elems)                 \
 	{                                                                      \
 		return sd_grow((srt_data **)c, extra_elems, tail_bytes);       \
 	}                                                                      \
+	S_INLINE void pfix##_set_grow_policy(t *c, int policy)                 \
+	{                                                                      \
+		sd_set_grow_policy((srt_data *)c, policy);                     \
+	}                                                                      \
+	S_INLINE int pfix##_grow_policy(const t *c)                            \
+	{                                                                      \
+		return sd_grow_policy((const srt_data *)c);                    \
+	}                                                                      \
 	S_INLINE size_t pfix##_reserve(t **c, size_t max_elems)                \
 	{                                                                      \
 		return sd_reserve((srt_data **)c, max_elems, tail_bytes);      \
@@ -233,6 +319,24 @@ struct SDataFull /* 20-byte structure (32-bit compiler), 40-byte (64-bit c.) */
 	 */
 	uint8_t sub_type;
 
+	/*
+	 * Allocator id (0: global allocator). Containers using a non-default
+	 * allocator are always in full mode, as the small header has no room
+	 * for it.
+	 */
+	uint8_t alloc_id;
+
+	/*
+	 * Growth policy (enum eSD_GrowPolicy)
+	 */
+	uint8_t grow_policy;
+
+	/*
+	 * Container type (enum eSD_CType). Small mode containers are always
+	 * strings.
+	 */
+	uint8_t ctype;
+
 	/*
 	 * Header size: struct SData size plus additional header from type
 	 * build on top of it.
@@ -259,10 +363,46 @@ typedef struct SDataFull srt_data; /* Opaque structure (accessors are provided)
 
 #define EMPTY_SDataFlags	{ 1, 1, 3, 0, 0, 0, 0 }
 #define EMPTY_SDataSmall	{ EMPTY_SDataFlags, 0, 0, 0 }
-#define EMPTY_SDataFull		{ EMPTY_SDataFlags, 0, 0, 0, 0, 0 }
+#define EMPTY_SDataFull		{ EMPTY_SDataFlags, 0, 0, 0, 0, 0, 0, 0, 0 }
 
 extern srt_data *sd_void;
 
+/*
+ * Allocator interface
+ *
+ * Runtime-pluggable allocator (e.g. arena or pool), that can be set globally
+ * or per container at allocation time (ss_alloc_a(), sv_alloc_a(),
+ * sm_alloc_a(), shm_alloc_a(), etc.). Container memory (allocation, resize,
+ * and release) goes through the allocator the container was created with.
+ *
+ * Observations:
+ * - The allocator must outlive the containers using it.
+ * - Allocators are registered in a small table (up to SD_MAX_ALLOCATORS - 1
+ *   allocators passed explicitly, plus the global one). Every allocator
+ *   passed explicitly gets its own table slot (even if it is the global
+ *   allocator, too). Registration is thread-safe (lock-free slot claim).
+ *   Table slots can be released with sd_allocator_release(), once no
+ *   container uses them.
+ * - The global allocator must not change while containers allocated with
+ *   it are alive: they release their memory through the global allocator
+ *   set at release time. Set it before allocating any container (it is not
+ *   thread-safe), and use the *_alloc_a() functions for per-container
+ *   allocators instead of switching the global one.
+ */
+
+#ifndef SD_MAX_ALLOCATORS
+#define SD_MAX_ALLOCATORS 16
+#endif
+
+struct SAllocator {
+	void *(*f_alloc)(void *context, size_t size);
+	void *(*f_realloc)(void *context, void *ptr, size_t size);
+	void (*f_free)(void *context, void *ptr);
+	void *context;
+};
+
+typedef struct SAllocator srt_allocator;
+
 /*
  * Functions
  */
@@ -335,6 +475,45 @@ S_INLINE size_t sd_elem_size(const srt_data *d)
 	return d->elem_size;
 }
 
+S_INLINE uint8_t sd_alloc_id(const srt_data *d)
+{
+	return d && d->f.st_mode <= SData_DynFull ? d->alloc_id : 0;
+}
+
+S_INLINE int sd_grow_policy(const srt_data *d)
+{
+	return d && d->f.st_mode <= SData_DynFull ? (int)d->grow_policy
+						  : (int)SD_GROW_DEFAULT;
+}
+
+/* BEHAVIOR: ignored for small mode and void data (see sdx_set_grow_policy) */
+S_INLINE void sd_set_grow_policy(srt_data *d, int policy)
+{
+	if (d && d->f.st_mode <= SData_DynFull)
+		d->grow_policy = (uint8_t)policy;
+}
+
+S_INLINE srt_bool sd_spill_enabled(const srt_data *d)
+{
+	return d->f.ext_buffer && (sd_grow_policy(d) & SD_GROW_SPILL) != 0
+		       ? S_TRUE
+		       : S_FALSE;
+}
+
+S_INLINE int sd_ctype(const srt_data *d)
+{
+	RETURN_IF(!d || d->f.st_mode == SData_VoidData, SD_CT_OTHER);
+	RETURN_IF(d->f.st_mode == SData_DynSmall, SD_CT_STRING);
+	return d->ctype < SD_CT_NumTypes ? (int)d->ctype : (int)SD_CT_OTHER;
+}
+
+/* BEHAVIOR: ignored for small mode and void data */
+S_INLINE void sd_set_ctype(srt_data *d, int ctype)
+{
+	if (d && d->f.st_mode <= SData_DynFull)
+		d->ctype = (uint8_t)ctype;
+}
+
 S_INLINE size_t sd_alloc_size(const srt_data *d)
 {
 	RETURN_IF(!d, 0);
@@ -462,10 +641,10 @@ S_INLINE int sdx_chk_st_change(const srt_data *d, size_t new_max_size)
 	size_t curr_max_size;
 	RETURN_IF(!d || !sdx_dyn_st(d), 0);
 	curr_max_size = sdx_max_size(d);
-	return (curr_max_size <= 255 && new_max_size > 255)
-			       || (curr_max_size > 255 && new_max_size <= 255)
-		       ? (new_max_size > curr_max_size ? 1 : -1)
-		       : 0;
+	/* Full mode can have small sizes, too (shrink, custom allocator) */
+	if (d->f.st_mode == SData_DynSmall)
+		return new_max_size > 255 ? 1 : 0;
+	return curr_max_size > 255 && new_max_size <= 255 ? -1 : 0;
 }
 
 S_INLINE size_t sd_alloc_size_raw(size_t header_size, size_t elem_size,
@@ -488,7 +667,15 @@ S_INLINE size_t sd_compute_max_elems(size_t buffer_size, size_t header_size,
 		       : (buffer_size - header_size) / elem_size;
 }
 
+void sd_set_allocator(const srt_allocator *a);
+const srt_allocator *sd_allocator(uint8_t alloc_id);
+int sd_allocator_id(const srt_allocator *a);
+void sd_allocator_release(const srt_allocator *a);
+void *sd_mem_alloc(uint8_t alloc_id, size_t size);
+void *sd_mem_realloc(uint8_t alloc_id, void *ptr, size_t size);
+void sd_mem_free(uint8_t alloc_id, void *ptr);
 void sd_set_alloc_size(srt_data *d, size_t alloc_size);
+srt_data *sd_alloc_a(uint8_t alloc_id, size_t header_size, size_t elem_size, size_t initial_reserve, srt_bool dyn_st, size_t extra_tail_bytes);
 srt_data *sd_alloc(size_t header_size, size_t elem_size, size_t initial_reserve, srt_bool dyn_st, size_t extra_tail_bytes);
 srt_data *sd_alloc_into_ext_buf(void *buffer, size_t max_size, size_t header_size, size_t elem_size, srt_bool dyn_st);
 void sd_free(srt_data **d);
@@ -496,8 +683,11 @@ void sd_free_va(srt_data **first, va_list ap);
 void sd_reset(srt_data *d, size_t header_size, size_t elem_size, size_t max_size, srt_bool ext_buf, srt_bool dyn_st);
 size_t sd_grow(srt_data **d, size_t extra_size, size_t extra_tail_bytes);
 size_t sd_reserve(srt_data **d, size_t max_size, size_t extra_tail_bytes);
+srt_data *sd_spill(srt_data **d, size_t alloc_size);
 size_t sdx_reserve(srt_data **d, size_t max_size, size_t full_header_size, size_t extra_tail_bytes);
 srt_data *sd_shrink(srt_data **d, size_t extra_tail_bytes);
+srt_bool sd_auto_shrink(srt_data **d, size_t extra_tail_bytes);
+srt_bool sdx_set_grow_policy(srt_data **d, int policy, size_t full_header_size, size_t extra_tail_bytes);
 
 #ifdef __cplusplus
 } /* extern "C" { */
@@ -0,0 +1,195 @@
+/*
+ * sdimage.c
+ *
+ * Container image store/restore (file save/load and memory mapping).
+ *
+ * Copyright (c) 2015-2020 F. Aragon. All rights reserved.
+ * Released under the BSD 3-Clause License (see the doc/LICENSE)
+ */
+
+#include "sdimage.h"
+#include "../sstats.h"
+#include "scommon.h"
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(S_MINIMAL)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SDI_MMAP
+#endif
+
+#define SDI_BASE_MAX 128 /* max container struct size (bytes) */
+
+/*
+ * Internal functions
+ */
+
+static void sdi_hdr_set(struct SDImageHdr *h, const srt_data *d, int type,
+			size_t image_size)
+{
+	memset(h, 0, sizeof(*h));
+	memcpy(h->magic, SD_IMAGE_MAGIC, sizeof(h->magic));
+	h->version = SD_IMAGE_VERSION;
+	h->endian_tag = SD_IMAGE_ENDIAN_TAG;
+	h->type = (uint8_t)type;
+	h->sub_type = d->sub_type;
+	h->size_t_size = (uint8_t)sizeof(size_t);
+	h->ptr_size = (uint8_t)sizeof(void *);
+	h->image_size = image_size;
+}
+
+static srt_bool sdi_hdr_check(const struct SDImageHdr *h, int type,
+			      size_t base_size)
+{
+	RETURN_IF(memcmp(h->magic, SD_IMAGE_MAGIC, sizeof(h->magic)), S_FALSE);
+	RETURN_IF(h->version != SD_IMAGE_VERSION
+			  || h->endian_tag != SD_IMAGE_ENDIAN_TAG
+			  || h->type != type
+			  || h->size_t_size != sizeof(size_t)
+			  || h->ptr_size != sizeof(void *),
+		  S_FALSE);
+	RETURN_IF(h->image_size < base_size
+			  || h->image_size != (uint64_t)(size_t)h->image_size,
+		  S_FALSE);
+	return S_TRUE;
+}
+
+/* Check the container header against the image size */
+static srt_bool sdi_image_check(const srt_data *d, size_t image_size,
+				size_t base_size, uint8_t sub_type)
+{
+	uint64_t data_size;
+	RETURN_IF(d->header_size < base_size || d->header_size > image_size
+			  || !d->elem_size || d->size != d->max_size
+			  || d->sub_type != sub_type,
+		  S_FALSE);
+	data_size = (uint64_t)d->elem_size * d->max_size;
+	RETURN_IF(data_size / d->elem_size != d->max_size, S_FALSE);
+	return data_size == image_size - d->header_size ? S_TRUE : S_FALSE;
+}
+
+S_INLINE void sdi_image_reset(srt_data *d, srt_bool ext_buf)
+{
+	d->f.ext_buffer = ext_buf;
+	d->f.alloc_errors = 0;
+	d->f.st_mode = ext_buf ? SData_Full : SData_DynFull;
+	d->alloc_id = 0;
+}
+
+/*
+ * Save/load
+ */
+
+srt_bool sd_image_save(FILE *f, const srt_data *d, int type,
+		       size_t base_size)
+{
+	size_t is;
+	struct SDImageHdr h;
+	union {
+		srt_data d;
+		uint8_t b[SDI_BASE_MAX];
+	} x;
+	RETURN_IF(!f || !sdx_full_st(d) || base_size > sizeof(x)
+			  || d->header_size < base_size,
+		  S_FALSE);
+	/* BEHAVIOR: only the used elements are stored */
+	is = d->header_size + d->elem_size * d->size;
+	sdi_hdr_set(&h, d, type, is);
+	memcpy(x.b, d, base_size);
+	sdi_image_reset(&x.d, S_FALSE);
+	x.d.f.st_mode = SData_Full;
+	x.d.max_size = d->size;
+	return fwrite(&h, 1, sizeof(h), f) == sizeof(h)
+			       && fwrite(x.b, 1, base_size, f) == base_size
+			       && fwrite((const uint8_t *)d + base_size, 1,
+					 is - base_size, f)
+					  == is - base_size
+		       ? S_TRUE
+		       : S_FALSE;
+}
+
+srt_data *sd_image_load(FILE *f, int type, size_t base_size)
+{
+	size_t is;
+	srt_data *d;
+	struct SDImageHdr h;
+	RETURN_IF(!f || fread(&h, 1, sizeof(h), f) != sizeof(h), NULL);
+	RETURN_IF(!sdi_hdr_check(&h, type, base_size), NULL);
+	is = (size_t)h.image_size;
+	d = (srt_data *)sd_mem_alloc(0, is);
+	RETURN_IF(!d, NULL); /* BEHAVIOR: not enough memory */
+	if (fread(d, 1, is, f) != is
+	    || !sdi_image_check(d, is, base_size, h.sub_type)) {
+		sd_mem_free(0, d);
+		return NULL;
+	}
+	sdi_image_reset(d, S_FALSE);
+	sst_on_alloc(d);
+	return d;
+}
+
+/*
+ * Memory mapping
+ */
+
+srt_data *sd_image_map(const char *path, int type, size_t base_size)
+{
+#ifdef SDI_MMAP
+	int fd;
+	void *p;
+	size_t ms;
+	srt_data *d;
+	struct stat st;
+	struct SDImageHdr *h;
+	RETURN_IF(!path, NULL);
+	fd = open(path, O_RDONLY);
+	RETURN_IF(fd < 0, NULL);
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(*h)
+	    || (uint64_t)st.st_size != (uint64_t)(size_t)st.st_size) {
+		close(fd);
+		return NULL;
+	}
+	ms = (size_t)st.st_size;
+	/*
+	 * Private writable mapping: container header updates are local
+	 * (copy on write), and the file is never modified
+	 */
+	p = mmap(NULL, ms, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	RETURN_IF(p == MAP_FAILED, NULL);
+	h = (struct SDImageHdr *)p;
+	d = (srt_data *)(h + 1);
+	if (!sdi_hdr_check(h, type, base_size)
+	    || h->image_size > ms - sizeof(*h)
+	    || !sdi_image_check(d, (size_t)h->image_size, base_size,
+				h->sub_type)) {
+		munmap(p, ms);
+		return NULL;
+	}
+	h->map_size = ms;
+	sdi_image_reset(d, S_TRUE);
+	return d;
+#else
+	(void)path;
+	(void)type;
+	(void)base_size;
+	return NULL;
+#endif
+}
+
+void sd_image_unmap(srt_data **d)
+{
+	struct SDImageHdr *h;
+	if (!d || !*d)
+		return;
+#ifdef SDI_MMAP
+	h = (struct SDImageHdr *)*d - 1;
+	S_ASSERT(h->map_size > 0);
+	if (h->map_size > 0)
+		munmap(h, (size_t)h->map_size);
+#else
+	(void)h;
+#endif
+	*d = NULL;
+}
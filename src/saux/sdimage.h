@@ -0,0 +1,71 @@
+#ifndef SDIMAGE_H
+#define SDIMAGE_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * sdimage.h
+ *
+ * Container image store/restore (file save/load and memory mapping).
+ *
+ * Copyright (c) 2015-2020 F. Aragon. All rights reserved.
+ * Released under the BSD 3-Clause License (see the doc/LICENSE)
+ *
+ * Observations:
+ * - This is not intended for direct use, but as base for the container
+ *   save/load/map functions (sv_save(), sm_save(), shm_save(), etc.)
+ * - Image file layout: | struct SDImageHdr | container memory block |
+ *   The container block is stored as is (header, buckets, nodes, etc.), with
+ *   max_size adjusted to the size, so no deserialization is required.
+ * - The image is only portable across systems with the same endianness,
+ *   size_t size, and pointer size (checked on load/map).
+ * - Only containers without pointers (e.g. no strings) can be stored.
+ */
+
+#include "sdata.h"
+
+#define SD_IMAGE_MAGIC "sRtI"
+#define SD_IMAGE_VERSION 1
+#define SD_IMAGE_ENDIAN_TAG 0x0102
+
+enum eSD_ImageType {
+	SD_IMAGE_VECTOR = 1,
+	SD_IMAGE_BITSET = 2,
+	SD_IMAGE_MAP = 3,
+	SD_IMAGE_HMAP = 4
+};
+
+struct SDImageHdr /* 64-byte structure */
+{
+	char magic[4];
+	uint16_t version;
+	uint16_t endian_tag; /* SD_IMAGE_ENDIAN_TAG, in the writer byte order */
+	uint8_t type;	     /* enum eSD_ImageType */
+	uint8_t sub_type;
+	uint8_t size_t_size;
+	uint8_t ptr_size;
+	uint32_t reserved;
+	uint64_t image_size; /* container memory block size (bytes) */
+	uint64_t map_size;   /* mapped bytes (0: not mapped) */
+	uint8_t padding[32];
+};
+
+/* Save container image (base_size: container struct size) */
+srt_bool sd_image_save(FILE *f, const srt_data *d, int type,
+		       size_t base_size);
+
+/* Load container image into heap memory (NULL: error) */
+srt_data *sd_image_load(FILE *f, int type, size_t base_size);
+
+/* Map image file (NULL: error or no mmap() support) */
+srt_data *sd_image_map(const char *path, int type, size_t base_size);
+
+/* Release mapped container */
+void sd_image_unmap(srt_data **d);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* #ifndef SDIMAGE_H */
@@ -0,0 +1,497 @@
+/*
+ * snum.c
+ *
+ * Number formatting and parsing
+ *
+ * Copyright (c) 2015-2020 F. Aragon. All rights reserved.
+ * Released under the BSD 3-Clause License (see the doc/LICENSE)
+ */
+
+#include "snum.h"
+
+/*
+ * Integer formatting
+ */
+
+static const char snum_d2[] =
+	"0001020304050607080910111213141516171819"
+	"2021222324252627282930313233343536373839"
+	"4041424344454647484950515253545556575859"
+	"6061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static const uint64_t snum_pow10[] = {1ULL,
+				      10ULL,
+				      100ULL,
+				      1000ULL,
+				      10000ULL,
+				      100000ULL,
+				      1000000ULL,
+				      10000000ULL,
+				      100000000ULL,
+				      1000000000ULL,
+				      10000000000ULL,
+				      100000000000ULL,
+				      1000000000000ULL,
+				      10000000000000ULL,
+				      100000000000000ULL,
+				      1000000000000000ULL,
+				      10000000000000000ULL,
+				      100000000000000000ULL,
+				      1000000000000000000ULL,
+				      10000000000000000000ULL};
+
+static size_t snum_u64_digits(uint64_t num)
+{
+	size_t digits = 1;
+	for (; num >= 10000; num /= 10000)
+		digits += 4;
+	return digits + (num >= 10) + (num >= 100) + (num >= 1000);
+}
+
+size_t snum_u64_to_c(char *o, uint64_t num)
+{
+	size_t i, digits = snum_u64_digits(num);
+	char *p = o + digits;
+	for (; num >= 100; num /= 100) {
+		i = (size_t)(num % 100) * 2;
+		p -= 2;
+		p[0] = snum_d2[i];
+		p[1] = snum_d2[i + 1];
+	}
+	if (num >= 10) {
+		p[-2] = snum_d2[num * 2];
+		p[-1] = snum_d2[num * 2 + 1];
+	} else {
+		p[-1] = (char)('0' + num);
+	}
+	return digits;
+}
+
+size_t snum_i64_to_c(char *o, int64_t num)
+{
+	if (num >= 0)
+		return snum_u64_to_c(o, (uint64_t)num);
+	*o = '-';
+	return 1 + snum_u64_to_c(o + 1, (uint64_t)0 - (uint64_t)num);
+}
+
+/*
+ * Double formatting (Grisu2)
+ */
+
+#define SNUM_DP_HIDDEN 0x0010000000000000ULL
+#define SNUM_DP_SMASK 0x000FFFFFFFFFFFFFULL
+#define SNUM_DP_EMASK 0x7FF0000000000000ULL
+#define SNUM_DP_SIGN 0x8000000000000000ULL
+#define SNUM_DP_BIAS 1075 /* 0x3ff + 52 */
+
+static const uint64_t snum_pw10_f[] = {
+	0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+	0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+	0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+	0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+	0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+	0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+	0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+	0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+	0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+	0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+	0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+	0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+	0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+	0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+	0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+	0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+	0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+	0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+	0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+	0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+	0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+	0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+	0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+	0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+	0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+	0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+	0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+	0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+	0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+static const int16_t snum_pw10_e[] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+	-954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+	-688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+	-422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+	-157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+	109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+	375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+	641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+	907, 933, 960, 986, 1013, 1039, 1066
+};
+
+struct SNumDiyFp {
+	uint64_t f;
+	int e;
+};
+
+typedef struct SNumDiyFp srt_diyfp;
+
+S_INLINE srt_diyfp dfp(uint64_t f, int e)
+{
+	srt_diyfp r;
+	r.f = f;
+	r.e = e;
+	return r;
+}
+
+static srt_diyfp dfp_mul(srt_diyfp x, srt_diyfp y)
+{
+	const uint64_t m32 = 0xFFFFFFFFULL;
+	uint64_t a = x.f >> 32, b = x.f & m32, c = y.f >> 32, d = y.f & m32,
+		 ac = a * c, bc = b * c, ad = a * d, bd = b * d,
+		 tmp = (bd >> 32) + (ad & m32) + (bc & m32) + (1ULL << 31);
+	return dfp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64);
+}
+
+static srt_diyfp dfp_normalize(srt_diyfp x)
+{
+	for (; !(x.f & SNUM_DP_SIGN); x.e--)
+		x.f <<= 1;
+	return x;
+}
+
+static void dfp_boundaries(srt_diyfp v, srt_diyfp *m, srt_diyfp *p)
+{
+	srt_diyfp pl = dfp((v.f << 1) + 1, v.e - 1), mi;
+	for (; !(pl.f & (SNUM_DP_HIDDEN << 1)); pl.e--)
+		pl.f <<= 1;
+	pl.f <<= 64 - 52 - 2;
+	pl.e -= 64 - 52 - 2;
+	mi = v.f == SNUM_DP_HIDDEN ? dfp((v.f << 2) - 1, v.e - 2)
+				   : dfp((v.f << 1) - 1, v.e - 1);
+	mi.f <<= mi.e - pl.e;
+	mi.e = pl.e;
+	*m = mi;
+	*p = pl;
+}
+
+static srt_diyfp snum_cached_pow10(int e, int *k10)
+{
+	double dk = (-61 - e) * 0.30102999566398114 + 347;
+	int k = (int)dk;
+	size_t i;
+	if (dk - k > 0.0)
+		k++;
+	i = (size_t)((k >> 3) + 1);
+	*k10 = -(-348 + (int)i * 8);
+	return dfp(snum_pw10_f[i], snum_pw10_e[i]);
+}
+
+static void snum_grisu_round(char *b, size_t len, uint64_t delta,
+			     uint64_t rest, uint64_t ten_kappa, uint64_t wp_w)
+{
+	while (rest < wp_w && delta - rest >= ten_kappa
+	       && (rest + ten_kappa < wp_w
+		   || wp_w - rest > rest + ten_kappa - wp_w)) {
+		b[len - 1]--;
+		rest += ten_kappa;
+	}
+}
+
+static size_t snum_digit_gen(srt_diyfp w, srt_diyfp mp, uint64_t delta,
+			     char *b, int *k10)
+{
+	srt_diyfp one = dfp(1ULL << -mp.e, mp.e);
+	uint64_t wp_w = mp.f - w.f, p2 = mp.f & (one.f - 1), tmp;
+	uint32_t d, p1 = (uint32_t)(mp.f >> -one.e);
+	int kappa = (int)snum_u64_digits(p1);
+	size_t len = 0;
+	while (kappa > 0) {
+		d = (uint32_t)(p1 / snum_pow10[kappa - 1]);
+		p1 = (uint32_t)(p1 % snum_pow10[kappa - 1]);
+		if (d || len)
+			b[len++] = (char)('0' + d);
+		kappa--;
+		tmp = ((uint64_t)p1 << -one.e) + p2;
+		if (tmp <= delta) {
+			*k10 += kappa;
+			snum_grisu_round(b, len, delta, tmp,
+					 snum_pow10[kappa] << -one.e, wp_w);
+			return len;
+		}
+	}
+	for (;;) {
+		p2 *= 10;
+		delta *= 10;
+		d = (uint32_t)(p2 >> -one.e);
+		if (d || len)
+			b[len++] = (char)('0' + d);
+		p2 &= one.f - 1;
+		kappa--;
+		if (p2 < delta) {
+			*k10 += kappa;
+			snum_grisu_round(b, len, delta, p2, one.f,
+					 -kappa < 20 ? wp_w * snum_pow10[-kappa]
+						     : 0);
+			return len;
+		}
+	}
+}
+
+static size_t snum_grisu2(double num, char *b, int *k10)
+{
+	uint64_t u = S_LD_U64(&num), e = (u & SNUM_DP_EMASK) >> 52,
+		 sig = u & SNUM_DP_SMASK;
+	srt_diyfp v = e ? dfp(sig + SNUM_DP_HIDDEN, (int)e - SNUM_DP_BIAS)
+			: dfp(sig, 1 - SNUM_DP_BIAS),
+		  w_m, w_p, c_mk, w, wp, wm;
+	dfp_boundaries(v, &w_m, &w_p);
+	c_mk = snum_cached_pow10(w_p.e, k10);
+	w = dfp_mul(dfp_normalize(v), c_mk);
+	wp = dfp_mul(w_p, c_mk);
+	wm = dfp_mul(w_m, c_mk);
+	wm.f++;
+	wp.f--;
+	return snum_digit_gen(w, wp, wp.f - wm.f, b, k10);
+}
+
+static size_t snum_write_exp(char *o, int k)
+{
+	size_t n = 0;
+	o[n++] = 'e';
+	if (k < 0) {
+		o[n++] = '-';
+		k = -k;
+	}
+	return n + snum_u64_to_c(o + n, (uint64_t)k);
+}
+
+/*
+ * Output format: integers up to 21 digits without decimals nor exponent
+ * (e.g. "123"), decimals for magnitudes in [1e-6, 1e21) (e.g. "0.001"),
+ * and exponent otherwise (e.g. "1e-7", "1.5e300")
+ */
+size_t snum_f64_to_c(char *o, double num)
+{
+	char *b = o;
+	int k = 0, kk, i;
+	size_t len;
+	uint64_t u = S_LD_U64(&num);
+	if ((u & SNUM_DP_EMASK) == SNUM_DP_EMASK) {
+		if (u & SNUM_DP_SMASK) {
+			memcpy(o, "nan", 3);
+			return 3;
+		}
+		if (u & SNUM_DP_SIGN) {
+			memcpy(o, "-inf", 4);
+			return 4;
+		}
+		memcpy(o, "inf", 3);
+		return 3;
+	}
+	if (u & SNUM_DP_SIGN) {
+		*b++ = '-';
+		num = -num;
+	}
+	if (num == 0) {
+		*b++ = '0';
+		return (size_t)(b - o);
+	}
+	len = snum_grisu2(num, b, &k);
+	kk = (int)len + k; /* 10^(kk - 1) <= num < 10^kk */
+	if (k >= 0 && kk <= 21) { /* 1234e7 -> 12340000000 */
+		for (i = (int)len; i < kk; i++)
+			b[i] = '0';
+		len = (size_t)kk;
+	} else if (kk > 0 && kk <= 21) { /* 1234e-2 -> 12.34 */
+		memmove(b + kk + 1, b + kk, len - (size_t)kk);
+		b[kk] = '.';
+		len++;
+	} else if (kk > -6 && kk <= 0) { /* 1234e-6 -> 0.001234 */
+		memmove(b + 2 - kk, b, len);
+		b[0] = '0';
+		b[1] = '.';
+		for (i = 2; i < 2 - kk; i++)
+			b[i] = '0';
+		len += (size_t)(2 - kk);
+	} else if (len == 1) { /* 1e30 */
+		len = 1 + snum_write_exp(b + 1, kk - 1);
+	} else { /* 1234e30 -> 1.234e33 */
+		memmove(b + 2, b + 1, len - 1);
+		b[1] = '.';
+		len = len + 1 + snum_write_exp(b + len + 1, kk - 1);
+	}
+	return (size_t)(b - o) + len;
+}
+
+/*
+ * Parsing
+ */
+
+S_INLINE srt_bool snum_is_8digits(uint64_t v)
+{
+	return !(((v & 0xF0F0F0F0F0F0F0F0ULL)
+		  | (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL)
+		     >> 4))
+		 ^ 0x3333333333333333ULL);
+}
+
+S_INLINE uint32_t snum_parse_8digits(uint64_t v)
+{
+	const uint64_t mask = 0x000000FF000000FFULL,
+		       mul1 = 0x000F424000000064ULL, /* 100 + (1000000 << 32) */
+		       mul2 = 0x0000271000000001ULL; /* 1 + (10000 << 32) */
+	v -= 0x3030303030303030ULL;
+	v = (v * 10) + (v >> 8);
+	v = (((v & mask) * mul1) + (((v >> 16) & mask) * mul2)) >> 32;
+	return (uint32_t)v;
+}
+
+#define SNUM_IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+
+/* Skip blanks and sign */
+static size_t snum_skip_prefix(const char *s, size_t ss, srt_bool *neg)
+{
+	size_t i = 0;
+	for (; i < ss && (s[i] == ' ' || s[i] == '\t'); i++)
+		;
+	*neg = i < ss && s[i] == '-' ? S_TRUE : S_FALSE;
+	if (i < ss && (s[i] == '-' || s[i] == '+'))
+		i++;
+	return i;
+}
+
+/* Decimal digits: up to 19 digits are kept, the rest are just counted */
+static size_t snum_parse_digits(const char *s, size_t ss, uint64_t *m,
+				size_t *nd, size_t *dropped)
+{
+	size_t i = 0;
+	for (; i + 8 <= ss && *nd + 8 <= 19 && snum_is_8digits(S_LD_LE_U64(s + i));
+	     i += 8) {
+		*m = *m * 100000000 + snum_parse_8digits(S_LD_LE_U64(s + i));
+		if (*m)
+			*nd += 8;
+	}
+	for (; i < ss && SNUM_IS_DIGIT(s[i]); i++) {
+		if (*nd < 19) {
+			*m = *m * 10 + (uint64_t)(s[i] - '0');
+			if (*m)
+				(*nd)++;
+		} else {
+			(*dropped)++;
+		}
+	}
+	return i;
+}
+
+int64_t snum_c_to_i64(const char *s, size_t ss, size_t *consumed)
+{
+	srt_bool neg, ovf = S_FALSE;
+	size_t i, i0;
+	uint64_t m = 0, d, lim;
+	i = i0 = snum_skip_prefix(s, ss, &neg);
+	for (; i + 8 <= ss && m < 100000000000ULL
+	       && snum_is_8digits(S_LD_LE_U64(s + i));
+	     i += 8)
+		m = m * 100000000 + snum_parse_8digits(S_LD_LE_U64(s + i));
+	for (; i < ss && SNUM_IS_DIGIT(s[i]); i++) {
+		d = (uint64_t)(s[i] - '0');
+		if (m > (0xFFFFFFFFFFFFFFFFULL - d) / 10)
+			ovf = S_TRUE;
+		else
+			m = m * 10 + d;
+	}
+	if (consumed)
+		*consumed = i > i0 ? i : 0;
+	RETURN_IF(i == i0, 0); /* BEHAVIOR: not a number */
+	lim = neg ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+	if (ovf || m > lim) /* BEHAVIOR: saturation (like strtoll) */
+		m = lim;
+	return neg && m ? -(int64_t)(m - 1) - 1 : (int64_t)m;
+}
+
+static double snum_strtod(const char *s, size_t ss, size_t *consumed)
+{
+	double r;
+	char *end = NULL, btmp[64], *b = ss < sizeof(btmp) ? btmp : NULL;
+	if (!b) {
+		b = (char *)s_malloc(ss + 1);
+		if (!b) {
+			*consumed = 0;
+			return 0;
+		}
+	}
+	memcpy(b, s, ss);
+	b[ss] = 0;
+	r = strtod(b, &end);
+	*consumed = end ? (size_t)(end - b) : 0;
+	if (b != btmp)
+		s_free(b);
+	return r;
+}
+
+double snum_c_to_f64(const char *s, size_t ss, size_t *consumed)
+{
+	static const double p10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+				     1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+				     1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+				     1e18, 1e19, 1e20, 1e21, 1e22};
+	double r;
+	srt_bool neg, eneg;
+	uint64_t m = 0;
+	size_t i, i0, ie, n, nd = 0, dropped = 0, dropped_f = 0, ndigits, c = 0;
+	long e10 = 0, ex = 0;
+	i = i0 = snum_skip_prefix(s, ss, &neg);
+	/* Non-numeric values (e.g. "inf", "nan") */
+	if (i < ss && !SNUM_IS_DIGIT(s[i]) && s[i] != '.') {
+		n = S_MIN(ss - i0, 16);
+		r = snum_strtod(s, i0 + n, &c);
+		if (consumed)
+			*consumed = c;
+		return r;
+	}
+	n = snum_parse_digits(s + i, ss - i, &m, &nd, &dropped);
+	e10 = (long)dropped;
+	ndigits = n;
+	i += n;
+	if (i < ss && s[i] == '.') {
+		i++;
+		n = snum_parse_digits(s + i, ss - i, &m, &nd, &dropped_f);
+		e10 -= (long)(n - dropped_f);
+		ndigits += n;
+		i += n;
+	}
+	if (!ndigits) {
+		if (consumed)
+			*consumed = 0;
+		return 0; /* BEHAVIOR: not a number */
+	}
+	if (i < ss && (s[i] == 'e' || s[i] == 'E')) {
+		ie = i + 1;
+		eneg = ie < ss && s[ie] == '-' ? S_TRUE : S_FALSE;
+		if (ie < ss && (s[ie] == '-' || s[ie] == '+'))
+			ie++;
+		if (ie < ss && SNUM_IS_DIGIT(s[ie])) {
+			for (; ie < ss && SNUM_IS_DIGIT(s[ie]); ie++)
+				if (ex < 100000)
+					ex = ex * 10 + (s[ie] - '0');
+			e10 += eneg ? -ex : ex;
+			i = ie;
+		}
+	}
+	if (consumed)
+		*consumed = i;
+	/*
+	 * Exact fast path (Clinger): both the mantissa and the power of ten
+	 * are exactly representable, so only one rounding happens.
+	 */
+	if (m == 0)
+		r = 0;
+	else if (!dropped && !dropped_f && m <= (1ULL << 53) && e10 >= -22
+		 && e10 <= 22)
+		r = e10 < 0 ? (double)m / p10[-e10] : (double)m * p10[e10];
+	else
+		r = snum_strtod(s + i0, i - i0, &c);
+	return neg ? -r : r;
+}
@@ -0,0 +1,41 @@
+#ifndef SNUM_H
+#define SNUM_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * snum.h
+ *
+ * Number formatting and parsing
+ *
+ * Copyright (c) 2015-2020 F. Aragon. All rights reserved.
+ * Released under the BSD 3-Clause License (see the doc/LICENSE)
+ *
+ * Features:
+ *
+ * - Integer formatting writing two digits per step (lookup table).
+ * - Round-trip double formatting (Grisu2 algorithm, by Florian Loitsch,
+ *   "Printing Floating-Point Numbers Quickly and Accurately with Integers",
+ *   PLDI 2010), giving the shortest output in ~99.9% of the cases.
+ * - Integer parsing with 8-digits-at-a-time SWAR conversion.
+ * - Double parsing with exact fast path (Clinger), and strtod() fallback
+ *   for the cases requiring big number arithmetic.
+ */
+
+#include "scommon.h"
+
+#define SNUM_I64_MAX_SIZE 24 /* output buffer size for integers */
+#define SNUM_F64_MAX_SIZE 32 /* output buffer size for doubles */
+
+size_t snum_u64_to_c(char *o, uint64_t num);
+size_t snum_i64_to_c(char *o, int64_t num);
+size_t snum_f64_to_c(char *o, double num);
+int64_t snum_c_to_i64(const char *s, size_t ss, size_t *consumed);
+double snum_c_to_f64(const char *s, size_t ss, size_t *consumed);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* SNUM_H */
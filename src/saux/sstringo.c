@@ -17,7 +17,34 @@ S_INLINE const uint8_t *sso_dd_get_s2_raw(const srt_stringo *s)
 	return &s->kv.d.s_raw[0] + ss_size(s1) + sizeof(struct SDataSmall) + 1;
 }
 
-S_INLINE void sso1_set0(srt_stringo1 *so, const srt_string *s, srt_string *s0)
+#define SSO_T(s) ((uint8_t)((s)->t & ~OptStr_Pool)) /* type without pool flag */
+
+/* Pool string allocation size (including the \0 required by ss_to_c()) */
+S_INLINE size_t sso_pool_asize(size_t ss)
+{
+	return sd_alloc_size_raw(sizeof(srt_string), 1, ss, S_TRUE) + 1;
+}
+
+static srt_string *sso_pool_dup(srt_arena *pool, const srt_string *s)
+{
+	size_t ss = ss_size(s);
+	srt_string *s_out;
+	void *buf = sa_malloc(pool, sso_pool_asize(ss));
+	/* BEHAVIOR: not enough memory (pooled strings are never released) */
+	RETURN_IF(!buf, (srt_string *)ss_void); /* CONSTNESS */
+	s_out = ss_alloc_into_ext_buf(buf, ss);
+	ss_cpy(&s_out, s);
+	return s_out;
+}
+
+/* Indirect string copy, using the string pool if any */
+S_INLINE srt_string *sso_dup_p(const srt_string *s, srt_arena *pool)
+{
+	return pool ? sso_pool_dup(pool, s) : ss_dup(s);
+}
+
+S_INLINE void sso1_set0(srt_stringo1 *so, const srt_string *s, srt_string *s0,
+			srt_arena *pool)
 {
 	size_t ss;
 	if (!so)
@@ -31,22 +58,24 @@ S_INLINE void sso1_set0(srt_stringo1 *so, const srt_string *s, srt_string *s0)
 		so->t = OptStr_D;
 		ss_cpy(&s_out, s);
 	} else {
-		so->t = OptStr_I;
+		so->t = (uint8_t)(OptStr_I | (pool ? OptStr_Pool : 0));
 		if (s0) {
 			so->i.s = s0;
 			s0 = NULL;
 			ss_cpy(&so->i.s, s);
 		} else
-			so->i.s = ss_dup(s);
+			so->i.s = sso_dup_p(s, pool);
 	}
 	ss_free(&s0);
 }
 
 S_INLINE void sso_set0(srt_stringo *so, const srt_string *s1,
-		       const srt_string *s2, srt_string *sa, srt_string *sb)
+		       const srt_string *s2, srt_string *sa, srt_string *sb,
+		       srt_arena *pool)
 {
 	size_t s1s, s2s;
 	srt_string *so1, *so2;
+	uint8_t pf = pool ? OptStr_Pool : 0;
 	if (!so)
 		return;
 	if (!s1)
@@ -77,8 +106,8 @@ S_INLINE void sso_set0(srt_stringo *so, const srt_string *s1,
 			}
 			ss_cpy(&so->kv.di.si, s2);
 		} else
-			so->kv.di.si = ss_dup(s2);
-		so->t = OptStr_DI;
+			so->kv.di.si = sso_dup_p(s2, pool);
+		so->t = (uint8_t)(OptStr_DI | pf);
 	} else if (s2s <= OptStr_MaxSize_DI) {
 		if (sa || sb) {
 			if (sa) {
@@ -90,25 +119,25 @@ S_INLINE void sso_set0(srt_stringo *so, const srt_string *s1,
 			}
 			ss_cpy(&so->kv.di.si, s1);
 		} else
-			so->kv.di.si = ss_dup(s1);
+			so->kv.di.si = sso_dup_p(s1, pool);
 		so2 = (srt_string *)so->kv.di.s_raw;
 		ss_alloc_into_ext_buf(so2, OptStr_MaxSize_DI);
 		ss_cpy(&so2, s2);
-		so->t = OptStr_ID;
+		so->t = (uint8_t)(OptStr_ID | pf);
 	} else {
 		if (sa) {
 			so->kv.ii.s1 = sa;
 			sa = NULL;
 			ss_cpy(&so->kv.ii.s1, s1);
 		} else
-			so->kv.ii.s1 = ss_dup(s1);
+			so->kv.ii.s1 = sso_dup_p(s1, pool);
 		if (sb) {
 			so->kv.ii.s2 = sb;
 			sb = NULL;
 			ss_cpy(&so->kv.ii.s2, s2);
 		} else
-			so->kv.ii.s2 = ss_dup(s2);
-		so->t = OptStr_II;
+			so->kv.ii.s2 = sso_dup_p(s2, pool);
+		so->t = (uint8_t)(OptStr_II | pf);
 	}
 	ss_free(&sa);
 	ss_free(&sb);
@@ -116,20 +145,24 @@ S_INLINE void sso_set0(srt_stringo *so, const srt_string *s1,
 
 const srt_string *sso1_get(const srt_stringo1 *s)
 {
+	uint8_t t;
 	RETURN_IF(!s, ss_void);
-	RETURN_IF(s->t == OptStr_D, (const srt_string *)s->d.s_raw);
-	RETURN_IF(s->t == OptStr_I, s->i.s);
+	t = SSO_T(s);
+	RETURN_IF(t == OptStr_D, (const srt_string *)s->d.s_raw);
+	RETURN_IF(t == OptStr_I, s->i.s);
 	return ss_void;
 }
 
 const srt_string *sso_get(const srt_stringo *s)
 {
+	uint8_t t;
 	RETURN_IF(!s || (s->k.t & OptStr_Null) != 0, ss_void);
 	RETURN_IF((s->t & OptStr_2) == 0, sso1_get((const srt_stringo1 *)s));
-	RETURN_IF(s->t == OptStr_DD, (const srt_string *)s->kv.d.s_raw);
-	RETURN_IF(s->t == OptStr_DI, (const srt_string *)s->kv.di.s_raw);
-	RETURN_IF(s->t == OptStr_ID, (const srt_string *)s->kv.di.si);
-	RETURN_IF(s->t == OptStr_II, (const srt_string *)s->kv.ii.s1);
+	t = SSO_T(s);
+	RETURN_IF(t == OptStr_DD, (const srt_string *)s->kv.d.s_raw);
+	RETURN_IF(t == OptStr_DI, (const srt_string *)s->kv.di.s_raw);
+	RETURN_IF(t == OptStr_ID, (const srt_string *)s->kv.di.si);
+	RETURN_IF(t == OptStr_II, (const srt_string *)s->kv.ii.s1);
 	return ss_void;
 }
 
@@ -141,28 +174,43 @@ const srt_string *sso_dd_get_s2(const srt_stringo *s)
 
 const srt_string *sso_get_s2(const srt_stringo *s)
 {
+	uint8_t t;
 	RETURN_IF(!s || (s->t & OptStr_2) == 0, ss_void);
-	RETURN_IF(s->t == OptStr_ID, (const srt_string *)s->kv.di.s_raw);
-	RETURN_IF(s->t == OptStr_DI, (const srt_string *)s->kv.di.si);
-	RETURN_IF(s->t == OptStr_II, s->kv.ii.s2);
+	t = SSO_T(s);
+	RETURN_IF(t == OptStr_ID, (const srt_string *)s->kv.di.s_raw);
+	RETURN_IF(t == OptStr_DI, (const srt_string *)s->kv.di.si);
+	RETURN_IF(t == OptStr_II, s->kv.ii.s2);
 	return sso_dd_get_s2(s); /* OptStr_DD */
 }
 
 void sso1_set(srt_stringo1 *so, const srt_string *s)
 {
-	sso1_set0(so, s, NULL);
+	sso1_set0(so, s, NULL, NULL);
 }
 
 void sso_set(srt_stringo *so, const srt_string *s1, const srt_string *s2)
 {
-	sso_set0(so, s1, s2, NULL, NULL);
+	sso_set0(so, s1, s2, NULL, NULL, NULL);
+}
+
+void sso1_set_p(srt_stringo1 *so, const srt_string *s, srt_arena *pool)
+{
+	sso1_set0(so, s, NULL, pool);
+}
+
+void sso_set_p(srt_stringo *so, const srt_string *s1, const srt_string *s2,
+	       srt_arena *pool)
+{
+	sso_set0(so, s1, s2, NULL, NULL, pool);
 }
 
 void sso_update(srt_stringo *so, const srt_string *s, const srt_string *s2)
 {
 	srt_string *s0, *s20;
 	if (so) {
-		if ((so->t & OptStr_Ix) != 0) {
+		if ((so->t & OptStr_Pool) != 0) { /* pooled: not reusable */
+			s0 = s20 = NULL;
+		} else if ((so->t & OptStr_Ix) != 0) {
 			s0 = so->kv.di.si;
 			s20 = NULL;
 		} else if (so->t == OptStr_II) {
@@ -170,7 +218,7 @@ void sso_update(srt_stringo *so, const srt_string *s, const srt_string *s2)
 			s20 = so->kv.ii.s2;
 		} else
 			s0 = s20 = NULL;
-		sso_set0(so, s, s2, s0, s20);
+		sso_set0(so, s, s2, s0, s20, NULL);
 	}
 }
 
@@ -179,7 +227,7 @@ void sso1_update(srt_stringo1 *so, const srt_string *s)
 	srt_string *s0;
 	if (so) {
 		s0 = so->t == OptStr_I ? so->i.s : NULL;
-		sso1_set0(so, s, s0);
+		sso1_set0(so, s, s0, NULL);
 	}
 }
 
@@ -217,40 +265,84 @@ void sso_free(srt_stringo *so)
 	else if (so->kv.t == OptStr_II) {
 		ss_free(&so->kv.ii.s1);
 		ss_free(&so->kv.ii.s2);
-	} else if (so->kv.t == OptStr_DI)
+	} else if (so->kv.t == OptStr_DI || so->kv.t == OptStr_ID)
 		ss_free(&so->kv.di.si);
 	so->k.t |= OptStr_Null;
 }
 
 /*
  * Duplication adjust: adjust sso string copied in bulk -e.g. with memcpy-,
- * so if using dynamic memory it duplicates the string references
+ * so if using dynamic memory it duplicates the string references (into the
+ * given string pool, or the heap if NULL)
  */
 
-void sso_dupa(srt_stringo *s)
+void sso_dupa_p(srt_stringo *s, srt_arena *pool)
 {
-	switch (s->t) {
+	uint8_t t = SSO_T(s);
+	switch (t) {
 	case OptStr_I:
-		s->k.i.s = ss_dup(s->k.i.s);
+		s->k.i.s = sso_dup_p(s->k.i.s, pool);
 		break;
 	case OptStr_DI:
 	case OptStr_ID:
-		s->kv.di.si = ss_dup(s->kv.di.si);
+		s->kv.di.si = sso_dup_p(s->kv.di.si, pool);
 		break;
 	case OptStr_II:
-		s->kv.ii.s1 = ss_dup(s->kv.ii.s1);
-		s->kv.ii.s2 = ss_dup(s->kv.ii.s2);
+		s->kv.ii.s1 = sso_dup_p(s->kv.ii.s1, pool);
+		s->kv.ii.s2 = sso_dup_p(s->kv.ii.s2, pool);
 		break;
 	default:
 		/* cases not using dynamic memory */
-		break;
+		return;
+	}
+	s->t = (uint8_t)(t | (pool ? OptStr_Pool : 0));
+}
+
+void sso_dupa1_p(srt_stringo1 *s, srt_arena *pool)
+{
+	if (SSO_T(s) == OptStr_I) {
+		s->i.s = sso_dup_p(s->i.s, pool);
+		s->t = (uint8_t)(OptStr_I | (pool ? OptStr_Pool : 0));
 	}
 }
 
+void sso_dupa(srt_stringo *s)
+{
+	sso_dupa_p(s, NULL);
+}
+
 void sso_dupa1(srt_stringo1 *s)
 {
-	if (s->t == OptStr_I)
-		s->i.s = ss_dup(s->i.s);
+	sso_dupa1_p(s, NULL);
+}
+
+/*
+ * String pool usage (bytes)
+ */
+
+size_t sso_pool_size(const srt_stringo *s)
+{
+	RETURN_IF((s->t & OptStr_Pool) == 0, 0);
+	switch (SSO_T(s)) {
+	case OptStr_I:
+		return sso_pool_asize(ss_size(s->k.i.s));
+	case OptStr_DI:
+	case OptStr_ID:
+		return sso_pool_asize(ss_size(s->kv.di.si));
+	case OptStr_II:
+		return sso_pool_asize(ss_size(s->kv.ii.s1))
+		       + sso_pool_asize(ss_size(s->kv.ii.s2));
+	default:
+		break;
+	}
+	return 0;
+}
+
+size_t sso1_pool_size(const srt_stringo1 *s)
+{
+	return s->t == (OptStr_I | OptStr_Pool)
+		       ? sso_pool_asize(ss_size(s->i.s))
+		       : 0;
 }
 
 #endif /* #ifdef S_ENABLE_SM_STRING_OPTIMIZATION */
@@ -13,6 +13,7 @@ extern "C" {
  * the BSD 3-Clause License (see the doc/LICENSE file included).
  */
 
+#include "../sarena.h"
 #include "../sstring.h"
 
 #ifndef S_DISABLE_SM_STRING_OPTIMIZATION
@@ -47,6 +48,7 @@ extern "C" {
 #define OptStr_2 0x08
 #define OptStr_Ix 0x10
 #define OptStr_Null 0x20
+#define OptStr_Pool 0x40 /* indirect strings stored in a string pool */
 #define OptStr_D 1 /* OptStrRaw */
 #define OptStr_I 2 /* OptStrI */
 #define OptStr_DD (OptStr_2 | 3) /* OptStrRaw2 */
@@ -140,6 +142,19 @@ void sso_free(srt_stringo *so);
 void sso_dupa(srt_stringo *s);
 void sso_dupa1(srt_stringo1 *s);
 
+/*
+ * String pool: strings not fitting in the node are stored in the pool
+ * (srt_arena) instead of having their own heap allocation. Pooled strings
+ * are not released individually (the pool is released at once).
+ */
+void sso1_set_p(srt_stringo1 *so, const srt_string *s, srt_arena *pool);
+void sso_set_p(srt_stringo *so, const srt_string *s1, const srt_string *s2,
+	       srt_arena *pool);
+void sso_dupa_p(srt_stringo *s, srt_arena *pool);
+void sso_dupa1_p(srt_stringo1 *s, srt_arena *pool);
+size_t sso_pool_size(const srt_stringo *s);
+size_t sso1_pool_size(const srt_stringo1 *s);
+
 #else
 
 S_INLINE const srt_string *sso1_get(const srt_stringo1 *s)
@@ -227,6 +242,46 @@ S_INLINE void sso_dupa(srt_stringo *s)
 	s->kv.s2 = ss_dup(s->kv.s2);
 }
 
+/* No string pool support: heap strings */
+
+S_INLINE void sso1_set_p(srt_stringo1 *so, const srt_string *s,
+			 srt_arena *pool)
+{
+	(void)pool;
+	sso1_set(so, s);
+}
+
+S_INLINE void sso_set_p(srt_stringo *so, const srt_string *s1,
+			const srt_string *s2, srt_arena *pool)
+{
+	(void)pool;
+	sso_set(so, s1, s2);
+}
+
+S_INLINE void sso_dupa_p(srt_stringo *s, srt_arena *pool)
+{
+	(void)pool;
+	sso_dupa(s);
+}
+
+S_INLINE void sso_dupa1_p(srt_stringo1 *s, srt_arena *pool)
+{
+	(void)pool;
+	sso_dupa1(s);
+}
+
+S_INLINE size_t sso_pool_size(const srt_stringo *s)
+{
+	(void)s;
+	return 0;
+}
+
+S_INLINE size_t sso1_pool_size(const srt_stringo1 *s)
+{
+	(void)s;
+	return 0;
+}
+
 #endif /* #ifdef S_ENABLE_SM_STRING_OPTIMIZATION */
 
 S_INLINE srt_bool sso1_eq(const srt_string *s, const srt_stringo1 *sso1)
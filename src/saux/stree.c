@@ -17,6 +17,7 @@
  */
 
 #include "stree.h"
+#include "../sstats.h"
 #include "../svector.h"
 #include "scommon.h"
 
@@ -69,18 +70,82 @@ S_INLINE srt_tndx get_lr(const srt_tnode *n, enum STNDir d)
 	return d == ST_Left ? n->x.l : n->r;
 }
 
-S_INLINE srt_tnode *locate_parent(srt_tree *t, const struct NodeContext *son,
-				  enum STNDir *d)
+/*
+ * Key comparison, used for generating the tree walk/insert/delete loops:
+ * generic (compare callback), and specialized for numeric keys stored right
+ * after the node header (inline comparison, no function call per level)
+ */
+
+#define ST_CMP_GEN(t, a, b) (t)->cmp_f(a, b)
+#define ST_NKEY(T, a) (*(const T *)((const srt_tnode *)(a) + 1))
+#define ST_CMP_NUM(T, a, b)                                                    \
+	(ST_NKEY(T, a) > ST_NKEY(T, b) ? 1                                     \
+				       : ST_NKEY(T, a) < ST_NKEY(T, b) ? -1 : 0)
+#define ST_CMP_I32(t, a, b) ST_CMP_NUM(int32_t, a, b)
+#define ST_CMP_U32(t, a, b) ST_CMP_NUM(uint32_t, a, b)
+#define ST_CMP_I64(t, a, b) ST_CMP_NUM(int64_t, a, b)
+#define ST_CMP_F(t, a, b) ST_CMP_NUM(float, a, b)
+#define ST_CMP_D(t, a, b) ST_CMP_NUM(double, a, b)
+
+#define BUILD_ST_LOCATE_PARENT(FN, CMP)                                        \
+	S_INLINE srt_tnode *FN(srt_tree *t, const struct NodeContext *son,     \
+				enum STNDir *d)                                \
+	{                                                                      \
+		srt_tndx lr;                                                   \
+		srt_tnode *cn;                                                 \
+		if (t->root == son->x)                                         \
+			return son->n;                                         \
+		cn = get_node(t, t->root);                                     \
+		for (; cn && cn->x.l != son->x && cn->r != son->x;) {          \
+			lr = get_lr(cn, CMP(t, cn, son->n) < 0 ? ST_Right      \
+								: ST_Left);    \
+			cn = get_node(t, lr);                                  \
+		}                                                              \
+		*d = cn && cn->x.l == son->x ? ST_Left : ST_Right;             \
+		return cn;                                                     \
+	}
+
+BUILD_ST_LOCATE_PARENT(locate_parent, ST_CMP_GEN)
+BUILD_ST_LOCATE_PARENT(locate_parent_i32, ST_CMP_I32)
+BUILD_ST_LOCATE_PARENT(locate_parent_u32, ST_CMP_U32)
+BUILD_ST_LOCATE_PARENT(locate_parent_i64, ST_CMP_I64)
+BUILD_ST_LOCATE_PARENT(locate_parent_f, ST_CMP_F)
+BUILD_ST_LOCATE_PARENT(locate_parent_d, ST_CMP_D)
+
+/*
+ * Parent lookup by key, from the subtree root p. With duplicated keys, equal
+ * keys can be at both sides of a node with the same key, so both subtrees
+ * are searched in that case (O(log n + m), being m the number of nodes with
+ * the same key)
+ */
+static srt_tndx st_parent_k(const srt_tree *t, srt_tndx p, srt_tndx x,
+			    const srt_tnode *n)
+{
+	int r;
+	srt_tndx y;
+	const srt_tnode *pn;
+	while (p != ST_NIL) {
+		pn = get_node_r(t, p);
+		if (pn->x.l == x || pn->r == x)
+			return p;
+		r = t->cmp_f(pn, n);
+		if (!r) {
+			y = st_parent_k(t, pn->x.l, x, n);
+			if (y != ST_NIL)
+				return y;
+		}
+		p = r <= 0 ? pn->r : pn->x.l;
+	}
+	return ST_NIL;
+}
+
+static srt_tnode *locate_parent_dup(srt_tree *t, const struct NodeContext *son,
+				    enum STNDir *d)
 {
-	srt_tndx lr;
 	srt_tnode *cn;
 	if (t->root == son->x)
 		return son->n;
-	cn = get_node(t, t->root);
-	for (; cn && cn->x.l != son->x && cn->r != son->x;) {
-		lr = get_lr(cn, t->cmp_f(cn, son->n) < 0 ? ST_Right : ST_Left);
-		cn = get_node(t, lr);
-	}
+	cn = get_node(t, st_parent_k(t, t->root, son->x, son->n));
 	*d = cn && cn->x.l == son->x ? ST_Left : ST_Right;
 	return cn;
 }
@@ -129,6 +194,76 @@ S_INLINE enum STNDir cd(enum STNDir d)
 	return d == ST_Left ? ST_Right : ST_Left;
 }
 
+	/*
+	 * Order statistics: subtree sizes
+	 */
+
+S_INLINE uint32_t st_rank_cnt(const srt_tree *t, srt_tndx x)
+{
+	return x != ST_NIL ? ((const uint32_t *)sv_get_buffer_r(t->rank))[x]
+			   : 0;
+}
+
+/* Update subtree size from the children ones */
+S_INLINE void st_rank_upd(srt_tree *t, srt_tndx x)
+{
+	const srt_tnode *n;
+	if (t->rank && x != ST_NIL) {
+		n = get_node_r(t, x);
+		((uint32_t *)sv_get_buffer(t->rank))[x] =
+			st_rank_cnt(t, n->x.l) + st_rank_cnt(t, n->r) + 1;
+	}
+}
+
+/* Room for the node x (BEHAVIOR: no order statistics: always S_TRUE) */
+S_INLINE srt_bool st_rank_reserve(srt_tree *t, srt_tndx x)
+{
+	RETURN_IF(!t->rank, S_TRUE);
+	RETURN_IF(sv_reserve(&t->rank, (size_t)x + 1) < (size_t)x + 1,
+		  S_FALSE);
+	((uint32_t *)sv_get_buffer(t->rank))[x] = 1;
+	return S_TRUE;
+}
+
+/* Subtree size move (node moved from src to tgt) */
+S_INLINE void st_rank_mv(srt_tree *t, srt_tndx tgt, srt_tndx src)
+{
+	uint32_t *c;
+	if (t->rank) {
+		c = (uint32_t *)sv_get_buffer(t->rank);
+		c[tgt] = c[src];
+	}
+}
+
+/*
+ * Subtree size update after insert/delete: rotated nodes left out of the
+ * search path are updated by the rotation, so only the search path nodes
+ * (descending to the leaf, equal keys to the left) and their children need
+ * to be updated, bottom-up.
+ */
+static void st_rank_fix(srt_tree *t, const srt_tnode *n)
+{
+	uint32_t d = 0;
+	srt_tndx x, next = ST_NIL, path[ST_MAX_DEPTH];
+	const srt_tnode *cn;
+	if (!t->rank)
+		return;
+	for (x = t->root; x != ST_NIL && d < ST_MAX_DEPTH;) {
+		path[d++] = x;
+		cn = get_node_r(t, x);
+		x = t->cmp_f(cn, n) < 0 ? cn->r : cn->x.l;
+	}
+	while (d-- > 0) {
+		cn = get_node_r(t, path[d]);
+		if (cn->x.l != next)
+			st_rank_upd(t, cn->x.l);
+		if (cn->r != next)
+			st_rank_upd(t, cn->r);
+		st_rank_upd(t, path[d]);
+		next = path[d];
+	}
+}
+
 	/*
 	 * Node rotation auxiliary functions
 	 */
@@ -139,7 +274,9 @@ S_INLINE enum STNDir cd(enum STNDir d)
 	set_lr(xn, xd, get_lr(yn, d));                                         \
 	set_lr(yn, d, x);                                                      \
 	set_red(t, x, S_TRUE);                                                 \
-	set_red(t, y, S_FALSE);
+	set_red(t, y, S_FALSE);                                                \
+	st_rank_upd(t, x);                                                     \
+	st_rank_upd(t, y);
 
 S_INLINE srt_tndx rot1x(srt_tree *t, srt_tnode *xn, srt_tndx x, enum STNDir d,
 			enum STNDir xd)
@@ -193,6 +330,7 @@ static size_t st_assert_aux(const srt_tree *t, srt_tndx ndx)
 {
 	size_t l, r;
 	const srt_tnode *n;
+	int eq = t && t->multi ? 1 : 0; /* equal keys at both sides */
 	RETURN_IF(!t, 0);
 	RETURN_IF(ndx == ST_NIL, 1);
 	n = get_node_r(t, ndx);
@@ -202,8 +340,8 @@ static size_t st_assert_aux(const srt_tree *t, srt_tndx ndx)
 #endif
 		return 0;
 	}
-	if (n->x.l != ST_NIL && t->cmp_f(get_node_r(t, n->x.l), n) >= 0
-	    && n->r != ST_NIL && t->cmp_f(get_node_r(t, n->r), n) <= 0) {
+	if (n->x.l != ST_NIL && t->cmp_f(get_node_r(t, n->x.l), n) >= eq
+	    && n->r != ST_NIL && t->cmp_f(get_node_r(t, n->r), n) <= -eq) {
 #ifdef DEBUG_stree
 		fprintf(stderr, "st_assert: tree structure violation\n");
 #endif
@@ -235,22 +373,40 @@ srt_tree *st_alloc_raw(srt_cmp cmp_f, srt_bool ext_buf, void *buffer,
 	t = (srt_tree *)buffer;
 	sd_reset((srt_data *)t, sizeof(srt_tree), elem_size, max_size, ext_buf,
 		 S_FALSE);
+	sd_set_ctype((srt_data *)t, SD_CT_MAP);
 	t->cmp_f = cmp_f;
 	t->root = 0;
+	t->bt = NULL;
+	t->rank = NULL;
+	t->multi = S_FALSE;
 	return t;
 }
 
-srt_tree *st_alloc(srt_cmp cmp_f, size_t elem_size, size_t init_size)
+srt_tree *st_alloc_a(const srt_allocator *a, srt_cmp cmp_f, size_t elem_size,
+		     size_t init_size)
 {
 	size_t alloc_size = sd_alloc_size_raw(sizeof(srt_tree), elem_size,
 					      init_size, S_FALSE);
-	void *buf = s_malloc(alloc_size);
-	srt_tree *t = st_alloc_raw(cmp_f, S_FALSE, buf, elem_size, init_size);
-	if (!t || t == st_void)
-		s_free(buf);
+	int id = sd_allocator_id(a);
+	void *buf;
+	srt_tree *t;
+	RETURN_IF(id < 0, st_void);
+	buf = sd_mem_alloc((uint8_t)id, alloc_size);
+	t = st_alloc_raw(cmp_f, S_FALSE, buf, elem_size, init_size);
+	if (!t || t == st_void) {
+		sd_mem_free((uint8_t)id, buf);
+	} else {
+		t->d.alloc_id = (uint8_t)id;
+		sst_on_alloc((srt_data *)t);
+	}
 	return t;
 }
 
+srt_tree *st_alloc(srt_cmp cmp_f, size_t elem_size, size_t init_size)
+{
+	return st_alloc_a(NULL, cmp_f, elem_size, init_size);
+}
+
 /*
  * Operations
  */
@@ -262,6 +418,10 @@ srt_tree *st_dup(const srt_tree *t)
 	t2 = st_alloc(t->cmp_f, t->d.elem_size, t->d.size);
 	RETURN_IF(!t2, NULL);
 	memcpy(t2, t, t->d.header_size + t->d.size * t->d.elem_size);
+	t2->bt = NULL; /* BEHAVIOR: the B+tree index is not duplicated */
+	t2->rank = NULL;
+	if (t->rank) /* BEHAVIOR: not enough memory: no order statistics */
+		st_rank_enable(t2);
 	return t2;
 }
 
@@ -270,308 +430,614 @@ srt_bool st_insert(srt_tree **tt, const srt_tnode *n)
 	return st_insert_rw(tt, n, NULL);
 }
 
+#define BUILD_ST_INSERT_RW(FN, CMP)                                            \
+	static srt_bool FN(srt_tree **tt, const srt_tnode *n,                  \
+			   srt_tree_rewrite rw_f)                              \
+	{                                                                      \
+		srt_tree *t;                                                   \
+		srt_tnode auxn = EMPTY_STN;                                    \
+		size_t ts, c, cp, cpp, cppp;                                   \
+		enum STNDir ld = ST_Left; /* last walk direction */            \
+		enum STNDir d = ST_Left;  /* current walk direction */         \
+		struct NodeContext w[CW_SIZE];                                 \
+		srt_bool done = S_FALSE;                                       \
+		enum STNDir xld;                                               \
+		srt_tndx pd, v;                                                \
+		int64_t cmp;                                                   \
+		/* BEHAVIOR: valid tree, with space for one extra element */   \
+		RETURN_IF(!tt || !*tt || !n || !st_grow(tt, 1), S_FALSE);      \
+		t = *tt;                                                       \
+		ts = st_size(t);                                               \
+		/* BEHAVIOR: tree reaching capability limit */                 \
+		RETURN_IF(ts >= ST_NIL, S_FALSE);                              \
+		RETURN_IF(!st_rank_reserve(t, (srt_tndx)ts), S_FALSE);         \
+		/*                                                             \
+		 * Trivial case: insert node into empty tree                   \
+		 */                                                            \
+		if (!ts) {                                                     \
+			srt_tnode *node = get_node(t, 0);                      \
+			new_node(t, node, n, S_FALSE, rw_f, S_FALSE);          \
+			t->root = 0;                                           \
+			st_set_size(t, 1);                                     \
+			st_rank_fix(t, n);                                     \
+			return S_TRUE;                                         \
+		}                                                              \
+		/*                                                             \
+		 * Typical case: insert into non-empty tree                    \
+		 */                                                            \
+		/*                                                             \
+		 * Prepare a 4-level node tracking window                      \
+		 */                                                            \
+		auxn.r = t->root;                                              \
+		/* c: current node (cn) */                                     \
+		w[0].x = t->root;                                              \
+		w[0].n = get_node(t, t->root);                                 \
+		/* cppp: cn parent parent parent node */                       \
+		w[1].x = ST_NIL;                                               \
+		w[1].n = &auxn;                                                \
+		/* cpp: cn parent parent node */                               \
+		w[2].x = ST_NIL;                                               \
+		w[2].n = NULL;                                                 \
+		/* cp: cn parent node */                                       \
+		w[3].x = ST_NIL;                                               \
+		w[3].n = NULL;                                                 \
+		c = 0;                                                         \
+		/*                                                             \
+		 * Search loop                                                 \
+		 */                                                            \
+		for (;;) {                                                     \
+			cp = (c + 3) % CW_SIZE;                                \
+			/* Leaf found? update tree, copy data, update size */  \
+			if (w[c].x == ST_NIL) {                                \
+				/* New node: */                                \
+				w[c].x = (srt_tndx)ts;                         \
+				w[c].n = get_node(t, (srt_tndx)ts);            \
+				new_node(t, w[c].n, n, S_TRUE, rw_f, S_FALSE); \
+				/* Update parent node: */                      \
+				set_lr(w[cp].n, d, w[c].x);                    \
+				if (get_lr(w[cp].n, cd(d)) != ST_NIL)          \
+					w[c].n->x.is_red = S_TRUE;             \
+				/* Ensure root is black: */                    \
+				set_red(t, t->root, S_FALSE);                  \
+				/* Increase tree size: */                      \
+				st_set_size(t, ts + 1);                        \
+				done = S_TRUE;                                 \
+			} else {                                               \
+				/* Two red sons? -> red parent + black sons */ \
+				if (is_red(t, w[c].n->x.l)                     \
+				    && is_red(t, w[c].n->r))                   \
+					STN_SET_RBB(t, w[c].n);                \
+			}                                                      \
+			/* Double red case (current and parent are red) */     \
+			cpp = (c + 2) % CW_SIZE;                               \
+			cppp = (c + 1) % CW_SIZE;                              \
+			if (w[cpp].n && w[c].n->x.is_red                       \
+			    && w[cp].n->x.is_red) {                            \
+				xld = cd(ld);                                  \
+				pd = get_lr(w[cp].n, ld);                      \
+				if (w[c].x == pd)                              \
+					v = rot1x(t, w[cpp].n, w[cpp].x, xld,  \
+						  ld);                         \
+				else                                           \
+					v = rot2x(t, w[cpp].n, w[cpp].x, xld,  \
+						  ld);                         \
+				if (w[cppp].n) {                               \
+					enum STNDir d2 =                       \
+						w[cppp].n->r == w[cpp].x       \
+							? ST_Right             \
+							: ST_Left;             \
+					set_lr(w[cppp].n, d2, v);              \
+					st_checkfix_root(t, w[cpp].x, v);      \
+				} else {                                       \
+					t->root = v;                           \
+				}                                              \
+			}                                                      \
+			if (done)                                              \
+				break;                                         \
+			cmp = CMP(t, w[c].n, n);                               \
+			if (!cmp && t->multi) /* after the equal ones */       \
+				cmp = -1;                                      \
+			if (!cmp) {                                            \
+				if (rw_f)                                      \
+					rw_f(w[c].n, n, S_TRUE);               \
+				else                                           \
+					update_node_data(t, w[c].n, n);        \
+				break;                                         \
+			}                                                      \
+			/* Step down: left or right */                         \
+			ld = d;                                                \
+			d = cmp < 0 ? ST_Right : ST_Left;                      \
+			/* Node context window shift */                        \
+			w[cppp].x = get_lr(w[c].n, d);                         \
+			w[cppp].n = get_node(t, w[cppp].x);                    \
+			c = cppp;                                              \
+		}                                                              \
+		st_rank_fix(t, n);                                             \
+		return S_TRUE;                                                 \
+	}
+
+BUILD_ST_INSERT_RW(st_insert_rw_gen, ST_CMP_GEN)
+BUILD_ST_INSERT_RW(st_insert_rw_i32, ST_CMP_I32)
+BUILD_ST_INSERT_RW(st_insert_rw_u32, ST_CMP_U32)
+BUILD_ST_INSERT_RW(st_insert_rw_i64, ST_CMP_I64)
+BUILD_ST_INSERT_RW(st_insert_rw_f, ST_CMP_F)
+BUILD_ST_INSERT_RW(st_insert_rw_d, ST_CMP_D)
+
 srt_bool st_insert_rw(srt_tree **tt, const srt_tnode *n, srt_tree_rewrite rw_f)
 {
-	srt_tree *t;
-	srt_tnode auxn = EMPTY_STN;
-	size_t ts, c, cp, cpp, cppp;
-	enum STNDir ld = ST_Left; /* last walk direction */
-	enum STNDir d = ST_Left;  /* current walk direction */
-	struct NodeContext w[CW_SIZE];
-	srt_bool done = S_FALSE;
-	enum STNDir xld;
-	srt_tndx pd, v;
-	int64_t cmp;
-	/* BEHAVIOR: valid tree, with space for one extra element */
-	RETURN_IF(!tt || !*tt || !n || !st_grow(tt, 1), S_FALSE);
-	t = *tt;
-	ts = st_size(t);
-	/* BEHAVIOR: tree reaching capability limit */
-	RETURN_IF(ts >= ST_NIL, S_FALSE);
-	/*
-	 * Trivial case: insert node into empty tree
-	 */
-	if (!ts) {
-		srt_tnode *node = get_node(t, 0);
-		new_node(t, node, n, S_FALSE, rw_f, S_FALSE);
-		t->root = 0;
-		st_set_size(t, 1);
-		return S_TRUE;
+	return st_insert_rw_gen(tt, n, rw_f);
+}
+
+#define BUILD_ST_DELETE(FN, LOCATE_PARENT, CMP)                                \
+	static srt_bool FN(srt_tree *t, const srt_tnode *n,                    \
+			   srt_tree_callback callback)                         \
+	{                                                                      \
+		size_t ts0;                                                    \
+		srt_tndx ts;                                                   \
+		srt_tnode auxn = EMPTY_STN;                                    \
+		srt_tndx c, cp, cpp, cppp;                                     \
+		struct NodeContext found = {ST_NIL, NULL};                     \
+		enum STNDir d0 = ST_Right;                                     \
+		struct NodeContext w[CW_SIZE];                                 \
+		int64_t cmp;                                                   \
+		enum STNDir d, ds, dt;                                         \
+		srt_tndx nd;                                                   \
+		srt_tnode *ndn;                                                \
+		srt_tndx y;                                                    \
+		enum STNDir xd, xd0, d2;                                       \
+		srt_tndx s, sz;                                                \
+		srt_tnode *yn, *sn, *cpp_d2n;                                  \
+		/* BEHAVIOR: valid request */                                  \
+		RETURN_IF(!t || !n, S_FALSE);                                  \
+		/* Check empty tree: */                                        \
+		ts0 = st_size(t);                                              \
+		RETURN_IF(ts0 == 0 || ts0 >= ST_NIL, S_FALSE);                 \
+		ts = (srt_tndx)ts0;                                            \
+		/*                                                             \
+		 * Prepare a 4-level node tracking window (in this case a      \
+		 * 3-level would be enough, using 4 in order to avoid the      \
+		 * division by 3, which is more expensive than by 4 in most    \
+		 * CPUs).                                                      \
+		 */                                                            \
+		auxn.r = t->root;                                              \
+		/* c: current node (cn) */                                     \
+		w[0].x = t->root;                                              \
+		w[0].n = get_node(t, t->root);                                 \
+		/* cppp: cn parent parent parent node */                       \
+		w[1].x = ST_NIL;                                               \
+		w[1].n = NULL;                                                 \
+		/* cpp: cn parent parent node */                               \
+		w[2].x = ST_NIL;                                               \
+		w[2].n = NULL;                                                 \
+		/* cp: cn parent node */                                       \
+		w[3].x = ST_NIL;                                               \
+		w[3].n = &auxn;                                                \
+		c = 0;                                                         \
+		cp = 3;                                                        \
+		cpp = 2;                                                       \
+		cppp = 1;                                                      \
+		/* Search loop */                                              \
+		for (;;) {                                                     \
+			/* Compare node key with given target */               \
+			cmp = CMP(t, w[c].n, n);                               \
+			d = cmp < 0 ? ST_Right : ST_Left;                      \
+			if (!cmp) {                                            \
+				S_ASSERT(found.n == NULL || t->multi);         \
+				if (ts == 1) { /* Trivial case: one node */    \
+					if (callback)                          \
+						callback((void *)w[c].n);      \
+					st_set_size(t, 0);                     \
+					return S_TRUE;                         \
+				}                                              \
+				found = w[c];                                  \
+			}                                                      \
+			for (;;) {                                             \
+				/* Push child red node down */                 \
+				nd = get_lr(w[c].n, d);                        \
+				ndn = get_node(t, nd);                         \
+				if (w[c].n->x.is_red                           \
+				    || (ndn && ndn->x.is_red))                 \
+					break;                                 \
+				xd = cd(d);                                    \
+				if (is_red(t, get_lr(w[c].n, xd))) {           \
+					yn = rot1x_y(t, w[c].n, w[c].x, d, xd, \
+						     &y);                      \
+					if (w[cp].n)                           \
+						set_lr(w[cp].n, d0, y);        \
+					/* Fix tree root if required: */       \
+					st_checkfix_root(t, w[c].x, y);        \
+					/* Update parent */                    \
+					w[cp].x = y;                           \
+					w[cp].n = yn;                          \
+					break;                                 \
+				}                                              \
+				/* s/sn: same-parent brother node */           \
+				xd0 = cd(d0);                                  \
+				s = get_lr(w[cp].n, xd0);                      \
+				if (s == ST_NIL)                               \
+					break;                                 \
+				sn = get_node(t, s);                           \
+				if (!is_red(t, get_lr(sn, xd0))                \
+				    && !is_red(t, get_lr(sn, d0))) {           \
+					/* Color flip */                       \
+					set_red(t, w[cp].x, S_FALSE);          \
+					set_red(t, s, S_TRUE);                 \
+					set_red(t, w[c].x, S_TRUE);            \
+					break;                                 \
+				}                                              \
+				if (!w[cpp].n)                                 \
+					break;                                 \
+				d2 = w[cpp].n->r == w[cp].x ? ST_Right         \
+								 : ST_Left;    \
+				if (is_red(t, get_lr(sn, d0))) {               \
+					y = rot2x(t, w[cp].n, w[cp].x, d0,     \
+						  xd0);                        \
+					set_lr(w[cpp].n, d2, y);               \
+					st_checkfix_root(t, w[cp].x, y);       \
+				} else {                                       \
+					if (is_red(t, get_lr(sn, xd0))) {      \
+						y = rot1x(t, w[cp].n, w[cp].x, \
+							  d0, xd0);            \
+						set_lr(w[cpp].n, d2, y);       \
+						st_checkfix_root(t, w[cp].x,   \
+								 y);           \
+					}                                      \
+				}                                              \
+				cpp_d2n = get_node(t, get_lr(w[cpp].n, d2));   \
+				/* Fix coloring */                             \
+				STN_SET_RBB(t, cpp_d2n);                       \
+				w[c].n->x.is_red = cpp_d2n->x.is_red;          \
+				break;                                         \
+			}                                                      \
+			w[cppp].x = get_lr(w[c].n, d);                         \
+			if (w[cppp].x == ST_NIL) /* bottom reached */          \
+				break;                                         \
+			/* Node context window shift */                        \
+			w[cppp].n = get_node(t, w[cppp].x);                    \
+			c = cppp;                                              \
+			cp = (c + 3) % CW_SIZE;                                \
+			cpp = (c + 2) % CW_SIZE;                               \
+			cppp = (c + 1) % CW_SIZE;                              \
+			d0 = d;                                                \
+		}                                                              \
+		if (found.n) {                                                 \
+			if (callback)                                          \
+				callback((void *)found.n);                     \
+			/*                                                     \
+			 * Node found (the one to be removed) will be used to  \
+			 * hold the last current node found. So shifting the   \
+			 * last node to the location of node to be deleted     \
+			 * balancin                                            \
+			 */                                                    \
+			if (found.n != w[c].n) {                               \
+				/*copy_node_data(t, found.n, cn); ?????*/      \
+				update_node_data(t, found.n, w[c].n);          \
+				found.x = w[c].x;                              \
+			}                                                      \
+			if (!w[cp].n) { /* Root node deletion (???) */         \
+				t->root = w[c].n->x.l != ST_NIL ? w[c].n->x.l  \
+								: w[c].n->r;   \
+			} else {                                               \
+				ds = w[c].n->x.l == ST_NIL ? ST_Right          \
+							       : ST_Left;      \
+				dt = w[cp].n->r == w[c].x ? ST_Right           \
+							      : ST_Left;       \
+				set_lr(w[cp].n, dt, get_lr(w[c].n, ds));       \
+			}                                                      \
+			/*                                                     \
+			 * If deleted node is not the last node in the         \
+			 * linear space, in order to avoid fragmentation the   \
+			 * last one will be moved to the deleted location.     \
+			 * Despite this, time is kept into O(log n).           \
+			 * Rationale: that's because not using dynamic memory  \
+			 * for individual nodes, but a dynamic memory for a    \
+			 * stack space.                                        \
+			 */                                                    \
+			st_rank_fix(t, found.n != w[c].n ? found.n : n);       \
+			S_ASSERT(ts - 1 < ST_NIL);                             \
+			sz = ts - 1; /* BEHAVIOR */                            \
+			if (w[c].x != sz) {                                    \
+				srt_tnode *fpn;                                \
+				struct NodeContext ct;                         \
+				enum STNDir dl = ST_Left;                      \
+				ct.x = sz;                                     \
+				ct.n = get_node(t, sz);                        \
+				/* TODO: cache this (!) */                     \
+				fpn = t->multi                                 \
+					      ? locate_parent_dup(t, &ct, &dl) \
+					      : LOCATE_PARENT(t, &ct, &dl);    \
+				if (fpn) {                                     \
+					copy_node(t, w[c].n, ct.n);            \
+					st_rank_mv(t, w[c].x, sz);             \
+					set_lr(fpn, dl, w[c].x);               \
+					if (t->root == sz)                     \
+						t->root = w[c].x;              \
+				} else {                                       \
+					/* BEHAVIOR: never reached */          \
+					S_ASSERT(S_FALSE);                     \
+				}                                              \
+			}                                                      \
+			st_set_size(t, ts - 1);                                \
+		} else {                                                       \
+			st_rank_fix(t, n);                                     \
+		}                                                              \
+		/* Set root node as black */                                   \
+		set_red(t, t->root, S_FALSE);                                  \
+		return found.n ? S_TRUE : S_FALSE;                             \
 	}
-	/*
-	 * Typical case: insert into non-empty tree
-	 */
-	/*
-	 * Prepare a 4-level node tracking window
-	 */
-	auxn.r = t->root;
-	/* c: current node (cn) */
-	w[0].x = t->root;
-	w[0].n = get_node(t, t->root);
-	/* cppp: cn parent parent parent node */
-	w[1].x = ST_NIL;
-	w[1].n = &auxn;
-	/* cpp: cn parent parent node */
-	w[2].x = ST_NIL;
-	w[2].n = NULL;
-	/* cp: cn parent node */
-	w[3].x = ST_NIL;
-	w[3].n = NULL;
-	c = 0;
-	/*
-	 * Search loop
-	 */
-	for (;;) {
-		cp = (c + 3) % CW_SIZE;
-		/* Leaf found? update tree, copy data, update size */
-		if (w[c].x == ST_NIL) {
-			/* New node: */
-			w[c].x = (srt_tndx)ts;
-			w[c].n = get_node(t, (srt_tndx)ts);
-			new_node(t, w[c].n, n, S_TRUE, rw_f, S_FALSE);
-			/* Update parent node: */
-			set_lr(w[cp].n, d, w[c].x);
-			if (get_lr(w[cp].n, cd(d)) != ST_NIL)
-				w[c].n->x.is_red = S_TRUE;
-			/* Ensure root is black: */
-			set_red(t, t->root, S_FALSE);
-			/* Increase tree size: */
-			st_set_size(t, ts + 1);
-			done = S_TRUE;
+
+BUILD_ST_DELETE(st_delete_gen, locate_parent, ST_CMP_GEN)
+BUILD_ST_DELETE(st_delete_i32, locate_parent_i32, ST_CMP_I32)
+BUILD_ST_DELETE(st_delete_u32, locate_parent_u32, ST_CMP_U32)
+BUILD_ST_DELETE(st_delete_i64, locate_parent_i64, ST_CMP_I64)
+BUILD_ST_DELETE(st_delete_f, locate_parent_f, ST_CMP_F)
+BUILD_ST_DELETE(st_delete_d, locate_parent_d, ST_CMP_D)
+
+srt_bool st_delete(srt_tree *t, const srt_tnode *n, srt_tree_callback callback)
+{
+	return st_delete_gen(t, n, callback);
+}
+
+#define BUILD_ST_LOCATE(FN, CMP)                                               \
+	static const srt_tnode *FN(const srt_tree *t, const srt_tnode *n)      \
+	{                                                                      \
+		int r;                                                         \
+		const srt_tnode *cn = get_node_r(t, t->root);                  \
+		for (;;)                                                       \
+			if (!(r = CMP(t, cn, n))                               \
+			    || !(cn = get_node_r(t, get_lr(cn, r < 0           \
+								? ST_Right     \
+								: ST_Left))))  \
+				break;                                         \
+		return cn;                                                     \
+	}
+
+BUILD_ST_LOCATE(st_locate_gen, ST_CMP_GEN)
+BUILD_ST_LOCATE(st_locate_i32, ST_CMP_I32)
+BUILD_ST_LOCATE(st_locate_u32, ST_CMP_U32)
+BUILD_ST_LOCATE(st_locate_i64, ST_CMP_I64)
+BUILD_ST_LOCATE(st_locate_f, ST_CMP_F)
+BUILD_ST_LOCATE(st_locate_d, ST_CMP_D)
+
+const srt_tnode *st_locate(const srt_tree *t, const srt_tnode *n)
+{
+	return st_locate_gen(t, n);
+}
+
+/*
+ * Key-type specialized operations (one dispatch per operation, not per
+ * tree level)
+ */
+
+srt_bool st_insert_rw_k(srt_tree **tt, const srt_tnode *n,
+			srt_tree_rewrite rw_f, enum eST_KeyType kt)
+{
+	switch (kt) {
+	case ST_KT_I32:
+		return st_insert_rw_i32(tt, n, rw_f);
+	case ST_KT_U32:
+		return st_insert_rw_u32(tt, n, rw_f);
+	case ST_KT_I64:
+		return st_insert_rw_i64(tt, n, rw_f);
+	case ST_KT_F:
+		return st_insert_rw_f(tt, n, rw_f);
+	case ST_KT_D:
+		return st_insert_rw_d(tt, n, rw_f);
+	default:
+		break;
+	}
+	return st_insert_rw_gen(tt, n, rw_f);
+}
+
+srt_bool st_delete_k(srt_tree *t, const srt_tnode *n,
+		     srt_tree_callback callback, enum eST_KeyType kt)
+{
+	switch (kt) {
+	case ST_KT_I32:
+		return st_delete_i32(t, n, callback);
+	case ST_KT_U32:
+		return st_delete_u32(t, n, callback);
+	case ST_KT_I64:
+		return st_delete_i64(t, n, callback);
+	case ST_KT_F:
+		return st_delete_f(t, n, callback);
+	case ST_KT_D:
+		return st_delete_d(t, n, callback);
+	default:
+		break;
+	}
+	return st_delete_gen(t, n, callback);
+}
+
+const srt_tnode *st_locate_k(const srt_tree *t, const srt_tnode *n,
+			     enum eST_KeyType kt)
+{
+	switch (kt) {
+	case ST_KT_I32:
+		return st_locate_i32(t, n);
+	case ST_KT_U32:
+		return st_locate_u32(t, n);
+	case ST_KT_I64:
+		return st_locate_i64(t, n);
+	case ST_KT_F:
+		return st_locate_f(t, n);
+	case ST_KT_D:
+		return st_locate_d(t, n);
+	default:
+		break;
+	}
+	return st_locate_gen(t, n);
+}
+
+srt_bool st_multi_enable(srt_tree *t)
+{
+	RETURN_IF(!t || t == st_void || t->rank, S_FALSE);
+	t->multi = S_TRUE;
+	return S_TRUE;
+}
+
+/*
+ * Ordered navigation
+ */
+
+/* Push x and its descendants in direction d, until reaching a leaf */
+static srt_tndx st_path_down(const srt_tree *t, struct STPath *p, srt_tndx x,
+			     enum STNDir d)
+{
+	for (; x != ST_NIL && p->depth < ST_MAX_DEPTH;
+	     x = get_lr(get_node_r(t, x), d))
+		p->x[p->depth++] = x;
+	return p->depth ? p->x[p->depth - 1] : ST_NIL;
+}
+
+/* In-order step (d = ST_Right: next; d = ST_Left: previous) */
+static srt_tndx st_path_step(const srt_tree *t, struct STPath *p,
+			     enum STNDir d)
+{
+	srt_tndx x;
+	RETURN_IF(!t || !p || !p->depth, ST_NIL);
+	x = get_lr(get_node_r(t, p->x[p->depth - 1]), d);
+	if (x != ST_NIL)
+		return st_path_down(t, p, x, cd(d));
+	/* Climb until coming from the opposite side */
+	do {
+		x = p->x[--p->depth];
+	} while (p->depth
+		 && get_lr(get_node_r(t, p->x[p->depth - 1]), d) == x);
+	return p->depth ? p->x[p->depth - 1] : ST_NIL;
+}
+
+srt_tndx st_path_bound(const srt_tree *t, const srt_tnode *n, srt_bool upper,
+		       struct STPath *p)
+{
+	int r;
+	srt_tndx x;
+	uint32_t d = 0, found = 0;
+	const srt_tnode *cn;
+	RETURN_IF(!p, ST_NIL);
+	p->depth = 0;
+	RETURN_IF(!t || !n || !st_size(t), ST_NIL);
+	for (x = t->root; x != ST_NIL && d < ST_MAX_DEPTH;) {
+		cn = get_node_r(t, x);
+		p->x[d++] = x;
+		r = t->cmp_f(cn, n);
+		if (r > 0 || (!r && !upper)) {
+			found = d; /* candidate: look for a lower one */
+			x = cn->x.l;
 		} else {
-			/* Two red sons? -> red parent + black sons */
-			if (is_red(t, w[c].n->x.l) && is_red(t, w[c].n->r))
-				STN_SET_RBB(t, w[c].n);
-		}
-		/* Check for double red case (current and parent are red) */
-		cpp = (c + 2) % CW_SIZE;
-		cppp = (c + 1) % CW_SIZE;
-		if (w[cpp].n && w[c].n->x.is_red && w[cp].n->x.is_red) {
-			xld = cd(ld);
-			pd = get_lr(w[cp].n, ld);
-			v = w[c].x == pd
-				    ? rot1x(t, w[cpp].n, w[cpp].x, xld, ld)
-				    : rot2x(t, w[cpp].n, w[cpp].x, xld, ld);
-			if (w[cppp].n) {
-				enum STNDir d2 = w[cppp].n->r == w[cpp].x
-							 ? ST_Right
-							 : ST_Left;
-				set_lr(w[cppp].n, d2, v);
-				st_checkfix_root(t, w[cpp].x, v);
-			} else {
-				t->root = v;
-			}
-		}
-		if (done)
-			break;
-		cmp = t->cmp_f(w[c].n, n);
-		if (!cmp) {
-			if (rw_f)
-				rw_f(w[c].n, n, S_TRUE);
-			else
-				update_node_data(t, w[c].n, n);
-			break;
+			x = cn->r;
 		}
-		/* Step down: left or right */
-		ld = d;
-		d = cmp < 0 ? ST_Right : ST_Left;
-		/* Node context window shift */
-		w[cppp].x = get_lr(w[c].n, d);
-		w[cppp].n = get_node(t, w[cppp].x);
-		c = cppp;
 	}
+	/* The path to the candidate is a prefix of the followed one */
+	p->depth = found;
+	return found ? p->x[found - 1] : ST_NIL;
+}
+
+srt_tndx st_path_first(const srt_tree *t, struct STPath *p)
+{
+	RETURN_IF(!p, ST_NIL);
+	p->depth = 0;
+	RETURN_IF(!t || !st_size(t), ST_NIL);
+	return st_path_down(t, p, t->root, ST_Left);
+}
+
+srt_tndx st_path_last(const srt_tree *t, struct STPath *p)
+{
+	RETURN_IF(!p, ST_NIL);
+	p->depth = 0;
+	RETURN_IF(!t || !st_size(t), ST_NIL);
+	return st_path_down(t, p, t->root, ST_Right);
+}
+
+srt_tndx st_path_next(const srt_tree *t, struct STPath *p)
+{
+	return st_path_step(t, p, ST_Right);
+}
+
+srt_tndx st_path_prev(const srt_tree *t, struct STPath *p)
+{
+	return st_path_step(t, p, ST_Left);
+}
+
+/*
+ * Order statistics
+ */
+
+static uint32_t st_rank_build(srt_tree *t, srt_tndx x, uint32_t depth)
+{
+	uint32_t c;
+	const srt_tnode *n;
+	if (x == ST_NIL || depth >= ST_MAX_DEPTH)
+		return 0;
+	n = get_node_r(t, x);
+	c = st_rank_build(t, n->x.l, depth + 1)
+	    + st_rank_build(t, n->r, depth + 1) + 1;
+	((uint32_t *)sv_get_buffer(t->rank))[x] = c;
+	return c;
+}
+
+srt_bool st_rank_enable(srt_tree *t)
+{
+	size_t ts;
+	/* BEHAVIOR: no order statistics with duplicated keys */
+	RETURN_IF(!t || t == st_void || t->multi, S_FALSE);
+	ts = st_size(t);
+	if (!t->rank)
+		t->rank = sv_alloc_t(SV_U32, ts);
+	if (!t->rank || sv_reserve(&t->rank, ts) < ts) {
+		st_rank_disable(t);
+		return S_FALSE;
+	}
+	if (ts)
+		st_rank_build(t, t->root, 0);
 	return S_TRUE;
 }
 
-srt_bool st_delete(srt_tree *t, const srt_tnode *n, srt_tree_callback callback)
+void st_rank_disable(srt_tree *t)
 {
-	size_t ts0;
-	srt_tndx ts;
-	srt_tnode auxn = EMPTY_STN;
-	srt_tndx c, cp, cpp, cppp;
-	struct NodeContext found = {ST_NIL, NULL};
-	enum STNDir d0 = ST_Right;
-	struct NodeContext w[CW_SIZE];
-	int64_t cmp;
-	enum STNDir d, ds, dt;
-	srt_tndx nd;
-	srt_tnode *ndn;
-	srt_tndx y;
-	enum STNDir xd, xd0, d2;
-	srt_tndx s, sz;
-	srt_tnode *yn, *sn, *cpp_d2n;
-	/* BEHAVIOR: valid request */
-	RETURN_IF(!t || !n, S_FALSE);
-	/* Check empty tree: */
-	ts0 = st_size(t);
-	RETURN_IF(ts0 == 0 || ts0 >= ST_NIL, S_FALSE);
-	ts = (srt_tndx)ts0;
-	/*
-	 * Prepare a 4-level node tracking window (in this case a 3-level
-	 * would be enough, using 4 in order to avoid the division by 3,
-	 * which is more expensive than by 4 in most CPUs).
-	 */
-	auxn.r = t->root;
-	/* c: current node (cn) */
-	w[0].x = t->root;
-	w[0].n = get_node(t, t->root);
-	/* cppp: cn parent parent parent node */
-	w[1].x = ST_NIL;
-	w[1].n = NULL;
-	/* cpp: cn parent parent node */
-	w[2].x = ST_NIL;
-	w[2].n = NULL;
-	/* cp: cn parent node */
-	w[3].x = ST_NIL;
-	w[3].n = &auxn;
-	c = 0;
-	cp = 3;
-	cpp = 2;
-	cppp = 1;
-	/* Search loop */
-	for (;;) {
-		/* Compare node key with given target */
-		cmp = t->cmp_f(w[c].n, n);
-		d = cmp < 0 ? ST_Right : ST_Left;
-		if (!cmp) {
-			S_ASSERT(found.n == NULL);
-			if (ts == 1) { /* Trivial case: one node */
-				if (callback)
-					callback((void *)w[c].n);
-				st_set_size(t, 0);
-				return S_TRUE;
-			}
-			found = w[c];
-		}
-		for (;;) {
-			/* Push child red node down */
-			nd = get_lr(w[c].n, d);
-			ndn = get_node(t, nd);
-			if (w[c].n->x.is_red || (ndn && ndn->x.is_red))
-				break;
-			xd = cd(d);
-			if (is_red(t, get_lr(w[c].n, xd))) {
-				yn = rot1x_y(t, w[c].n, w[c].x, d, xd, &y);
-				if (w[cp].n)
-					set_lr(w[cp].n, d0, y);
-				/* Fix tree root if required: */
-				st_checkfix_root(t, w[c].x, y);
-				/* Update parent */
-				w[cp].x = y;
-				w[cp].n = yn;
-				break;
-			}
-			/* s/sn: same-parent brother node */
-			xd0 = cd(d0);
-			s = get_lr(w[cp].n, xd0);
-			if (s == ST_NIL)
-				break;
-			sn = get_node(t, s);
-			if (!is_red(t, get_lr(sn, xd0))
-			    && !is_red(t, get_lr(sn, d0))) {
-				/* Color flip */
-				set_red(t, w[cp].x, S_FALSE);
-				set_red(t, s, S_TRUE);
-				set_red(t, w[c].x, S_TRUE);
-				break;
-			}
-			if (!w[cpp].n)
-				break;
-			d2 = w[cpp].n->r == w[cp].x ? ST_Right : ST_Left;
-			if (is_red(t, get_lr(sn, d0))) {
-				y = rot2x(t, w[cp].n, w[cp].x, d0, xd0);
-				set_lr(w[cpp].n, d2, y);
-				st_checkfix_root(t, w[cp].x, y);
-			} else {
-				if (is_red(t, get_lr(sn, xd0))) {
-					y = rot1x(t, w[cp].n, w[cp].x, d0, xd0);
-					set_lr(w[cpp].n, d2, y);
-					st_checkfix_root(t, w[cp].x, y);
-				}
-			}
-			cpp_d2n = get_node(t, get_lr(w[cpp].n, d2));
-			/* Fix coloring */
-			STN_SET_RBB(t, cpp_d2n);
-			w[c].n->x.is_red = cpp_d2n->x.is_red;
-			break;
-		}
-		w[cppp].x = get_lr(w[c].n, d);
-		if (w[cppp].x == ST_NIL) /* bottom reached */
+	if (t && t != st_void && t->rank) {
+		sv_free(&t->rank);
+		t->rank = NULL;
+	}
+}
+
+srt_tndx st_select(const srt_tree *t, size_t k)
+{
+	size_t l;
+	srt_tndx x;
+	const srt_tnode *n;
+	RETURN_IF(!t || !t->rank || k >= st_size(t), ST_NIL);
+	for (x = t->root; x != ST_NIL;) {
+		n = get_node_r(t, x);
+		l = st_rank_cnt(t, n->x.l);
+		if (k == l)
 			break;
-		/* Node context window shift */
-		w[cppp].n = get_node(t, w[cppp].x);
-		c = cppp;
-		cp = (c + 3) % CW_SIZE;
-		cpp = (c + 2) % CW_SIZE;
-		cppp = (c + 1) % CW_SIZE;
-		d0 = d;
-	}
-	if (found.n) {
-		if (callback)
-			callback((void *)found.n);
-		/*
-		 * Node found (the one to be removed) will be used to hold
-		 * the last current node found. So shifting the last node to
-		 * the location of node to be deleted balancin
-		 */
-		if (found.n != w[c].n) {
-			/*copy_node_data(t, found.n, cn); ?????*/
-			update_node_data(t, found.n, w[c].n);
-			found.x = w[c].x;
-		}
-		if (!w[cp].n) { /* Root node deletion (???) */
-			t->root =
-				w[c].n->x.l != ST_NIL ? w[c].n->x.l : w[c].n->r;
+		if (k < l) {
+			x = n->x.l;
 		} else {
-			ds = w[c].n->x.l == ST_NIL ? ST_Right : ST_Left;
-			dt = w[cp].n->r == w[c].x ? ST_Right : ST_Left;
-			set_lr(w[cp].n, dt, get_lr(w[c].n, ds));
-		}
-		/*
-		 * If deleted node is not the last node in the linear space,
-		 * in order to avoid fragmentation the last one will be
-		 * moved to the deleted location. Despite this, time is
-		 * kept into O(log n). Rationale: that's because not using
-		 * dynamic memory for individual nodes, but a dynamic memory
-		 * for a stack space.
-		 */
-		S_ASSERT(ts - 1 < ST_NIL);
-		sz = ts - 1; /* BEHAVIOR */
-		if (w[c].x != sz) {
-			srt_tnode *fpn;
-			struct NodeContext ct;
-			enum STNDir dl = ST_Left;
-			ct.x = sz;
-			ct.n = get_node(t, sz);
-			/* TODO: cache this (!) */
-			fpn = locate_parent(t, &ct, &dl);
-			if (fpn) {
-				copy_node(t, w[c].n, ct.n);
-				set_lr(fpn, dl, w[c].x);
-				if (t->root == sz)
-					t->root = w[c].x;
-			} else {
-				/* BEHAVIOR: this should never be reached */
-				S_ASSERT(S_FALSE);
-			}
+			k -= l + 1;
+			x = n->r;
 		}
-		st_set_size(t, ts - 1);
 	}
-	/* Set root node as black */
-	set_red(t, t->root, S_FALSE);
-	return found.n ? S_TRUE : S_FALSE;
+	return x;
 }
 
-const srt_tnode *st_locate(const srt_tree *t, const srt_tnode *n)
+size_t st_rank(const srt_tree *t, const srt_tnode *n)
 {
-	int r;
-	const srt_tnode *cn = get_node_r(t, t->root);
-	for (;;)
-		if (!(r = t->cmp_f(cn, n))
-		    || !(cn = get_node_r(
-				 t, get_lr(cn, r < 0 ? ST_Right : ST_Left))))
-			break;
-	return cn;
+	size_t r = 0;
+	srt_tndx x;
+	const srt_tnode *cn;
+	RETURN_IF(!t || !t->rank || !n || !st_size(t), 0);
+	for (x = t->root; x != ST_NIL;) {
+		cn = get_node_r(t, x);
+		if (t->cmp_f(cn, n) < 0) {
+			r += st_rank_cnt(t, cn->x.l) + 1;
+			x = cn->r;
+		} else {
+			x = cn->x.l;
+		}
+	}
+	return r;
 }
 
 /*
@@ -754,6 +1220,464 @@ ssize_t st_traverse_levelorder(const srt_tree *t, st_traverse f, void *context)
 	return tp.max_level + 1;
 }
 
+/*
+ * Node layout
+ */
+
+S_INLINE srt_tndx st_remap(const srt_tndx *newpos, srt_tndx x)
+{
+	return x != ST_NIL ? newpos[x] : ST_NIL;
+}
+
+srt_bool st_permute(srt_tree *t, const srt_tndx *newpos)
+{
+	uint8_t *tmp;
+	srt_tnode *n;
+	srt_tndx i;
+	size_t ts, es;
+	RETURN_IF(!t || !newpos, S_FALSE);
+	ts = st_size(t);
+	RETURN_IF(!ts, S_TRUE);
+	es = t->d.elem_size;
+	tmp = (uint8_t *)s_malloc(ts * es);
+	RETURN_IF(!tmp, S_FALSE); /* BEHAVIOR: not enough memory */
+	for (i = 0; i < (srt_tndx)ts; i++) {
+		n = (srt_tnode *)(tmp + (size_t)newpos[i] * es);
+		memcpy(n, get_node_r(t, i), es);
+		n->x.l = st_remap(newpos, n->x.l);
+		n->r = st_remap(newpos, n->r);
+	}
+	memcpy(get_node(t, 0), tmp, ts * es);
+	s_free(tmp);
+	t->root = st_remap(newpos, t->root);
+	if (t->rank)
+		st_rank_build(t, t->root, 0);
+	return S_TRUE;
+}
+
+static srt_tndx st_height(const srt_tree *t, srt_tndx x, srt_tndx depth)
+{
+	srt_tndx hl, hr;
+	const srt_tnode *n;
+	if (x == ST_NIL || depth >= ST_MAX_DEPTH)
+		return 0;
+	n = get_node_r(t, x);
+	hl = st_height(t, n->x.l, depth + 1);
+	hr = st_height(t, n->r, depth + 1);
+	return (hl > hr ? hl : hr) + 1;
+}
+
+static void st_veb(const srt_tree *t, srt_tndx x, srt_tndx h, srt_tndx *newpos,
+		   srt_tndx *cnt);
+
+/* van Emde Boas: bottom subtrees (the ones rooted at depth d) */
+static void st_veb_bottom(const srt_tree *t, srt_tndx x, srt_tndx d,
+			  srt_tndx h, srt_tndx *newpos, srt_tndx *cnt)
+{
+	const srt_tnode *n;
+	if (x == ST_NIL)
+		return;
+	if (!d) {
+		st_veb(t, x, h, newpos, cnt);
+		return;
+	}
+	n = get_node_r(t, x);
+	st_veb_bottom(t, n->x.l, d - 1, h, newpos, cnt);
+	st_veb_bottom(t, n->r, d - 1, h, newpos, cnt);
+}
+
+/*
+ * van Emde Boas: the top half levels of the subtree (height h) first, then
+ * the bottom subtrees, recursively
+ */
+static void st_veb(const srt_tree *t, srt_tndx x, srt_tndx h, srt_tndx *newpos,
+		   srt_tndx *cnt)
+{
+	if (x == ST_NIL || !h)
+		return;
+	if (h == 1) {
+		newpos[x] = (*cnt)++;
+		return;
+	}
+	st_veb(t, x, h / 2, newpos, cnt);
+	st_veb_bottom(t, x, h / 2, h - h / 2, newpos, cnt);
+}
+
+srt_bool st_relayout(srt_tree *t, enum eST_Layout l)
+{
+	srt_bool r;
+	size_t ts;
+	srt_tndx i, j, x, *newpos, *q;
+	struct STPath p;
+	const srt_tnode *n;
+	RETURN_IF(!t, S_FALSE);
+	ts = st_size(t);
+	RETURN_IF(!ts, S_TRUE);
+	newpos = (srt_tndx *)s_malloc(ts * sizeof(srt_tndx)
+				      * (l == ST_LAYOUT_BFS ? 2 : 1));
+	RETURN_IF(!newpos, S_FALSE); /* BEHAVIOR: not enough memory */
+	switch (l) {
+	case ST_LAYOUT_BFS:
+		/* Queue: second half of the buffer */
+		q = newpos + ts;
+		q[0] = t->root;
+		for (i = 0, j = 1; i < j; i++) {
+			newpos[q[i]] = i;
+			n = get_node_r(t, q[i]);
+			if (n->x.l != ST_NIL)
+				q[j++] = n->x.l;
+			if (n->r != ST_NIL)
+				q[j++] = n->r;
+		}
+		break;
+	case ST_LAYOUT_VEB:
+		i = 0;
+		st_veb(t, t->root, st_height(t, t->root, 0), newpos, &i);
+		break;
+	case ST_LAYOUT_INORDER:
+	default:
+		for (i = 0, x = st_path_first(t, &p); x != ST_NIL;
+		     x = st_path_next(t, &p))
+			newpos[x] = i++;
+		break;
+	}
+	r = st_permute(t, newpos);
+	s_free(newpos);
+	return r;
+}
+
+/* Swap link references to a and b */
+S_INLINE void st_swap_ref(srt_tndx *x, srt_tndx a, srt_tndx b)
+{
+	if (*x == a)
+		*x = b;
+	else if (*x == b)
+		*x = a;
+}
+
+srt_bool st_swap(srt_tree *t, srt_tndx a, srt_tndx b)
+{
+	size_t i, np = 0, es, done, chunk;
+	srt_tndx pa = ST_NIL, pb = ST_NIL, fix[4];
+	struct STPath p;
+	srt_tnode *n;
+	uint32_t *c, ct;
+	uint8_t tmp[64], *na, *nb;
+	RETURN_IF(!t || a >= st_size(t) || b >= st_size(t), S_FALSE);
+	RETURN_IF(a == b, S_TRUE);
+	/* Parents (path to the node, located by key) */
+	if (t->multi) {
+		if (a != t->root)
+			pa = st_parent_k(t, t->root, a, get_node_r(t, a));
+		if (b != t->root)
+			pb = st_parent_k(t, t->root, b, get_node_r(t, b));
+	} else {
+		if (st_path_bound(t, get_node_r(t, a), S_FALSE, &p) == a
+		    && p.depth > 1)
+			pa = p.x[p.depth - 2];
+		if (st_path_bound(t, get_node_r(t, b), S_FALSE, &p) == b
+		    && p.depth > 1)
+			pb = p.x[p.depth - 2];
+	}
+	/* Node swap */
+	es = t->d.elem_size;
+	na = (uint8_t *)get_node(t, a);
+	nb = (uint8_t *)get_node(t, b);
+	for (done = 0; done < es; done += chunk) {
+		chunk = S_MIN(es - done, sizeof(tmp));
+		memcpy(tmp, na + done, chunk);
+		memcpy(na + done, nb + done, chunk);
+		memcpy(nb + done, tmp, chunk);
+	}
+	if (t->rank) {
+		c = (uint32_t *)sv_get_buffer(t->rank);
+		ct = c[a];
+		c[a] = c[b];
+		c[b] = ct;
+	}
+	/*
+	 * References to a and b: from the parents, and from the swapped
+	 * nodes themselves (case of being parent and child)
+	 */
+	st_swap_ref(&t->root, a, b);
+	fix[np++] = a;
+	fix[np++] = b;
+	if (pa != ST_NIL && pa != a && pa != b)
+		fix[np++] = pa;
+	if (pb != ST_NIL && pb != a && pb != b && pb != pa)
+		fix[np++] = pb;
+	for (i = 0; i < np; i++) {
+		n = get_node(t, fix[i]);
+		st_swap_ref(&n->r, a, b);
+		if (n->x.l == a)
+			n->x.l = b;
+		else if (n->x.l == b)
+			n->x.l = a;
+	}
+	return S_TRUE;
+}
+
+/* Next node, in order */
+static srt_tndx st_path_succ(const srt_tree *t, srt_tndx x, struct STPath *p)
+{
+	srt_tndx y;
+	const srt_tnode *n = get_node_r(t, x);
+	RETURN_IF(!t->multi, st_path_bound(t, n, S_TRUE, p));
+	/* Duplicated keys: walk the equal ones, up to the node */
+	for (y = st_path_bound(t, n, S_FALSE, p); y != ST_NIL && y != x;)
+		y = st_path_next(t, p);
+	return y != ST_NIL ? st_path_next(t, p) : ST_NIL;
+}
+
+srt_bool st_relayout_step(srt_tree *t, size_t *pos, size_t steps)
+{
+	srt_tndx x;
+	struct STPath p;
+	RETURN_IF(!t || !pos, S_TRUE);
+	for (; steps > 0 && *pos < st_size(t); steps--, (*pos)++) {
+		x = !*pos ? st_path_first(t, &p)
+			  : st_path_succ(t, (srt_tndx)*pos - 1, &p);
+		if (x == ST_NIL) { /* BEHAVIOR: broken tree */
+			*pos = st_size(t);
+			break;
+		}
+		st_swap(t, x, (srt_tndx)*pos);
+	}
+	return *pos >= st_size(t) ? S_TRUE : S_FALSE;
+}
+
+/*
+ * Join and split
+ *
+ * Trees are joined by black height (the lower tree is hung from the spine
+ * of the higher one, fixing the red-red violation on the way back, like
+ * in the insertion), and split recursively, joining the subtrees at every
+ * level. Both take O(log n) node visits. Heights are the number of black
+ * nodes from the root to a leaf, and the output roots are black.
+ */
+
+static uint32_t st_bh(const srt_tree *t, srt_tndx x)
+{
+	uint32_t h = 0;
+	for (; x != ST_NIL; x = get_node_r(t, x)->x.l)
+		if (!is_red(t, x))
+			h++;
+	return h;
+}
+
+/* Join y (black root) to the d side of x, being x higher (hx >= hy) */
+static srt_tndx st_join_side(srt_tree *t, srt_tndx x, uint32_t hx, srt_tndx k,
+			     srt_tndx y, uint32_t hy, enum STNDir d)
+{
+	srt_tndx c;
+	srt_tnode *xn, *cn;
+	if (hx == hy && !is_red(t, x)) {
+		cn = get_node(t, k);
+		set_lr(cn, cd(d), x);
+		set_lr(cn, d, y);
+		cn->x.is_red = S_TRUE;
+		return k;
+	}
+	xn = get_node(t, x);
+	c = st_join_side(t, get_lr(xn, d), hx - (xn->x.is_red ? 0 : 1), k, y,
+			 hy, d);
+	set_lr(xn, d, c);
+	cn = get_node(t, c);
+	if (!xn->x.is_red && cn->x.is_red && is_red(t, get_lr(cn, d))) {
+		set_red(t, get_lr(cn, d), S_FALSE);
+		set_lr(xn, d, get_lr(cn, cd(d)));
+		set_lr(cn, cd(d), x);
+		return c;
+	}
+	return x;
+}
+
+/* Join trees l and r, using the node k as middle element (l < k < r) */
+static srt_tndx st_join3(srt_tree *t, srt_tndx l, uint32_t hl, srt_tndx k,
+			 srt_tndx r, uint32_t hr, uint32_t *h)
+{
+	srt_tndx x;
+	srt_tnode *kn;
+	if (is_red(t, l)) {
+		set_red(t, l, S_FALSE);
+		hl++;
+	}
+	if (is_red(t, r)) {
+		set_red(t, r, S_FALSE);
+		hr++;
+	}
+	if (hl == hr) {
+		kn = get_node(t, k);
+		kn->x.l = l;
+		kn->r = r;
+		kn->x.is_red = S_FALSE;
+		*h = hl + 1;
+		return k;
+	}
+	x = hl > hr ? st_join_side(t, l, hl, k, r, hr, ST_Right)
+		    : st_join_side(t, r, hr, k, l, hl, ST_Left);
+	*h = S_MAX(hl, hr);
+	if (is_red(t, x)) {
+		set_red(t, x, S_FALSE);
+		(*h)++;
+	}
+	return x;
+}
+
+/*
+ * Split the subtree x: nodes lower than n go to the left tree, and the rest
+ * to the right one (if first is not ST_NIL, only that node, which must be
+ * the lowest one, goes to the left tree)
+ */
+static void st_split_rec(srt_tree *t, srt_tndx x, uint32_t hx,
+			 const srt_tnode *n, srt_tndx first, srt_tndx *l,
+			 uint32_t *hl, srt_tndx *r, uint32_t *hr)
+{
+	srt_tndx a, b;
+	uint32_t hc;
+	const srt_tnode *xn;
+	if (x == ST_NIL) {
+		*l = *r = ST_NIL;
+		*hl = *hr = 0;
+		return;
+	}
+	xn = get_node_r(t, x);
+	a = xn->x.l;
+	b = xn->r;
+	hc = hx - (xn->x.is_red ? 0 : 1);
+	if (first != ST_NIL ? x != first : t->cmp_f(xn, n) >= 0) {
+		st_split_rec(t, a, hc, n, first, l, hl, r, hr);
+		*r = st_join3(t, *r, *hr, x, b, hc, hr);
+	} else {
+		st_split_rec(t, b, hc, n, first, l, hl, r, hr);
+		*l = st_join3(t, a, hc, x, *l, *hl, hl);
+	}
+}
+
+/* Copy the subtree x to o, in key order, keeping the source node indexes */
+static srt_tndx st_mv_inorder(const srt_tree *t, srt_tndx x, srt_tree *o,
+			      srt_tndx *src, size_t *cnt)
+{
+	srt_tndx y, l;
+	srt_tnode *yn;
+	if (x == ST_NIL)
+		return ST_NIL;
+	l = st_mv_inorder(t, get_node_r(t, x)->x.l, o, src, cnt);
+	y = (srt_tndx)(*cnt)++;
+	src[y] = x;
+	yn = get_node(o, y);
+	memcpy(yn, get_node_r(t, x), t->d.elem_size);
+	yn->x.l = l;
+	yn->r = st_mv_inorder(t, yn->r, o, src, cnt);
+	return y;
+}
+
+srt_bool st_split(srt_tree *t, const srt_tnode *n, srt_tree **r)
+{
+	size_t ts, nl, cnt = 0, i, j;
+	srt_tndx x, y, p, l, rr, *src;
+	uint32_t hl, hr;
+	uint8_t *moved;
+	srt_tnode *pn;
+	struct STPath pa;
+	RETURN_IF(!t || !n || !r || !*r || *r == t || st_size(*r), S_FALSE);
+	RETURN_IF(t->d.elem_size != (*r)->d.elem_size, S_FALSE);
+	for (x = st_path_bound(t, n, S_FALSE, &pa); x != ST_NIL;
+	     x = st_path_next(t, &pa))
+		cnt++;
+	RETURN_IF(!cnt, S_TRUE);
+	RETURN_IF(st_reserve(r, cnt) < cnt, S_FALSE);
+	src = (srt_tndx *)s_malloc(cnt * (sizeof(srt_tndx) + 1));
+	RETURN_IF(!src, S_FALSE); /* BEHAVIOR: not enough memory */
+	ts = st_size(t);
+	nl = ts - cnt;
+	moved = (uint8_t *)(src + cnt); /* nodes moved, from nl to ts - 1 */
+	memset(moved, 0, cnt);
+	st_split_rec(t, t->root, st_bh(t, t->root), n, ST_NIL, &l, &hl, &rr,
+		     &hr);
+	i = 0;
+	(*r)->root = st_mv_inorder(t, rr, *r, src, &i);
+	/*
+	 * Keep the node space compact: the holes below nl are filled with the
+	 * nodes of the left tree above it
+	 */
+	for (i = 0; i < cnt; i++)
+		if (src[i] >= nl)
+			moved[src[i] - nl] = 1;
+	for (i = j = 0; i < cnt; i++) {
+		if (src[i] >= nl)
+			continue;
+		while (moved[j])
+			j++;
+		y = (srt_tndx)(nl + j++);
+		x = src[i];
+		if (y == l) {
+			l = x;
+		} else {
+			p = st_parent_k(t, l, y, get_node_r(t, y));
+			pn = get_node(t, p);
+			set_lr(pn, pn->x.l == y ? ST_Left : ST_Right, x);
+		}
+		memcpy(get_node(t, x), get_node_r(t, y), t->d.elem_size);
+	}
+	s_free(src);
+	t->root = nl ? l : 0;
+	st_set_size(t, nl);
+	st_set_size(*r, cnt);
+	/* BEHAVIOR: not enough memory: no order statistics */
+	if (t->rank)
+		st_rank_enable(t);
+	if ((*r)->rank)
+		st_rank_enable(*r);
+	return S_TRUE;
+}
+
+srt_bool st_join(srt_tree **t, srt_tree *r)
+{
+	int c;
+	size_t i, ts, rs;
+	srt_tndx k, b, f;
+	uint32_t h, hb;
+	srt_tnode *n;
+	struct STPath p;
+	RETURN_IF(!t || !*t || !r || *t == r, S_FALSE);
+	RETURN_IF((*t)->d.elem_size != r->d.elem_size, S_FALSE);
+	ts = st_size(*t);
+	rs = st_size(r);
+	RETURN_IF(!rs, S_TRUE);
+	RETURN_IF(ts + rs >= ST_NIL, S_FALSE);
+	if (ts) { /* BEHAVIOR: overlapping keys */
+		c = (*t)->cmp_f(get_node_r(*t, st_path_last(*t, &p)),
+				get_node_r(r, st_path_first(r, &p)));
+		RETURN_IF(c > 0 || (!c && !(*t)->multi), S_FALSE);
+	}
+	RETURN_IF(st_reserve(t, ts + rs) < ts + rs, S_FALSE);
+	for (i = 0; i < rs; i++) {
+		n = get_node(*t, (srt_tndx)(ts + i));
+		memcpy(n, get_node_r(r, (srt_tndx)i), r->d.elem_size);
+		if (n->x.l != ST_NIL)
+			n->x.l = (srt_tndx)(n->x.l + ts);
+		if (n->r != ST_NIL)
+			n->r = (srt_tndx)(n->r + ts);
+	}
+	b = (srt_tndx)(r->root + ts);
+	if (ts) {
+		/* The lowest node of r is the middle node for the join */
+		for (f = b; get_node_r(*t, f)->x.l != ST_NIL;)
+			f = get_node_r(*t, f)->x.l;
+		st_split_rec(*t, b, st_bh(*t, b), NULL, f, &k, &h, &b, &hb);
+		b = st_join3(*t, (*t)->root, st_bh(*t, (*t)->root), k, b, hb,
+			     &h);
+	}
+	(*t)->root = b;
+	st_set_size(*t, ts + rs);
+	st_set_size(r, 0);
+	/* BEHAVIOR: not enough memory: no order statistics */
+	if ((*t)->rank)
+		st_rank_enable(*t);
+	return S_TRUE;
+}
+
 srt_bool st_assert(const srt_tree *t)
 {
 	RETURN_IF(!t, S_FALSE);
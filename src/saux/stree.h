@@ -41,10 +41,16 @@ struct S_Node {
 	srt_tndx r;
 };
 
+struct S_BTree;
+struct SVector;
+
 struct S_Tree {
 	struct SDataFull d;
 	srt_tndx root;
 	srt_cmp cmp_f;
+	struct S_BTree *bt; /* optional B+tree index (NULL: red-black tree) */
+	struct SVector *rank; /* optional subtree sizes (NULL: no rank) */
+	srt_bool multi; /* duplicated keys allowed (multimap/multiset) */
 };
 
 typedef struct S_Node srt_tnode;
@@ -62,6 +68,28 @@ typedef int (*st_traverse)(struct STraverseParams *p);
 typedef void (*srt_tree_rewrite)(srt_tnode *node, const srt_tnode *new_data,
 				 srt_bool existing);
 
+/* Path from the root to a node (red-black tree height is < 2 * log2(n)) */
+#define ST_MAX_DEPTH (2 * ST_NODE_BITS + 2)
+
+struct STPath {
+	uint32_t depth;		  /* number of nodes (0: no node) */
+	srt_tndx x[ST_MAX_DEPTH]; /* x[depth - 1]: current node */
+};
+
+/*
+ * Key type for the specialized tree operations (st_*_k()): numeric keys
+ * stored right after the node header are compared inline, without calling
+ * the compare function.
+ */
+enum eST_KeyType {
+	ST_KT_GEN = 0, /* compare function (cmp_f) */
+	ST_KT_I32,
+	ST_KT_U32,
+	ST_KT_I64,
+	ST_KT_F,
+	ST_KT_D
+};
+
 /*
  * Constants
  */
@@ -88,6 +116,9 @@ srt_tree *st_alloc_raw(srt_cmp cmp_f, srt_bool ext_buf,
 /* #NOTAPI: |Allocate tree (heap)|compare function;element size;space preallocated to store n elements|allocated tree|O(1)|1;2| */
 srt_tree *st_alloc(srt_cmp cmp_f, size_t elem_size, size_t init_size);
 
+/* #NOTAPI: |Allocate tree (heap) using the given allocator|allocator (NULL: global allocator);compare function;element size;space preallocated to store n elements|allocated tree|O(1)|1;2| */
+srt_tree *st_alloc_a(const srt_allocator *a, srt_cmp cmp_f, size_t elem_size, size_t init_size);
+
 SD_BUILDFUNCS_FULL(st, srt_tree, 0)
 
 /*
@@ -138,6 +169,90 @@ srt_bool st_delete(srt_tree *t, const srt_tnode *n, srt_tree_callback callback);
 /* #NOTAPI: |Locate node|tree; node|Reference to the located node; NULL if not found|O(log n)|1;2| */
 const srt_tnode *st_locate(const srt_tree *t, const srt_tnode *n);
 
+/* #NOTAPI: |Insert element into tree, with rewrite function, comparing keys inline for numeric key types|tree; element to insert; rewrite function; key type|S_TRUE: OK, S_FALSE: error (not enough memory)|O(log n)|1;2| */
+srt_bool st_insert_rw_k(srt_tree **t, const srt_tnode *n, srt_tree_rewrite rw_f, enum eST_KeyType kt);
+
+/* #NOTAPI: |Delete tree element, comparing keys inline for numeric key types|tree; element to delete; node delete handling callback; key type|S_TRUE: found and deleted; S_FALSE: not found|O(log n)|1;2| */
+srt_bool st_delete_k(srt_tree *t, const srt_tnode *n, srt_tree_callback callback, enum eST_KeyType kt);
+
+/* #NOTAPI: |Locate node, comparing keys inline for numeric key types|tree; node; key type|Reference to the located node; NULL if not found|O(log n)|1;2| */
+const srt_tnode *st_locate_k(const srt_tree *t, const srt_tnode *n, enum eST_KeyType kt);
+
+/* #NOTAPI: |Allow duplicated keys: insertion never overwrites, equal keys are placed after the existing ones (not compatible with order statistics)|tree|S_TRUE: OK; S_FALSE: order statistics enabled|O(1)|1;2| */
+srt_bool st_multi_enable(srt_tree *t);
+
+/*
+ * Ordered navigation (root-to-node path, no parent links)
+ */
+
+/* #NOTAPI: |Locate first node not lower (lower bound) or greater (upper bound) than the given one|tree; node; S_FALSE: lower bound, S_TRUE: upper bound; output path|node index (ST_NIL: not found)|O(log n)|1;2| */
+srt_tndx st_path_bound(const srt_tree *t, const srt_tnode *n, srt_bool upper, struct STPath *p);
+
+/* #NOTAPI: |Locate first node|tree; output path|node index (ST_NIL: empty tree)|O(log n)|1;2| */
+srt_tndx st_path_first(const srt_tree *t, struct STPath *p);
+
+/* #NOTAPI: |Locate last node|tree; output path|node index (ST_NIL: empty tree)|O(log n)|1;2| */
+srt_tndx st_path_last(const srt_tree *t, struct STPath *p);
+
+/* #NOTAPI: |Move to the next node, in order|tree; path|node index (ST_NIL: no more nodes)|O(1) amortized; O(log n) worst case|1;2| */
+srt_tndx st_path_next(const srt_tree *t, struct STPath *p);
+
+/* #NOTAPI: |Move to the previous node, in order|tree; path|node index (ST_NIL: no more nodes)|O(1) amortized; O(log n) worst case|1;2| */
+srt_tndx st_path_prev(const srt_tree *t, struct STPath *p);
+
+/*
+ * Order statistics (optional subtree size per node, kept in a separate
+ * array indexed by node, so the node layout is not changed)
+ */
+
+/* #NOTAPI: |Enable order statistics (subtree sizes are computed)|tree|S_TRUE: OK; S_FALSE: not enough memory|O(n)|1;2| */
+srt_bool st_rank_enable(srt_tree *t);
+
+/* #NOTAPI: |Disable order statistics (subtree sizes are freed)|tree|-|O(1)|1;2| */
+void st_rank_disable(srt_tree *t);
+
+/* #NOTAPI: |Locate the k-th node, in order (order statistics required)|tree; position (0: lowest)|node index (ST_NIL: out of range or order statistics not enabled)|O(log n)|1;2| */
+srt_tndx st_select(const srt_tree *t, size_t k);
+
+/* #NOTAPI: |Number of nodes lower than the given one (order statistics required)|tree; node|rank|O(log n)|1;2| */
+size_t st_rank(const srt_tree *t, const srt_tnode *n);
+
+/*
+ * Node layout (node array order, for memory access locality)
+ */
+
+enum eST_Layout {
+	ST_LAYOUT_INORDER = 0, /* key order (range scans) */
+	ST_LAYOUT_BFS,	       /* level order (top levels together) */
+	ST_LAYOUT_VEB	       /* van Emde Boas (cache-oblivious) */
+};
+
+/* #NOTAPI: |Move nodes to new positions, updating the links|tree; new position for every node (permutation)|S_TRUE: OK; S_FALSE: not enough memory|O(n)|1;2| */
+srt_bool st_permute(srt_tree *t, const srt_tndx *newpos);
+
+/* #NOTAPI: |Rewrite the node array in the given layout|tree; layout|S_TRUE: OK; S_FALSE: not enough memory|O(n); ST_LAYOUT_VEB: O(n log log n)|1;2| */
+srt_bool st_relayout(srt_tree *t, enum eST_Layout l);
+
+/* #NOTAPI: |Swap node positions, updating the links|tree; node; node|S_TRUE: OK; S_FALSE: invalid node|O(log n)|1;2| */
+srt_bool st_swap(srt_tree *t, srt_tndx a, srt_tndx b);
+
+/* #NOTAPI: |Incremental in-order relayout: move the next nodes, in key order, to the beginning of the node array|tree; number of nodes already placed (0: start; it is updated); maximum number of nodes to place|S_TRUE: layout complete; S_FALSE: pending|O(steps log n)|1;2| */
+srt_bool st_relayout_step(srt_tree *t, size_t *pos, size_t steps);
+
+/*
+ * Join and split
+ */
+
+/* #NOTAPI: |Split tree: nodes not lower than the given one are moved to the output tree|tree; node (key); output tree (empty, same node type)|S_TRUE: OK; S_FALSE: not enough memory|O(log n) + O(m log n), being m the number of nodes moved|1;2| */
+srt_bool st_split(srt_tree *t, const srt_tnode *n, srt_tree **r);
+
+/* #NOTAPI: |Join trees: nodes of the second tree, not lower than the ones of the first one, are moved to it|tree; tree|S_TRUE: OK; S_FALSE: overlapping keys or not enough memory|O(log n) + O(m), being m the number of nodes moved|1;2| */
+srt_bool st_join(srt_tree **t, srt_tree *r);
+
+/*
+ * Traversal
+ */
+
 /* #NOTAPI: |Full tree traversal: pre-order|tree; traverse callback; callback context|Number of levels stepped down|O(n)|1;2| */
 ssize_t st_traverse_preorder(const srt_tree *t, st_traverse f, void *context);
 
@@ -8,6 +8,7 @@
  */
 
 #include "sbitset.h"
+#include "saux/sdimage.h"
 
 srt_bitset *sb_alloc_aux(srt_bitset *b)
 {
@@ -15,6 +16,46 @@ srt_bitset *sb_alloc_aux(srt_bitset *b)
 	return b;
 }
 
+static srt_bool sb_image_chk(const srt_bitset *b)
+{
+	return b->d.sub_type == SV_GEN && b->d.elem_size == 1
+			       && b->d.header_size == sizeof(srt_bitset)
+			       && b->vx.cnt <= 8 * (uintptr_t)sv_size(b)
+		       ? S_TRUE
+		       : S_FALSE;
+}
+
+srt_bool sb_save(FILE *f, const srt_bitset *b)
+{
+	RETURN_IF(!b, S_FALSE);
+	return sd_image_save(f, (const srt_data *)b, SD_IMAGE_BITSET,
+			     sizeof(srt_bitset));
+}
+
+srt_bitset *sb_load(FILE *f)
+{
+	srt_bitset *b = (srt_bitset *)sd_image_load(f, SD_IMAGE_BITSET,
+						    sizeof(srt_bitset));
+	/* BEHAVIOR: invalid image: raw release (no type-specific free) */
+	if (b && !sb_image_chk(b))
+		sd_free((srt_data **)&b);
+	return b;
+}
+
+srt_bitset *sb_map(const char *path)
+{
+	srt_bitset *b = (srt_bitset *)sd_image_map(path, SD_IMAGE_BITSET,
+						   sizeof(srt_bitset));
+	if (b && !sb_image_chk(b))
+		sb_unmap(&b);
+	return b;
+}
+
+void sb_unmap(srt_bitset **b)
+{
+	sd_image_unmap((srt_data **)b);
+}
+
 void sb_clear(srt_bitset *b)
 {
 	size_t nb;
@@ -62,6 +62,22 @@ srt_bitset *sb_free(srt_bitset **b, ...)
 srt_bitset *sb_dup(const srt_bitset *src)
 */
 
+/*
+ * Persistence (store/restore)
+ */
+
+/* #API: |Save bitset image to file (including the bit count)|file handle; bitset|S_TRUE: OK; S_FALSE: I/O error or unsupported bitset type|O(n): WARNING: involves external file I/O|1;2| */
+srt_bool sb_save(FILE *f, const srt_bitset *b);
+
+/* #API: |Load bitset image from file|file handle|bitset (NULL: I/O error, not enough memory, or invalid/incompatible image)|O(n): WARNING: involves external file I/O|1;2| */
+srt_bitset *sb_load(FILE *f);
+
+/* #API: |Open bitset image file using memory mapping (no deserialization: the mapped file is used as fixed-size bitset; changes are not written back to the file)|file path|bitset (NULL: I/O error, invalid/incompatible image, or system without mmap() support)|O(1)|1;2| */
+srt_bitset *sb_map(const char *path);
+
+/* #API: |Release bitset opened with sb_map()|bitset|-|O(1)|1;2| */
+void sb_unmap(srt_bitset **b);
+
 /*
  * Accessors
  */
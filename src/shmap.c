@@ -8,8 +8,10 @@
  */
 
 #include "shmap.h"
+#include "saux/sdimage.h"
 #include "saux/shash.h"
 #include "saux/sstringo.h"
+#include "sstats.h"
 
 /*
  * Internal constants
@@ -28,6 +30,7 @@ struct SHMapCtx {
 #define SHM_MAX_ELEMS 0xffffffff
 #define SHM_LOC_EMPTY 0			    /* do not change this */
 #define SHM_REHASH_DEFAULT_THRESHOLD_PCT 90 /* rehash at 90% of buckets */
+#define SHM_SHRINK_MIN_HBITS 6		    /* auto-shrink: 64 buckets min. */
 #define shm_void (srt_hmap *)sd_void
 
 /*
@@ -69,129 +72,155 @@ static srt_bool eq_sso1(const void *key, const void *node)
 	return sso1_eq((const srt_string *)key, (const srt_stringo1 *)node);
 }
 
-static void shmcb_set_ii32(void *loc, const void *key, const void *value)
+static void shmcb_set_ii32(void *loc, const void *key, const void *value,
+			   srt_arena *pool)
 {
 	struct SHMapii *e = (struct SHMapii *)loc;
+	(void)pool;
 	memcpy(&e->x.k, key, sizeof(e->x.k));
 	memcpy(&e->v, value, sizeof(e->v));
 }
 
-static void shmcb_set_uu32(void *loc, const void *key, const void *value)
+static void shmcb_set_uu32(void *loc, const void *key, const void *value,
+			   srt_arena *pool)
 {
 	struct SHMapuu *e = (struct SHMapuu *)loc;
+	(void)pool;
 	memcpy(&e->x.k, key, sizeof(e->x.k));
 	memcpy(&e->v, value, sizeof(e->v));
 }
 
-static void shmcb_set_ii64(void *loc, const void *key, const void *value)
+static void shmcb_set_ii64(void *loc, const void *key, const void *value,
+			   srt_arena *pool)
 {
 	struct SHMapII *e = (struct SHMapII *)loc;
+	(void)pool;
 	memcpy(&e->x.k, key, sizeof(e->x.k));
 	memcpy(&e->v, value, sizeof(e->v));
 }
 
-static void shmcb_set_is(void *loc, const void *key, const void *value)
+static void shmcb_set_is(void *loc, const void *key, const void *value,
+			 srt_arena *pool)
 {
 	struct SHMapIS *e = (struct SHMapIS *)loc;
 	memcpy(&e->x.k, key, sizeof(e->x.k));
-	sso1_set(&e->v, (const srt_string *)value);
+	sso1_set_p(&e->v, (const srt_string *)value, pool);
 }
 
-static void shmcb_set_ip(void *loc, const void *key, const void *value)
+static void shmcb_set_ip(void *loc, const void *key, const void *value,
+			 srt_arena *pool)
 {
 	struct SHMapIP *e = (struct SHMapIP *)loc;
+	(void)pool;
 	memcpy(&e->x.k, key, sizeof(e->x.k));
 	e->v = value;
 }
 
-static void shmcb_set_si(void *loc, const void *key, const void *value)
+static void shmcb_set_si(void *loc, const void *key, const void *value,
+			 srt_arena *pool)
 {
 	struct SHMapSI *e = (struct SHMapSI *)loc;
-	sso1_set(&e->x.k, (const srt_string *)key);
+	sso1_set_p(&e->x.k, (const srt_string *)key, pool);
 	memcpy(&e->v, value, sizeof(e->v));
 }
 
-static void shmcb_set_ss(void *loc, const void *key, const void *value)
+static void shmcb_set_ss(void *loc, const void *key, const void *value,
+			 srt_arena *pool)
 {
 	struct SHMapSS *e = (struct SHMapSS *)loc;
-	sso_set(&e->kv, (const srt_string *)key, (const srt_string *)value);
+	sso_set_p(&e->kv, (const srt_string *)key,
+		  (const srt_string *)value, pool);
 }
 
-static void shmcb_set_sp(void *loc, const void *key, const void *value)
+static void shmcb_set_sp(void *loc, const void *key, const void *value,
+			 srt_arena *pool)
 {
 	struct SHMapSP *e = (struct SHMapSP *)loc;
-	sso1_set(&e->x.k, (const srt_string *)key);
+	sso1_set_p(&e->x.k, (const srt_string *)key, pool);
 	e->v = value;
 }
 
-static void shmcb_set_i32(void *loc, const void *key)
+static void shmcb_set_i32(void *loc, const void *key, srt_arena *pool)
 {
 	struct SHMapi *e = (struct SHMapi *)loc;
+	(void)pool;
 	memcpy(&e->k, key, sizeof(e->k));
 }
 
-static void shmcb_set_u32(void *loc, const void *key)
+static void shmcb_set_u32(void *loc, const void *key, srt_arena *pool)
 {
 	struct SHMapu *e = (struct SHMapu *)loc;
+	(void)pool;
 	memcpy(&e->k, key, sizeof(e->k));
 }
 
-static void shmcb_set_i64(void *loc, const void *key)
+static void shmcb_set_i64(void *loc, const void *key, srt_arena *pool)
 {
 	struct SHMapI *e = (struct SHMapI *)loc;
+	(void)pool;
 	memcpy(&e->k, key, sizeof(e->k));
 }
 
-static void shmcb_set_s(void *loc, const void *key)
+static void shmcb_set_s(void *loc, const void *key, srt_arena *pool)
 {
 	struct SHMapS *e = (struct SHMapS *)loc;
-	sso1_set(&e->k, (const srt_string *)key);
+	sso1_set_p(&e->k, (const srt_string *)key, pool);
 }
 
-static void shmcb_set_f(void *loc, const void *key)
+static void shmcb_set_f(void *loc, const void *key, srt_arena *pool)
 {
 	struct SHMapF *e = (struct SHMapF *)loc;
+	(void)pool;
 	memcpy(&e->k, key, sizeof(e->k));
 }
 
-static void shmcb_set_d(void *loc, const void *key)
+static void shmcb_set_d(void *loc, const void *key, srt_arena *pool)
 {
 	struct SHMapD *e = (struct SHMapD *)loc;
+	(void)pool;
 	memcpy(&e->k, key, sizeof(e->k));
 }
 
-static void shmcb_set_ff(void *loc, const void *key, const void *value)
+static void shmcb_set_ff(void *loc, const void *key, const void *value,
+			 srt_arena *pool)
 {
 	struct SHMapFF *e = (struct SHMapFF *)loc;
+	(void)pool;
 	memcpy(&e->x.k, key, sizeof(e->x.k));
 	memcpy(&e->v, value, sizeof(e->v));
 }
 
-static void shmcb_set_dd(void *loc, const void *key, const void *value)
+static void shmcb_set_dd(void *loc, const void *key, const void *value,
+			 srt_arena *pool)
 {
 	struct SHMapDD *e = (struct SHMapDD *)loc;
+	(void)pool;
 	memcpy(&e->x.k, key, sizeof(e->x.k));
 	memcpy(&e->v, value, sizeof(e->v));
 }
 
-static void shmcb_set_ds(void *loc, const void *key, const void *value)
+static void shmcb_set_ds(void *loc, const void *key, const void *value,
+			 srt_arena *pool)
 {
 	struct SHMapDS *e = (struct SHMapDS *)loc;
 	memcpy(&e->x.k, key, sizeof(e->x.k));
-	sso1_set(&e->v, (const srt_string *)value);
+	sso1_set_p(&e->v, (const srt_string *)value, pool);
 }
 
-static void shmcb_set_dp(void *loc, const void *key, const void *value)
+static void shmcb_set_dp(void *loc, const void *key, const void *value,
+			 srt_arena *pool)
 {
 	struct SHMapDP *e = (struct SHMapDP *)loc;
+	(void)pool;
 	memcpy(&e->x.k, key, sizeof(e->x.k));
 	e->v = value;
 }
 
-static void shmcb_set_sd(void *loc, const void *key, const void *value)
+static void shmcb_set_sd(void *loc, const void *key, const void *value,
+			 srt_arena *pool)
 {
 	struct SHMapSD *e = (struct SHMapSD *)loc;
-	sso1_set(&e->x.k, (const srt_string *)key);
+	sso1_set_p(&e->x.k, (const srt_string *)key, pool);
 	memcpy(&e->v, value, sizeof(e->v));
 }
 
@@ -383,12 +412,125 @@ static void aux_rehash(srt_hmap *hm)
 	memset(b, 0, sizeof(struct SHMBucket) * nbuckets);
 	for (i = 0; i < nelems; i++, data += elem_size)
 		aux_reg_hash(hm, data, hashf(data), i);
+	if (nelems > 0)
+		sst_on_rehash((srt_data *)hm);
+}
+
+/*
+ * String pool
+ */
+
+S_INLINE srt_arena *shm_pool(const srt_hmap *hm)
+{
+	return hm && hm != shm_void ? hm->pool : NULL;
+}
+
+/* Node string offset (S_NPOS: no strings), and string type (two: SS) */
+static size_t aux_sso_off(int t, srt_bool *two)
+{
+	*two = t == SHM0_SS ? S_TRUE : S_FALSE;
+	switch (t) {
+	case SHM0_S:
+	case SHM0_SI:
+	case SHM0_SP:
+	case SHM0_SD:
+	case SHM0_SS:
+		return 0;
+	case SHM0_IS:
+		return offsetof(struct SHMapIS, v);
+	case SHM0_DS:
+		return offsetof(struct SHMapDS, v);
+	default:
+		break;
+	}
+	return S_NPOS;
+}
+
+/*
+ * Duplicate node strings into the pool (heap if NULL), optionally releasing
+ * the previous ones (pooled strings are not released individually)
+ */
+static void aux_sso_dupa(srt_hmap *hm, srt_arena *pool, srt_bool release)
+{
+	srt_bool two;
+	srt_stringo so;
+	size_t i, es = hm->d.elem_size, ss = shm_size(hm),
+		  off = aux_sso_off(hm->d.sub_type, &two);
+	uint8_t *p = shm_get_buffer(hm);
+	if (off == S_NPOS)
+		return;
+	for (p += off, i = 0; i < ss; i++, p += es) {
+		if (two) {
+			memcpy(&so, p, sizeof(srt_stringo));
+			sso_dupa_p((srt_stringo *)p, pool);
+			if (release)
+				sso_free(&so);
+		} else {
+			memcpy(&so.k, p, sizeof(srt_stringo1));
+			sso_dupa1_p((srt_stringo1 *)p, pool);
+			if (release)
+				sso1_free(&so.k);
+		}
+	}
+}
+
+/* Pool space used by the stored strings */
+static size_t aux_pool_used(const srt_hmap *hm)
+{
+	srt_bool two;
+	size_t i, acc = 0, es = hm->d.elem_size, ss = shm_size(hm),
+		  off = aux_sso_off(hm->d.sub_type, &two);
+	const uint8_t *p = shm_get_buffer_r(hm);
+	RETURN_IF(off == S_NPOS, 0);
+	for (p += off, i = 0; i < ss; i++, p += es)
+		acc += two ? sso_pool_size((const srt_stringo *)p)
+			   : sso1_pool_size((const srt_stringo1 *)p);
+	return acc;
+}
+
+/* Move the strings to a new pool (unused space is released) */
+static void aux_pool_move(srt_hmap *hm)
+{
+	srt_arena *pool = sa_alloc(0);
+	if (!pool) /* BEHAVIOR: not enough memory, keep the current pool */
+		return;
+	aux_sso_dupa(hm, pool, S_FALSE);
+	sa_free(&hm->pool);
+	hm->pool = pool;
+}
+
+/*
+ * Automatic shrink (SD_GROW_SHRINK policy): halve the hash table in place
+ * when below 1/SD_SHRINK_DIV of the rehash threshold (the element area is
+ * released on the next insert, as delete can not move the map). Like the
+ * growth in aux_insert_check(), all elements are rehashed at once: O(n) for
+ * that delete, O(1) amortized, as the hysteresis requires deleting at least
+ * half of the elements between two halvings.
+ */
+static void aux_shrink_check(srt_hmap *hm)
+{
+	size_t hs1, hs2, sz = shm_size(hm);
+	if ((shm_grow_policy(hm) & SD_GROW_SHRINK) == 0
+	    || hm->hbits <= SHM_SHRINK_MIN_HBITS
+	    || sz >= hm->rh_threshold / SD_SHRINK_DIV)
+		return;
+	hs1 = hm->d.header_size;
+	hs2 = sh_hdr_size(hm->d.sub_type, (uint64_t)1 << (hm->hbits - 1));
+	memmove((uint8_t *)hm + hs2, (uint8_t *)hm + hs1,
+		sz * hm->d.elem_size);
+	hm->d.max_size += (hs1 - hs2) / hm->d.elem_size;
+	hm->d.header_size = hs2;
+	hm->hbits--;
+	aux_rehash(hm);
 }
 
 static srt_bool aux_insert_check(srt_hmap **hm)
 {
 	srt_hmap *h2;
+	srt_bool spill;
 	size_t h2bits, hs1, hs2, hsd, sxz, sxzm, sz;
+	if (hm)
+		sd_auto_shrink((srt_data **)hm, 0);
 	RETURN_IF(!shm_grow(hm, 1) || !hm || !*hm, S_FALSE);
 	sz = shm_size(*hm);
 	/* Check if rehash is not required */
@@ -400,7 +542,8 @@ static srt_bool aux_insert_check(srt_hmap **hm)
 		return S_TRUE;
 	}
 	/* Rehash required: realloc for twice the bucket size */
-	if ((*hm)->d.f.ext_buffer) {
+	spill = (*hm)->d.f.ext_buffer;
+	if (spill && !sd_spill_enabled(&(*hm)->d)) {
 		S_ERROR("out of memory on fixed-size allocated space");
 		shm_set_alloc_errors(*hm);
 		return S_FALSE;
@@ -410,7 +553,9 @@ static srt_bool aux_insert_check(srt_hmap **hm)
 	hs1 = (*hm)->d.header_size;
 	h2bits = (*hm)->hbits + 1;
 	hs2 = sh_hdr_size((*hm)->d.sub_type, (uint64_t)1 << h2bits);
-	h2 = (srt_hmap *)s_realloc(*hm, hs2 + sxzm);
+	h2 = spill ? (srt_hmap *)sd_spill((srt_data **)hm, hs2 + sxzm)
+		   : (srt_hmap *)sd_mem_realloc((*hm)->d.alloc_id, *hm,
+						hs2 + sxzm);
 	RETURN_IF(!h2, S_FALSE); /* Not enough memory */
 	*hm = h2;
 #if 1
@@ -440,8 +585,16 @@ static srt_bool aux_insert_check(srt_hmap **hm)
 	/* Reconfigure the data structure */
 	h2->d.header_size = hs2;
 	h2->hbits = (uint32_t)h2bits;
+	if (spill)
+		sst_on_alloc((srt_data *)h2);
+	else
+		sst_on_resize((srt_data *)h2, hs1 + sxzm, hs2 + sxz);
 	/* Rehash elements */
 	aux_rehash(h2);
+	/* Release the pool space of deleted and overwritten strings */
+	if (h2->pool
+	    && sa_alloc_size(h2->pool) > 2 * aux_pool_used(h2) + SA_CHUNK_SIZE)
+		aux_pool_move(h2);
 	return S_TRUE;
 }
 
@@ -542,6 +695,7 @@ static srt_bool del(srt_hmap *hm, uint32_t h, const void *key)
 					b[tl].loc = l0;
 				}
 				shm_set_size(hm, ss - 1);
+				aux_shrink_check(hm);
 				return S_TRUE;
 			}
 		}
@@ -561,42 +715,59 @@ srt_hmap *shm_alloc_raw(int t, srt_bool ext_buf, void *buffer, size_t hdr_size,
 	h = (srt_hmap *)buffer;
 	sd_reset((srt_data *)h, hdr_size, elem_size, max_size, ext_buf,
 		 S_FALSE);
+	sd_set_ctype((srt_data *)h, SD_CT_HMAP);
 	h->d.sub_type = (uint8_t)t;
 	h->rh_threshold_pct = SHM_REHASH_DEFAULT_THRESHOLD_PCT;
+	h->pool = NULL;
 	h->hbits = (uint32_t)hbits;
 	aux_rehash(h);
 	return h;
 }
 
-srt_hmap *shm_alloc_aux(int t, size_t init_size)
+srt_hmap *shm_alloc_aux_a(const srt_allocator *a, int t, size_t init_size)
 {
 	size_t elem_size = shm_elem_size(t), hbits = shm_s2hb(init_size),
 	       hs = sh_hdr_size(t, (uint64_t)1 << hbits),
 	       as = sd_alloc_size_raw(hs, elem_size, init_size, S_FALSE);
-	void *buf = s_malloc(as);
-	srt_hmap *h =
-		shm_alloc_raw(t, S_FALSE, buf, hs, elem_size, init_size, hbits);
-	if (!h || h == shm_void)
-		s_free(buf);
+	int id = sd_allocator_id(a);
+	void *buf;
+	srt_hmap *h;
+	RETURN_IF(id < 0, shm_void);
+	buf = sd_mem_alloc((uint8_t)id, as);
+	h = shm_alloc_raw(t, S_FALSE, buf, hs, elem_size, init_size, hbits);
+	if (!h || h == shm_void) {
+		sd_mem_free((uint8_t)id, buf);
+	} else {
+		h->d.alloc_id = (uint8_t)id;
+		sst_on_alloc((srt_data *)h);
+	}
 	return h;
 }
 
+srt_hmap *shm_alloc_aux(int t, size_t init_size)
+{
+	return shm_alloc_aux_a(NULL, t, init_size);
+}
+
 void shm_clear(srt_hmap *hm)
 {
 	size_t es;
 	shm_del_f delf;
 	uint8_t *p, *pt, t;
-	if (!hm)
+	if (!hm || hm == shm_void)
 		return;
 	p = shm_get_buffer(hm);
 	es = hm->d.elem_size;
 	pt = p + shm_size(hm) * es;
 	t = hm->d.sub_type;
 	delf = t < SHM0_NumTypes ? shm_ctx[t].delf : NULL;
-	if (delf && delf != del_nop)
+	if (shm_pool(hm))
+		sa_reset(hm->pool); /* pooled strings: O(chunks) release */
+	else if (delf && delf != del_nop)
 		for (; p < pt; p += es)
 			delf(p);
 	shm_set_size(hm, 0);
+	aux_rehash(hm); /* reset buckets (no stale references) */
 }
 
 void shm_free_aux(srt_hmap **hm, ...)
@@ -606,6 +777,8 @@ void shm_free_aux(srt_hmap **hm, ...)
 	va_start(ap, hm);
 	while (!s_varg_tail_ptr_tag(next)) { /* last element tag */
 		shm_clear(*next); /* release associated dyn. memory */
+		if (shm_pool(*next))
+			sa_free(&(*next)->pool);
 		sd_free((srt_data **)next);
 		next = (srt_hmap **)va_arg(ap, srt_hmap **);
 	}
@@ -625,7 +798,8 @@ S_INLINE size_t shm_current_alloc_size(const srt_hmap *h)
 
 static srt_bool shm_cpy_reconfig(srt_hmap **hm, const srt_hmap *src)
 {
-	srt_hmap *hra;
+	srt_hmap *hra = NULL;
+	srt_bool spill = S_FALSE;
 	uint8_t t = src->d.sub_type;
 	uint64_t hs64 = snextpow2(shm_size(src));
 	size_t tgt0_cas, src0_cas, np2, hbits, hdr_size, es, elems, data_size,
@@ -643,6 +817,12 @@ static srt_bool shm_cpy_reconfig(srt_hmap **hm, const srt_hmap *src)
 	/* Target cleanup, before the copy */
 	shm_clear(*hm);
 	/* Make room for the copy */
+	if (min_alloc_size > tgt0_cas && sd_spill_enabled(&(*hm)->d)) {
+		/* Stack-allocated, with spill enabled: move to the heap */
+		tgt0_cas = S_MAX(src0_cas, min_alloc_size);
+		RETURN_IF(!sd_spill((srt_data **)hm, tgt0_cas), S_FALSE);
+		spill = S_TRUE;
+	}
 	if ((*hm)->d.f.ext_buffer) {
 		/* Using stack-allocated: check for enough space */
 		RETURN_IF(min_alloc_size > tgt0_cas, S_FALSE);
@@ -652,7 +832,8 @@ static srt_bool shm_cpy_reconfig(srt_hmap **hm, const srt_hmap *src)
 	} else {
 		/* Check if requiring extra expace */
 		if (min_alloc_size > tgt0_cas) {
-			hra = (srt_hmap *)s_realloc(*hm, src0_cas);
+			hra = (srt_hmap *)sd_mem_realloc((*hm)->d.alloc_id, *hm,
+							  src0_cas);
 			RETURN_IF(!hra, S_FALSE);
 			*hm = hra;
 			(*hm)->d.max_size = (src0_cas - hdr_size) / es;
@@ -664,6 +845,10 @@ static srt_bool shm_cpy_reconfig(srt_hmap **hm, const srt_hmap *src)
 	}
 	(*hm)->d.header_size = hdr_size;
 	(*hm)->hbits = (uint32_t)hbits;
+	if (spill)
+		sst_on_alloc((srt_data *)*hm);
+	else if (hra)
+		sst_on_resize((srt_data *)*hm, tgt0_cas, min_alloc_size);
 	return S_TRUE;
 }
 
@@ -672,14 +857,7 @@ srt_hmap *shm_cpy(srt_hmap **hm, const srt_hmap *src)
 	uint8_t t;
 	uint8_t *data_tgt;
 	const uint8_t *data_src;
-	size_t i, hs, hdr0_size, es, ss;
-	struct SHMapS *h_s;
-	struct SHMapIS *h_is;
-	struct SHMapSI *h_si;
-	struct SHMapSP *h_sp;
-	struct SHMapSS *h_ss;
-	struct SHMapDS *h_ds;
-	struct SHMapSD *h_sd;
+	size_t hs, hdr0_size, es, ss;
 	RETURN_IF(!hm || !src, NULL); /* BEHAVIOR */
 	RETURN_IF(*hm == src, *hm);
 	t = src->d.sub_type;
@@ -693,6 +871,8 @@ srt_hmap *shm_cpy(srt_hmap **hm, const srt_hmap *src)
 	} else {
 		*hm = shm_alloc_aux(t, ss);
 		RETURN_IF(!*hm, NULL); /* BEHAVIOR: allocation error */
+		if (shm_pool(src))
+			shm_set_string_pool(*hm, S_TRUE);
 	}
 	RETURN_IF(shm_max_size(*hm) < ss, *hm); /* BEHAVIOR: not enough space */
 	/* Copy data */
@@ -702,45 +882,7 @@ srt_hmap *shm_cpy(srt_hmap **hm, const srt_hmap *src)
 	memcpy(data_tgt, data_src, es * ss);
 	shm_set_size(*hm, ss);
 	/* cases potentially requiring adaptation */
-	switch (t) {
-	case SHM0_S:
-		h_s = (struct SHMapS *)data_tgt;
-		for (i = 0; i < ss; i++)
-			sso_dupa1(&h_s[i].k);
-		break;
-	case SHM0_IS:
-		h_is = (struct SHMapIS *)data_tgt;
-		for (i = 0; i < ss; sso_dupa1(&h_is[i++].v))
-			;
-		break;
-	case SHM0_SP:
-		h_sp = (struct SHMapSP *)data_tgt;
-		for (i = 0; i < ss; sso_dupa1(&h_sp[i++].x.k))
-			;
-		break;
-	case SHM0_SI:
-		h_si = (struct SHMapSI *)data_tgt;
-		for (i = 0; i < ss; sso_dupa1(&h_si[i++].x.k))
-			;
-		break;
-	case SHM0_SS:
-		h_ss = (struct SHMapSS *)data_tgt;
-		for (i = 0; i < ss; sso_dupa(&h_ss[i++].kv))
-			;
-		break;
-	case SHM0_DS:
-		h_ds = (struct SHMapDS *)data_tgt;
-		for (i = 0; i < ss; sso_dupa1(&h_ds[i++].v))
-			;
-		break;
-	case SHM0_SD:
-		h_sd = (struct SHMapSD *)data_tgt;
-		for (i = 0; i < ss; sso_dupa1(&h_sd[i++].x.k))
-			;
-		break;
-	default:
-		break;
-	}
+	aux_sso_dupa(*hm, shm_pool(*hm), S_FALSE);
 	/* rehash */
 	if ((*hm)->d.header_size == src->d.header_size) {
 		/* Same header size: hash table buckets bulk copy */
@@ -755,11 +897,129 @@ srt_hmap *shm_cpy(srt_hmap **hm, const srt_hmap *src)
 	return *hm;
 }
 
+/*
+ * String pool
+ */
+
+srt_bool shm_set_string_pool(srt_hmap *hm, srt_bool enable)
+{
+	srt_bool two;
+	srt_arena *pool;
+	RETURN_IF(!hm || hm == shm_void, S_FALSE);
+	if (!enable) {
+		if (hm->pool) {
+			aux_sso_dupa(hm, NULL, S_FALSE);
+			sa_free(&hm->pool);
+		}
+		return S_TRUE;
+	}
+	RETURN_IF(hm->pool, S_TRUE);
+#ifdef S_ENABLE_SM_STRING_OPTIMIZATION
+	RETURN_IF(hm->d.f.ext_buffer
+			  || aux_sso_off(hm->d.sub_type, &two) == S_NPOS,
+		  S_FALSE);
+	pool = sa_alloc(0);
+	RETURN_IF(!pool, S_FALSE); /* BEHAVIOR: not enough memory */
+	aux_sso_dupa(hm, pool, S_TRUE);
+	hm->pool = pool;
+	return S_TRUE;
+#else
+	(void)two;
+	(void)pool;
+	return S_FALSE;
+#endif
+}
+
+void shm_shrink_string_pool(srt_hmap *hm)
+{
+	if (shm_pool(hm))
+		aux_pool_move(hm);
+}
+
+size_t shm_string_pool_size(const srt_hmap *hm)
+{
+	srt_arena *pool = shm_pool(hm);
+	return pool ? sa_alloc_size(pool) : 0;
+}
+
+/*
+ * Persistence
+ */
+
+/* Types without strings or pointers (suitable for store/restore) */
+static srt_bool shm_flat_t(int t)
+{
+	switch (t) {
+	case SHM0_II32:
+	case SHM0_UU32:
+	case SHM0_II:
+	case SHM0_I32:
+	case SHM0_U32:
+	case SHM0_I:
+	case SHM0_FF:
+	case SHM0_DD:
+	case SHM0_F:
+	case SHM0_D:
+		return S_TRUE;
+	default:
+		break;
+	}
+	return S_FALSE;
+}
+
+static srt_bool shm_image_chk(srt_hmap *hm)
+{
+	int t = hm->d.sub_type;
+	uint64_t nb;
+	hm->pool = NULL; /* BEHAVIOR: stored images have no string pool */
+	RETURN_IF(!shm_flat_t(t) || hm->d.elem_size != shm_elem_size(t)
+			  || hm->hbits < 1 || hm->hbits > 32
+			  || hm->d.size > SHM_MAX_ELEMS,
+		  S_FALSE);
+	nb = (uint64_t)1 << hm->hbits;
+	return hm->d.header_size == sh_hdr_size(t, nb)
+			       && hm->hmask == (uint32_t)(nb - 1)
+			       && hm->rh_threshold <= nb
+		       ? S_TRUE
+		       : S_FALSE;
+}
+
+srt_bool shm_save(FILE *f, const srt_hmap *hm)
+{
+	RETURN_IF(!hm || !shm_flat_t(hm->d.sub_type), S_FALSE);
+	return sd_image_save(f, (const srt_data *)hm, SD_IMAGE_HMAP,
+			     sizeof(srt_hmap));
+}
+
+srt_hmap *shm_load(FILE *f)
+{
+	srt_hmap *hm =
+		(srt_hmap *)sd_image_load(f, SD_IMAGE_HMAP, sizeof(srt_hmap));
+	/* BEHAVIOR: invalid image: raw release (no type-specific free) */
+	if (hm && !shm_image_chk(hm))
+		sd_free((srt_data **)&hm);
+	return hm;
+}
+
+srt_hmap *shm_map(const char *path)
+{
+	srt_hmap *hm =
+		(srt_hmap *)sd_image_map(path, SD_IMAGE_HMAP, sizeof(srt_hmap));
+	if (hm && !shm_image_chk(hm))
+		shm_unmap(&hm);
+	return hm;
+}
+
+void shm_unmap(srt_hmap **hm)
+{
+	sd_image_unmap((srt_data **)hm);
+}
+
 /*
  * Insert
  */
 
-typedef void (*shm_set1_f)(void *loc, const void *key);
+typedef void (*shm_set1_f)(void *loc, const void *key, srt_arena *pool);
 
 static srt_bool shm_insert1(srt_hmap **hm, int t, const void *k, uint32_t h32,
 			    shm_set1_f setf)
@@ -774,12 +1034,13 @@ static srt_bool shm_insert1(srt_hmap **hm, int t, const void *k, uint32_t h32,
 		aux_reg_hash(*hm, k, h32, (shm_eloc_t_)i);
 		shm_set_size(*hm, i + 1);
 		l = shm_get_buffer(*hm) + i * (*hm)->d.elem_size;
+		setf(l, k, (*hm)->pool);
 	}
-	setf(l, k);
 	return S_TRUE;
 }
 
-typedef void (*shm_set_f)(void *loc, const void *key, const void *value);
+typedef void (*shm_set_f)(void *loc, const void *key, const void *value,
+			  srt_arena *pool);
 
 static srt_bool shm_insert(srt_hmap **hm, int t, const void *k, uint32_t h32,
 			   const void *v, shm_set_f setf)
@@ -794,8 +1055,10 @@ static srt_bool shm_insert(srt_hmap **hm, int t, const void *k, uint32_t h32,
 		aux_reg_hash(*hm, k, h32, (shm_eloc_t_)i);
 		shm_set_size(*hm, i + 1);
 		l = shm_get_buffer(*hm) + i * (*hm)->d.elem_size;
+	} else {
+		shm_ctx[t].delf(l); /* overwrite: release previous strings */
 	}
-	setf(l, k, v);
+	setf(l, k, v, (*hm)->pool);
 	return S_TRUE;
 }
 
@@ -1056,3 +1319,129 @@ BUILD_SHM_ITP_X(shm_itp_ss, SHM_SS, struct SHMapSS, srt_hmap_it_ss,
 		f(sso_get(&e->kv), sso_get_s2(&e->kv), context))
 BUILD_SHM_ITP_X(shm_itp_sp, SHM_SP, struct SHMapSP, srt_hmap_it_sp,
 		f(sso1_get((const srt_stringo1 *)&e->x.k), e->v, context))
+
+/*
+ * Set algebra
+ */
+
+static shm_set1_f shm_set1_t(int t)
+{
+	switch (t) {
+	case SHM0_I32:
+		return shmcb_set_i32;
+	case SHM0_U32:
+		return shmcb_set_u32;
+	case SHM0_I:
+		return shmcb_set_i64;
+	case SHM0_F:
+		return shmcb_set_f;
+	case SHM0_D:
+		return shmcb_set_d;
+	case SHM0_S:
+		return shmcb_set_s;
+	default:
+		return NULL;
+	}
+}
+
+/* Output set reuse (same type) or allocation */
+static srt_hmap *shm_so_out(srt_hmap *o, int t, size_t n)
+{
+	if (o && !shm_chk_t(o, t))
+		shm_free(&o);
+	if (!o)
+		return shm_alloc_aux(t, n);
+	shm_clear(o);
+	shm_reserve(&o, n);
+	return o;
+}
+
+/* Insert 'src' elements found (or not found) in 'q' (NULL: all) */
+static srt_bool shm_so_ins(srt_hmap **o, const srt_hmap *src,
+			   const srt_hmap *q, srt_bool found, shm_set1_f setf)
+{
+	uint32_t h;
+	const void *k;
+	const uint8_t *e, *ee;
+	int t = src->d.sub_type;
+	size_t es = src->d.elem_size;
+	e = shm_get_buffer_r(src);
+	ee = e + es * shm_size(src);
+	for (; e < ee; e += es) {
+		h = shm_ctx[t].hashf(e);
+		k = shm_ctx[t].n2kf(e);
+		if (q && (shm_at(q, h, k, NULL) != NULL) != found)
+			continue;
+		if (!shm_insert1(o, t, k, h, setf))
+			return S_FALSE;
+	}
+	return S_TRUE;
+}
+
+/* Delete 'src' elements */
+static void shm_so_del(srt_hmap *o, const srt_hmap *src)
+{
+	const uint8_t *e, *ee;
+	int t = src->d.sub_type;
+	size_t es = src->d.elem_size;
+	e = shm_get_buffer_r(src);
+	ee = e + es * shm_size(src);
+	for (; e < ee; e += es)
+		del(o, shm_ctx[t].hashf(e), shm_ctx[t].n2kf(e));
+}
+
+srt_hmap *shm_set_op(srt_hmap **s, const srt_hmap *a, const srt_hmap *b,
+		     int op)
+{
+	int t;
+	srt_hmap *o;
+	shm_set1_f setf;
+	const srt_hmap *p, *q;
+	srt_bool alias, ok;
+	RETURN_IF(!s || !a || !b, NULL);
+	t = a->d.sub_type;
+	setf = shm_set1_t(t);
+	RETURN_IF(!setf || !shm_chk_t(b, t), NULL); /* BEHAVIOR */
+	alias = *s == a || *s == b;
+	p = shm_size(a) <= shm_size(b) ? a : b; /* smaller set */
+	q = p == a ? b : a;
+	/*
+	 * Union: the smaller set is inserted into a copy of the larger one,
+	 * or the other set into the output, when it is one of the inputs
+	 */
+	if (op == SHM_SO_UNION) {
+		if (alias) {
+			p = *s == a ? b : a;
+		} else {
+			RETURN_IF(!shm_cpy(s, q), NULL);
+		}
+		return shm_so_ins(s, p, NULL, S_TRUE, setf) ? *s : NULL;
+	}
+	/*
+	 * Difference, large minuend: delete subtrahend elements, in place
+	 * or from a copy
+	 */
+	if (op == SHM_SO_DIFF && a != b
+	    && (*s == a || (!alias && shm_size(a) > shm_size(b)))) {
+		if (*s != a) {
+			RETURN_IF(!shm_cpy(s, a), NULL);
+		}
+		shm_so_del(*s, b);
+		return *s;
+	}
+	/*
+	 * Intersection, or difference with small minuend: probe the elements
+	 * against the other set
+	 */
+	if (op == SHM_SO_DIFF) {
+		p = a;
+		q = b;
+	}
+	o = shm_so_out(alias ? NULL : *s, t, shm_size(p));
+	ok = o ? shm_so_ins(&o, p, q, op == SHM_SO_INTERSECT, setf) : S_FALSE;
+	if (alias && o)
+		shm_free(s);
+	if (!alias || o)
+		*s = o;
+	return ok ? o : NULL;
+}
@@ -72,12 +72,21 @@ extern "C" {
  * #DOC	typedef srt_bool (*srt_hmap_it_ss)(const srt_string *, const srt_string *, void *context);
  * #DOC
  * #DOC	typedef srt_bool (*srt_hmap_it_sp)(const srt_string *, const void *, void *context);
+ * #DOC
+ * #DOC
+ * #DOC String pool (shm_set_string_pool()): strings not fitting into the
+ * #DOC node are stored in a map-owned arena instead of one heap allocation
+ * #DOC per string, so insert avoids malloc() calls, and clear/free are
+ * #DOC O(number of arena chunks) instead of O(n). Space of deleted and
+ * #DOC overwritten strings is recovered on rehash, or explicitly with
+ * #DOC shm_shrink_string_pool().
  *
  * Copyright (c) 2015-2020 F. Aragon. All rights reserved.
  * Released under the BSD 3-Clause License (see the doc/LICENSE)
  */
 
 #include "saux/scommon.h"
+#include "sarena.h"
 #include "saux/sstringo.h"
 
 /*
@@ -232,6 +241,7 @@ struct S_HMap {
 	uint32_t hmask; /* hash table bitmask */
 	size_t rh_threshold; /* (1 << hbits) * rh_threshold_pct) / 100 */
 	size_t rh_threshold_pct;
+	srt_arena *pool; /* string pool (NULL: per-node heap strings) */
 };
 
 /*
@@ -347,6 +357,7 @@ srt_hmap *shm_alloc_raw(int t, srt_bool ext_buf, void *buffer, size_t hdr_size,
 			size_t elem_size, size_t max_size, size_t np2_size);
 
 srt_hmap *shm_alloc_aux(int t, size_t init_size);
+srt_hmap *shm_alloc_aux_a(const srt_allocator *a, int t, size_t init_size);
 
 /* #api: |allocate hash map (heap)|hash map type; initial reserve|hmap|O(n)|1;2| */
 S_INLINE srt_hmap *shm_alloc(enum eSHM_Type t, size_t init_size)
@@ -354,6 +365,13 @@ S_INLINE srt_hmap *shm_alloc(enum eSHM_Type t, size_t init_size)
 	return shm_alloc_aux((int)t, init_size);
 }
 
+/* #API: |Allocate hash map (heap) using the given allocator|allocator (NULL: global allocator); hash map type; initial reserve|hmap|O(n)|1;2| */
+S_INLINE srt_hmap *shm_alloc_a(const srt_allocator *a, enum eSHM_Type t,
+			       size_t init_size)
+{
+	return shm_alloc_aux_a(a, (int)t, init_size);
+}
+
 SD_BUILDFUNCS_FULL_ST(shm, srt_hmap, 0)
 
 /*
@@ -366,6 +384,12 @@ size_t shm_reserve(srt_hmap **hm, size_t max_elems)
 #API: |Make the hmap use the minimum possible memory|hmap|hmap reference (optional usage)|O(1) for allocators using memory remap; O(n) for naive allocators|1;2|
 srt_hmap *shm_shrink(srt_hmap **hm);
 
+#API: |Set growth policy (SD_GROW_DEFAULT, SD_GROW_EXACT, SD_GROW_DOUBLE, SD_GROW_HALF, SD_GROW_LINEAR, optionally combined with SD_GROW_PAGE, SD_GROW_SHRINK, and/or SD_GROW_SPILL -for stack-allocated ones-)|hash map;growth policy|-|O(1)|1;2|
+void shm_set_grow_policy(srt_hmap *hm, int policy)
+
+#API: |Get growth policy|hash map|growth policy|O(1)|1;2|
+int shm_grow_policy(const srt_hmap *hm)
+
 #API: |Get hmap size|hmap|Hash map number of elements|O(1)|1;2|
 size_t shm_size(const srt_hmap *hm);
 
@@ -406,6 +430,44 @@ void shm_free_aux(srt_hmap **s, ...);
 /* #API: |Overwrite map with a map copy|output hash map; input map|output map reference (optional usage)|O(n)|0;1| */
 srt_hmap *shm_cpy(srt_hmap **hm, const srt_hmap *src);
 
+/*
+ * Set algebra (see shset.h)
+ */
+
+enum eSHM_SetOp { SHM_SO_UNION, SHM_SO_INTERSECT, SHM_SO_DIFF };
+
+/* #NOTAPI: |Set union/intersection/difference|output set (it can be one of the inputs); set; set; operation (SHM_SO_UNION, SHM_SO_INTERSECT, SHM_SO_DIFF)|output set (NULL: set type mismatch, or not enough memory)|O(n + m) for the union; O(min(n, m)) for the intersection; O(n) or O(m) for the difference|1;2| */
+srt_hmap *shm_set_op(srt_hmap **s, const srt_hmap *a, const srt_hmap *b, int op);
+
+/*
+ * String pool
+ */
+
+/* #API: |Enable/disable the string pool (string key/value maps): strings not fitting into the node are stored in a map-owned arena; stored strings are moved|hash map; S_TRUE: enable, S_FALSE: disable|S_TRUE: OK; S_FALSE: not supported (map without strings, stack-allocated map, string optimization disabled) or not enough memory|O(n)|1;2| */
+srt_bool shm_set_string_pool(srt_hmap *hm, srt_bool enable);
+
+/* #API: |Release string pool space of deleted and overwritten strings (it is also done automatically on rehash)|hash map|-|O(n)|1;2| */
+void shm_shrink_string_pool(srt_hmap *hm);
+
+/* #API: |Get string pool allocated space|hash map|bytes (0: no string pool)|O(1)|1;2| */
+size_t shm_string_pool_size(const srt_hmap *hm);
+
+/*
+ * Persistence (store/restore)
+ */
+
+/* #API: |Save hmap image to file (integer and floating point key/value maps and sets, i.e. not having strings or pointers)|file handle; hmap|S_TRUE: OK; S_FALSE: I/O error or unsupported hmap type|O(n): WARNING: involves external file I/O|1;2| */
+srt_bool shm_save(FILE *f, const srt_hmap *hm);
+
+/* #API: |Load hmap image from file|file handle|hmap (NULL: I/O error, not enough memory, or invalid/incompatible image)|O(n): WARNING: involves external file I/O|1;2| */
+srt_hmap *shm_load(FILE *f);
+
+/* #API: |Open hmap image file using memory mapping (no deserialization: the mapped file is used as fixed-size hmap; changes are not written back to the file)|file path|hmap (NULL: I/O error, invalid/incompatible image, or system without mmap() support)|O(1)|1;2| */
+srt_hmap *shm_map(const char *path);
+
+/* #API: |Release hmap opened with shm_map()|hmap|-|O(1)|1;2| */
+void shm_unmap(srt_hmap **hm);
+
 /*
  * Random access
  */
@@ -642,22 +704,22 @@ srt_bool shm_inc_sd(srt_hmap **hm, const srt_string *k, double v);
  * Delete
  */
 
-/* #API: |Delete map element (SHM_II32)|hash map; key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized|1;2| */
+/* #API: |Delete map element (SHM_II32)|hash map; key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized (with SD_GROW_SHRINK, the delete halving the bucket table rehashes all elements)|1;2| */
 srt_bool shm_delete_i32(srt_hmap *hm, int32_t k);
 
-/* #API: |Delete map element (SHM_UU32)|hash map; key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized|1;2| */
+/* #API: |Delete map element (SHM_UU32)|hash map; key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized (with SD_GROW_SHRINK, the delete halving the bucket table rehashes all elements)|1;2| */
 srt_bool shm_delete_u32(srt_hmap *hm, uint32_t k);
 
-/* #API: |Delete map element (SHM_I*)|hash map; key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized|1;2| */
+/* #API: |Delete map element (SHM_I*)|hash map; key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized (with SD_GROW_SHRINK, the delete halving the bucket table rehashes all elements)|1;2| */
 srt_bool shm_delete_i(srt_hmap *hm, int64_t k);
 
-/* #API: |Delete map element (SHM_FF)|hash map; key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized|1;2| */
+/* #API: |Delete map element (SHM_FF)|hash map; key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized (with SD_GROW_SHRINK, the delete halving the bucket table rehashes all elements)|1;2| */
 srt_bool shm_delete_f(srt_hmap *hm, float k);
 
-/* #API: |Delete map element (SHM_D*)|hash map; key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized|1;2| */
+/* #API: |Delete map element (SHM_D*)|hash map; key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized (with SD_GROW_SHRINK, the delete halving the bucket table rehashes all elements)|1;2| */
 srt_bool shm_delete_d(srt_hmap *hm, double k);
 
-/* #API: |Delete map element (SHM_S*)|hash map; key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized|1;2| */
+/* #API: |Delete map element (SHM_S*)|hash map; key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized (with SD_GROW_SHRINK, the delete halving the bucket table rehashes all elements)|1;2| */
 srt_bool shm_delete_s(srt_hmap *hm, const srt_string *k);
 
 /*
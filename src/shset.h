@@ -82,6 +82,13 @@ S_INLINE srt_hset *shs_alloc(enum eSHS_Type t, size_t init_size)
 	return shm_alloc_aux((int)t, init_size);
 }
 
+/* #API: |Allocate hash set (heap) using the given allocator|allocator (NULL: global allocator); set type; initial reserve|hash set|O(n)|1;2| */
+S_INLINE srt_hset *shs_alloc_a(const srt_allocator *a, enum eSHS_Type t,
+			       size_t init_size)
+{
+	return shm_alloc_aux_a(a, (int)t, init_size);
+}
+
 /* #API: |Ensure space for extra elements|hash set;number of extra elements|extra size allocated|O(1)|1;2| */
 S_INLINE size_t shs_grow(srt_hset **hs, size_t extra_elems)
 {
@@ -100,6 +107,18 @@ S_INLINE srt_hset *shs_shrink(srt_hset **hs)
 	return shm_shrink(hs);
 }
 
+/* #API: |Set growth policy (SD_GROW_DEFAULT, SD_GROW_EXACT, SD_GROW_DOUBLE, SD_GROW_HALF, SD_GROW_LINEAR, optionally combined with SD_GROW_PAGE, SD_GROW_SHRINK, and/or SD_GROW_SPILL -for stack-allocated ones-)|hash set;growth policy|-|O(1)|1;2| */
+S_INLINE void shs_set_grow_policy(srt_hset *hs, int policy)
+{
+	shm_set_grow_policy(hs, policy);
+}
+
+/* #API: |Get growth policy|hash set|growth policy|O(1)|1;2| */
+S_INLINE int shs_grow_policy(const srt_hset *hs)
+{
+	return shm_grow_policy(hs);
+}
+
 /* #API: |Get hmap size|map|hash set number of elements|O(1)|1;2| */
 S_INLINE size_t shs_size(const srt_hset *hs)
 {
@@ -162,6 +181,28 @@ S_INLINE srt_hset *shs_cpy(srt_hset **hs, const srt_hset *src)
 	return shm_cpy(hs, src);
 }
 
+/*
+ * String pool
+ */
+
+/* #API: |Enable/disable the string pool (SHS_S): strings not fitting into the node are stored in a set-owned arena|hash set; S_TRUE: enable, S_FALSE: disable|S_TRUE: OK; S_FALSE: not supported or not enough memory|O(n)|1;2| */
+S_INLINE srt_bool shs_set_string_pool(srt_hset *hs, srt_bool enable)
+{
+	return shm_set_string_pool(hs, enable);
+}
+
+/* #API: |Release string pool space of deleted strings|hash set|-|O(n)|1;2| */
+S_INLINE void shs_shrink_string_pool(srt_hset *hs)
+{
+	shm_shrink_string_pool(hs);
+}
+
+/* #API: |Get string pool allocated space|hash set|bytes (0: no string pool)|O(1)|1;2| */
+S_INLINE size_t shs_string_pool_size(const srt_hset *hs)
+{
+	return shm_string_pool_size(hs);
+}
+
 /*
  * Existence check
  */
@@ -246,42 +287,69 @@ S_INLINE srt_bool shs_insert_s(srt_hset **hs, const srt_string *k)
  * Delete
  */
 
-/* #API: |Delete map element (SHS_U32)|hash set; int32_t key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized|1;2| */
+/* #API: |Delete map element (SHS_U32)|hash set; int32_t key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized (with SD_GROW_SHRINK, the delete halving the bucket table rehashes all elements)|1;2| */
 S_INLINE srt_bool shs_delete_u32(srt_hset *hs, uint32_t k)
 {
 	return shm_delete_u32(hs, k);
 }
 
-/* #API: |Delete map element (SHS_I32)|hash set; int32_t key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized|1;2| */
+/* #API: |Delete map element (SHS_I32)|hash set; int32_t key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized (with SD_GROW_SHRINK, the delete halving the bucket table rehashes all elements)|1;2| */
 S_INLINE srt_bool shs_delete_i32(srt_hset *hs, int32_t k)
 {
 	return shm_delete_i32(hs, k);
 }
 
-/* #API: |Delete map element (SHS_I)|hash set; int64_t key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized|1;2| */
+/* #API: |Delete map element (SHS_I)|hash set; int64_t key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized (with SD_GROW_SHRINK, the delete halving the bucket table rehashes all elements)|1;2| */
 S_INLINE srt_bool shs_delete_i(srt_hset *hs, int64_t k)
 {
 	return shm_delete_i(hs, k);
 }
 
-/* #API: |Delete map element (SHS_F)|hash set; float key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized|1;2| */
+/* #API: |Delete map element (SHS_F)|hash set; float key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized (with SD_GROW_SHRINK, the delete halving the bucket table rehashes all elements)|1;2| */
 S_INLINE srt_bool shs_delete_f(srt_hset *hs, float k)
 {
 	return shm_delete_f(hs, k);
 }
 
-/* #API: |Delete map element (SHS_D)|hash set; double key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized|1;2| */
+/* #API: |Delete map element (SHS_D)|hash set; double key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized (with SD_GROW_SHRINK, the delete halving the bucket table rehashes all elements)|1;2| */
 S_INLINE srt_bool shs_delete_d(srt_hset *hs, double k)
 {
 	return shm_delete_d(hs, k);
 }
 
-/* #API: |Delete map element (SHS_S)|hash set; string key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized|1;2| */
+/* #API: |Delete map element (SHS_S)|hash set; string key|S_TRUE: found and deleted; S_FALSE: not found|O(n), O(1) average amortized (with SD_GROW_SHRINK, the delete halving the bucket table rehashes all elements)|1;2| */
 S_INLINE srt_bool shs_delete_s(srt_hset *hs, const srt_string *k)
 {
 	return shm_delete_s(hs, k);
 }
 
+/*
+ * Set algebra
+ *
+ * The smaller set is probed against the larger one (the union inserts the
+ * smaller set into a copy of the larger one), and when the output is one
+ * of the inputs, the union and the difference are done in place.
+ */
+
+/* #API: |Union (elements in a or b)|output set (it can be one of the inputs); set a; set b (same type)|output set (NULL: set type mismatch or not enough memory)|O(n + m); O(m) in place (m: size of the set not being the output)|1;2| */
+S_INLINE srt_hset *shs_union(srt_hset **s, const srt_hset *a, const srt_hset *b)
+{
+	return shm_set_op(s, a, b, SHM_SO_UNION);
+}
+
+/* #API: |Intersection (elements in both a and b)|output set (it can be one of the inputs); set a; set b (same type)|output set (NULL: set type mismatch or not enough memory)|O(min(n, m))|1;2| */
+S_INLINE srt_hset *shs_intersect(srt_hset **s, const srt_hset *a,
+				 const srt_hset *b)
+{
+	return shm_set_op(s, a, b, SHM_SO_INTERSECT);
+}
+
+/* #API: |Difference (elements in a but not in b)|output set (it can be one of the inputs); set a; set b (same type)|output set (NULL: set type mismatch or not enough memory)|O(m) in place (output set a; m: size of b); O(n) when a is the smaller set (n: size of a); O(n + m) otherwise|1;2| */
+S_INLINE srt_hset *shs_diff(srt_hset **s, const srt_hset *a, const srt_hset *b)
+{
+	return shm_set_op(s, a, b, SHM_SO_DIFF);
+}
+
 /*
  * Enumeration
  */
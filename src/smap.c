@@ -9,6 +9,7 @@
 
 #include "smap.h"
 #include "saux/scommon.h"
+#include "saux/sdimage.h"
 
 /*
  * Internal constants
@@ -19,6 +20,7 @@ struct SMapCtx {
 	st_traverse sort_tr;
 	srt_tree_callback delete_callback;
 	srt_cmp cmpf;
+	enum eST_KeyType kt; /* inline key comparison for numeric keys */
 };
 
 /*
@@ -37,6 +39,22 @@ BUILD_SMAP_CMP(cmp_I, struct SMapI)
 BUILD_SMAP_CMP(cmp_F, struct SMapF)
 BUILD_SMAP_CMP(cmp_D, struct SMapD)
 
+/* Bulk load sort: same key nodes keep the input order (r: input index) */
+#define BUILD_SMAP_BULK_CMP(FN, T)                                             \
+	static int FN(const void *a, const void *b)                            \
+	{                                                                      \
+		const T *x = (const T *)a, *y = (const T *)b;                  \
+		if (x->k != y->k)                                              \
+			return x->k > y->k ? 1 : -1;                           \
+		return x->n.r > y->n.r ? 1 : x->n.r < y->n.r ? -1 : 0;         \
+	}
+
+BUILD_SMAP_BULK_CMP(cmp_bulk_i, struct SMapi)
+BUILD_SMAP_BULK_CMP(cmp_bulk_u, struct SMapu)
+BUILD_SMAP_BULK_CMP(cmp_bulk_I, struct SMapI)
+BUILD_SMAP_BULK_CMP(cmp_bulk_F, struct SMapF)
+BUILD_SMAP_BULK_CMP(cmp_bulk_D, struct SMapD)
+
 static int cmp_s(const struct SMapS *a, const struct SMapS *b)
 {
 	return ss_cmp(sso_get((const srt_stringo *)&a->k),
@@ -259,25 +277,44 @@ static int aux_sp_sort(struct STraverseParams *tp)
 }
 
 const struct SMapCtx sm_ctx[SM0_NumTypes] = {
-	{SV_I32, SV_I32, aux_ii32_sort, NULL, (srt_cmp)cmp_i}, /*SM0_II32*/
-	{SV_U32, SV_U32, aux_uu32_sort, NULL, (srt_cmp)cmp_u}, /*SM0_UU32*/
-	{SV_I64, SV_I64, aux_ii_sort, NULL, (srt_cmp)cmp_I},   /*SM0_II*/
-	{SV_I64, SV_GEN, aux_is_sort, aux_is_delete, (srt_cmp)cmp_I}, /*SM0_IS*/
-	{SV_I64, SV_GEN, aux_ip_sort, NULL, (srt_cmp)cmp_I},	  /*SM0_IP*/
-	{SV_GEN, SV_I64, aux_si_sort, aux_sx_delete, (srt_cmp)cmp_s}, /*SM0_SI*/
-	{SV_GEN, SV_GEN, aux_ss_sort, aux_ss_delete, (srt_cmp)cmp_s}, /*SM0_SS*/
-	{SV_GEN, SV_GEN, aux_sp_sort, aux_sx_delete, (srt_cmp)cmp_s}, /*SM0_SP*/
-	{SV_I64, SV_I64, aux_i_sort, NULL, (srt_cmp)cmp_I},	   /*SM0_I*/
-	{SV_I32, SV_I32, aux_i32_sort, NULL, (srt_cmp)cmp_i},	/*SM0_I32*/
-	{SV_U32, SV_U32, aux_u32_sort, NULL, (srt_cmp)cmp_u},	/*SM0_U32*/
-	{SV_GEN, SV_GEN, aux_s_sort, aux_sx_delete, (srt_cmp)cmp_s}, /*SM0_S*/
-	{SV_F, SV_F, aux_f_sort, NULL, (srt_cmp)cmp_F},		     /*SM0_F*/
-	{SV_D, SV_D, aux_d_sort, NULL, (srt_cmp)cmp_D},		     /*SM0_D*/
-	{SV_F, SV_F, aux_ff_sort, NULL, (srt_cmp)cmp_F},	     /*SM0_FF*/
-	{SV_D, SV_D, aux_dd_sort, NULL, (srt_cmp)cmp_D},	     /*SM0_DD*/
-	{SV_D, SV_GEN, aux_dp_sort, NULL, (srt_cmp)cmp_D},	   /*SM0_DP*/
-	{SV_D, SV_GEN, aux_ds_sort, aux_ds_delete, (srt_cmp)cmp_D},  /*SM0_DS*/
-	{SV_GEN, SV_D, aux_sd_sort, aux_sx_delete, (srt_cmp)cmp_s}}; /*SM0_SD*/
+	/* SM0_II32 */
+	{SV_I32, SV_I32, aux_ii32_sort, NULL, (srt_cmp)cmp_i, ST_KT_I32},
+	/* SM0_UU32 */
+	{SV_U32, SV_U32, aux_uu32_sort, NULL, (srt_cmp)cmp_u, ST_KT_U32},
+	/* SM0_II */
+	{SV_I64, SV_I64, aux_ii_sort, NULL, (srt_cmp)cmp_I, ST_KT_I64},
+	/* SM0_IS */
+	{SV_I64, SV_GEN, aux_is_sort, aux_is_delete, (srt_cmp)cmp_I, ST_KT_I64},
+	/* SM0_IP */
+	{SV_I64, SV_GEN, aux_ip_sort, NULL, (srt_cmp)cmp_I, ST_KT_I64},
+	/* SM0_SI */
+	{SV_GEN, SV_I64, aux_si_sort, aux_sx_delete, (srt_cmp)cmp_s, ST_KT_GEN},
+	/* SM0_SS */
+	{SV_GEN, SV_GEN, aux_ss_sort, aux_ss_delete, (srt_cmp)cmp_s, ST_KT_GEN},
+	/* SM0_SP */
+	{SV_GEN, SV_GEN, aux_sp_sort, aux_sx_delete, (srt_cmp)cmp_s, ST_KT_GEN},
+	/* SM0_I */
+	{SV_I64, SV_I64, aux_i_sort, NULL, (srt_cmp)cmp_I, ST_KT_I64},
+	/* SM0_I32 */
+	{SV_I32, SV_I32, aux_i32_sort, NULL, (srt_cmp)cmp_i, ST_KT_I32},
+	/* SM0_U32 */
+	{SV_U32, SV_U32, aux_u32_sort, NULL, (srt_cmp)cmp_u, ST_KT_U32},
+	/* SM0_S */
+	{SV_GEN, SV_GEN, aux_s_sort, aux_sx_delete, (srt_cmp)cmp_s, ST_KT_GEN},
+	/* SM0_F */
+	{SV_F, SV_F, aux_f_sort, NULL, (srt_cmp)cmp_F, ST_KT_F},
+	/* SM0_D */
+	{SV_D, SV_D, aux_d_sort, NULL, (srt_cmp)cmp_D, ST_KT_D},
+	/* SM0_FF */
+	{SV_F, SV_F, aux_ff_sort, NULL, (srt_cmp)cmp_F, ST_KT_F},
+	/* SM0_DD */
+	{SV_D, SV_D, aux_dd_sort, NULL, (srt_cmp)cmp_D, ST_KT_D},
+	/* SM0_DP */
+	{SV_D, SV_GEN, aux_dp_sort, NULL, (srt_cmp)cmp_D, ST_KT_D},
+	/* SM0_DS */
+	{SV_D, SV_GEN, aux_ds_sort, aux_ds_delete, (srt_cmp)cmp_D, ST_KT_D},
+	/* SM0_SD */
+	{SV_GEN, SV_D, aux_sd_sort, aux_sx_delete, (srt_cmp)cmp_s, ST_KT_GEN}};
 
 S_INLINE srt_cmp type2cmpf(enum eSM_Type0 t)
 {
@@ -322,35 +359,98 @@ S_INLINE srt_bool sm_chk_dx(const srt_map *m)
 	       || sm_chk_t(m, SM0_DP);
 }
 
+/* Types supporting the B+tree index (integer keys) */
+static srt_bool sm_bt_t(int t)
+{
+	switch (t) {
+	case SM0_II32:
+	case SM0_UU32:
+	case SM0_II:
+	case SM0_IS:
+	case SM0_IP:
+	case SM0_I:
+	case SM0_I32:
+	case SM0_U32:
+		return S_TRUE;
+	default:
+		break;
+	}
+	return S_FALSE;
+}
+
+/* B+tree index key (only for the sm_bt_t() types) */
+S_INLINE int64_t sm_bt_key(int t, const srt_tnode *n)
+{
+	switch (t) {
+	case SM0_II32:
+	case SM0_I32:
+		return ((const struct SMapi *)n)->k;
+	case SM0_UU32:
+	case SM0_U32:
+		return ((const struct SMapu *)n)->k;
+	case SM0_II:
+	case SM0_IS:
+	case SM0_IP:
+	case SM0_I:
+		return ((const struct SMapI *)n)->k;
+	default:
+		break;
+	}
+	S_ASSERT(0);
+	return 0;
+}
+
+/* Rebuild the red-black tree links (e.g. after copying from a B+tree) */
+static void sm_rb_relink(srt_map *m)
+{
+	size_t i, ss = sm_size(m);
+	union {
+		srt_tnode n;
+		int64_t a[32];
+	} tmp;
+	S_ASSERT(m->d.elem_size <= sizeof(tmp));
+	st_set_size(m, 0);
+	for (i = 0; i < ss; i++) {
+		/* the node is re-inserted in the same slot */
+		memcpy(&tmp, st_enum_r(m, (srt_tndx)i), m->d.elem_size);
+		st_insert(&m, &tmp.n);
+	}
+}
+
 SM_ENUM_INORDER_XX(sm_itr_ii32, srt_map_it_ii32, SM_II32, int32_t,
 		   cmp_ni_i((const struct SMapi *)cn, kmin),
 		   cmp_ni_i((const struct SMapi *)cn, kmax),
 		   f(((const struct SMapi *)cn)->k,
-		     ((const struct SMapii *)cn)->v, context))
+		     ((const struct SMapii *)cn)->v, context),
+		   (int64_t)kmin)
 
 SM_ENUM_INORDER_XX(sm_itr_uu32, srt_map_it_uu32, SM_UU32, uint32_t,
 		   cmp_nu_u((const struct SMapu *)cn, kmin),
 		   cmp_nu_u((const struct SMapu *)cn, kmax),
 		   f(((const struct SMapu *)cn)->k,
-		     ((const struct SMapuu *)cn)->v, context))
+		     ((const struct SMapuu *)cn)->v, context),
+		   (int64_t)kmin)
 
 SM_ENUM_INORDER_XX(sm_itr_ii, srt_map_it_ii, SM_II, int64_t,
 		   cmp_nI_I((const struct SMapI *)cn, kmin),
 		   cmp_nI_I((const struct SMapI *)cn, kmax),
 		   f(((const struct SMapI *)cn)->k,
-		     ((const struct SMapII *)cn)->v, context))
+		     ((const struct SMapII *)cn)->v, context),
+		   (int64_t)kmin)
 
 SM_ENUM_INORDER_XX(sm_itr_ff, srt_map_it_ff, SM_FF, float,
 		   cmp_nF_F((const struct SMapF *)cn, kmin),
 		   cmp_nF_F((const struct SMapF *)cn, kmax),
 		   f(((const struct SMapF *)cn)->k,
-		     ((const struct SMapFF *)cn)->v, context))
+		     ((const struct SMapFF *)cn)->v, context),
+		   0)
 
 SM_ENUM_INORDER_XX(sm_itr_dd, srt_map_it_dd, SM_DD, double,
 		   cmp_nD_D((const struct SMapD *)cn, kmin),
 		   cmp_nD_D((const struct SMapD *)cn, kmax),
 		   f(((const struct SMapD *)cn)->k,
-		     ((const struct SMapDD *)cn)->v, context))
+		     ((const struct SMapDD *)cn)->v, context),
+		   0)
 
 SM_ENUM_INORDER_XX(
 	sm_itr_is, srt_map_it_is, SM_IS, int64_t,
@@ -358,7 +458,8 @@ SM_ENUM_INORDER_XX(
 	cmp_nI_I((const struct SMapI *)cn, kmax),
 	f(((const struct SMapI *)cn)->k,
 	  sso_get((const srt_stringo *)&((const struct SMapIS *)cn)->v),
-	  context))
+	  context),
+	(int64_t)kmin)
 
 SM_ENUM_INORDER_XX(
 	sm_itr_ds, srt_map_it_ds, SM_DS, double,
@@ -366,46 +467,53 @@ SM_ENUM_INORDER_XX(
 	cmp_nD_D((const struct SMapD *)cn, kmax),
 	f(((const struct SMapD *)cn)->k,
 	  sso_get((const srt_stringo *)&((const struct SMapDS *)cn)->v),
-	  context))
+	  context),
+	0)
 
 SM_ENUM_INORDER_XX(sm_itr_ip, srt_map_it_ip, SM_IP, int64_t,
 		   cmp_nI_I((const struct SMapI *)cn, kmin),
 		   cmp_nI_I((const struct SMapI *)cn, kmax),
 		   f(((const struct SMapI *)cn)->k,
-		     ((const struct SMapIP *)cn)->v, context))
+		     ((const struct SMapIP *)cn)->v, context),
+		   (int64_t)kmin)
 
 SM_ENUM_INORDER_XX(sm_itr_dp, srt_map_it_dp, SM_DP, double,
 		   cmp_nD_D((const struct SMapD *)cn, kmin),
 		   cmp_nD_D((const struct SMapD *)cn, kmax),
 		   f(((const struct SMapD *)cn)->k,
-		     ((const struct SMapDP *)cn)->v, context))
+		     ((const struct SMapDP *)cn)->v, context),
+		   0)
 
 SM_ENUM_INORDER_XX(
 	sm_itr_si, srt_map_it_si, SM_SI, const srt_string *,
 	cmp_ns_s((const struct SMapS *)cn, kmin),
 	cmp_ns_s((const struct SMapS *)cn, kmax),
 	f(sso_get((const srt_stringo *)&((const struct SMapS *)cn)->k),
-	  ((const struct SMapSI *)cn)->v, context))
+	  ((const struct SMapSI *)cn)->v, context),
+	0)
 
 SM_ENUM_INORDER_XX(
 	sm_itr_sd, srt_map_it_sd, SM_SD, const srt_string *,
 	cmp_ns_s((const struct SMapS *)cn, kmin),
 	cmp_ns_s((const struct SMapS *)cn, kmax),
 	f(sso_get((const srt_stringo *)&((const struct SMapS *)cn)->k),
-	  ((const struct SMapSD *)cn)->v, context))
+	  ((const struct SMapSD *)cn)->v, context),
+	0)
 
 SM_ENUM_INORDER_XX(sm_itr_ss, srt_map_it_ss, SM_SS, const srt_string *,
 		   cmp_ns_s((const struct SMapS *)cn, kmin),
 		   cmp_ns_s((const struct SMapS *)cn, kmax),
 		   f(sso_get(&((const struct SMapSS *)cn)->s),
-		     sso_get_s2(&((const struct SMapSS *)cn)->s), context))
+		     sso_get_s2(&((const struct SMapSS *)cn)->s), context),
+		   0)
 
 SM_ENUM_INORDER_XX(
 	sm_itr_sp, srt_map_it_sp, SM_SP, const srt_string *,
 	cmp_ns_s((const struct SMapS *)cn, kmin),
 	cmp_ns_s((const struct SMapS *)cn, kmax),
 	f(sso_get((const srt_stringo *)&((const struct SMapS *)cn)->k),
-	  ((const struct SMapSP *)cn)->v, context))
+	  ((const struct SMapSP *)cn)->v, context),
+	0)
 
 /*
  * Allocation
@@ -423,15 +531,50 @@ srt_map *sm_alloc_raw0(enum eSM_Type0 t, srt_bool ext_buf, void *buffer,
 	return m;
 }
 
-srt_map *sm_alloc0(enum eSM_Type0 t, size_t init_size)
+srt_map *sm_alloc0_a(const srt_allocator *a, enum eSM_Type0 t,
+		     size_t init_size)
 {
-	srt_map *m = (srt_map *)st_alloc(type2cmpf(t), sm_elem_size((int)t),
-					 init_size);
-	if (m)
+	srt_map *m = (srt_map *)st_alloc_a(a, type2cmpf(t),
+					   sm_elem_size((int)t), init_size);
+	if (m && m != (srt_map *)sd_void)
 		m->d.sub_type = (uint8_t)t;
 	return m;
 }
 
+srt_map *sm_alloc0(enum eSM_Type0 t, size_t init_size)
+{
+	return sm_alloc0_a(NULL, t, init_size);
+}
+
+srt_map *sm_alloc_btree(enum eSM_Type t, size_t init_size)
+{
+	srt_map *m = sm_alloc0((enum eSM_Type0)t, init_size);
+	/*
+	 * BEHAVIOR: types without B+tree support, or not enough memory for
+	 * the index, fall back to the red-black tree
+	 */
+	if (m && m != (srt_map *)sd_void && sm_bt_t(m->d.sub_type))
+		m->bt = sbt_alloc(m->d.alloc_id, init_size);
+	return m;
+}
+
+srt_map *sm_alloc_ranked(enum eSM_Type t, size_t init_size)
+{
+	srt_map *m = sm_alloc0((enum eSM_Type0)t, init_size);
+	/* BEHAVIOR: not enough memory: no order statistics */
+	if (m && m != (srt_map *)sd_void)
+		st_rank_enable(m);
+	return m;
+}
+
+srt_map *sm_alloc_multi(enum eSM_Type t, size_t init_size)
+{
+	srt_map *m = sm_alloc0((enum eSM_Type0)t, init_size);
+	if (m && m != (srt_map *)sd_void)
+		st_multi_enable(m);
+	return m;
+}
+
 void sm_free_aux(srt_map **m, ...)
 {
 	va_list ap;
@@ -441,6 +584,10 @@ void sm_free_aux(srt_map **m, ...)
 	while (!s_varg_tail_ptr_tag(next)) { /* last element tag */
 		if (next) {
 			sm_clear(*next); /* release associated dyn. memory */
+			if (*next && *next != (srt_map *)sd_void) {
+				sbt_free(&(*next)->bt);
+				st_rank_disable(*next);
+			}
 			sd_free((srt_data **)next);
 		}
 		next = (srt_map **)va_arg(ap, srt_map **);
@@ -470,6 +617,7 @@ void sm_clear(srt_map *m)
 		}
 	}
 	st_set_size((srt_tree *)m, 0);
+	sbt_clear(m->bt);
 }
 
 /*
@@ -478,7 +626,7 @@ void sm_clear(srt_map *m)
 
 srt_map *sm_cpy(srt_map **m, const srt_map *src)
 {
-	srt_tndx i;
+	srt_tndx i, x;
 	enum eSM_Type0 t;
 	size_t ss, src_buf_size;
 	RETURN_IF(!m || !src, NULL); /* BEHAVIOR */
@@ -499,10 +647,14 @@ srt_map *sm_cpy(srt_map **m, const srt_map *src)
 			(*m)->d.max_size = new_max_size;
 			(*m)->cmp_f = src->cmp_f;
 			(*m)->d.sub_type = src->d.sub_type;
+			if (!sm_bt_t(t))
+				sbt_free(&(*m)->bt);
 		}
 		sm_reserve(m, ss);
 	} else {
-		*m = sm_alloc0(t, ss);
+		*m = src->bt ? sm_alloc_btree((enum eSM_Type)t, ss)
+			     : src->rank ? sm_alloc_ranked((enum eSM_Type)t, ss)
+					 : sm_alloc0(t, ss);
 		RETURN_IF(!*m, NULL); /* BEHAVIOR: allocation error */
 	}
 	RETURN_IF(sm_max_size(*m) < ss, *m); /* BEHAVIOR: not enough space */
@@ -556,9 +708,298 @@ srt_map *sm_cpy(srt_map **m, const srt_map *src)
 		/* no additional action required */
 		break;
 	}
+	/*
+	 * Ordering: the output map keeps its backend (red-black tree or
+	 * B+tree index)
+	 */
+	if (src->multi) { /* BEHAVIOR: duplicated keys: red-black tree */
+		sbt_free(&(*m)->bt);
+		(*m)->multi = S_TRUE;
+	}
+	if ((*m)->bt) {
+		if (src->bt) {
+			if (!sbt_cpy(&(*m)->bt, src->bt))
+				sbt_free(&(*m)->bt);
+		} else {
+			for (i = 0; i < ss && (*m)->bt; i++)
+				if (!sbt_insert(&(*m)->bt,
+						sm_bt_key(t, st_enum_r(src, i)),
+						i, &x))
+					sbt_free(&(*m)->bt);
+		}
+		/* BEHAVIOR: not enough memory for the index: red-black */
+		if (!(*m)->bt && src->bt)
+			sm_rb_relink(*m);
+	} else if (src->bt) {
+		sm_rb_relink(*m);
+	}
+	/* BEHAVIOR: not enough memory: no order statistics */
+	if ((*m)->rank && ((*m)->bt || !st_rank_enable(*m)))
+		st_rank_disable(*m);
 	return *m;
 }
 
+/*
+ * Bulk load
+ */
+
+/*
+ * Types supported for bulk load (numeric keys and values), returning the
+ * node value offset (0: set) and the sort compare function
+ */
+static srt_bool sm_bulk_t(int t, size_t *vo, int (**cmpf)(const void *,
+							  const void *))
+{
+	switch (t) {
+	case SM0_II32:
+	case SM0_I32:
+		*cmpf = cmp_bulk_i;
+		break;
+	case SM0_UU32:
+	case SM0_U32:
+		*cmpf = cmp_bulk_u;
+		break;
+	case SM0_II:
+	case SM0_I:
+		*cmpf = cmp_bulk_I;
+		break;
+	case SM0_FF:
+	case SM0_F:
+		*cmpf = cmp_bulk_F;
+		break;
+	case SM0_DD:
+	case SM0_D:
+		*cmpf = cmp_bulk_D;
+		break;
+	default:
+		return S_FALSE;
+	}
+	*vo = t == SM0_II32   ? offsetof(struct SMapii, v)
+	      : t == SM0_UU32 ? offsetof(struct SMapuu, v)
+	      : t == SM0_II   ? offsetof(struct SMapII, v)
+	      : t == SM0_FF   ? offsetof(struct SMapFF, v)
+	      : t == SM0_DD   ? offsetof(struct SMapDD, v)
+			      : 0;
+	return S_TRUE;
+}
+
+/*
+ * Link nodes [lo, hi) as perfectly balanced red-black tree: upper levels
+ * are full, so the nodes in the deepest level (red_depth) can be red
+ */
+static srt_tndx sm_bulk_link(srt_map *m, size_t lo, size_t hi, size_t depth,
+			     size_t red_depth)
+{
+	size_t mid;
+	srt_tnode *n;
+	RETURN_IF(lo >= hi, ST_NIL);
+	mid = lo + (hi - lo) / 2;
+	n = st_enum(m, (srt_tndx)mid);
+	n->x.l = sm_bulk_link(m, lo, mid, depth + 1, red_depth);
+	n->r = sm_bulk_link(m, mid + 1, hi, depth + 1, red_depth);
+	n->x.is_red = depth == red_depth ? 1 : 0;
+	return (srt_tndx)mid;
+}
+
+srt_map *sm_from_sorted_vectors(enum eSM_Type t, const srt_vector *kv,
+				const srt_vector *vv)
+{
+	srt_map *m;
+	srt_tnode *n;
+	uint8_t *nb;
+	const uint8_t *kb, *vb;
+	srt_bool sorted = S_TRUE;
+	size_t i, j, ne, es, ks, vs, vo = 0;
+	int (*cmpf)(const void *, const void *) = NULL;
+	RETURN_IF(!kv || !sm_bulk_t((int)t, &vo, &cmpf)
+			  || kv->d.sub_type != sm_ctx[t].sort_kt,
+		  NULL); /* BEHAVIOR: unsupported map or key vector type */
+	ne = sv_size(kv);
+	RETURN_IF(vo && (!vv || vv->d.sub_type != sm_ctx[t].sort_vt
+			 || sv_size(vv) != ne),
+		  NULL); /* BEHAVIOR: missing values or wrong value vector */
+	RETURN_IF(ne > ST_NDX_MAX, NULL);
+	m = sm_alloc(t, ne);
+	if (!m || sm_max_size(m) < ne) {
+		sm_free(&m);
+		return NULL; /* BEHAVIOR: not enough memory */
+	}
+	/*
+	 * Sequential node write, checking the ordering
+	 */
+	nb = (uint8_t *)sm_get_buffer(m);
+	es = m->d.elem_size;
+	kb = (const uint8_t *)sv_get_buffer_r(kv);
+	ks = kv->d.elem_size;
+	vb = vo ? (const uint8_t *)sv_get_buffer_r(vv) : NULL;
+	vs = vo ? vv->d.elem_size : 0;
+	for (i = 0; i < ne; i++) {
+		n = (srt_tnode *)(nb + i * es);
+		memcpy((uint8_t *)n + sizeof(srt_tnode), kb + i * ks, ks);
+		if (vo)
+			memcpy((uint8_t *)n + vo, vb + i * vs, vs);
+		n->r = (srt_tndx)i;
+		if (sorted && i > 0
+		    && m->cmp_f((const uint8_t *)n - es, n) >= 0)
+			sorted = S_FALSE;
+	}
+	/*
+	 * Unsorted input: sort, removing duplicated keys (BEHAVIOR: the last
+	 * value is kept, as when inserting one by one)
+	 */
+	if (!sorted) {
+		qsort(nb, ne, es, cmpf);
+		for (i = j = 0; i < ne; i++) {
+			if (i + 1 < ne
+			    && !m->cmp_f(nb + i * es, nb + (i + 1) * es))
+				continue;
+			if (i != j)
+				memcpy(nb + j * es, nb + i * es, es);
+			j++;
+		}
+		ne = j;
+	}
+	sm_set_size(m, ne);
+	if (ne > 0)
+		m->root = sm_bulk_link(m, 0, ne, 0, ne > 1 ? slog2(ne) : 1);
+	return m;
+}
+
+/*
+ * Persistence
+ */
+
+/* Types without strings or pointers (suitable for store/restore) */
+static srt_bool sm_flat_t(int t)
+{
+	switch (t) {
+	case SM0_II32:
+	case SM0_UU32:
+	case SM0_II:
+	case SM0_I:
+	case SM0_I32:
+	case SM0_U32:
+	case SM0_F:
+	case SM0_D:
+	case SM0_FF:
+	case SM0_DD:
+		return S_TRUE;
+	default:
+		break;
+	}
+	return S_FALSE;
+}
+
+static srt_bool sm_image_chk(srt_map *m)
+{
+	int t = m->d.sub_type;
+	m->bt = NULL;
+	m->rank = NULL;
+	RETURN_IF(!sm_flat_t(t) || m->d.elem_size != sm_elem_size(t)
+			  || m->d.header_size != sizeof(srt_map),
+		  S_FALSE);
+	RETURN_IF(m->d.size > ST_NDX_MAX
+			  || (m->d.size > 0 && m->root >= m->d.size),
+		  S_FALSE);
+	m->cmp_f = type2cmpf((enum eSM_Type0)t);
+	return S_TRUE;
+}
+
+srt_bool sm_save(FILE *f, const srt_map *m)
+{
+	RETURN_IF(!m || m->bt || !sm_flat_t(m->d.sub_type), S_FALSE);
+	return sd_image_save(f, (const srt_data *)m, SD_IMAGE_MAP,
+			     sizeof(srt_map));
+}
+
+srt_map *sm_load(FILE *f)
+{
+	srt_map *m =
+		(srt_map *)sd_image_load(f, SD_IMAGE_MAP, sizeof(srt_map));
+	/* BEHAVIOR: invalid image: raw release (no type-specific free) */
+	if (m && !sm_image_chk(m))
+		sd_free((srt_data **)&m);
+	return m;
+}
+
+srt_map *sm_map(const char *path)
+{
+	srt_map *m =
+		(srt_map *)sd_image_map(path, SD_IMAGE_MAP, sizeof(srt_map));
+	if (m && !sm_image_chk(m))
+		sm_unmap(&m);
+	return m;
+}
+
+void sm_unmap(srt_map **m)
+{
+	sd_image_unmap((srt_data **)m);
+}
+
+/*
+ * Node operations (red-black tree or B+tree index)
+ */
+
+const srt_tnode *sm_locate_n(const srt_map *m, const srt_tnode *n)
+{
+	srt_tndx x;
+	RETURN_IF(!m, NULL);
+	RETURN_IF(!m->bt, st_locate_k(m, n, sm_ctx[m->d.sub_type].kt));
+	x = sbt_locate(m->bt, sm_bt_key(m->d.sub_type, n));
+	return x != ST_NIL ? get_node_r(m, x) : NULL;
+}
+
+srt_bool sm_insert_n(srt_map **m, const srt_tnode *n, srt_tree_rewrite rw_f)
+{
+	size_t ts;
+	srt_tndx x;
+	srt_tnode *cn;
+	RETURN_IF(!m || !*m, S_FALSE);
+	RETURN_IF(!(*m)->bt,
+		  st_insert_rw_k(m, n, rw_f, sm_ctx[(*m)->d.sub_type].kt));
+	ts = sm_size(*m);
+	RETURN_IF(ts >= ST_NDX_MAX || !sm_grow(m, 1), S_FALSE);
+	RETURN_IF(!sbt_insert(&(*m)->bt, sm_bt_key((*m)->d.sub_type, n),
+			      (srt_tndx)ts, &x),
+		  S_FALSE); /* BEHAVIOR: not enough memory */
+	cn = get_node(*m, x);
+	if (rw_f)
+		rw_f(cn, n, x != ts ? S_TRUE : S_FALSE);
+	else
+		memcpy((char *)cn + sizeof(srt_tnode),
+		       (const char *)n + sizeof(srt_tnode),
+		       (*m)->d.elem_size - sizeof(srt_tnode));
+	if (x == ts) { /* new node: unlinked (no red-black tree) */
+		cn->x.l = cn->r = ST_NIL;
+		cn->x.is_red = S_FALSE;
+		sm_set_size(*m, ts + 1);
+	}
+	return S_TRUE;
+}
+
+srt_bool sm_delete_n(srt_map *m, const srt_tnode *n,
+		     srt_tree_callback callback)
+{
+	srt_tndx x, last;
+	srt_tnode *cn;
+	RETURN_IF(!m, S_FALSE);
+	RETURN_IF(!m->bt,
+		  st_delete_k(m, n, callback, sm_ctx[m->d.sub_type].kt));
+	x = sbt_delete(&m->bt, sm_bt_key(m->d.sub_type, n));
+	RETURN_IF(x == ST_NIL, S_FALSE); /* BEHAVIOR: not found */
+	cn = get_node(m, x);
+	if (callback)
+		callback((void *)cn);
+	/* Keep the node space compact: the last node fills the hole */
+	last = (srt_tndx)sm_size(m) - 1;
+	if (x != last) {
+		memcpy(cn, get_node_r(m, last), m->d.elem_size);
+		sbt_set(m->bt, sm_bt_key(m->d.sub_type, cn), x);
+	}
+	sm_set_size(m, last);
+	return S_TRUE;
+}
+
 	/*
 	 * Random access
 	 */
@@ -570,7 +1011,7 @@ srt_map *sm_cpy(srt_map **m, const srt_map *src)
 		const TS *nr;                                                  \
 		RETURN_IF(!sm_chk_t(m, ID), 0);                                \
 		n.x.k = k;                                                     \
-		nr = (const TS *)st_locate(m, (const srt_tnode *)&n);          \
+		nr = (const TS *)sm_locate_n(m, (const srt_tnode *)&n);        \
 		return nr ? nr->v : 0; /* BEHAVIOR */                          \
 	}
 
@@ -589,7 +1030,7 @@ BUILD_SM_AT(sm_at_dp, SM_DP, struct SMapDP, double, const void *)
 		const TS *nr;                                                  \
 		RETURN_IF(!sm_chk_t(m, ID), ss_void);                          \
 		n.x.k = k;                                                     \
-		nr = (const TS *)st_locate(m, (const srt_tnode *)&n);          \
+		nr = (const TS *)sm_locate_n(m, (const srt_tnode *)&n);        \
 		return nr ? sso_get((const srt_stringo *)&nr->v) : ss_void;    \
 	}
 
@@ -603,7 +1044,7 @@ BUILD_SM_AT_XS(sm_at_ds, SM_DS, struct SMapDS, double)
 		const TS *nr;                                                  \
 		RETURN_IF(!sm_chk_t(m, ID), DEF_VAL);                          \
 		sso1_setref(&n.x.k, k);                                        \
-		nr = (const TS *)st_locate(m, &n.x.n);                         \
+		nr = (const TS *)sm_locate_n(m, &n.x.n);                       \
 		return nr ? nr->v : DEF_VAL; /* BEHAVIOR */                    \
 	}
 
@@ -617,7 +1058,7 @@ const srt_string *sm_at_ss(const srt_map *m, const srt_string *k)
 	const struct SMapSS *nr;
 	RETURN_IF(!sm_chk_t(m, SM_SS), ss_void);
 	sso_setref(&n.s, k, NULL);
-	nr = (const struct SMapSS *)st_locate(m, &n.n);
+	nr = (const struct SMapSS *)sm_locate_n(m, &n.n);
 	return nr ? sso_get_s2(&nr->s) : ss_void;
 }
 
@@ -625,13 +1066,28 @@ const srt_string *sm_at_ss(const srt_map *m, const srt_string *k)
 	 * Existence check
 	 */
 
+static size_t sm_count_n(const srt_map *m, const srt_tnode *n)
+{
+	size_t cnt = 0;
+	srt_tndx x, end;
+	struct STPath p;
+	if (!m->multi)
+		return sm_locate_n(m, n) ? 1 : 0;
+	/* Duplicated keys: elements from the lower to the upper bound */
+	end = st_path_bound(m, n, S_TRUE, &p);
+	for (x = st_path_bound(m, n, S_FALSE, &p); x != ST_NIL && x != end;
+	     x = st_path_next(m, &p))
+		cnt++;
+	return cnt;
+}
+
 #define BUILD_SM_COUNT(FN, CHK, TS, TK)                                        \
 	size_t FN(const srt_map *m, TK k)                                      \
 	{                                                                      \
 		TS n;                                                          \
 		RETURN_IF(!(CHK), S_FALSE);                                    \
 		n.k = k;                                                       \
-		return st_locate(m, (const srt_tnode *)&n) ? 1 : 0;            \
+		return sm_count_n(m, (const srt_tnode *)&n);                   \
 	}
 
 BUILD_SM_COUNT(sm_count_i32, sm_chk_i32x(m), struct SMapi, int32_t)
@@ -645,7 +1101,7 @@ size_t sm_count_s(const srt_map *m, const srt_string *k)
 	struct SMapS n;
 	RETURN_IF(!sm_chk_sx(m), S_FALSE);
 	sso1_setref(&n.k, k);
-	return st_locate(m, (const srt_tnode *)&n) ? 1 : 0;
+	return sm_count_n(m, (const srt_tnode *)&n);
 }
 
 /*
@@ -659,7 +1115,7 @@ S_INLINE srt_bool sm_insert_ii32_aux(srt_map **m, int32_t k, int32_t v,
 	RETURN_IF(!m || !sm_chk_t(*m, SM0_II32), S_FALSE);
 	n.x.k = k;
 	n.v = v;
-	return st_insert_rw((srt_tree **)m, (const srt_tnode *)&n, rw_f);
+	return sm_insert_n(m, (const srt_tnode *)&n, rw_f);
 }
 
 srt_bool sm_insert_ii32(srt_map **m, int32_t k, int32_t v)
@@ -679,7 +1135,7 @@ S_INLINE srt_bool sm_insert_uu32_aux(srt_map **m, uint32_t k, uint32_t v,
 	RETURN_IF(!m || !sm_chk_t(*m, SM0_UU32), S_FALSE);
 	n.x.k = k;
 	n.v = v;
-	return st_insert_rw((srt_tree **)m, (const srt_tnode *)&n, rw_f);
+	return sm_insert_n(m, (const srt_tnode *)&n, rw_f);
 }
 
 srt_bool sm_insert_uu32(srt_map **m, uint32_t k, uint32_t v)
@@ -699,7 +1155,7 @@ S_INLINE srt_bool sm_insert_ii_aux(srt_map **m, int64_t k, int64_t v,
 	RETURN_IF(!m || !sm_chk_t(*m, SM0_II), S_FALSE);
 	n.x.k = k;
 	n.v = v;
-	return st_insert_rw((srt_tree **)m, (const srt_tnode *)&n, rw_f);
+	return sm_insert_n(m, (const srt_tnode *)&n, rw_f);
 }
 
 srt_bool sm_insert_ii(srt_map **m, int64_t k, int64_t v)
@@ -719,7 +1175,7 @@ S_INLINE srt_bool sm_insert_ff_aux(srt_map **m, float k, float v,
 	RETURN_IF(!m || !sm_chk_t(*m, SM0_FF), S_FALSE);
 	n.x.k = k;
 	n.v = v;
-	return st_insert_rw((srt_tree **)m, (const srt_tnode *)&n, rw_f);
+	return sm_insert_n(m, (const srt_tnode *)&n, rw_f);
 }
 
 srt_bool sm_insert_ff(srt_map **m, float k, float v)
@@ -739,7 +1195,7 @@ S_INLINE srt_bool sm_insert_dd_aux(srt_map **m, double k, double v,
 	RETURN_IF(!m || !sm_chk_t(*m, SM0_DD), S_FALSE);
 	n.x.k = k;
 	n.v = v;
-	return st_insert_rw((srt_tree **)m, (const srt_tnode *)&n, rw_f);
+	return sm_insert_n(m, (const srt_tnode *)&n, rw_f);
 }
 
 srt_bool sm_insert_dd(srt_map **m, double k, double v)
@@ -758,8 +1214,7 @@ srt_bool sm_insert_is(srt_map **m, int64_t k, const srt_string *v)
 	RETURN_IF(!m || !sm_chk_t(*m, SM0_IS), S_FALSE);
 	n.x.k = k;
 	sso1_setref(&n.v, v);
-	return st_insert_rw((srt_tree **)m, (const srt_tnode *)&n,
-			    rw_add_SM_IS);
+	return sm_insert_n(m, (const srt_tnode *)&n, rw_add_SM_IS);
 }
 
 srt_bool sm_insert_ds(srt_map **m, double k, const srt_string *v)
@@ -768,8 +1223,7 @@ srt_bool sm_insert_ds(srt_map **m, double k, const srt_string *v)
 	RETURN_IF(!m || !sm_chk_t(*m, SM0_DS), S_FALSE);
 	n.x.k = k;
 	sso1_setref(&n.v, v);
-	return st_insert_rw((srt_tree **)m, (const srt_tnode *)&n,
-			    rw_add_SM_DS);
+	return sm_insert_n(m, (const srt_tnode *)&n, rw_add_SM_DS);
 }
 
 srt_bool sm_insert_ip(srt_map **m, int64_t k, const void *v)
@@ -778,7 +1232,7 @@ srt_bool sm_insert_ip(srt_map **m, int64_t k, const void *v)
 	RETURN_IF(!m || !sm_chk_t(*m, SM0_IP), S_FALSE);
 	n.x.k = k;
 	n.v = v;
-	return st_insert((srt_tree **)m, (const srt_tnode *)&n);
+	return sm_insert_n(m, (const srt_tnode *)&n, NULL);
 }
 
 srt_bool sm_insert_dp(srt_map **m, double k, const void *v)
@@ -787,7 +1241,7 @@ srt_bool sm_insert_dp(srt_map **m, double k, const void *v)
 	RETURN_IF(!m || !sm_chk_t(*m, SM0_DP), S_FALSE);
 	n.x.k = k;
 	n.v = v;
-	return st_insert((srt_tree **)m, (const srt_tnode *)&n);
+	return sm_insert_n(m, (const srt_tnode *)&n, NULL);
 }
 
 S_INLINE srt_bool sm_insert_si_aux(srt_map **m, const srt_string *k, int64_t v,
@@ -798,7 +1252,7 @@ S_INLINE srt_bool sm_insert_si_aux(srt_map **m, const srt_string *k, int64_t v,
 	RETURN_IF(!m || !sm_chk_t(*m, SM0_SI), S_FALSE);
 	sso1_setref(&n.x.k, k);
 	n.v = v;
-	r = st_insert_rw((srt_tree **)m, (const srt_tnode *)&n, rw_f);
+	r = sm_insert_n(m, (const srt_tnode *)&n, rw_f);
 	return r;
 }
 
@@ -820,7 +1274,7 @@ S_INLINE srt_bool sm_insert_sd_aux(srt_map **m, const srt_string *k, double v,
 	RETURN_IF(!m || !sm_chk_t(*m, SM0_SD), S_FALSE);
 	sso1_setref(&n.x.k, k);
 	n.v = v;
-	r = st_insert_rw((srt_tree **)m, (const srt_tnode *)&n, rw_f);
+	r = sm_insert_n(m, (const srt_tnode *)&n, rw_f);
 	return r;
 }
 
@@ -839,8 +1293,7 @@ srt_bool sm_insert_ss(srt_map **m, const srt_string *k, const srt_string *v)
 	struct SMapSS n;
 	RETURN_IF(!m || !sm_chk_t(*m, SM0_SS), S_FALSE);
 	sso_setref(&n.s, k, v);
-	return st_insert_rw((srt_tree **)m, (const srt_tnode *)&n,
-			    rw_add_SM_SS);
+	return sm_insert_n(m, (const srt_tnode *)&n, rw_add_SM_SS);
 }
 
 srt_bool sm_insert_sp(srt_map **m, const srt_string *k, const void *v)
@@ -849,8 +1302,7 @@ srt_bool sm_insert_sp(srt_map **m, const srt_string *k, const void *v)
 	RETURN_IF(!m || !sm_chk_t(*m, SM0_SP), S_FALSE);
 	sso1_setref(&n.x.k, k);
 	n.v = v;
-	return st_insert_rw((srt_tree **)m, (const srt_tnode *)&n,
-			    rw_add_SM_SP);
+	return sm_insert_n(m, (const srt_tnode *)&n, rw_add_SM_SP);
 }
 
 /*
@@ -862,7 +1314,7 @@ srt_bool sm_delete_i32(srt_map *m, int32_t k)
 	struct SMapi n;
 	RETURN_IF(!sm_chk_i32x(m), S_FALSE);
 	n.k = k;
-	return st_delete(m, (const srt_tnode *)&n, NULL);
+	return sm_delete_n(m, (const srt_tnode *)&n, NULL);
 }
 
 srt_bool sm_delete_u32(srt_map *m, uint32_t k)
@@ -870,7 +1322,7 @@ srt_bool sm_delete_u32(srt_map *m, uint32_t k)
 	struct SMapu n;
 	RETURN_IF(!sm_chk_u32x(m), S_FALSE);
 	n.k = k;
-	return st_delete(m, (const srt_tnode *)&n, NULL);
+	return sm_delete_n(m, (const srt_tnode *)&n, NULL);
 }
 
 srt_bool sm_delete_i(srt_map *m, int64_t k)
@@ -878,8 +1330,8 @@ srt_bool sm_delete_i(srt_map *m, int64_t k)
 	struct SMapI n;
 	RETURN_IF(!sm_chk_ix(m), S_FALSE);
 	n.k = k;
-	return st_delete(m, (const srt_tnode *)&n,
-			 sm_chk_t(m, SM0_IS) ? aux_is_delete : NULL);
+	return sm_delete_n(m, (const srt_tnode *)&n,
+			   sm_chk_t(m, SM0_IS) ? aux_is_delete : NULL);
 }
 
 srt_bool sm_delete_f(srt_map *m, float k)
@@ -887,7 +1339,7 @@ srt_bool sm_delete_f(srt_map *m, float k)
 	struct SMapF n;
 	RETURN_IF(!sm_chk_fx(m), S_FALSE);
 	n.k = k;
-	return st_delete(m, (const srt_tnode *)&n, NULL);
+	return sm_delete_n(m, (const srt_tnode *)&n, NULL);
 }
 
 srt_bool sm_delete_d(srt_map *m, double k)
@@ -895,8 +1347,8 @@ srt_bool sm_delete_d(srt_map *m, double k)
 	struct SMapD n;
 	RETURN_IF(!sm_chk_dx(m), S_FALSE);
 	n.k = k;
-	return st_delete(m, (const srt_tnode *)&n,
-			 sm_chk_t(m, SM0_DS) ? aux_ds_delete : NULL);
+	return sm_delete_n(m, (const srt_tnode *)&n,
+			   sm_chk_t(m, SM0_DS) ? aux_ds_delete : NULL);
 }
 
 srt_bool sm_delete_s(srt_map *m, const srt_string *k)
@@ -911,7 +1363,7 @@ srt_bool sm_delete_s(srt_map *m, const srt_string *k)
 		callback = aux_sx_delete;
 	else
 		return S_FALSE;
-	return st_delete(m, (const srt_tnode *)&sx, callback);
+	return sm_delete_n(m, (const srt_tnode *)&sx, callback);
 }
 
 /*
@@ -922,6 +1374,8 @@ ssize_t sm_sort_to_vectors(const srt_map *m, srt_vector **kv, srt_vector **vv)
 {
 	ssize_t r;
 	struct SV2X v2x;
+	struct SBTScan bs;
+	struct STraverseParams tp;
 	uint8_t t;
 	enum eSV_Type kt, vt;
 	st_traverse traverse_f = NULL;
@@ -948,8 +1402,654 @@ ssize_t sm_sort_to_vectors(const srt_map *m, srt_vector **kv, srt_vector **vv)
 		v2x.kv = sv_alloc_t(kt, m->d.size);
 	if (!v2x.vv)
 		v2x.vv = sv_alloc_t(vt, m->d.size);
-	r = st_traverse_inorder((const srt_tree *)m, traverse_f, (void *)&v2x);
+	if (m->bt) {
+		tp.context = (void *)&v2x;
+		tp.t = m;
+		tp.level = tp.max_level = 0;
+		sbt_scan_lb(m->bt, INT64_MIN, &bs);
+		while (sbt_scan_next(&bs, &tp.c))
+			traverse_f(&tp);
+		r = (ssize_t)sm_size(m);
+	} else {
+		r = st_traverse_inorder((const srt_tree *)m, traverse_f,
+					(void *)&v2x);
+	}
 	*kv = v2x.kv;
 	*vv = v2x.vv;
 	return r;
 }
+
+/*
+ * Cursors
+ */
+
+static srt_tndx sm_cursor_bound(const srt_map *m, const srt_tnode *n,
+				srt_bool upper, srt_map_cursor *c)
+{
+	if (m->bt)
+		c->x = sbt_path_bound(m->bt, sm_bt_key(m->d.sub_type, n), upper,
+				      &c->p.bt);
+	else
+		c->x = st_path_bound(m, n, upper, &c->p.rb);
+	return c->x;
+}
+
+#define BUILD_SM_BOUND(FN, CHK, TS, TK, UPPER)                                 \
+	srt_tndx FN(const srt_map *m, TK k, srt_map_cursor *c)                 \
+	{                                                                      \
+		TS n;                                                          \
+		RETURN_IF(!c, ST_NIL);                                         \
+		c->m = m;                                                      \
+		c->x = ST_NIL;                                                 \
+		RETURN_IF(!(CHK), ST_NIL);                                     \
+		n.k = k;                                                       \
+		return sm_cursor_bound(m, (const srt_tnode *)&n, UPPER, c);    \
+	}
+
+BUILD_SM_BOUND(sm_lower_bound_i32, sm_chk_i32x(m), struct SMapi, int32_t,
+	       S_FALSE)
+BUILD_SM_BOUND(sm_lower_bound_u32, sm_chk_u32x(m), struct SMapu, uint32_t,
+	       S_FALSE)
+BUILD_SM_BOUND(sm_lower_bound_i, sm_chk_ix(m), struct SMapI, int64_t, S_FALSE)
+BUILD_SM_BOUND(sm_lower_bound_f, sm_chk_fx(m), struct SMapF, float, S_FALSE)
+BUILD_SM_BOUND(sm_lower_bound_d, sm_chk_dx(m), struct SMapD, double, S_FALSE)
+BUILD_SM_BOUND(sm_upper_bound_i32, sm_chk_i32x(m), struct SMapi, int32_t,
+	       S_TRUE)
+BUILD_SM_BOUND(sm_upper_bound_u32, sm_chk_u32x(m), struct SMapu, uint32_t,
+	       S_TRUE)
+BUILD_SM_BOUND(sm_upper_bound_i, sm_chk_ix(m), struct SMapI, int64_t, S_TRUE)
+BUILD_SM_BOUND(sm_upper_bound_f, sm_chk_fx(m), struct SMapF, float, S_TRUE)
+BUILD_SM_BOUND(sm_upper_bound_d, sm_chk_dx(m), struct SMapD, double, S_TRUE)
+
+static srt_tndx sm_bound_s(const srt_map *m, const srt_string *k,
+			   srt_bool upper, srt_map_cursor *c)
+{
+	struct SMapS n;
+	RETURN_IF(!c, ST_NIL);
+	c->m = m;
+	c->x = ST_NIL;
+	RETURN_IF(!sm_chk_sx(m) || !k, ST_NIL);
+	sso1_setref(&n.k, k);
+	return sm_cursor_bound(m, (const srt_tnode *)&n, upper, c);
+}
+
+srt_tndx sm_lower_bound_s(const srt_map *m, const srt_string *k,
+			  srt_map_cursor *c)
+{
+	return sm_bound_s(m, k, S_FALSE, c);
+}
+
+srt_tndx sm_upper_bound_s(const srt_map *m, const srt_string *k,
+			  srt_map_cursor *c)
+{
+	return sm_bound_s(m, k, S_TRUE, c);
+}
+
+srt_tndx sm_cursor_first(const srt_map *m, srt_map_cursor *c)
+{
+	RETURN_IF(!c, ST_NIL);
+	c->m = m;
+	c->x = !m ? ST_NIL
+		  : m->bt ? sbt_path_first(m->bt, &c->p.bt)
+			  : st_path_first(m, &c->p.rb);
+	return c->x;
+}
+
+srt_tndx sm_cursor_last(const srt_map *m, srt_map_cursor *c)
+{
+	RETURN_IF(!c, ST_NIL);
+	c->m = m;
+	c->x = !m ? ST_NIL
+		  : m->bt ? sbt_path_last(m->bt, &c->p.bt)
+			  : st_path_last(m, &c->p.rb);
+	return c->x;
+}
+
+srt_tndx sm_cursor_next(srt_map_cursor *c)
+{
+	RETURN_IF(!c || !c->m || c->x == ST_NIL, ST_NIL);
+	c->x = c->m->bt ? sbt_path_next(c->m->bt, &c->p.bt)
+			: st_path_next(c->m, &c->p.rb);
+	return c->x;
+}
+
+srt_tndx sm_cursor_prev(srt_map_cursor *c)
+{
+	RETURN_IF(!c || !c->m || c->x == ST_NIL, ST_NIL);
+	c->x = c->m->bt ? sbt_path_prev(c->m->bt, &c->p.bt)
+			: st_path_prev(c->m, &c->p.rb);
+	return c->x;
+}
+
+/*
+ * Order statistics
+ */
+
+srt_tndx sm_select(const srt_map *m, size_t k)
+{
+	srt_tndx x;
+	srt_map_cursor c;
+	RETURN_IF(!m || k >= sm_size(m), ST_NIL);
+	RETURN_IF(sm_is_ranked(m), st_select(m, k));
+	/* BEHAVIOR: no order statistics: in-order scan */
+	for (x = sm_cursor_first(m, &c); k > 0 && x != ST_NIL; k--)
+		x = sm_cursor_next(&c);
+	return x;
+}
+
+static size_t sm_rank_n(const srt_map *m, const srt_tnode *n)
+{
+	size_t r = 0;
+	srt_tndx x, lb;
+	srt_map_cursor c;
+	RETURN_IF(sm_is_ranked(m), st_rank(m, n));
+	/* BEHAVIOR: no order statistics: in-order scan */
+	lb = sm_cursor_bound(m, n, S_FALSE, &c);
+	for (x = sm_cursor_first(m, &c); x != ST_NIL && x != lb;
+	     x = sm_cursor_next(&c))
+		r++;
+	return r;
+}
+
+#define BUILD_SM_RANK(FN, CHK, TS, TK)                                         \
+	size_t FN(const srt_map *m, TK k)                                      \
+	{                                                                      \
+		TS n;                                                          \
+		RETURN_IF(!(CHK), 0);                                          \
+		n.k = k;                                                       \
+		return sm_rank_n(m, (const srt_tnode *)&n);                    \
+	}
+
+BUILD_SM_RANK(sm_rank_i32, sm_chk_i32x(m), struct SMapi, int32_t)
+BUILD_SM_RANK(sm_rank_u32, sm_chk_u32x(m), struct SMapu, uint32_t)
+BUILD_SM_RANK(sm_rank_i, sm_chk_ix(m), struct SMapI, int64_t)
+BUILD_SM_RANK(sm_rank_f, sm_chk_fx(m), struct SMapF, float)
+BUILD_SM_RANK(sm_rank_d, sm_chk_dx(m), struct SMapD, double)
+
+size_t sm_rank_s(const srt_map *m, const srt_string *k)
+{
+	struct SMapS n;
+	RETURN_IF(!sm_chk_sx(m) || !k, 0);
+	sso1_setref(&n.k, k);
+	return sm_rank_n(m, (const srt_tnode *)&n);
+}
+
+/*
+ * Partitioned scan
+ */
+
+struct SMPartCtx {
+	const srt_map *m;
+	const srt_tnode *lo, *hi; /* range: (lo, hi) (hi NULL: unbounded) */
+	size_t c;		  /* candidate split points seen */
+	size_t cnt;		  /* candidates (second pass) */
+	size_t k, np;
+	srt_map_part *p; /* output (NULL: counting pass) */
+};
+
+/*
+ * Split point candidate, in key order. The second pass picks the
+ * candidates evenly spaced (all, if there are fewer than k - 1)
+ */
+static void sm_part_cand(struct SMPartCtx *pc, srt_tndx x)
+{
+	size_t w;
+	if (pc->p && pc->np < pc->k) {
+		w = pc->cnt >= pc->k - 1 ? pc->np * pc->cnt / pc->k
+					 : pc->np - 1;
+		if (pc->c == w) {
+			pc->p[pc->np - 1].end = x;
+			pc->p[pc->np].m = pc->m;
+			pc->p[pc->np].first = x;
+			pc->np++;
+		}
+	}
+	pc->c++;
+}
+
+/* Red-black tree: nodes inside the range, up to the depth limit */
+static void sm_part_rb(struct SMPartCtx *pc, srt_tndx x, size_t depth,
+		       size_t max_depth)
+{
+	srt_bool gt_lo, lt_hi, in;
+	const srt_tnode *n;
+	if (x == ST_NIL || depth >= max_depth)
+		return;
+	n = st_enum_r(pc->m, x);
+	gt_lo = pc->m->cmp_f(n, pc->lo) > 0;
+	lt_hi = !pc->hi || pc->m->cmp_f(n, pc->hi) < 0;
+	in = gt_lo && lt_hi;
+	if (gt_lo)
+		sm_part_rb(pc, n->x.l, depth + in, max_depth);
+	if (in)
+		sm_part_cand(pc, x);
+	if (lt_hi)
+		sm_part_rb(pc, n->r, depth + in, max_depth);
+}
+
+/* B+tree: inner node keys inside the range (if still in the map) */
+static void sm_part_bt(int64_t k, void *context)
+{
+	srt_tndx x;
+	struct SMPartCtx *pc = (struct SMPartCtx *)context;
+	int t = pc->m->d.sub_type;
+	if (k <= sm_bt_key(t, pc->lo) || (pc->hi && k >= sm_bt_key(t, pc->hi)))
+		return;
+	x = sbt_locate(pc->m->bt, k);
+	if (x != ST_NIL)
+		sm_part_cand(pc, x);
+}
+
+static void sm_part_enum(struct SMPartCtx *pc, uint32_t levels,
+			 size_t max_depth)
+{
+	size_t i, r, r0, r1, rp;
+	if (pc->m->bt) {
+		sbt_enum_inner(pc->m->bt, levels, sm_part_bt, pc);
+	} else if (sm_is_ranked(pc->m)) {
+		/* Order statistics: evenly spaced elements */
+		r0 = rp = st_rank(pc->m, pc->lo);
+		r1 = pc->hi ? st_rank(pc->m, pc->hi) : sm_size(pc->m);
+		for (i = 1; i < pc->k; i++) {
+			r = r0 + i * (r1 - r0) / pc->k;
+			if (r > rp)
+				sm_part_cand(pc, st_select(pc->m, r));
+			rp = r;
+		}
+	} else {
+		sm_part_rb(pc, pc->m->root, 0, max_depth);
+	}
+}
+
+size_t sm_part_split(const srt_map *m, srt_tndx first, srt_tndx end,
+		     srt_map_part *p, size_t k)
+{
+	uint32_t levels = 1;
+	size_t max_depth = 1;
+	struct SMPartCtx pc;
+	RETURN_IF(!m || !p || !k || first == ST_NIL, 0);
+	RETURN_IF(first >= sm_size(m) || (end != ST_NIL && end >= sm_size(m)),
+		  0); /* BEHAVIOR: invalid node */
+	pc.m = m;
+	pc.lo = st_enum_r(m, first);
+	pc.hi = end != ST_NIL ? st_enum_r(m, end) : NULL;
+	RETURN_IF(pc.hi && m->cmp_f(pc.lo, pc.hi) >= 0, 0); /* empty range */
+	pc.c = pc.cnt = 0;
+	pc.k = k;
+	pc.np = 1;
+	p[0].m = m;
+	p[0].first = first;
+	if (k > 1) {
+		/*
+		 * Counting pass (B+tree: descending until having enough
+		 * candidates; red-black tree: at least 2 * k candidates, if
+		 * the range is not too small), and selection pass
+		 */
+		while (((size_t)1 << max_depth) <= k
+		       && max_depth < sizeof(size_t) * 8 - 2)
+			max_depth++;
+		max_depth++;
+		pc.p = NULL;
+		for (;;) {
+			pc.c = 0;
+			sm_part_enum(&pc, levels, max_depth);
+			if (!m->bt || pc.c >= k - 1 || levels >= m->bt->height)
+				break;
+			levels++;
+		}
+		pc.cnt = pc.c;
+		pc.c = 0;
+		pc.p = p;
+		sm_part_enum(&pc, levels, max_depth);
+	}
+	p[pc.np - 1].end = end;
+	return pc.np;
+}
+
+size_t sm_part_scan(const srt_map_part *p, srt_map_it_n f, void *context)
+{
+	size_t cnt = 0;
+	srt_tndx x;
+	srt_map_cursor c;
+	RETURN_IF(!p || !p->m || p->first == ST_NIL, 0);
+	c.m = p->m;
+	x = sm_cursor_bound(p->m, st_enum_r(p->m, p->first), S_FALSE, &c);
+	/* Multimap: the bound is the first of the equal keys */
+	while (x != ST_NIL && x != p->first)
+		x = sm_cursor_next(&c);
+	for (; x != ST_NIL && x != p->end; x = sm_cursor_next(&c), cnt++)
+		if (f && !f(p->m, x, context))
+			break;
+	return cnt;
+}
+
+/*
+ * Node layout
+ */
+
+/*
+ * B+tree node moves: the nodes are unlinked, and 'root' is not used, so
+ * only the node contents are moved (no red-black tree link remapping)
+ */
+
+static srt_bool sm_bt_permute(srt_map *m, const srt_tndx *newpos)
+{
+	uint8_t *tmp;
+	srt_tndx i;
+	size_t ts = sm_size(m), es = m->d.elem_size;
+	tmp = (uint8_t *)s_malloc(ts * es);
+	RETURN_IF(!tmp, S_FALSE); /* BEHAVIOR: not enough memory */
+	for (i = 0; i < (srt_tndx)ts; i++)
+		memcpy(tmp + (size_t)newpos[i] * es, get_node_r(m, i), es);
+	memcpy(get_node(m, 0), tmp, ts * es);
+	s_free(tmp);
+	return S_TRUE;
+}
+
+static void sm_bt_swap(srt_map *m, srt_tndx a, srt_tndx b)
+{
+	size_t done, chunk, es = m->d.elem_size;
+	uint8_t tmp[64], *na = (uint8_t *)get_node(m, a),
+			 *nb = (uint8_t *)get_node(m, b);
+	for (done = 0; done < es; done += chunk) {
+		chunk = S_MIN(es - done, sizeof(tmp));
+		memcpy(tmp, na + done, chunk);
+		memcpy(na + done, nb + done, chunk);
+		memcpy(nb + done, tmp, chunk);
+	}
+}
+
+srt_bool sm_compact(srt_map *m, enum eSM_Layout l)
+{
+	size_t ts;
+	srt_bool r;
+	srt_tndx i, x, *newpos;
+	struct SBTScan bs;
+	RETURN_IF(!m, S_FALSE);
+	RETURN_IF(!m->bt, st_relayout(m, (enum eST_Layout)l));
+	/* B+tree: unlinked nodes, placed in key order */
+	ts = sm_size(m);
+	RETURN_IF(!ts, S_TRUE);
+	newpos = (srt_tndx *)s_malloc(ts * sizeof(srt_tndx));
+	RETURN_IF(!newpos, S_FALSE); /* BEHAVIOR: not enough memory */
+	sbt_scan_lb(m->bt, INT64_MIN, &bs);
+	for (i = 0; sbt_scan_next(&bs, &x); i++)
+		newpos[x] = i;
+	r = sm_bt_permute(m, newpos);
+	if (r)
+		sbt_renumber(m->bt, newpos);
+	s_free(newpos);
+	return r;
+}
+
+srt_bool sm_compact_step(srt_map *m, size_t *pos, size_t steps)
+{
+	int t;
+	srt_tndx x, y;
+	struct SBTPath p;
+	RETURN_IF(!m || !pos, S_TRUE);
+	RETURN_IF(!m->bt, st_relayout_step(m, pos, steps));
+	t = m->d.sub_type;
+	for (; steps > 0 && *pos < sm_size(m); steps--, (*pos)++) {
+		y = (srt_tndx)*pos;
+		x = !y ? sbt_path_first(m->bt, &p)
+		       : sbt_path_bound(m->bt,
+					sm_bt_key(t, get_node_r(m, y - 1)),
+					S_TRUE, &p);
+		if (x == ST_NIL) { /* BEHAVIOR: broken index */
+			*pos = sm_size(m);
+			break;
+		}
+		if (x != y) {
+			sm_bt_swap(m, x, y);
+			sbt_set(m->bt, sm_bt_key(t, get_node_r(m, x)), x);
+			sbt_set(m->bt, sm_bt_key(t, get_node_r(m, y)), y);
+		}
+	}
+	return *pos >= sm_size(m) ? S_TRUE : S_FALSE;
+}
+
+/*
+ * Split and join
+ */
+
+/* Move one element, with the node as key (B+tree) */
+static srt_bool sm_mv_n(srt_map *m, srt_tndx x, srt_map **o, void *buf)
+{
+	/* Node copy: it is overwritten by the delete */
+	memcpy(buf, get_node_r(m, x), m->d.elem_size);
+	RETURN_IF(!sm_insert_n(o, (const srt_tnode *)buf, NULL), S_FALSE);
+	return sm_delete_n(m, (const srt_tnode *)buf, NULL);
+}
+
+srt_bool sm_split(srt_map *m, srt_tndx x, srt_map **right)
+{
+	void *buf;
+	srt_map *r;
+	srt_bool ok = S_TRUE;
+	srt_map_cursor c;
+	enum eSM_Type t;
+	RETURN_IF(!m || !right || *right == m, S_FALSE);
+	RETURN_IF(x != ST_NIL && x >= sm_size(m), S_FALSE); /* BEHAVIOR */
+	t = (enum eSM_Type)m->d.sub_type;
+	sm_free(right);
+	r = m->bt ? sm_alloc_btree(t, 0)
+		  : m->multi ? sm_alloc_multi(t, 0)
+			     : m->rank ? sm_alloc_ranked(t, 0) : sm_alloc(t, 0);
+	RETURN_IF(!r || r == (srt_map *)sd_void, S_FALSE);
+	*right = r;
+	RETURN_IF(x == ST_NIL, S_TRUE);
+	RETURN_IF(!m->bt, st_split(m, get_node_r(m, x), right));
+	/* BEHAVIOR: not enough memory: elements already moved are kept */
+	buf = s_malloc(m->d.elem_size);
+	RETURN_IF(!buf, S_FALSE);
+	memcpy(buf, get_node_r(m, x), m->d.elem_size);
+	while (ok && sm_cursor_bound(m, (const srt_tnode *)buf, S_FALSE, &c)
+			     != ST_NIL)
+		ok = sm_mv_n(m, c.x, right, buf);
+	s_free(buf);
+	return ok;
+}
+
+srt_bool sm_join(srt_map **m, srt_map *right)
+{
+	int cmp;
+	void *buf;
+	srt_tndx x, y;
+	srt_bool ok = S_TRUE;
+	srt_map_cursor c;
+	RETURN_IF(!m || !*m || !right || *m == right, S_FALSE);
+	RETURN_IF((*m)->d.sub_type != right->d.sub_type, S_FALSE);
+	/* BEHAVIOR: duplicated keys are not joined into a map without them */
+	RETURN_IF(right->multi && !(*m)->multi, S_FALSE);
+	RETURN_IF(!sm_size(right), S_TRUE);
+	RETURN_IF(!(*m)->bt && !right->bt, st_join(m, right));
+	if (sm_size(*m)) { /* BEHAVIOR: overlapping keys */
+		x = sm_cursor_first(right, &c);
+		y = sm_cursor_last(*m, &c);
+		cmp = (*m)->cmp_f(get_node_r(*m, y), get_node_r(right, x));
+		RETURN_IF(cmp > 0 || (!cmp && !(*m)->multi), S_FALSE);
+	}
+	buf = s_malloc(right->d.elem_size);
+	RETURN_IF(!buf, S_FALSE);
+	while (ok && (x = sm_cursor_first(right, &c)) != ST_NIL)
+		ok = sm_mv_n(right, x, m, buf);
+	s_free(buf);
+	return ok;
+}
+
+/*
+ * Set algebra
+ */
+
+struct SMSetOpOut {
+	srt_map *m;   /* output set (NULL: key vector output) */
+	uint8_t *buf; /* output nodes or keys */
+	size_t es, cnt;
+};
+
+S_INLINE srt_bool sm_set_t(int t)
+{
+	return t == SM0_I32 || t == SM0_U32 || t == SM0_I || t == SM0_F
+	       || t == SM0_D || t == SM0_S;
+}
+
+S_INLINE size_t sm_so_size(const srt_map *a, const srt_map *b, int op)
+{
+	size_t sa = sm_size(a), sb = sm_size(b);
+	return op == SM_SO_UNION ? sa + sb
+	       : op == SM_SO_INTERSECT ? S_MIN(sa, sb)
+				       : sa;
+}
+
+/*
+ * Sequential output: node copy (linked later) or key copy
+ */
+S_INLINE void sm_so_emit(struct SMSetOpOut *o, const srt_tnode *n)
+{
+	uint8_t *w = o->buf + o->cnt++ * o->es;
+	if (!o->m) {
+		memcpy(w, (const uint8_t *)n + sizeof(srt_tnode), o->es);
+		return;
+	}
+	memcpy(w, n, o->es);
+	if (o->m->d.sub_type == SM0_S)
+		sso1_set(&((struct SMapS *)w)->k,
+			 sso1_get(&((const struct SMapS *)n)->k));
+}
+
+/*
+ * Linear merge of the in-order sequences. When one set is much smaller
+ * than the other (intersection) or than the subtrahend (difference), its
+ * elements are probed against the other set instead, in key order, too.
+ */
+static void sm_so_merge(const srt_map *a, const srt_map *b, int op,
+			struct SMSetOpOut *o)
+{
+	int c;
+	srt_tndx xa, xb;
+	srt_map_cursor ca, cb;
+	const srt_tnode *na;
+	const srt_map *p = NULL, *q = NULL;
+	size_t sa = sm_size(a), sb = sm_size(b);
+	if (op == SM_SO_INTERSECT) {
+		p = sa <= sb ? a : b;
+		q = p == a ? b : a;
+	} else if (op == SM_SO_DIFF) {
+		p = a;
+		q = b;
+	}
+	if (p && sm_size(p) * slog2(sm_size(q) + 1) < sa + sb) {
+		for (xa = sm_cursor_first(p, &ca); xa != ST_NIL;
+		     xa = sm_cursor_next(&ca)) {
+			na = st_enum_r(p, xa);
+			if ((sm_locate_n(q, na) ? SM_SO_INTERSECT : SM_SO_DIFF)
+			    == op)
+				sm_so_emit(o, na);
+		}
+		return;
+	}
+	xa = sm_cursor_first(a, &ca);
+	xb = sm_cursor_first(b, &cb);
+	while (xa != ST_NIL && xb != ST_NIL) {
+		na = st_enum_r(a, xa);
+		c = a->cmp_f(na, st_enum_r(b, xb));
+		if (c < 0) {
+			if (op != SM_SO_INTERSECT)
+				sm_so_emit(o, na);
+			xa = sm_cursor_next(&ca);
+		} else if (c > 0) {
+			if (op == SM_SO_UNION)
+				sm_so_emit(o, st_enum_r(b, xb));
+			xb = sm_cursor_next(&cb);
+		} else {
+			if (op != SM_SO_DIFF)
+				sm_so_emit(o, na);
+			xa = sm_cursor_next(&ca);
+			xb = sm_cursor_next(&cb);
+		}
+	}
+	if (op == SM_SO_INTERSECT)
+		return;
+	for (; xa != ST_NIL; xa = sm_cursor_next(&ca))
+		sm_so_emit(o, st_enum_r(a, xa));
+	for (; xb != ST_NIL && op == SM_SO_UNION; xb = sm_cursor_next(&cb))
+		sm_so_emit(o, st_enum_r(b, xb));
+}
+
+srt_map *sm_set_op(srt_map **s, const srt_map *a, const srt_map *b, int op)
+{
+	int t;
+	size_t ne;
+	srt_map *m;
+	struct SMSetOpOut o;
+	RETURN_IF(!s || !a || !b, NULL);
+	t = a->d.sub_type;
+	RETURN_IF(!sm_set_t(t) || !sm_chk_t(b, t), NULL); /* BEHAVIOR */
+	ne = sm_so_size(a, b, op);
+	RETURN_IF(ne > ST_NDX_MAX, NULL);
+	/*
+	 * The output set memory is reused, unless it is one of the inputs,
+	 * or it has a different configuration (BEHAVIOR: the output is
+	 * always a red-black tree set, without order statistics)
+	 */
+	if (*s && *s != a && *s != b && sm_chk_t(*s, t) && !(*s)->bt
+	    && !(*s)->rank) {
+		sm_clear(*s);
+		sm_reserve(s, ne);
+		m = *s;
+	} else {
+		m = sm_alloc((enum eSM_Type)t, ne);
+	}
+	if (!m || sm_max_size(m) < ne) {
+		if (m != *s)
+			sm_free(&m);
+		return NULL; /* BEHAVIOR: not enough memory */
+	}
+	o.m = m;
+	o.buf = (uint8_t *)sm_get_buffer(m);
+	o.es = m->d.elem_size;
+	o.cnt = 0;
+	sm_so_merge(a, b, op, &o);
+	sm_set_size(m, o.cnt);
+	m->root = o.cnt > 0 ? sm_bulk_link(m, 0, o.cnt, 0,
+					   o.cnt > 1 ? slog2(o.cnt) : 1)
+			    : ST_NIL;
+	if (m != *s) {
+		sm_free(s);
+		*s = m;
+	}
+	return m;
+}
+
+srt_vector *sm_set_op_to_vector(srt_vector **v, const srt_map *a,
+				const srt_map *b, int op)
+{
+	int t;
+	size_t ne;
+	enum eSV_Type kt;
+	struct SMSetOpOut o;
+	RETURN_IF(!v || !a || !b, NULL);
+	t = a->d.sub_type;
+	RETURN_IF(!sm_set_t(t) || t == SM0_S || !sm_chk_t(b, t),
+		  NULL); /* BEHAVIOR: numeric key sets only */
+	kt = sm_ctx[t].sort_kt;
+	ne = sm_so_size(a, b, op);
+	if (*v && (*v)->d.sub_type != kt)
+		sv_free(v);
+	if (*v) {
+		sv_clear(*v);
+		sv_reserve(v, ne);
+	} else {
+		*v = sv_alloc_t(kt, ne);
+	}
+	RETURN_IF(!*v || sv_max_size(*v) < ne,
+		  NULL); /* BEHAVIOR: not enough memory */
+	o.m = NULL;
+	o.buf = (uint8_t *)sv_get_buffer(*v);
+	o.es = (*v)->d.elem_size;
+	o.cnt = 0;
+	sm_so_merge(a, b, op, &o);
+	sv_set_size(*v, o.cnt);
+	return *v;
+}
@@ -12,6 +12,16 @@ extern "C" {
  * #DOC Map functions handle key-value storage, which is implemented as a
  * #DOC Red-Black tree (O(log n) time complexity for insert/read/delete)
  * #DOC
+ * #DOC Maps and sets with integer keys can use a B+tree index instead
+ * #DOC (sm_alloc_btree(), sms_alloc_btree()): same API and time complexity,
+ * #DOC but with fewer cache misses per lookup and faster range enumeration,
+ * #DOC at the cost of the index memory (about 16 bytes per element).
+ * #DOC
+ * #DOC Red-black tree maps and sets can keep order statistics (subtree
+ * #DOC sizes, 4 bytes per element, stored apart from the nodes), so getting
+ * #DOC the k-th element (sm_select()) or the rank of a key (sm_rank_*())
+ * #DOC takes O(log n) instead of O(n) (sm_alloc_ranked(), sms_alloc_ranked()).
+ * #DOC
  * #DOC
  * #DOC Supported key/value modes (enum eSM_Type):
  * #DOC
@@ -76,6 +86,7 @@ extern "C" {
  * Released under the BSD 3-Clause License (see the doc/LICENSE)
  */
 
+#include "saux/sbtree.h"
 #include "saux/stree.h"
 #include "saux/sstringo.h"
 #include "sstring.h"
@@ -236,6 +247,27 @@ typedef srt_bool (*srt_map_it_ds)(double k, const srt_string *, void *context);
 typedef srt_bool (*srt_map_it_dp)(double k, const void *, void *context);
 typedef srt_bool (*srt_map_it_sd)(const srt_string *, double v, void *context);
 
+struct SMapCursor {
+	const srt_map *m;
+	srt_tndx x; /* current node (ST_NIL: out of range) */
+	union {
+		struct STPath rb;
+		struct SBTPath bt;
+	} p;
+};
+
+typedef struct SMapCursor srt_map_cursor;
+
+struct SMapPart {
+	const srt_map *m;
+	srt_tndx first; /* first node */
+	srt_tndx end;   /* next partition first node (ST_NIL: map end) */
+};
+
+typedef struct SMapPart srt_map_part;
+
+typedef srt_bool (*srt_map_it_n)(const srt_map *m, srt_tndx n, void *context);
+
 /*
  * Allocation
  */
@@ -264,6 +296,8 @@ S_INLINE srt_map *sm_alloc_raw(enum eSM_Type t, srt_bool ext_buf,
 }
 
 srt_map *sm_alloc0(enum eSM_Type0 t, size_t initial_num_elems_reserve);
+srt_map *sm_alloc0_a(const srt_allocator *a, enum eSM_Type0 t,
+		     size_t initial_num_elems_reserve);
 
 /* #API: |Allocate map (heap)|map type; initial reserve|map|O(1)|1;2| */
 S_INLINE srt_map *sm_alloc(enum eSM_Type t, size_t initial_num_elems_reserve)
@@ -271,6 +305,50 @@ S_INLINE srt_map *sm_alloc(enum eSM_Type t, size_t initial_num_elems_reserve)
 	return sm_alloc0((enum eSM_Type0)t, initial_num_elems_reserve);
 }
 
+/* #API: |Allocate map (heap) using the given allocator|allocator (NULL: global allocator); map type; initial reserve|map|O(1)|1;2| */
+S_INLINE srt_map *sm_alloc_a(const srt_allocator *a, enum eSM_Type t,
+			     size_t initial_num_elems_reserve)
+{
+	return sm_alloc0_a(a, (enum eSM_Type0)t, initial_num_elems_reserve);
+}
+
+/* #API: |Allocate map (heap) using a B+tree index instead of a red-black tree (SM_II32, SM_UU32, SM_II, SM_IS, SM_IP; other map types use the red-black tree)|map type; initial reserve|map|O(1)|1;2| */
+srt_map *sm_alloc_btree(enum eSM_Type t, size_t initial_num_elems_reserve);
+
+/* #API: |Check if the map uses a B+tree index|map|S_TRUE: B+tree; S_FALSE: red-black tree|O(1)|1;2| */
+S_INLINE srt_bool sm_is_btree(const srt_map *m)
+{
+	return m && m->bt ? S_TRUE : S_FALSE;
+}
+
+/* #API: |Allocate map (heap) keeping order statistics, for O(log n) sm_select() and sm_rank_*()|map type; initial reserve|map|O(1)|1;2| */
+srt_map *sm_alloc_ranked(enum eSM_Type t, size_t initial_num_elems_reserve);
+
+/* #API: |Check if the map keeps order statistics|map|S_TRUE: O(log n) select/rank; S_FALSE: O(n) select/rank|O(1)|1;2| */
+S_INLINE srt_bool sm_is_ranked(const srt_map *m)
+{
+	return m && m->rank && !m->bt ? S_TRUE : S_FALSE;
+}
+
+/*
+ * Multimap (duplicated keys): sm_insert_*() and sm_inc_*() always add a new
+ * element, placed after the ones with the same key (so the insertion order
+ * is kept), sm_delete_*() removes one element per call, sm_at_*() gets the
+ * value of one of them, and sm_count_*() returns how many there are. The
+ * elements with a given key are the cursor range from sm_lower_bound_*()
+ * to sm_upper_bound_*(), and sm_compact() with SM_LAYOUT_INORDER places
+ * them contiguously in the node array.
+ */
+
+/* #API: |Allocate multimap (heap), allowing duplicated keys (red-black tree, without order statistics)|map type; initial reserve|map|O(1)|1;2| */
+srt_map *sm_alloc_multi(enum eSM_Type t, size_t initial_num_elems_reserve);
+
+/* #API: |Check if the map allows duplicated keys|map|S_TRUE: multimap; S_FALSE: unique keys|O(1)|1;2| */
+S_INLINE srt_bool sm_is_multi(const srt_map *m)
+{
+	return m && m->multi ? S_TRUE : S_FALSE;
+}
+
 /* #NOTAPI: |Get map node size from map type|map type|bytes required for storing a single node|O(1)|1;2| */
 S_INLINE uint8_t sm_elem_size(int t)
 {
@@ -348,6 +426,12 @@ size_t sm_reserve(srt_map **m, size_t max_elems)
 #API: |Make the map use the minimum possible memory|map|map reference (optional usage)|O(1) for allocators using memory remap; O(n) for naive allocators|1;2|
 srt_map *sm_shrink(srt_map **m);
 
+#API: |Set growth policy (SD_GROW_DEFAULT, SD_GROW_EXACT, SD_GROW_DOUBLE, SD_GROW_HALF, SD_GROW_LINEAR, optionally combined with SD_GROW_PAGE and/or SD_GROW_SPILL -for stack-allocated ones-)|map;growth policy|-|O(1)|1;2|
+void sm_set_grow_policy(srt_map *m, int policy)
+
+#API: |Get growth policy|map|growth policy|O(1)|1;2|
+int sm_grow_policy(const srt_map *m)
+
 #API: |Get map size|map|Map number of elements|O(1)|1;2|
 size_t sm_size(const srt_map *m);
 
@@ -365,9 +449,32 @@ srt_bool sm_empty(const srt_map *m)
  * Copy
  */
 
-/* #API: |Overwrite map with a map copy|output map; input map|output map reference (optional usage)|O(n)|1;2| */
+/* #API: |Overwrite map with a map copy (an existing output map keeps its red-black tree or B+tree backend and order statistics configuration; a new one takes the ones of the input map)|output map; input map|output map reference (optional usage)|O(n)|1;2| */
 srt_map *sm_cpy(srt_map **m, const srt_map *src);
 
+/*
+ * Bulk load
+ */
+
+/* #API: |Build map from key and value vectors, e.g. from sm_sort_to_vectors() output (SM_II32, SM_UU32, SM_II, SM_FF, SM_DD; vector types: SV_I32, SV_U32, SV_I64, SV_F, SV_D). Sorted input, without duplicated keys, is linked as balanced tree without comparisons; otherwise it is sorted first, keeping the last value for duplicated keys|map type; key vector; value vector|map (NULL: unsupported type, vector type/size mismatch, or not enough memory)|O(n) for sorted input; O(n log n) otherwise|1;2| */
+srt_map *sm_from_sorted_vectors(enum eSM_Type t, const srt_vector *kv, const srt_vector *vv);
+
+/*
+ * Persistence (store/restore)
+ */
+
+/* #API: |Save map image to file (integer and floating point key/value maps and sets, i.e. not having strings or pointers; B+tree maps are not supported)|file handle; map|S_TRUE: OK; S_FALSE: I/O error or unsupported map type|O(n): WARNING: involves external file I/O|1;2| */
+srt_bool sm_save(FILE *f, const srt_map *m);
+
+/* #API: |Load map image from file|file handle|map (NULL: I/O error, not enough memory, or invalid/incompatible image)|O(n): WARNING: involves external file I/O|1;2| */
+srt_map *sm_load(FILE *f);
+
+/* #API: |Open map image file using memory mapping (no deserialization: the mapped file is used as fixed-size map; changes are not written back to the file)|file path|map (NULL: I/O error, invalid/incompatible image, or system without mmap() support)|O(1)|1;2| */
+srt_map *sm_map(const char *path);
+
+/* #API: |Release map opened with sm_map()|map|-|O(1)|1;2| */
+void sm_unmap(srt_map **m);
+
 /*
  * Random access
  */
@@ -415,22 +522,22 @@ double sm_at_sd(const srt_map *m, const srt_string *k);
  * Existence check
  */
 
-/* #API: |Map element count/check (SM_II32)|map; key|S_TRUE: element found; S_FALSE: not in the map|O(log n)|1;2| */
+/* #API: |Map element count/check (SM_II32)|map; key|number of elements with the key (0 or 1, except for multimaps)|O(log n); multimap: O(log n + m)|1;2| */
 size_t sm_count_i32(const srt_map *m, int32_t k);
 
-/* #API: |Map element count/check|map (SM_UU32); key|S_TRUE: element found; S_FALSE: not in the map|O(log n)|1;2| */
+/* #API: |Map element count/check|map (SM_UU32); key|number of elements with the key (0 or 1, except for multimaps)|O(log n); multimap: O(log n + m)|1;2| */
 size_t sm_count_u32(const srt_map *m, uint32_t k);
 
-/* #API: |Map element count/check|map (SM_II); key|S_TRUE: element found; S_FALSE: not in the map|O(log n)|1;2| */
+/* #API: |Map element count/check|map (SM_II); key|number of elements with the key (0 or 1, except for multimaps)|O(log n); multimap: O(log n + m)|1;2| */
 size_t sm_count_i(const srt_map *m, int64_t k);
 
-/* #API: |Map element count/check|map (SM_FF); key|S_TRUE: element found; S_FALSE: not in the map|O(log n)|1;2| */
+/* #API: |Map element count/check|map (SM_FF); key|number of elements with the key (0 or 1, except for multimaps)|O(log n); multimap: O(log n + m)|1;2| */
 size_t sm_count_f(const srt_map *m, float k);
 
-/* #API: |Map element count/check|map (SM_D*); key|S_TRUE: element found; S_FALSE: not in the map|O(log n)|1;2| */
+/* #API: |Map element count/check|map (SM_D*); key|number of elements with the key (0 or 1, except for multimaps)|O(log n); multimap: O(log n + m)|1;2| */
 size_t sm_count_d(const srt_map *m, double k);
 
-/* #API: |Map element count/check|map (SM_S*); key|S_TRUE: element found; S_FALSE: not in the map|O(log n)|1;2| */
+/* #API: |Map element count/check|map (SM_S*); key|number of elements with the key (0 or 1, except for multimaps)|O(log n); multimap: O(log n + m)|1;2| */
 size_t sm_count_s(const srt_map *m, const srt_string *k);
 
 /*
@@ -562,9 +669,171 @@ size_t sm_itr_ss(const srt_map *m, const srt_string *key_min, const srt_string *
 /* #API: |Enumerate map elements in a given key range (SM_SP)|map; key lower bound; key upper bound; callback function; callback function context|Elements processed|O(log n) + O(log m); additional 2 * O(log n) space required, allocated on the stack, i.e. fast|1;2| */
 size_t sm_itr_sp(const srt_map *m, const srt_string *key_min, const srt_string *key_max, srt_map_it_sp f, void *context);
 
+/*
+ * Cursors (ordered navigation, without callbacks)
+ *
+ * The cursor holds the path from the root to the current node, so stepping
+ * to the next/previous element takes O(1) amortized time. Elements are
+ * accessed with the node index and the sm_it_*() functions. Any map
+ * modification invalidates the cursors (reposition them after it).
+ */
+
+/* #API: |Position cursor at the first element with key >= k (int32_t key: SM_II32, SMS_I32)|map; key; cursor|node index (ST_NIL: not found)|O(log n)|1;2| */
+srt_tndx sm_lower_bound_i32(const srt_map *m, int32_t k, srt_map_cursor *c);
+
+/* #API: |Position cursor at the first element with key >= k (uint32_t key: SM_UU32, SMS_U32)|map; key; cursor|node index (ST_NIL: not found)|O(log n)|1;2| */
+srt_tndx sm_lower_bound_u32(const srt_map *m, uint32_t k, srt_map_cursor *c);
+
+/* #API: |Position cursor at the first element with key >= k (int64_t key: SM_II, SM_IS, SM_IP, SMS_I)|map; key; cursor|node index (ST_NIL: not found)|O(log n)|1;2| */
+srt_tndx sm_lower_bound_i(const srt_map *m, int64_t k, srt_map_cursor *c);
+
+/* #API: |Position cursor at the first element with key >= k (float key: SM_FF, SMS_F)|map; key; cursor|node index (ST_NIL: not found)|O(log n)|1;2| */
+srt_tndx sm_lower_bound_f(const srt_map *m, float k, srt_map_cursor *c);
+
+/* #API: |Position cursor at the first element with key >= k (double key: SM_DD, SM_DS, SM_DP, SMS_D)|map; key; cursor|node index (ST_NIL: not found)|O(log n)|1;2| */
+srt_tndx sm_lower_bound_d(const srt_map *m, double k, srt_map_cursor *c);
+
+/* #API: |Position cursor at the first element with key >= k (string key: SM_SI, SM_SD, SM_SS, SM_SP, SMS_S)|map; key; cursor|node index (ST_NIL: not found)|O(log n)|1;2| */
+srt_tndx sm_lower_bound_s(const srt_map *m, const srt_string *k, srt_map_cursor *c);
+
+/* #API: |Position cursor at the first element with key > k (int32_t key: SM_II32, SMS_I32)|map; key; cursor|node index (ST_NIL: not found)|O(log n)|1;2| */
+srt_tndx sm_upper_bound_i32(const srt_map *m, int32_t k, srt_map_cursor *c);
+
+/* #API: |Position cursor at the first element with key > k (uint32_t key: SM_UU32, SMS_U32)|map; key; cursor|node index (ST_NIL: not found)|O(log n)|1;2| */
+srt_tndx sm_upper_bound_u32(const srt_map *m, uint32_t k, srt_map_cursor *c);
+
+/* #API: |Position cursor at the first element with key > k (int64_t key: SM_II, SM_IS, SM_IP, SMS_I)|map; key; cursor|node index (ST_NIL: not found)|O(log n)|1;2| */
+srt_tndx sm_upper_bound_i(const srt_map *m, int64_t k, srt_map_cursor *c);
+
+/* #API: |Position cursor at the first element with key > k (float key: SM_FF, SMS_F)|map; key; cursor|node index (ST_NIL: not found)|O(log n)|1;2| */
+srt_tndx sm_upper_bound_f(const srt_map *m, float k, srt_map_cursor *c);
+
+/* #API: |Position cursor at the first element with key > k (double key: SM_DD, SM_DS, SM_DP, SMS_D)|map; key; cursor|node index (ST_NIL: not found)|O(log n)|1;2| */
+srt_tndx sm_upper_bound_d(const srt_map *m, double k, srt_map_cursor *c);
+
+/* #API: |Position cursor at the first element with key > k (string key: SM_SI, SM_SD, SM_SS, SM_SP, SMS_S)|map; key; cursor|node index (ST_NIL: not found)|O(log n)|1;2| */
+srt_tndx sm_upper_bound_s(const srt_map *m, const srt_string *k, srt_map_cursor *c);
+
+/* #API: |Position cursor at the first element (lowest key)|map; cursor|node index (ST_NIL: empty map)|O(log n)|1;2| */
+srt_tndx sm_cursor_first(const srt_map *m, srt_map_cursor *c);
+
+/* #API: |Position cursor at the last element (highest key)|map; cursor|node index (ST_NIL: empty map)|O(log n)|1;2| */
+srt_tndx sm_cursor_last(const srt_map *m, srt_map_cursor *c);
+
+/* #API: |Move cursor to the next element (in key order)|cursor|node index (ST_NIL: no more elements)|O(1) amortized; O(log n) worst case|1;2| */
+srt_tndx sm_cursor_next(srt_map_cursor *c);
+
+/* #API: |Move cursor to the previous element (in key order)|cursor|node index (ST_NIL: no more elements)|O(1) amortized; O(log n) worst case|1;2| */
+srt_tndx sm_cursor_prev(srt_map_cursor *c);
+
+/* #API: |Current cursor element|cursor|node index (ST_NIL: out of range)|O(1)|1;2| */
+S_INLINE srt_tndx sm_cursor_node(const srt_map_cursor *c)
+{
+	return c ? c->x : ST_NIL;
+}
+
+/*
+ * Order statistics
+ */
+
+/* #API: |Get the k-th element, in key order|map; position (0: lowest key)|node index (ST_NIL: out of range)|O(log n) with order statistics (sm_alloc_ranked()), O(n) otherwise|1;2| */
+srt_tndx sm_select(const srt_map *m, size_t k);
+
+/* #API: |Number of elements with key lower than k (int32_t key: SM_II32, SMS_I32)|map; key|rank|O(log n) with order statistics (sm_alloc_ranked()), O(n) otherwise|1;2| */
+size_t sm_rank_i32(const srt_map *m, int32_t k);
+
+/* #API: |Number of elements with key lower than k (uint32_t key: SM_UU32, SMS_U32)|map; key|rank|O(log n) with order statistics (sm_alloc_ranked()), O(n) otherwise|1;2| */
+size_t sm_rank_u32(const srt_map *m, uint32_t k);
+
+/* #API: |Number of elements with key lower than k (int64_t key: SM_II, SM_IS, SM_IP, SMS_I)|map; key|rank|O(log n) with order statistics (sm_alloc_ranked()), O(n) otherwise|1;2| */
+size_t sm_rank_i(const srt_map *m, int64_t k);
+
+/* #API: |Number of elements with key lower than k (float key: SM_FF, SMS_F)|map; key|rank|O(log n) with order statistics (sm_alloc_ranked()), O(n) otherwise|1;2| */
+size_t sm_rank_f(const srt_map *m, float k);
+
+/* #API: |Number of elements with key lower than k (double key: SM_DD, SM_DS, SM_DP, SMS_D)|map; key|rank|O(log n) with order statistics (sm_alloc_ranked()), O(n) otherwise|1;2| */
+size_t sm_rank_d(const srt_map *m, double k);
+
+/* #API: |Number of elements with key lower than k (string key: SM_SI, SM_SD, SM_SS, SM_SP, SMS_S)|map; key|rank|O(log n) with order statistics (sm_alloc_ranked()), O(n) otherwise|1;2| */
+size_t sm_rank_s(const srt_map *m, const srt_string *k);
+
+/*
+ * Partitioned scan
+ *
+ * A key range is split into key-ordered partitions, for processing them
+ * in parallel, e.g. one worker thread per partition, each one with its own
+ * callback context, reducing the contexts after joining the threads. The
+ * scan is read-only, so concurrent partition scans are safe, as long as
+ * the map is not modified meanwhile. The split points come from the top
+ * levels of the tree, so partitions are approximately balanced (exactly,
+ * with order statistics, see sm_alloc_ranked()).
+ */
+
+/* #API: |Split key range into up to k partitions (whole map: first from sm_cursor_first(), end ST_NIL; key range: first from sm_lower_bound_*(), end from sm_upper_bound_*())|map; first node of the range; node after the range (ST_NIL: up to the map end); output partitions (k elements); maximum number of partitions|number of partitions (0: empty range)|O(k log n)|1;2| */
+size_t sm_part_split(const srt_map *m, srt_tndx first, srt_tndx end, srt_map_part *p, size_t k);
+
+/* #API: |Enumerate partition elements, in key order (read them with sm_it_*())|partition; callback function (it returns S_FALSE for stopping the scan); callback function context|Elements processed|O(n) (n: partition elements)|1;2| */
+size_t sm_part_scan(const srt_map_part *p, srt_map_it_n f, void *context);
+
+/*
+ * Node layout
+ *
+ * Nodes are stored in a vector (deleted nodes are filled with the last
+ * one, so there are no holes), but after insert/delete churn, nodes with
+ * neighbouring keys are scattered across it. Rewriting the node array
+ * restores the memory access locality. Node indexes (e.g. the ones from
+ * cursors or sm_select()) are invalidated.
+ */
+
+enum eSM_Layout {
+	SM_LAYOUT_INORDER = ST_LAYOUT_INORDER,
+	SM_LAYOUT_BFS = ST_LAYOUT_BFS,
+	SM_LAYOUT_VEB = ST_LAYOUT_VEB
+};
+
+/* #API: |Rewrite the node array in the given layout (SM_LAYOUT_INORDER: key order, for range scans; SM_LAYOUT_BFS: level order; SM_LAYOUT_VEB: van Emde Boas, for lookups). B+tree maps always use key order|map; layout|S_TRUE: OK; S_FALSE: not enough memory|O(n); SM_LAYOUT_VEB: O(n log log n)|1;2| */
+srt_bool sm_compact(srt_map *m, enum eSM_Layout l);
+
+/* #API: |Incremental key order relayout (e.g. for running it in idle periods): move the next nodes, in key order, to the beginning of the node array. Map modifications between steps are allowed (the layout is then approximate)|map; number of nodes already placed (0: start; it is updated); maximum number of nodes to place|S_TRUE: layout complete; S_FALSE: pending|O(steps log n)|1;2| */
+srt_bool sm_compact_step(srt_map *m, size_t *pos, size_t steps);
+
+/*
+ * Split and join (key range partitioning, e.g. for moving elements between
+ * shards). The tree is split or joined in O(log n); nodes moved to the other
+ * map are copied, as every map has its own node vector. B+tree maps, or
+ * mixing backends, move the elements one by one.
+ */
+
+/* #API: |Split map: elements with key not lower than the one of the given node (e.g. from sm_lower_bound_*()) are moved to the output map, which gets the same backend as the input map (any previous content is released)|map; node index (ST_NIL: nothing moved); output map|S_TRUE: OK; S_FALSE: invalid node or not enough memory|O(log n) + O(m log n), being m the number of elements moved; B+tree: O(m log n)|1;2| */
+srt_bool sm_split(srt_map *m, srt_tndx x, srt_map **right);
+
+/* #API: |Join maps: the elements of the second map, with keys greater than the ones of the first map, are moved to it|map; map (it is left empty)|S_TRUE: OK; S_FALSE: type mismatch, overlapping keys, or not enough memory|O(log n) + O(m), being m the number of elements moved; B+tree: O(m log n)|1;2| */
+srt_bool sm_join(srt_map **m, srt_map *right);
+
+/*
+ * Set algebra (see smset.h)
+ */
+
+enum eSM_SetOp { SM_SO_UNION, SM_SO_INTERSECT, SM_SO_DIFF };
+
+/* #NOTAPI: |Set union/intersection/difference, written in key order and linked as balanced tree without comparisons|output set (it can be one of the inputs); set; set; operation (SM_SO_UNION, SM_SO_INTERSECT, SM_SO_DIFF)|output set (NULL: set type mismatch, or not enough memory)|O(n + m); O(m log n) when probing a small set against a large one|1;2| */
+srt_map *sm_set_op(srt_map **s, const srt_map *a, const srt_map *b, int op);
+
+/* #NOTAPI: |Set union/intersection/difference into sorted key vector (numeric key sets)|output vector; set; set; operation (SM_SO_UNION, SM_SO_INTERSECT, SM_SO_DIFF)|output vector (NULL: set type mismatch, or not enough memory)|O(n + m); O(m log n) when probing a small set against a large one|1;2| */
+srt_vector *sm_set_op_to_vector(srt_vector **v, const srt_map *a, const srt_map *b, int op);
+
 /* #NOTAPI: |Sort map to vector (used for test coverage, not as documented API)|map; output vector for keys; output vector for values|Number of map elements|O(n)|0;1| */
 ssize_t sm_sort_to_vectors(const srt_map *m, srt_vector **kv, srt_vector **vv);
 
+/* #NOTAPI: |Locate node (red-black tree or B+tree)|map; node with the key|node (NULL: not found)|O(log n)|1;2| */
+const srt_tnode *sm_locate_n(const srt_map *m, const srt_tnode *n);
+
+/* #NOTAPI: |Insert node (red-black tree or B+tree)|map; node; rewrite function (optional)|S_TRUE: OK, S_FALSE: error (not enough memory)|O(log n)|1;2| */
+srt_bool sm_insert_n(srt_map **m, const srt_tnode *n, srt_tree_rewrite rw_f);
+
+/* #NOTAPI: |Delete node (red-black tree or B+tree)|map; node with the key; node delete callback (optional)|S_TRUE: found and deleted; S_FALSE: not found|O(log n)|1;2| */
+srt_bool sm_delete_n(srt_map *m, const srt_tnode *n, srt_tree_callback callback);
+
 /*
  * Auxiliary inlined functions
  */
@@ -708,13 +977,15 @@ S_INLINE const void *sm_it_sp_v(const srt_map *m, srt_tndx i)
 	 */
 
 #define SM_ENUM_INORDER_XX(FN, CALLBACK_T, MAP_TYPE, KEY_T, TR_CMP_MIN,        \
-			   TR_CMP_MAX, TR_CALLBACK)                            \
+			   TR_CMP_MAX, TR_CALLBACK, BT_KMIN)                   \
 	size_t FN(const srt_map *m, KEY_T kmin, KEY_T kmax, CALLBACK_T f,      \
 		  void *context)                                               \
 	{                                                                      \
 		ssize_t level;                                                 \
 		size_t ts, nelems, rbt_max_depth;                              \
 		struct STreeScan *p;                                           \
+		struct SBTScan bs;                                             \
+		srt_tndx bx;                                                   \
 		const srt_tnode *cn;                                           \
 		int cmpmin, cmpmax;                                            \
 		RETURN_IF(!m, 0);			 /* null tree */       \
@@ -723,6 +994,19 @@ S_INLINE const void *sm_it_sp_v(const srt_map *m, srt_tndx i)
 		RETURN_IF(!ts, S_FALSE); /* empty tree */                      \
 		level = 0;                                                     \
 		nelems = 0;                                                    \
+		if (m->bt) { /* B+tree: linked leaves scan */                  \
+			sbt_scan_lb(m->bt, BT_KMIN, &bs);                      \
+			while (sbt_scan_next(&bs, &bx)) {                      \
+				cn = get_node_r(m, bx);                        \
+				cmpmax = TR_CMP_MAX;                           \
+				if (cmpmax > 0)                                \
+					break;                                 \
+				if (f && !TR_CALLBACK)                         \
+					return nelems;                         \
+				nelems++;                                      \
+			}                                                      \
+			return nelems;                                         \
+		}                                                              \
 		rbt_max_depth = 2 * (slog2(ts) + 1);                           \
 		p = (struct STreeScan *)s_alloca(sizeof(struct STreeScan)      \
 						 * (rbt_max_depth + 3));       \
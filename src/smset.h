@@ -102,6 +102,34 @@ S_INLINE srt_set *sms_alloc(enum eSMS_Type t, size_t initial_num_elems_reserve)
 	return sm_alloc0((enum eSM_Type0)t, initial_num_elems_reserve);
 }
 
+/* #API: |Allocate set (heap) using the given allocator|allocator (NULL: global allocator); set type; initial reserve|set|O(1)|1;2| */
+S_INLINE srt_set *sms_alloc_a(const srt_allocator *a, enum eSMS_Type t,
+			      size_t initial_num_elems_reserve)
+{
+	return sm_alloc0_a(a, (enum eSM_Type0)t, initial_num_elems_reserve);
+}
+
+/* #API: |Allocate set (heap) using a B+tree index instead of a red-black tree (SMS_I32, SMS_U32, SMS_I; other set types use the red-black tree)|set type; initial reserve|set|O(1)|1;2| */
+S_INLINE srt_set *sms_alloc_btree(enum eSMS_Type t,
+				  size_t initial_num_elems_reserve)
+{
+	return sm_alloc_btree((enum eSM_Type)t, initial_num_elems_reserve);
+}
+
+/* #API: |Allocate set (heap) keeping order statistics, for O(log n) sms_select() and sms_rank_*()|set type; initial reserve|set|O(1)|1;2| */
+S_INLINE srt_set *sms_alloc_ranked(enum eSMS_Type t,
+				   size_t initial_num_elems_reserve)
+{
+	return sm_alloc_ranked((enum eSM_Type)t, initial_num_elems_reserve);
+}
+
+/* #API: |Allocate multiset (heap), allowing duplicated elements (see sm_alloc_multi())|set type; initial reserve|set|O(1)|1;2| */
+S_INLINE srt_set *sms_alloc_multi(enum eSMS_Type t,
+				  size_t initial_num_elems_reserve)
+{
+	return sm_alloc_multi((enum eSM_Type)t, initial_num_elems_reserve);
+}
+
 /* #API: |Duplicate set|input set|output set|O(n)|1;2| */
 S_INLINE srt_set *sms_dup(const srt_set *src)
 {
@@ -136,6 +164,12 @@ size_t sms_reserve(srt_set **s, size_t max_elems)
 #API: |Make the set use the minimum possible memory|set|set reference (optional usage)|O(1) for allocators using memory reset; O(n) for naive allocators|1;2|
 srt_set *sms_shrink(srt_set **s);
 
+#API: |Set growth policy (SD_GROW_DEFAULT, SD_GROW_EXACT, SD_GROW_DOUBLE, SD_GROW_HALF, SD_GROW_LINEAR, optionally combined with SD_GROW_PAGE and/or SD_GROW_SPILL -for stack-allocated ones-)|set;growth policy|-|O(1)|1;2|
+void sms_set_grow_policy(srt_set *s, int policy)
+
+#API: |Get growth policy|set|growth policy|O(1)|1;2|
+int sms_grow_policy(const srt_set *s)
+
 #API: |Get set size|set|Set number of elements|O(1)|1;2|
 size_t sms_size(const srt_set *s);
 
@@ -163,41 +197,51 @@ S_INLINE srt_set *sms_cpy(srt_set **s, const srt_set *src)
 	return sm_cpy(s, src);
 }
 
+/*
+ * Bulk load
+ */
+
+/* #API: |Build set from key vector (SMS_I32, SMS_U32, SMS_I, SMS_F, SMS_D; vector types: SV_I32, SV_U32, SV_I64, SV_F, SV_D). Sorted input, without duplicated keys, is linked as balanced tree without comparisons; otherwise it is sorted first, and duplicated keys are removed|set type; key vector|set (NULL: unsupported type, vector type mismatch, or not enough memory)|O(n) for sorted input; O(n log n) otherwise|1;2| */
+S_INLINE srt_set *sms_from_sorted_vector(enum eSMS_Type t, const srt_vector *kv)
+{
+	return sm_from_sorted_vectors((enum eSM_Type)t, kv, NULL);
+}
+
 /*
  * Existence check
  */
 
-/* #API: |Set element count/check (SMS_U32)|set; key|S_TRUE: element found; S_FALSE: not in the set|O(log n)|1;2| */
+/* #API: |Set element count/check (SMS_U32)|set; key|number of elements equal to the key (0 or 1, except for multisets)|O(log n); multiset: O(log n + m)|1;2| */
 S_INLINE size_t sms_count_u32(const srt_set *s, uint32_t k)
 {
 	return sm_count_u32(s, k);
 }
 
-/* #API: |Set element count/check (SMS_I32)|set; key|S_TRUE: element found; S_FALSE: not in the set|O(log n)|1;2| */
+/* #API: |Set element count/check (SMS_I32)|set; key|number of elements equal to the key (0 or 1, except for multisets)|O(log n); multiset: O(log n + m)|1;2| */
 S_INLINE size_t sms_count_i32(const srt_set *s, int32_t k)
 {
 	return sm_count_i32(s, k);
 }
 
-/* #API: |Set element count/check (SMS_I)|set; key|S_TRUE: element found; S_FALSE: not in the set|O(log n)|1;2| */
+/* #API: |Set element count/check (SMS_I)|set; key|number of elements equal to the key (0 or 1, except for multisets)|O(log n); multiset: O(log n + m)|1;2| */
 S_INLINE size_t sms_count_i(const srt_set *s, int64_t k)
 {
 	return sm_count_i(s, k);
 }
 
-/* #API: |Set element count/check (SMS_F)|set; key|S_TRUE: element found; S_FALSE: not in the set|O(log n)|1;2| */
+/* #API: |Set element count/check (SMS_F)|set; key|number of elements equal to the key (0 or 1, except for multisets)|O(log n); multiset: O(log n + m)|1;2| */
 S_INLINE size_t sms_count_f(const srt_set *s, float k)
 {
 	return sm_count_f(s, k);
 }
 
-/* #API: |Set element count/check (SMS_D)|set; key|S_TRUE: element found; S_FALSE: not in the set|O(log n)|1;2| */
+/* #API: |Set element count/check (SMS_D)|set; key|number of elements equal to the key (0 or 1, except for multisets)|O(log n); multiset: O(log n + m)|1;2| */
 S_INLINE size_t sms_count_d(const srt_set *s, double k)
 {
 	return sm_count_d(s, k);
 }
 
-/* #API: |Set element count/check (SMS_S)|set; key|S_TRUE: element found; S_FALSE: not in the set|O(log n)|1;2| */
+/* #API: |Set element count/check (SMS_S)|set; key|number of elements equal to the key (0 or 1, except for multisets)|O(log n); multiset: O(log n + m)|1;2| */
 S_INLINE size_t sms_count_s(const srt_set *s, const srt_string *k)
 {
 	return sm_count_s(s, k);
@@ -213,7 +257,7 @@ S_INLINE srt_bool sms_insert_i32(srt_set **s, int32_t k)
 	struct SMapi n;
 	RETURN_IF(!s || (*s)->d.sub_type != SMS_I32, S_FALSE);
 	n.k = k;
-	return st_insert((srt_tree **)s, (const srt_tnode *)&n);
+	return sm_insert_n(s, (const srt_tnode *)&n, NULL);
 }
 
 /* #API: |Insert element (SMS_U32)|set; key|S_TRUE: OK, S_FALSE: insertion error|O(log n)|1;2| */
@@ -222,7 +266,7 @@ S_INLINE srt_bool sms_insert_u32(srt_set **s, uint32_t k)
 	struct SMapu n;
 	RETURN_IF(!s || (*s)->d.sub_type != SMS_U32, S_FALSE);
 	n.k = k;
-	return st_insert((srt_tree **)s, (const srt_tnode *)&n);
+	return sm_insert_n(s, (const srt_tnode *)&n, NULL);
 }
 
 /* #API: |Insert element (SMS_I)|set; key|S_TRUE: OK, S_FALSE: insertion error|O(log n)|1;2| */
@@ -231,7 +275,7 @@ S_INLINE srt_bool sms_insert_i(srt_set **s, int64_t k)
 	struct SMapI n;
 	RETURN_IF(!s || (*s)->d.sub_type != SMS_I, S_FALSE);
 	n.k = k;
-	return st_insert((srt_tree **)s, (const srt_tnode *)&n);
+	return sm_insert_n(s, (const srt_tnode *)&n, NULL);
 }
 
 /* #API: |Insert element (SMS_F)|set; key|S_TRUE: OK, S_FALSE: insertion error|O(log n)|1;2| */
@@ -240,7 +284,7 @@ S_INLINE srt_bool sms_insert_f(srt_set **s, float k)
 	struct SMapF n;
 	RETURN_IF(!s || (*s)->d.sub_type != SMS_F, S_FALSE);
 	n.k = k;
-	return st_insert((srt_tree **)s, (const srt_tnode *)&n);
+	return sm_insert_n(s, (const srt_tnode *)&n, NULL);
 }
 
 /* #API: |Insert element (SMS_D)|set; key|S_TRUE: OK, S_FALSE: insertion error|O(log n)|1;2| */
@@ -249,7 +293,7 @@ S_INLINE srt_bool sms_insert_d(srt_set **s, double k)
 	struct SMapD n;
 	RETURN_IF(!s || (*s)->d.sub_type != SMS_D, S_FALSE);
 	n.k = k;
-	return st_insert((srt_tree **)s, (const srt_tnode *)&n);
+	return sm_insert_n(s, (const srt_tnode *)&n, NULL);
 }
 
 /* #API: |Insert element (SMS_S)|set; key|S_TRUE: OK, S_FALSE: insertion error|O(log n)|1;2| */
@@ -260,7 +304,7 @@ S_INLINE srt_bool sms_insert_s(srt_set **s, const srt_string *k)
 	RETURN_IF(!s || (*s)->d.sub_type != SMS_S, S_FALSE);
 #if 1 /* workaround */
 	sso1_set(&n.k, k);
-	ins_ok = st_insert((srt_tree **)s, (const srt_tnode *)&n);
+	ins_ok = sm_insert_n(s, (const srt_tnode *)&n, NULL);
 	if (!ins_ok)
 		sso1_free(&n.k);
 	return ins_ok;
@@ -334,6 +378,114 @@ size_t sms_itr_d(const srt_set *s, double key_min, double key_max, srt_set_it_d
 /* #API: |Enumerate elements in a given key range (SMS_S)|set; key lower bound; key upper bound; callback function; callback function context|Elements processed|O(log n) + O(log m); additional 2 * O(log n) space required, allocated on the stack, i.e. fast|1;2| */
 size_t sms_itr_s(const srt_set *s, const srt_string *key_min, const srt_string *key_max, srt_set_it_s f, void *context);
 
+/*
+ * Order statistics
+ */
+
+/* #API: |Get the k-th element, in key order (read it with sms_it_*())|set; position (0: lowest key)|node index (ST_NIL: out of range)|O(log n) with order statistics (sms_alloc_ranked()), O(n) otherwise|1;2| */
+S_INLINE srt_tndx sms_select(const srt_set *s, size_t k)
+{
+	return sm_select(s, k);
+}
+
+/* #API: |Number of elements lower than k (SMS_I32)|set; key|rank|O(log n) with order statistics (sms_alloc_ranked()), O(n) otherwise|1;2| */
+S_INLINE size_t sms_rank_i32(const srt_set *s, int32_t k)
+{
+	return sm_rank_i32(s, k);
+}
+
+/* #API: |Number of elements lower than k (SMS_U32)|set; key|rank|O(log n) with order statistics (sms_alloc_ranked()), O(n) otherwise|1;2| */
+S_INLINE size_t sms_rank_u32(const srt_set *s, uint32_t k)
+{
+	return sm_rank_u32(s, k);
+}
+
+/* #API: |Number of elements lower than k (SMS_I)|set; key|rank|O(log n) with order statistics (sms_alloc_ranked()), O(n) otherwise|1;2| */
+S_INLINE size_t sms_rank_i(const srt_set *s, int64_t k)
+{
+	return sm_rank_i(s, k);
+}
+
+/* #API: |Number of elements lower than k (SMS_F)|set; key|rank|O(log n) with order statistics (sms_alloc_ranked()), O(n) otherwise|1;2| */
+S_INLINE size_t sms_rank_f(const srt_set *s, float k)
+{
+	return sm_rank_f(s, k);
+}
+
+/* #API: |Number of elements lower than k (SMS_D)|set; key|rank|O(log n) with order statistics (sms_alloc_ranked()), O(n) otherwise|1;2| */
+S_INLINE size_t sms_rank_d(const srt_set *s, double k)
+{
+	return sm_rank_d(s, k);
+}
+
+/* #API: |Number of elements lower than k (SMS_S)|set; key|rank|O(log n) with order statistics (sms_alloc_ranked()), O(n) otherwise|1;2| */
+S_INLINE size_t sms_rank_s(const srt_set *s, const srt_string *k)
+{
+	return sm_rank_s(s, k);
+}
+
+/*
+ * Split and join (see sm_split() and sm_join())
+ */
+
+/* #API: |Split set: elements not lower than the given node (e.g. from sm_lower_bound_*()) are moved to the output set|set; node index (ST_NIL: nothing moved); output set (any previous content is released)|S_TRUE: OK; S_FALSE: invalid node or not enough memory|O(log n) + O(m log n), being m the number of elements moved|1;2| */
+S_INLINE srt_bool sms_split(srt_set *s, srt_tndx x, srt_set **right)
+{
+	return sm_split(s, x, right);
+}
+
+/* #API: |Join sets: the elements of the second set, greater than the ones of the first set, are moved to it|set; set (it is left empty)|S_TRUE: OK; S_FALSE: type mismatch, overlapping elements, or not enough memory|O(log n) + O(m), being m the number of elements moved|1;2| */
+S_INLINE srt_bool sms_join(srt_set **s, srt_set *right)
+{
+	return sm_join(s, right);
+}
+
+/*
+ * Set algebra
+ *
+ * Linear merge of the in-order sequences, writing the output sequentially
+ * and linking it as balanced tree, without comparisons.
+ */
+
+/* #API: |Union (elements in a or b), written into a red-black tree set|output set (it can be one of the inputs); set a; set b (same type)|output set (NULL: set type mismatch or not enough memory)|O(n + m)|1;2| */
+S_INLINE srt_set *sms_union(srt_set **s, const srt_set *a, const srt_set *b)
+{
+	return sm_set_op(s, a, b, SM_SO_UNION);
+}
+
+/* #API: |Intersection (elements in both a and b), written into a red-black tree set|output set (it can be one of the inputs); set a; set b (same type)|output set (NULL: set type mismatch or not enough memory)|O(n + m); O(m log n) when the smaller set is probed against the larger one|1;2| */
+S_INLINE srt_set *sms_intersect(srt_set **s, const srt_set *a, const srt_set *b)
+{
+	return sm_set_op(s, a, b, SM_SO_INTERSECT);
+}
+
+/* #API: |Difference (elements in a but not in b), written into a red-black tree set|output set (it can be one of the inputs); set a; set b (same type)|output set (NULL: set type mismatch or not enough memory)|O(n + m); O(m log n) when the smaller set is probed against the larger one|1;2| */
+S_INLINE srt_set *sms_diff(srt_set **s, const srt_set *a, const srt_set *b)
+{
+	return sm_set_op(s, a, b, SM_SO_DIFF);
+}
+
+/* #API: |Union (elements in a or b) into sorted key vector (SMS_I32, SMS_U32, SMS_I, SMS_F, SMS_D; vector types: SV_I32, SV_U32, SV_I64, SV_F, SV_D)|output vector; set a; set b (same type)|output vector (NULL: unsupported or mismatched set type, or not enough memory)|O(n + m)|1;2| */
+S_INLINE srt_vector *sms_union_to_vector(srt_vector **v, const srt_set *a,
+					 const srt_set *b)
+{
+	return sm_set_op_to_vector(v, a, b, SM_SO_UNION);
+}
+
+/* #API: |Intersection (elements in both a and b) into sorted key vector (SMS_I32, SMS_U32, SMS_I, SMS_F, SMS_D; vector types: SV_I32, SV_U32, SV_I64, SV_F, SV_D)|output vector; set a; set b (same type)|output vector (NULL: unsupported or mismatched set type, or not enough memory)|O(n + m)|1;2| */
+S_INLINE srt_vector *sms_intersect_to_vector(srt_vector **v, const srt_set *a,
+					     const srt_set *b)
+{
+	return sm_set_op_to_vector(v, a, b, SM_SO_INTERSECT);
+}
+
+/* #API: |Difference (elements in a but not in b) into sorted key vector (SMS_I32, SMS_U32, SMS_I, SMS_F, SMS_D; vector types: SV_I32, SV_U32, SV_I64, SV_F, SV_D)|output vector; set a; set b (same type)|output vector (NULL: unsupported or mismatched set type, or not enough memory)|O(n + m)|1;2| */
+S_INLINE srt_vector *sms_diff_to_vector(srt_vector **v, const srt_set *a,
+					const srt_set *b)
+{
+	return sm_set_op_to_vector(v, a, b, SM_SO_DIFF);
+}
+
 /*
  * Unordered enumeration is inlined in order to get almost as fast
  * as array access after compiler optimization.
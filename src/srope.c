@@ -0,0 +1,594 @@
+/*
+ * srope.c
+ *
+ * Rope (chunked string) handling.
+ *
+ * Observations:
+ * - Implicit treap (randomized balanced tree keyed by position): every node
+ *   keeps the byte count of its subtree, so locating an offset is O(log n).
+ * - Nodes are stored in one linear block (indexes instead of pointers), with
+ *   a free list for reusing the slots of erased chunks.
+ * - Node slots required by split/merge are reserved in advance, so the node
+ *   block never moves during the recursive operations.
+ *
+ * Copyright (c) 2015-2020 F. Aragon. All rights reserved.
+ * Released under the BSD 3-Clause License (see the doc/LICENSE)
+ */
+
+#include "srope.h"
+#include "saux/scommon.h"
+#include "sstats.h"
+
+/*
+ * Constants
+ */
+
+#define SR_SEED 2463534242U /* xorshift32 seed (must be non-zero) */
+
+/*
+ * Internal functions
+ */
+
+S_INLINE struct SRopeNode *sr_node(srt_rope *r, srt_tndx x)
+{
+	RETURN_IF(x == ST_NIL, NULL);
+	return (struct SRopeNode *)sd_elem_addr((srt_data *)r, x);
+}
+
+S_INLINE const struct SRopeNode *sr_node_r(const srt_rope *r, srt_tndx x)
+{
+	RETURN_IF(x == ST_NIL, NULL);
+	return (const struct SRopeNode *)sd_elem_addr_r((const srt_data *)r,
+							x);
+}
+
+S_INLINE size_t sr_nsize(const srt_rope *r, srt_tndx x)
+{
+	return x == ST_NIL ? 0 : sr_node_r(r, x)->size;
+}
+
+S_INLINE void sr_upd(srt_rope *r, srt_tndx x)
+{
+	struct SRopeNode *n = sr_node(r, x);
+	n->size = sr_nsize(r, n->l) + sr_nsize(r, n->r) + ss_size(n->s);
+}
+
+S_INLINE uint32_t sr_rnd(srt_rope *r)
+{
+	uint32_t x = r->seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	r->seed = x;
+	return x;
+}
+
+S_INLINE void sr_chunk_free(srt_string **c)
+{
+	if (*c != ss_void)
+		ss_free(c);
+	*c = NULL;
+}
+
+/* Chunk copy, using the rope allocator */
+static srt_string *sr_chunk_dup(const srt_rope *r, const srt_string *s,
+				size_t off, size_t n)
+{
+	uint8_t id = sd_alloc_id((const srt_data *)r);
+	srt_string *c = id ? ss_alloc_a(sd_allocator(id), n) : ss_alloc(n);
+	if (c != ss_void)
+		ss_cpy_substr(&c, s, off, n);
+	return c;
+}
+
+static srt_bool sr_reserve_nodes(srt_rope **r, size_t n)
+{
+	RETURN_IF(s_size_t_add(sd_size((srt_data *)*r), n, ST_NIL) >= ST_NIL,
+		  S_FALSE);
+	RETURN_IF(sd_grow((srt_data **)r, n, 0) >= n, S_TRUE);
+	sd_set_alloc_errors((srt_data *)*r);
+	return S_FALSE;
+}
+
+/* Node slot availability must be guaranteed by the caller */
+static srt_tndx sr_new_node(srt_rope *r, srt_string *s)
+{
+	srt_tndx x;
+	struct SRopeNode *n;
+	if (r->free_list != ST_NIL) {
+		x = r->free_list;
+		n = sr_node(r, x);
+		r->free_list = n->l;
+	} else {
+		S_ASSERT(sd_size((srt_data *)r) < sd_max_size((srt_data *)r));
+		x = (srt_tndx)sd_size((srt_data *)r);
+		sd_set_size((srt_data *)r, x + 1);
+		n = sr_node(r, x);
+	}
+	n->l = n->r = ST_NIL;
+	n->prio = sr_rnd(r);
+	n->size = ss_size(s);
+	n->s = s;
+	r->nchunks++;
+	return x;
+}
+
+static void sr_free_subtree(srt_rope *r, srt_tndx x)
+{
+	struct SRopeNode *n;
+	if (x == ST_NIL)
+		return;
+	n = sr_node(r, x);
+	sr_free_subtree(r, n->l);
+	sr_free_subtree(r, n->r);
+	sr_chunk_free(&n->s);
+	n->l = r->free_list;
+	n->r = ST_NIL;
+	n->size = 0;
+	r->free_list = x;
+	r->nchunks--;
+}
+
+static srt_tndx sr_merge(srt_rope *r, srt_tndx a, srt_tndx b)
+{
+	struct SRopeNode *na, *nb;
+	RETURN_IF(a == ST_NIL, b);
+	RETURN_IF(b == ST_NIL, a);
+	na = sr_node(r, a);
+	nb = sr_node(r, b);
+	if (na->prio > nb->prio) {
+		na->r = sr_merge(r, na->r, b);
+		sr_upd(r, a);
+		return a;
+	}
+	nb->l = sr_merge(r, a, nb->l);
+	sr_upd(r, b);
+	return b;
+}
+
+/*
+ * Split subtree 'x' so 'lo' gets the first 'off' bytes, and 'hi' the rest.
+ * If the split point is inside a chunk, the chunk tail is moved to a new
+ * node (one free slot must be available). On S_FALSE (not enough memory for
+ * the chunk tail) 'lo' and 'hi' are still a valid partition, but with the
+ * chunk kept whole in 'lo': merging them back restores the original content.
+ */
+static srt_bool sr_split(srt_rope *r, srt_tndx x, size_t off, srt_tndx *lo,
+			 srt_tndx *hi)
+{
+	srt_tndx y;
+	srt_bool ok = S_TRUE;
+	size_t ls, cs, k;
+	srt_string *tail;
+	struct SRopeNode *n;
+	if (x == ST_NIL) {
+		*lo = *hi = ST_NIL;
+		return S_TRUE;
+	}
+	n = sr_node(r, x);
+	ls = sr_nsize(r, n->l);
+	cs = ss_size(n->s);
+	if (off <= ls) {
+		ok = sr_split(r, n->l, off, lo, &y);
+		n->l = y;
+		sr_upd(r, x);
+		*hi = x;
+	} else if (off >= ls + cs) {
+		ok = sr_split(r, n->r, off - ls - cs, &y, hi);
+		n->r = y;
+		sr_upd(r, x);
+		*lo = x;
+	} else {
+		k = off - ls;
+		tail = sr_chunk_dup(r, n->s, k, cs - k);
+		if (ss_size(tail) != cs - k) {
+			/* BEHAVIOR: not enough memory (chunk kept whole) */
+			sr_chunk_free(&tail);
+			sd_set_alloc_errors((srt_data *)r);
+			ok = S_FALSE;
+			*hi = n->r;
+			n->r = ST_NIL;
+		} else {
+			ss_resize(&n->s, k, 0);
+			*hi = sr_merge(r, sr_new_node(r, tail), n->r);
+			n->r = ST_NIL;
+		}
+		sr_upd(r, x);
+		*lo = x;
+	}
+	return ok;
+}
+
+/*
+ * Locate the chunk for a given offset, adding 'inc' and subtracting 'dec'
+ * to every subtree size in the path. If 'tail' is S_TRUE, an offset at a
+ * chunk boundary selects the chunk ending there (insertion point),
+ * otherwise the chunk starting there (byte access). The offset is
+ * returned relative to the chunk.
+ */
+static srt_tndx sr_locate(srt_rope *r, size_t *off, srt_bool tail, size_t inc,
+			  size_t dec)
+{
+	size_t ls, cs, k = *off;
+	srt_tndx x = r->root;
+	struct SRopeNode *n;
+	while (x != ST_NIL) {
+		n = sr_node(r, x);
+		ls = sr_nsize(r, n->l);
+		cs = ss_size(n->s);
+		n->size = n->size + inc - dec;
+		if (k < ls || (tail && k == ls && ls > 0)) {
+			x = n->l;
+		} else if (tail ? k <= ls + cs : k < ls + cs) {
+			*off = k - ls;
+			return x;
+		} else {
+			k -= ls + cs;
+			x = n->r;
+		}
+	}
+	return ST_NIL;
+}
+
+static srt_bool sr_insert_in_place(srt_rope *r, size_t off,
+				   const srt_string *s)
+{
+	char *p;
+	size_t k = off, cs, m = ss_size(s);
+	srt_tndx x = sr_locate(r, &k, S_TRUE, 0, 0);
+	struct SRopeNode *n = sr_node(r, x);
+	RETURN_IF(!n, S_FALSE);
+	cs = ss_size(n->s);
+	RETURN_IF(cs + m > SR_CHUNK_MAX, S_FALSE);
+	ss_resize(&n->s, cs + m, 0);
+	if (ss_size(n->s) != cs + m) { /* BEHAVIOR: not enough memory */
+		ss_resize(&n->s, cs, 0);
+		return S_FALSE;
+	}
+	p = ss_get_buffer(n->s);
+	memmove(p + k + m, p + k, cs - k);
+	memcpy(p + k, ss_get_buffer_r(s), m);
+	k = off;
+	sr_locate(r, &k, S_TRUE, m, 0);
+	return S_TRUE;
+}
+
+static size_t sr_itr_aux(const srt_rope *r, srt_tndx x, size_t off, size_t end,
+			 srt_rope_it f, void *context, srt_bool *done)
+{
+	size_t ls, cs, cnt = 0, c0, c1;
+	srt_string_ref ref;
+	const srt_string *chunk;
+	const struct SRopeNode *n;
+	if (x == ST_NIL || *done)
+		return 0;
+	n = sr_node_r(r, x);
+	ls = sr_nsize(r, n->l);
+	cs = ss_size(n->s);
+	if (off < ls)
+		cnt += sr_itr_aux(r, n->l, off, S_MIN(end, ls), f, context,
+				  done);
+	if (!*done && off < ls + cs && end > ls) {
+		c0 = off > ls ? off - ls : 0;
+		c1 = S_MIN(end - ls, cs);
+		chunk = c0 == 0 && c1 == cs
+				? n->s
+				: ss_ref_buf(&ref, ss_get_buffer_r(n->s) + c0,
+					     c1 - c0);
+		cnt++;
+		if (f && !f(chunk, context))
+			*done = S_TRUE;
+	}
+	if (!*done && end > ls + cs)
+		cnt += sr_itr_aux(r, n->r, off > ls + cs ? off - ls - cs : 0,
+				  end - ls - cs, f, context, done);
+	return cnt;
+}
+
+static srt_bool sr_cb_cat_ss(const srt_string *chunk, void *context)
+{
+	ss_cat((srt_string **)context, chunk);
+	return S_TRUE;
+}
+
+static srt_bool sr_cb_cat_sr(const srt_string *chunk, void *context)
+{
+	return sr_cat((srt_rope **)context, chunk);
+}
+
+struct SRopeWriteCtx {
+	FILE *handle;
+	ssize_t written;
+};
+
+static srt_bool sr_cb_write(const srt_string *chunk, void *context)
+{
+	struct SRopeWriteCtx *wc = (struct SRopeWriteCtx *)context;
+	ssize_t w = ss_write(wc->handle, chunk, 0, S_NPOS);
+	if (w < 0) {
+		wc->written = -1;
+		return S_FALSE;
+	}
+	wc->written += w;
+	return S_TRUE;
+}
+
+/*
+ * Allocation
+ */
+
+static srt_rope *sr_alloc_id(uint8_t alloc_id, size_t init_size)
+{
+	srt_rope *r = (srt_rope *)sd_alloc_a(alloc_id, sizeof(srt_rope),
+					     sizeof(struct SRopeNode),
+					     init_size, S_FALSE, 0);
+	RETURN_IF(!r || r == (srt_rope *)sd_void, NULL);
+	sst_on_alloc((srt_data *)r);
+	r->root = r->free_list = ST_NIL;
+	r->nchunks = 0;
+	r->seed = SR_SEED;
+	return r;
+}
+
+srt_rope *sr_alloc(size_t init_size)
+{
+	return sr_alloc_id(0, init_size);
+}
+
+srt_rope *sr_alloc_a(const srt_allocator *a, size_t init_size)
+{
+	int id = sd_allocator_id(a);
+	RETURN_IF(id < 0, NULL);
+	return sr_alloc_id((uint8_t)id, init_size);
+}
+
+void sr_free_aux(srt_rope **r, ...)
+{
+	va_list ap;
+	srt_rope **next;
+	va_start(ap, r);
+	next = r;
+	while (!s_varg_tail_ptr_tag(next)) { /* last element tag */
+		if (next) {
+			sr_clear(*next); /* release chunks */
+			sd_free((srt_data **)next);
+		}
+		next = (srt_rope **)va_arg(ap, srt_rope **);
+	}
+	va_end(ap);
+}
+
+srt_rope *sr_dup(const srt_rope *r)
+{
+	size_t i, ns;
+	srt_rope *r2;
+	struct SRopeNode *n;
+	RETURN_IF(!r, NULL);
+	ns = sd_size((const srt_data *)r);
+	r2 = sr_alloc(ns);
+	RETURN_IF(!r2, NULL);
+	if (ns)
+		memcpy(sd_elem_addr((srt_data *)r2, 0),
+		       sd_elem_addr_r((const srt_data *)r, 0),
+		       ns * r->d.elem_size);
+	sd_set_size((srt_data *)r2, ns);
+	r2->root = r->root;
+	r2->free_list = r->free_list;
+	r2->nchunks = r->nchunks;
+	r2->seed = r->seed;
+	for (i = 0; i < ns; i++) {
+		n = sr_node(r2, (srt_tndx)i);
+		if (!n->s)
+			continue;
+		n->s = ss_dup(n->s);
+		if (n->s == ss_void) { /* BEHAVIOR: not enough memory */
+			n->s = NULL;
+			sd_set_alloc_errors((srt_data *)r2);
+		}
+	}
+	return r2;
+}
+
+srt_rope *sr_dup_ss(const srt_string *s)
+{
+	size_t ss = ss_size(s);
+	srt_rope *r = sr_alloc(ss / SR_CHUNK_MAX + 1);
+	if (r)
+		sr_cat(&r, s);
+	return r;
+}
+
+void sr_clear(srt_rope *r)
+{
+	size_t i, ns;
+	struct SRopeNode *n;
+	if (!r)
+		return;
+	ns = sd_size((srt_data *)r);
+	for (i = 0; i < ns; i++) {
+		n = sr_node(r, (srt_tndx)i);
+		if (n->s)
+			sr_chunk_free(&n->s);
+	}
+	sd_set_size((srt_data *)r, 0);
+	r->root = r->free_list = ST_NIL;
+	r->nchunks = 0;
+}
+
+/*
+ * Accessors
+ */
+
+size_t sr_len(const srt_rope *r)
+{
+	return r ? sr_nsize(r, r->root) : 0;
+}
+
+size_t sr_nchunks(const srt_rope *r)
+{
+	return r ? r->nchunks : 0;
+}
+
+int sr_at(const srt_rope *r, size_t off)
+{
+	size_t ls, cs;
+	srt_tndx x;
+	const struct SRopeNode *n;
+	RETURN_IF(!r || off >= sr_len(r), EOF);
+	for (x = r->root; x != ST_NIL;) {
+		n = sr_node_r(r, x);
+		ls = sr_nsize(r, n->l);
+		cs = ss_size(n->s);
+		if (off < ls) {
+			x = n->l;
+		} else if (off < ls + cs) {
+			return (unsigned char)ss_get_buffer_r(n->s)[off - ls];
+		} else {
+			off -= ls + cs;
+			x = n->r;
+		}
+	}
+	return EOF;
+}
+
+/*
+ * Operations
+ */
+
+srt_bool sr_insert(srt_rope **r, size_t off, const srt_string *s)
+{
+	srt_tndx lo, hi, mid;
+	srt_string *c;
+	size_t i, m, cm, len;
+	RETURN_IF(!r || !*r, S_FALSE);
+	m = ss_size(s);
+	RETURN_IF(!m, S_TRUE);
+	len = sr_len(*r);
+	RETURN_IF(s_size_t_overflow(len, m), S_FALSE);
+	if (off > len)
+		off = len;
+	RETURN_IF(sr_insert_in_place(*r, off, s), S_TRUE);
+	RETURN_IF(!sr_reserve_nodes(r, m / SR_CHUNK_MAX + 2), S_FALSE);
+	for (mid = ST_NIL, i = 0; i < m; i += cm) {
+		cm = S_MIN(m - i, SR_CHUNK_MAX);
+		c = sr_chunk_dup(*r, s, i, cm);
+		if (ss_size(c) != cm) { /* BEHAVIOR: not enough memory */
+			sr_chunk_free(&c);
+			sr_free_subtree(*r, mid);
+			sd_set_alloc_errors((srt_data *)*r);
+			return S_FALSE;
+		}
+		mid = sr_merge(*r, mid, sr_new_node(*r, c));
+	}
+	if (!sr_split(*r, (*r)->root, off, &lo, &hi)) {
+		/* BEHAVIOR: not enough memory (rope content not modified) */
+		sr_free_subtree(*r, mid);
+		(*r)->root = sr_merge(*r, lo, hi);
+		return S_FALSE;
+	}
+	(*r)->root = sr_merge(*r, sr_merge(*r, lo, mid), hi);
+	return S_TRUE;
+}
+
+srt_bool sr_cat(srt_rope **r, const srt_string *s)
+{
+	return sr_insert(r, S_NPOS, s);
+}
+
+srt_bool sr_erase(srt_rope **r, size_t off, size_t n)
+{
+	char *p;
+	size_t len, k, cs;
+	srt_tndx x, lo, mid, hi;
+	struct SRopeNode *cn;
+	RETURN_IF(!r || !*r, S_FALSE);
+	len = sr_len(*r);
+	RETURN_IF(off >= len || !n, S_TRUE);
+	n = S_MIN(n, len - off);
+	/* Erase inside one chunk: in-place */
+	k = off;
+	x = sr_locate(*r, &k, S_FALSE, 0, 0);
+	cn = sr_node(*r, x);
+	cs = ss_size(cn->s);
+	if (k + n <= cs && n < cs) {
+		/*
+		 * Subtree sizes are updated before shrinking the chunk, as
+		 * the path is located using the current chunk sizes
+		 */
+		k = off;
+		sr_locate(*r, &k, S_FALSE, 0, n);
+		p = ss_get_buffer(cn->s);
+		memmove(p + k, p + k + n, cs - k - n);
+		ss_resize(&cn->s, cs - n, 0);
+		return S_TRUE;
+	}
+	/* Generic case: cut the range out of the tree */
+	RETURN_IF(!sr_reserve_nodes(r, 2), S_FALSE);
+	if (!sr_split(*r, (*r)->root, off, &lo, &x)) {
+		/* BEHAVIOR: not enough memory (rope content not modified) */
+		(*r)->root = sr_merge(*r, lo, x);
+		return S_FALSE;
+	}
+	if (!sr_split(*r, x, n, &mid, &hi)) {
+		/* BEHAVIOR: same, merging back the partial split */
+		(*r)->root = sr_merge(*r, sr_merge(*r, lo, mid), hi);
+		return S_FALSE;
+	}
+	sr_free_subtree(*r, mid);
+	(*r)->root = sr_merge(*r, lo, hi);
+	return S_TRUE;
+}
+
+srt_rope *sr_dup_substr(const srt_rope *r, size_t off, size_t n)
+{
+	srt_rope *r2 = sr_alloc(0);
+	if (r2 && r && n)
+		sr_itr(r, off, n, sr_cb_cat_sr, &r2);
+	return r2;
+}
+
+/*
+ * Conversion and I/O
+ */
+
+srt_string *sr_to_ss(srt_string **s, const srt_rope *r)
+{
+	return sr_substr_to_ss(s, r, 0, S_NPOS);
+}
+
+srt_string *sr_substr_to_ss(srt_string **s, const srt_rope *r, size_t off,
+			    size_t n)
+{
+	size_t len;
+	ASSERT_RETURN_IF(!s, ss_void);
+	len = sr_len(r);
+	n = off < len ? S_MIN(n, len - off) : 0;
+	if (!*s)
+		*s = ss_alloc(n);
+	else
+		ss_clear(*s);
+	if (n && ss_reserve(s, n) >= n)
+		sr_itr(r, off, n, sr_cb_cat_ss, s);
+	return *s;
+}
+
+size_t sr_itr(const srt_rope *r, size_t off, size_t n, srt_rope_it f,
+	      void *context)
+{
+	size_t len, end;
+	srt_bool done = S_FALSE;
+	len = sr_len(r);
+	RETURN_IF(off >= len || !n, 0);
+	end = off + S_MIN(n, len - off);
+	return sr_itr_aux(r, r->root, off, end, f, context, &done);
+}
+
+ssize_t sr_write(FILE *handle, const srt_rope *r)
+{
+	struct SRopeWriteCtx wc;
+	RETURN_IF(!handle, -1);
+	wc.handle = handle;
+	wc.written = 0;
+	sr_itr(r, 0, S_NPOS, sr_cb_write, &wc);
+	return wc.written;
+}
@@ -0,0 +1,135 @@
+#ifndef SROPE_H
+#define SROPE_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * srope.h
+ *
+ * #SHORTDOC rope (chunked string) handling
+ *
+ * #DOC Rope functions, for editing very large strings. The rope is a
+ * #DOC balanced tree (randomized, by position) of srt_string chunks, so
+ * #DOC insert, erase, and substring extraction in the middle of the
+ * #DOC content are O(log n) plus the affected chunk bytes, instead of the
+ * #DOC O(n) memory move required by a single contiguous srt_string.
+ * #DOC
+ * #DOC Like the other tree-based containers, nodes are stored in one
+ * #DOC linear memory block, using indexes instead of pointers. Chunk
+ * #DOC contents are regular srt_string heap strings, of up to
+ * #DOC SR_CHUNK_MAX bytes each, allocated with the rope allocator.
+ *
+ * Copyright (c) 2015-2020 F. Aragon. All rights reserved.
+ * Released under the BSD 3-Clause License (see the doc/LICENSE)
+ */
+
+#include "sstring.h"
+#include "saux/stree.h"
+
+/*
+ * Structures
+ */
+
+#ifndef SR_CHUNK_MAX
+#define SR_CHUNK_MAX 4096 /* max chunk size (bytes) */
+#endif
+
+struct SRopeNode {
+	srt_tndx l, r;	/* children (ST_NIL: none) */
+	uint32_t prio;	/* heap priority */
+	size_t size;	/* subtree size (bytes) */
+	srt_string *s;	/* chunk (NULL: free node slot) */
+};
+
+struct S_Rope {
+	struct SDataFull d;
+	srt_tndx root, free_list;
+	size_t nchunks;
+	uint32_t seed;
+};
+
+typedef struct S_Rope srt_rope; /* Opaque structure (accessors are provided) */
+
+typedef srt_bool (*srt_rope_it)(const srt_string *chunk, void *context);
+
+/*
+ * Allocation
+ */
+
+/*
+#API: |Free one or more ropes|rope;more ropes (optional)|-|O(n)|1;2|
+void sr_free(srt_rope **r, ...)
+*/
+#ifdef S_USE_VA_ARGS
+#define sr_free(...) sr_free_aux(__VA_ARGS__, S_INVALID_PTR_VARG_TAIL)
+#else
+#define sr_free(r) sr_free_aux(r, S_INVALID_PTR_VARG_TAIL)
+#endif
+void sr_free_aux(srt_rope **r, ...);
+
+/* #API: |Allocate rope (heap)|space preallocated to store n chunks|rope|O(1)|1;2| */
+srt_rope *sr_alloc(size_t initial_num_chunks_reserve);
+
+/* #API: |Allocate rope (heap) using the given allocator (also used for the chunks)|allocator (NULL: global allocator); space preallocated to store n chunks|rope|O(1)|1;2| */
+srt_rope *sr_alloc_a(const srt_allocator *a, size_t initial_num_chunks_reserve);
+
+/* #API: |Duplicate rope|rope|output rope|O(n)|1;2| */
+srt_rope *sr_dup(const srt_rope *r);
+
+/* #API: |Build rope from string|string|output rope|O(n)|1;2| */
+srt_rope *sr_dup_ss(const srt_string *s);
+
+/* #API: |Clear/reset rope|rope||O(n)|1;2| */
+void sr_clear(srt_rope *r);
+
+/*
+ * Accessors
+ */
+
+/* #API: |Rope length|rope|length in bytes|O(1)|1;2| */
+size_t sr_len(const srt_rope *r);
+
+/* #API: |Number of chunks|rope|number of chunks|O(1)|1;2| */
+size_t sr_nchunks(const srt_rope *r);
+
+/* #API: |Get byte at given position|rope; offset (bytes)|byte value (0 to 255), or EOF if out of range|O(log n)|1;2| */
+int sr_at(const srt_rope *r, size_t off);
+
+/*
+ * Operations
+ */
+
+/* #API: |Insert string at given position|rope; offset (bytes, S_NPOS for appending); input string|S_TRUE: OK, S_FALSE: not enough memory (rope content not modified)|O(log n + m)|1;2| */
+srt_bool sr_insert(srt_rope **r, size_t off, const srt_string *s);
+
+/* #API: |Append string|rope; input string|S_TRUE: OK, S_FALSE: not enough memory|O(log n + m)|1;2| */
+srt_bool sr_cat(srt_rope **r, const srt_string *s);
+
+/* #API: |Erase portion of the rope|rope; offset (bytes); number of bytes|S_TRUE: OK, S_FALSE: not enough memory (rope content not modified)|O(log n + erased chunks)|1;2| */
+srt_bool sr_erase(srt_rope **r, size_t off, size_t n);
+
+/* #API: |Duplicate rope portion|rope; offset (bytes); number of bytes|output rope|O(log n + m)|1;2| */
+srt_rope *sr_dup_substr(const srt_rope *r, size_t off, size_t n);
+
+/*
+ * Conversion and I/O
+ */
+
+/* #API: |Overwrite string with the rope contents|output string; rope|output string reference (optional usage)|O(n)|1;2| */
+srt_string *sr_to_ss(srt_string **s, const srt_rope *r);
+
+/* #API: |Overwrite string with a rope portion|output string; rope; offset (bytes); number of bytes|output string reference (optional usage)|O(log n + m)|1;2| */
+srt_string *sr_substr_to_ss(srt_string **s, const srt_rope *r, size_t off, size_t n);
+
+/* #API: |In-order chunk enumeration (zero-copy)|rope; offset (bytes); number of bytes; callback (it receives references to the chunk portions covered by the range); callback context|Number of chunks processed|O(log n + k)|1;2| */
+size_t sr_itr(const srt_rope *r, size_t off, size_t n, srt_rope_it f, void *context);
+
+/* #API: |Write rope to file (zero-copy, chunk by chunk)|file handle; rope|Number of bytes written (< 0: error)|O(n)|1;2| */
+ssize_t sr_write(FILE *handle, const srt_rope *r);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* #ifndef SROPE_H */
@@ -0,0 +1,124 @@
+/*
+ * sstats.c
+ *
+ * Allocation stats (container memory accounting).
+ *
+ * Copyright (c) 2015-2020 F. Aragon. All rights reserved.
+ * Released under the BSD 3-Clause License (see the doc/LICENSE)
+ */
+
+#include "sstats.h"
+#include "saux/scommon.h"
+
+/*
+ * Internal functions
+ */
+
+#ifdef S_TLS
+static S_TLS srt_alloc_stats sst_cnt[SD_CT_NumTypes];
+#else
+static srt_alloc_stats sst_cnt[SD_CT_NumTypes];
+#endif
+
+S_INLINE srt_alloc_stats *sst_c(const srt_data *d)
+{
+	return &sst_cnt[sd_ctype(d)];
+}
+
+S_INLINE srt_bool sst_skip(const srt_data *d)
+{
+#ifdef S_DISABLE_ALLOC_STATS
+	(void)d;
+	return S_TRUE;
+#else
+	return !d || d == sd_void || d->f.ext_buffer ? S_TRUE : S_FALSE;
+#endif
+}
+
+/*
+ * Accounting hooks
+ */
+
+void sst_on_alloc(const srt_data *d)
+{
+	srt_alloc_stats *c;
+	if (sst_skip(d))
+		return;
+	c = sst_c(d);
+	c->allocs++;
+	c->alloc_bytes += sdx_alloc_size(d);
+}
+
+void sst_on_free(const srt_data *d)
+{
+	srt_alloc_stats *c;
+	if (sst_skip(d))
+		return;
+	c = sst_c(d);
+	c->frees++;
+	c->free_bytes += sdx_alloc_size(d);
+}
+
+void sst_on_resize(const srt_data *d, size_t prev_size, size_t req_size)
+{
+	size_t as;
+	srt_alloc_stats *c;
+	if (sst_skip(d))
+		return;
+	c = sst_c(d);
+	as = sdx_alloc_size(d);
+	c->reallocs++;
+	if (as >= prev_size) {
+		c->grows++;
+		c->alloc_bytes += as - prev_size;
+		c->grow_req_bytes += req_size;
+		c->grow_bytes += as;
+	} else {
+		c->shrinks++;
+		c->free_bytes += prev_size - as;
+	}
+}
+
+void sst_on_rehash(const srt_data *d)
+{
+	if (!sst_skip(d))
+		sst_c(d)->rehashes++;
+}
+
+/*
+ * Stats
+ */
+
+srt_bool sst_get(int ctype, srt_alloc_stats *st)
+{
+	RETURN_IF(!st || ctype < 0 || ctype >= SD_CT_NumTypes, S_FALSE);
+	*st = sst_cnt[ctype];
+	return S_TRUE;
+}
+
+void sst_get_all(srt_alloc_stats *st)
+{
+	int i;
+	const srt_alloc_stats *c;
+	if (!st)
+		return;
+	memset(st, 0, sizeof(*st));
+	for (i = 0; i < SD_CT_NumTypes; i++) {
+		c = &sst_cnt[i];
+		st->allocs += c->allocs;
+		st->reallocs += c->reallocs;
+		st->frees += c->frees;
+		st->grows += c->grows;
+		st->shrinks += c->shrinks;
+		st->rehashes += c->rehashes;
+		st->alloc_bytes += c->alloc_bytes;
+		st->free_bytes += c->free_bytes;
+		st->grow_req_bytes += c->grow_req_bytes;
+		st->grow_bytes += c->grow_bytes;
+	}
+}
+
+void sst_reset(void)
+{
+	memset(sst_cnt, 0, sizeof(sst_cnt));
+}
@@ -0,0 +1,81 @@
+#ifndef SSTATS_H
+#define SSTATS_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * sstats.h
+ *
+ * #SHORTDOC allocation stats (container memory accounting)
+ *
+ * #DOC Per-thread allocation counters, by container type (SD_CT_STRING,
+ * #DOC SD_CT_VECTOR, SD_CT_MAP, SD_CT_HMAP, SD_CT_OTHER), always available
+ * #DOC (no debug build required). Counters are updated on container
+ * #DOC allocation, resize, and release (not on every element insert), so
+ * #DOC the overhead is negligible compared to the allocation itself.
+ * #DOC
+ * #DOC Byte counts are container memory block sizes (header and elements).
+ * #DOC The growth counters compare the bytes required by the operations
+ * #DOC causing the growth with the bytes actually reserved (growth policy
+ * #DOC and heuristic over-allocation), e.g. for detecting wasteful growth:
+ * #DOC
+ * #DOC	srt_alloc_stats st;
+ * #DOC	sst_get(SD_CT_HMAP, &st);
+ * #DOC	printf("%u rehashes, %u bytes reserved for %u required\n",
+ * #DOC	       (unsigned)st.rehashes, (unsigned)st.grow_bytes,
+ * #DOC	       (unsigned)st.grow_req_bytes);
+ * #DOC
+ * #DOC Observations:
+ * #DOC - Counters are thread-local: containers released by a different
+ * #DOC   thread are accounted by the releasing thread.
+ * #DOC - If the compiler has no thread-local storage support, counters are
+ * #DOC   global and not thread-safe.
+ * #DOC - Stack-allocated containers and containers using external buffers
+ * #DOC   are not accounted.
+ * #DOC - Define S_DISABLE_ALLOC_STATS for building without the counters.
+ *
+ * Copyright (c) 2015-2020 F. Aragon. All rights reserved.
+ * Released under the BSD 3-Clause License (see the doc/LICENSE)
+ */
+
+#include "saux/sdata.h"
+
+struct SAllocStats {
+	size_t allocs;	       /* container allocations */
+	size_t reallocs;       /* container resizes */
+	size_t frees;	       /* container releases */
+	size_t grows;	       /* resizes for making room */
+	size_t shrinks;	       /* resizes for releasing unused space */
+	size_t rehashes;       /* hash table rehashes (hash maps and sets) */
+	size_t alloc_bytes;    /* bytes taken (allocations and growth) */
+	size_t free_bytes;     /* bytes released (releases and shrinks) */
+	size_t grow_req_bytes; /* bytes required by growth operations */
+	size_t grow_bytes;     /* bytes reserved by growth operations */
+};
+
+typedef struct SAllocStats srt_alloc_stats;
+
+/* #API: |Get current thread allocation stats for a container type|container type (SD_CT_STRING, SD_CT_VECTOR, SD_CT_MAP, SD_CT_HMAP, SD_CT_OTHER); output stats|S_TRUE: OK; S_FALSE: invalid parameters|O(1)|1;2| */
+srt_bool sst_get(int ctype, srt_alloc_stats *st);
+
+/* #API: |Get current thread allocation stats (all container types)|output stats|-|O(1)|1;2| */
+void sst_get_all(srt_alloc_stats *st);
+
+/* #API: |Reset current thread allocation stats||-|O(1)|1;2| */
+void sst_reset(void);
+
+/*
+ * Accounting hooks (container implementation)
+ */
+
+void sst_on_alloc(const srt_data *d);
+void sst_on_free(const srt_data *d);
+void sst_on_resize(const srt_data *d, size_t prev_size, size_t req_size);
+void sst_on_rehash(const srt_data *d);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* #ifndef SSTATS_H */
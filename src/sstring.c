@@ -12,7 +12,9 @@
 #include "saux/scommon.h"
 #include "saux/senc.h"
 #include "saux/shash.h"
+#include "saux/snum.h"
 #include "saux/ssearch.h"
+#include "sstats.h"
 
 /*
  * Togglable optimizations
@@ -119,6 +121,7 @@ srt_string *ss_void = &ss_void0; /* empty string w/ alloc error set */
  */
 
 static srt_string *ss_reset(srt_string *s);
+static srt_string *ss_alloc_id(uint8_t alloc_id, size_t initial_reserve);
 
 /*
  * Global variables (used only for Turkish mode)
@@ -170,6 +173,15 @@ S_INLINE size_t get_unicode_size(const srt_string *s)
 				       : ((const struct SDataSmall *)s)->aux;
 }
 
+/*
+ * Internal write access (the caller already did the copy-on-write check,
+ * or the string is being built)
+ */
+S_INLINE char *get_buffer_rw(srt_string *s)
+{
+	return (char *)ss_get_buffer_r(s);
+}
+
 S_INLINE size_t get_str_off(const srt_string *s)
 {
 	S_ASSERT(ss_get_buffer_r(s) >= (const char *)s);
@@ -223,11 +235,145 @@ static srt_string *ss_reset(srt_string *s)
 	return s;
 }
 
+/*
+ * Shared strings (copy-on-write)
+ */
+
+S_INLINE struct SStringShared *get_shared(const srt_string *s)
+{
+	return s && sdx_full_st(&s->d) && s->d.sub_type == SS_ST_SHARED
+		       ? (struct SStringShared *)s
+		       : NULL;
+}
+
+static srt_string *ss_alloc_shared(const srt_string *src)
+{
+	srt_string *s;
+	struct SStringShared *sh;
+	size_t ss = ss_size(src);
+	uint8_t id = src->d.f.ext_buffer || ss_is_ref(src) ? 0
+							  : sd_alloc_id(&src->d);
+	sh = (struct SStringShared *)sd_alloc_a(
+		id, sizeof(struct SStringShared), 1, ss, S_FALSE, 1);
+	RETURN_IF(!sh || (srt_data *)sh == sd_void, NULL);
+	s = &sh->s;
+	ss_reset(s);
+	sd_set_ctype(&s->d, SD_CT_STRING);
+	sst_on_alloc(&s->d);
+	if (ss > 0)
+		memcpy(get_buffer_rw(s), ss_get_buffer_r(src), ss);
+	get_buffer_rw(s)[ss] = 0; /* shared strings are not modified later */
+	ss_set_size(s, ss);
+	set_unicode_size_cached(s, is_unicode_size_cached(src));
+	set_unicode_size(s, get_unicode_size(src));
+	set_encoding_errors(s, has_encoding_errors(src));
+	s->d.sub_type = SS_ST_SHARED;
+	sh->refs = 1;
+	return s;
+}
+
+/* Returns S_TRUE if the string memory can be released */
+static srt_bool ss_release_shared(srt_string *s)
+{
+	struct SStringShared *sh = get_shared(s);
+	return !sh || S_ATOMIC_ADD(&sh->refs, -1) == 0 ? S_TRUE : S_FALSE;
+}
+
+/*
+ * Convert a shared reference into a private string: in-place if it is the
+ * only reference, or making a copy (if keep_data is set) otherwise.
+ */
+static void ss_unshare(srt_string **s, srt_bool keep_data)
+{
+	srt_string *s2;
+	size_t ss, hs = sizeof(srt_string), hsh = sizeof(struct SStringShared);
+	if (S_ATOMIC_LOAD(&get_shared(*s)->refs) == 1) {
+		ss = keep_data ? ss_size(*s) : 0;
+		if (ss > 0)
+			memmove((char *)*s + hs, (char *)*s + hsh, ss);
+		(*s)->d.header_size = hs;
+		(*s)->d.max_size += hsh - hs;
+		(*s)->d.sub_type = 0;
+		if (!keep_data)
+			ss_reset(*s);
+		return;
+	}
+	ss = keep_data ? ss_size(*s) : 0;
+	s2 = ss_alloc_id(sd_alloc_id(&(*s)->d), ss);
+	if (keep_data && s2 != ss_void)
+		ss_cat(&s2, *s);
+	if (ss_release_shared(*s))
+		sd_free((srt_data **)s);
+	*s = s2;
+}
+
+/*
+ * Copy-on-write check before modifying *s: returns 'src' (or the updated
+ * *s if 'src' was the shared string being modified)
+ */
+S_INLINE const srt_string *ss_cow(srt_string **s, const srt_string *src,
+				  srt_bool keep_data)
+{
+	srt_bool aliasing;
+	if (S_LIKELY(!get_shared(*s)))
+		return src;
+	aliasing = *s == src;
+	ss_unshare(s, keep_data || aliasing);
+	return aliasing ? *s : src;
+}
+
+srt_string *ss_share(srt_string **s)
+{
+	srt_string *s2;
+	RETURN_IF(!s, ss_void);
+	if (!get_shared(*s)) {
+		/* BEHAVIOR: NULL input is shared as a new empty string */
+		s2 = ss_alloc_shared(*s ? *s : ss_void);
+		RETURN_IF(!s2, ss_void);
+		if (*s && ((*s)->d.f.ext_buffer || ss_is_ref(*s)))
+			return s2; /* BEHAVIOR: no ownership, (*s) kept */
+		ss_free(s);
+		*s = s2;
+	}
+	S_ATOMIC_ADD(&get_shared(*s)->refs, 1);
+	return *s;
+}
+
+srt_bool ss_is_shared(const srt_string *s)
+{
+	return get_shared(s) ? S_TRUE : S_FALSE;
+}
+
+size_t ss_refcount(const srt_string *s)
+{
+	const struct SStringShared *sh = get_shared(s);
+	return sh ? (size_t)S_ATOMIC_LOAD(&((struct SStringShared *)sh)->refs)
+		  : 1;
+}
+
+void ss_free_aux(srt_string **s, ...)
+{
+	va_list ap;
+	srt_string **next = s;
+	va_start(ap, s);
+	while (!s_varg_tail_ptr_tag(next)) { /* last element tag */
+		if (next) {
+			if (ss_release_shared(*next))
+				sd_free((srt_data **)next);
+			else
+				*next = NULL;
+		}
+		next = (srt_string **)va_arg(ap, srt_string **);
+	}
+	va_end(ap);
+}
+
 size_t ss_reserve(srt_string **s, size_t max_size)
 {
 	srt_bool full_st;
 	size_t ss, unicode_size, r;
 	RETURN_IF(!s, 0);
+	ss_cow(s, NULL, S_TRUE);
 	if (!*s) {
 		*s = ss_alloc(max_size);
 		RETURN_IF(!(*s), 0);
@@ -252,6 +398,7 @@ size_t ss_grow(srt_string **s, size_t extra_size)
 	size_t size, unicode_size, new_size;
 	RETURN_IF(!s, 0);
 	RETURN_IF(!(*s), ss_reserve(s, extra_size));
+	ss_cow(s, NULL, S_TRUE);
 	size = ss_size(*s);
 	if (s_size_t_overflow(size, extra_size)) {
 		ss_set_alloc_errors(*s);
@@ -270,6 +417,23 @@ size_t ss_grow(srt_string **s, size_t extra_size)
 	return new_size >= (size + extra_size) ? (new_size - size) : 0;
 }
 
+srt_bool ss_set_grow_policy(srt_string **s, int policy)
+{
+	srt_bool r;
+	size_t unicode_size;
+	RETURN_IF(!s || !*s, S_FALSE);
+	ss_cow(s, NULL, S_TRUE);
+	unicode_size = get_unicode_size(*s);
+	r = sdx_set_grow_policy((srt_data **)s, policy, sizeof(srt_string), 1);
+	set_unicode_size(*s, unicode_size);
+	return r;
+}
+
+int ss_grow_policy(const srt_string *s)
+{
+	return sd_grow_policy(&s->d);
+}
+
 /* BEHAVIOR: aliasing is supported, e.g. append(&a, a) */
 static srt_string *ss_cat_cn_raw(srt_string **s, const char *src,
 				 size_t src_off, size_t src_size,
@@ -280,7 +444,7 @@ static srt_string *ss_cat_cn_raw(srt_string **s, const char *src,
 	if (src && src_size > 0) {
 		off = *s ? ss_size(*s) : 0;
 		if (ss_grow(s, src_size) && *s) {
-			memmove(ss_get_buffer(*s) + off, src + src_off,
+			memmove(get_buffer_rw(*s) + off, src + src_off,
 				src_size);
 			inc_size(*s, src_size);
 			if (is_unicode_size_cached(*s)) {
@@ -298,7 +462,7 @@ static srt_string *ss_cat_aliasing(srt_string **s, const srt_string *s0,
 				   size_t s0_size, size_t s0_unicode_size,
 				   const srt_string *src)
 {
-	return src == s0 ? ss_cat_cn_raw(s, ss_get_buffer(*s), 0, s0_size,
+	return src == s0 ? ss_cat_cn_raw(s, get_buffer_rw(*s), 0, s0_size,
 					 s0_unicode_size)
 			 : ss_cat_cn_raw(s, ss_get_buffer_r(src), 0,
 					 ss_size(src), get_unicode_size(src));
@@ -328,35 +492,36 @@ static size_t ss_utf8_to_wc(const char *s, size_t off, size_t max_off,
 	return csize;
 }
 
-static srt_string *aux_toint(srt_string **s, srt_bool cat, int64_t num)
+static srt_string *aux_tonum(srt_string **s, srt_bool cat, const char *btmp,
+			     size_t digits)
 {
-	int64_t n;
-	char *p, btmp[128];
-	size_t off, digits, at, out_size;
+	size_t at, out_size;
 	ASSERT_RETURN_IF(!s, ss_void);
-	p = btmp + sizeof(btmp) - 1;
-	n = num < 0 ? -num : num;
-	do {
-		*p-- = '0' + n % 10;
-		n /= 10;
-	} while (n);
-	if (num < 0)
-		*p-- = '-';
-	off = (size_t)((p - (char *)btmp) + 1);
-	digits = sizeof(btmp) - off;
 	at = (cat && *s) ? ss_size(*s) : 0;
 	SS_OVERFLOW_CHECK(s, at, digits);
 	out_size = s_size_t_add(at, digits, S_NPOS);
 	if (ss_reserve(s, out_size) >= out_size && *s) {
 		if (!cat)
 			ss_reset(*s);
-		memcpy(ss_get_buffer(*s) + at, btmp + off, digits);
+		memcpy(get_buffer_rw(*s) + at, btmp, digits);
 		ss_set_size(*s, out_size);
 		inc_unicode_size(*s, digits);
 	}
 	return *s;
 }
 
+static srt_string *aux_toint(srt_string **s, srt_bool cat, int64_t num)
+{
+	char btmp[SNUM_I64_MAX_SIZE];
+	return aux_tonum(s, cat, btmp, snum_i64_to_c(btmp, num));
+}
+
+static srt_string *aux_todouble(srt_string **s, srt_bool cat, double num)
+{
+	char btmp[SNUM_F64_MAX_SIZE];
+	return aux_tonum(s, cat, btmp, snum_f64_to_c(btmp, num));
+}
+
 static srt_string *aux_toXcase(srt_string **s, srt_bool cat,
 			       const srt_string *src, int32_t (*towX)(int32_t))
 {
@@ -371,6 +536,7 @@ static srt_string *aux_toXcase(srt_string **s, srt_bool cat,
 	size_t i2;
 #endif
 	ASSERT_RETURN_IF(!s, ss_void);
+	src = ss_cow(s, src, S_TRUE);
 	if (!src)
 		src = ss_void;
 	ss = ss_size(src);
@@ -405,7 +571,8 @@ static srt_string *aux_toXcase(srt_string **s, srt_bool cat,
 	sso_req = extra < 0 ? s_size_t_sub(at_ss, (size_t)(-extra))
 			    : s_size_t_add(at_ss, (size_t)extra, S_NPOS);
 	if (!*s || sso_req > sso_max || (aliasing && extra > 0)) {
-		if (*s && (*s)->d.f.ext_buffer) { /* BEHAVIOR */
+		if (*s && (*s)->d.f.ext_buffer
+		    && !sd_spill_enabled(&(*s)->d)) { /* BEHAVIOR */
 			S_ERROR("not enough memory: strings stored into a "
 				"fixed-length buffer can not be resized.");
 			ss_set_alloc_errors(*s);
@@ -419,12 +586,12 @@ static srt_string *aux_toXcase(srt_string **s, srt_bool cat,
 				ss_set_alloc_errors(*s);
 			return ss_check(s);
 		}
-		pout = ss_get_buffer(out);
+		pout = get_buffer_rw(out);
 		if (at > 0) /* cat */
-			memcpy(pout, ss_get_buffer(*s), at);
+			memcpy(pout, get_buffer_rw(*s), at);
 		po0 = pout + at;
 	} else {
-		po0 = ss_get_buffer(*s) + at;
+		po0 = get_buffer_rw(*s) + at;
 	}
 	/* Case conversion loop: */
 	i = 0;
@@ -487,6 +654,7 @@ static srt_string *aux_toenc(srt_string **s, srt_bool cat,
 	const unsigned char *src_buf, *s_in;
 	size_t in_size, at, enc_size, out_size;
 	ASSERT_RETURN_IF(!s, ss_void);
+	src = ss_cow(s, src, S_TRUE);
 	if (!src)
 		src = ss_void;
 	aliasing = *s == src ? S_TRUE : S_FALSE;
@@ -512,7 +680,7 @@ static srt_string *aux_toenc(srt_string **s, srt_bool cat,
 			src1 = src;
 		}
 		s_in = (const unsigned char *)ss_get_buffer_r(src1);
-		s_out = (unsigned char *)ss_get_buffer(*s) + at;
+		s_out = (unsigned char *)get_buffer_rw(*s) + at;
 		enc_size = f ? f(s_in, in_size, s_out)
 			     : f2(s_in, in_size, s_out, enc_size);
 		if (at == 0) {
@@ -541,6 +709,7 @@ static srt_string *aux_erase(srt_string **s, srt_bool cat,
 	srt_bool overflow;
 	size_t ss0, at, src_size, copy_size, out_size;
 	ASSERT_RETURN_IF(!s, ss_void);
+	src = ss_cow(s, src, S_TRUE);
 	if (!src)
 		src = ss_void;
 	ss0 = ss_size(src);
@@ -552,7 +721,7 @@ static srt_string *aux_erase(srt_string **s, srt_bool cat,
 		if (off + n >= ss0) { /* tail clean cut */
 			ss_set_size(*s, off);
 		} else {
-			char *ps = ss_get_buffer(*s);
+			char *ps = get_buffer_rw(*s);
 			memmove(ps + off, ps + off + n, copy_size);
 			ss_set_size(*s, ss0 - n);
 		}
@@ -560,7 +729,7 @@ static srt_string *aux_erase(srt_string **s, srt_bool cat,
 	} else { /* copy or cat */
 		out_size = at + off + copy_size;
 		if (ss_reserve(s, out_size) >= out_size && *s) {
-			po = ss_get_buffer(*s);
+			po = get_buffer_rw(*s);
 			memcpy(po + at, ss_get_buffer_r(src), off);
 			memcpy(po + at + off, ss_get_buffer_r(src) + off + n,
 			       copy_size);
@@ -579,6 +748,7 @@ static srt_string *aux_erase_u(srt_string **s, srt_bool cat,
 	size_t sso0, ss0, head_size, actual_n, cus, cut_size, tail_size,
 		out_size, prefix_usize, at;
 	ASSERT_RETURN_IF(!s, ss_void);
+	src = ss_cow(s, src, S_TRUE);
 	if (!src)
 		src = ss_void;
 	ps = ss_get_buffer_r(src);
@@ -594,13 +764,13 @@ static srt_string *aux_erase_u(srt_string **s, srt_bool cat,
 	out_size = ss0 - cut_size;
 	prefix_usize = 0;
 	if (*s == src) { /* aliasing: copy-only */
-		po = ss_get_buffer(*s);
+		po = get_buffer_rw(*s);
 		memmove(po + head_size, ps + head_size + cut_size, tail_size);
 	} else { /* copy/cat */
 		at = (cat && *s) ? ss_size(*s) : 0;
 		out_size += at;
 		if (ss_reserve(s, out_size) >= out_size && *s) {
-			po = ss_get_buffer(*s);
+			po = get_buffer_rw(*s);
 			memcpy(po + at, ss_get_buffer_r(src), head_size);
 			memcpy(po + at + head_size,
 			       ss_get_buffer_r(src) + head_size + cut_size,
@@ -635,6 +805,7 @@ static srt_string *aux_replace(srt_string **s, srt_bool cat,
 	typedef void (*memcpy_t)(void *, const void *, size_t);
 	memcpy_t f_cpy;
 	ASSERT_RETURN_IF(!s, ss_void);
+	src = ss_cow(s, src, S_TRUE);
 	if (!s1)
 		s1 = ss_void;
 	if (!s2)
@@ -672,7 +843,7 @@ static srt_string *aux_replace(srt_string **s, srt_bool cat,
 			ss_set_alloc_errors(*s);
 			return ss_check(s);
 		}
-		o0 = o = ss_get_buffer(out);
+		o0 = o = get_buffer_rw(out);
 		/* copy prefix data (cat) */
 		if (at > 0)
 			memcpy(o, ss_get_buffer_r(*s), at);
@@ -683,7 +854,7 @@ static srt_string *aux_replace(srt_string **s, srt_bool cat,
 			if (ss_reserve(s, out_size) < out_size) /* BEHAVIOR */
 				return ss_check(s);
 		}
-		o0 = o = ss_get_buffer(*s);
+		o0 = o = get_buffer_rw(*s);
 		RETURN_IF(!o, ss_check(s));
 	}
 	if (aliasing) {
@@ -731,6 +902,7 @@ static srt_string *aux_resize(srt_string **s, srt_bool cat,
 	srt_bool aliasing;
 	size_t src_size, at, out_size;
 	ASSERT_RETURN_IF(!s, ss_void);
+	src = ss_cow(s, src, S_TRUE);
 	if (!src)
 		src = ss_void;
 	src_size = ss_size(src);
@@ -739,7 +911,7 @@ static srt_string *aux_resize(srt_string **s, srt_bool cat,
 	aliasing = *s == src;
 	if (src_size < n) { /* fill */
 		if (ss_reserve(s, out_size) >= out_size && *s) {
-			char *o = ss_get_buffer(*s);
+			char *o = get_buffer_rw(*s);
 			if (!aliasing) {
 				const char *p = ss_get_buffer_r(src);
 				memcpy(o + at, p, src_size);
@@ -752,7 +924,7 @@ static srt_string *aux_resize(srt_string **s, srt_bool cat,
 	} else {  /* else: cut (implicit) */
 		if (ss_reserve(s, out_size) >= out_size && *s) {
 			if (!aliasing)
-				memcpy(ss_get_buffer(*s) + at,
+				memcpy(get_buffer_rw(*s) + at,
 				       ss_get_buffer_r(src), n);
 			ss_set_size(*s, out_size);
 			set_unicode_size_cached(*s, S_FALSE);
@@ -770,6 +942,7 @@ static srt_string *aux_resize_u(srt_string **s, srt_bool cat, srt_string *src,
 	size_t at, char_size, current_u_chars, srcs, new_elems, at_inc,
 		out_size, i, actual_unicode_count, head_size;
 	ASSERT_RETURN_IF(!s, ss_void);
+	src = (srt_string *)ss_cow(s, src, S_TRUE);
 	if (!src)
 		src = ss_void;
 	at = (cat && *s) ? ss_size(*s) : 0;
@@ -787,7 +960,7 @@ static srt_string *aux_resize_u(srt_string **s, srt_bool cat, srt_string *src,
 			if (!cat && !aliasing) /* copy */
 				ss_clear(*s);
 			if (!aliasing) {
-				memcpy(ss_get_buffer(*s) + at,
+				memcpy(get_buffer_rw(*s) + at,
 				       ss_get_buffer_r(src), srcs);
 				inc_unicode_size(*s, current_u_chars);
 				inc_size(*s, srcs);
@@ -808,7 +981,7 @@ static srt_string *aux_resize_u(srt_string **s, srt_bool cat, srt_string *src,
 			if (ss_reserve(s, out_size) >= out_size && *s) {
 				if (!cat && !aliasing) /* copy */
 					ss_clear(*s);
-				memcpy(ss_get_buffer(*s) + at, ps, head_size);
+				memcpy(get_buffer_rw(*s) + at, ps, head_size);
 				inc_unicode_size(*s, actual_unicode_count);
 				inc_size(*s, head_size);
 			} /* else: BEHAVIOR */
@@ -828,6 +1001,7 @@ static srt_string *aux_ltrim(srt_string **s, srt_bool cat,
 	srt_bool aliasing;
 	size_t ss, at, cat_usize, i, out_size;
 	ASSERT_RETURN_IF(!s, ss_void);
+	src = ss_cow(s, src, S_TRUE);
 	if (!src)
 		src = ss_void;
 	ss = ss_size(src);
@@ -848,7 +1022,7 @@ static srt_string *aux_ltrim(srt_string **s, srt_bool cat,
 		}
 		out_size = at + ss - i;
 		if (ss_reserve(s, out_size) >= out_size && *s) {
-			pt = ss_get_buffer(*s);
+			pt = get_buffer_rw(*s);
 			if (!aliasing) /* copy or cat: shift data */
 				memcpy(pt + at, ps + i, ss - i);
 			else if (i > 0) /* copy: shift data */
@@ -879,6 +1053,7 @@ static srt_string *aux_rtrim(srt_string **s, srt_bool cat,
 	srt_bool aliasing;
 	size_t ss, at, i, nspaces, copy_size, out_size, cat_usize;
 	ASSERT_RETURN_IF(!s, ss_void);
+	src = ss_cow(s, src, S_TRUE);
 	if (!src)
 		src = ss_void;
 	ss = ss_size(src);
@@ -896,7 +1071,7 @@ static srt_string *aux_rtrim(srt_string **s, srt_bool cat,
 		out_size = at + copy_size;
 		cat_usize = cat ? get_unicode_size(*s) : 0;
 		if (ss_reserve(s, out_size) >= out_size && *s) {
-			char *pt = ss_get_buffer(*s);
+			char *pt = get_buffer_rw(*s);
 			if (!aliasing)
 				memcpy(pt + at, ps, copy_size);
 			ss_set_size(*s, out_size);
@@ -934,14 +1109,15 @@ static ssize_t aux_read(srt_string **s, srt_bool cat, FILE *h, size_t max_bytes)
 						   && off + def_buf < max_off
 					   ? def_buf
 					   : max_off - off;
-			if (cat && (*s)->d.f.ext_buffer) {
+			if (cat && (*s)->d.f.ext_buffer
+			    && !sd_spill_enabled(&(*s)->d)) {
 				cap = ss_capacity_left(*s);
 				buf_size = S_MIN(buf_size, cap);
 			}
 			if (ss_reserve(s, off + buf_size) >= off + buf_size) {
 				if (feof(h))
 					break;
-				sc = ss_get_buffer(*s);
+				sc = get_buffer_rw(*s);
 				l0 = (size_t)fread(sc + off, 1, buf_size, h);
 				if (l0 > 0 && !ferror(h)) {
 					off += l0;
@@ -1030,15 +1206,29 @@ MK_SS_DUP_CPY_CAT(dec_esc_squote, sdec_esc_squote, NULL)
  * Allocation
  */
 
-srt_string *ss_alloc(size_t initial_reserve)
+static srt_string *ss_alloc_id(uint8_t alloc_id, size_t initial_reserve)
 {
-	srt_string *s = ss_reset((srt_string *)sd_alloc(
-		sizeof(srt_string), 1, initial_reserve, S_TRUE, 1));
+	srt_string *s = ss_reset((srt_string *)sd_alloc_a(
+		alloc_id, sizeof(srt_string), 1, initial_reserve, S_TRUE, 1));
 	RETURN_IF(!s, ss_void);
 	set_reference_mode(s, S_FALSE, S_FALSE);
+	sd_set_ctype(&s->d, SD_CT_STRING);
+	sst_on_alloc(&s->d);
 	return s;
 }
 
+srt_string *ss_alloc(size_t initial_reserve)
+{
+	return ss_alloc_id(0, initial_reserve);
+}
+
+srt_string *ss_alloc_a(const srt_allocator *a, size_t initial_reserve)
+{
+	int id = sd_allocator_id(a);
+	RETURN_IF(id < 0, ss_void);
+	return ss_alloc_id((uint8_t)id, initial_reserve);
+}
+
 srt_string *ss_alloc_into_ext_buf(void *buf, size_t max_size)
 {
 	srt_string *s = (srt_string *)sd_alloc_into_ext_buf(
@@ -1046,6 +1236,20 @@ srt_string *ss_alloc_into_ext_buf(void *buf, size_t max_size)
 	RETURN_IF(!s, ss_void);
 	ss_reset((srt_string *)s);
 	set_reference_mode(s, S_FALSE, S_FALSE);
+	sd_set_ctype(&s->d, SD_CT_STRING);
+	return s;
+}
+
+srt_string *ss_alloc_into_ext_buf_spill(void *buf, size_t max_size)
+{
+	/* Full header, as the small one has no room for the policy */
+	srt_string *s = (srt_string *)sd_alloc_into_ext_buf(
+		buf, max_size, sizeof(srt_string), 1, S_FALSE);
+	RETURN_IF(!s, ss_void);
+	ss_reset((srt_string *)s);
+	set_reference_mode(s, S_FALSE, S_FALSE);
+	sd_set_ctype(&s->d, SD_CT_STRING);
+	sd_set_grow_policy(&s->d, SD_GROW_SPILL);
 	return s;
 }
 
@@ -1123,7 +1327,10 @@ size_t ss_len_u(const srt_string *s)
 
 size_t ss_max(const srt_string *s)
 {
-	return !s ? 0 : s->d.f.ext_buffer ? ss_max_size(s) : SS_RANGE;
+	RETURN_IF(!s, 0);
+	/* BEHAVIOR: fixed-size buffer, unless spilling to the heap */
+	return s->d.f.ext_buffer && !sd_spill_enabled(&s->d) ? ss_max_size(s)
+							     : SS_RANGE;
 }
 
 S_INLINE size_t ss_real_off(const srt_string *s, size_t off)
@@ -1152,6 +1359,8 @@ void ss_clear_errors(srt_string *s)
 srt_string *ss_dup(const srt_string *src)
 {
 	srt_string *s = NULL;
+	if (get_shared(src))
+		return ss_share((srt_string **)&src);
 	return ss_cpy(&s, src);
 }
 
@@ -1191,6 +1400,12 @@ srt_string *ss_dup_int(int64_t num)
 	return ss_cpy_int(&s, num);
 }
 
+srt_string *ss_dup_double(double num)
+{
+	srt_string *s = NULL;
+	return ss_cpy_double(&s, num);
+}
+
 srt_string *ss_dup_tolower(const srt_string *src)
 {
 	srt_string *s = NULL;
@@ -1294,6 +1509,13 @@ srt_string *ss_cpy(srt_string **s, const srt_string *src)
 {
 	RETURN_IF(!s, ss_void);
 	RETURN_IF(*s == src && ss_check(s), *s); /* aliasing, same string */
+	if (get_shared(src)
+	    && (!*s || (!(*s)->d.f.ext_buffer && !ss_is_ref(*s)))) {
+		ss_free(s);
+		*s = ss_share((srt_string **)&src);
+		return *s;
+	}
+	ss_cow(s, NULL, S_FALSE);
 	ss_clear(*s);
 	RETURN_IF(!src, *s); /* BEHAVIOR: empty */
 	return ss_cat(s, src);
@@ -1305,9 +1527,10 @@ srt_string *ss_cpy_substr(srt_string **s, const srt_string *src, size_t off,
 	char *ps;
 	size_t ss, copy_size;
 	RETURN_IF(!s, ss_void);
+	src = ss_cow(s, src, S_FALSE);
 	RETURN_IF(!src || !n, ss_reset(*s)); /* BEHAVIOR: empty */
 	if (*s == src) {		     /* aliasing */
-		ps = ss_get_buffer(*s);
+		ps = get_buffer_rw(*s);
 		ss = ss_size(*s);
 		RETURN_IF(off >= ss, ss_reset(*s)); /* BEHAVIOR: empty */
 		copy_size = S_MIN(ss - off, n);
@@ -1328,9 +1551,10 @@ srt_string *ss_cpy_substr_u(srt_string **s, const srt_string *src,
 	char *ps;
 	size_t actual_unicode_count, ss, off, n_size, copy_size;
 	RETURN_IF(!s, ss_void);
+	src = ss_cow(s, src, S_FALSE);
 	RETURN_IF(!src || !n, ss_reset(*s)); /* BEHAVIOR: empty */
 	if (*s == src) {		     /* aliasing */
-		ps = ss_get_buffer(*s);
+		ps = get_buffer_rw(*s);
 		actual_unicode_count = 0;
 		ss = ss_size(*s);
 		off = sc_unicode_count_to_utf8_size(ps, 0, ss, char_off,
@@ -1357,6 +1581,7 @@ srt_string *ss_cpy_substr_u(srt_string **s, const srt_string *src,
 srt_string *ss_cpy_cn(srt_string **s, const char *src, size_t src_size)
 {
 	RETURN_IF(!s, ss_void);
+	ss_cow(s, NULL, S_FALSE);
 	ss_clear(*s);
 	RETURN_IF(!src || !src_size, *s); /* BEHAVIOR: empty */
 	ss_cat_cn(s, src, src_size);
@@ -1374,6 +1599,7 @@ srt_string *ss_cpy_c_aux(srt_string **s, const char *s1, ...)
 srt_string *ss_cpy_wn(srt_string **s, const wchar_t *src, size_t src_size)
 {
 	ASSERT_RETURN_IF(!s, ss_void);
+	ss_cow(s, NULL, S_FALSE);
 	ss_clear(*s);
 	return ss_cat_wn(s, src, src_size);
 }
@@ -1391,6 +1617,11 @@ srt_string *ss_cpy_int(srt_string **s, int64_t num)
 	return aux_toint(s, S_FALSE, num);
 }
 
+srt_string *ss_cpy_double(srt_string **s, double num)
+{
+	return aux_todouble(s, S_FALSE, num);
+}
+
 srt_string *ss_cpy_tolower(srt_string **s, const srt_string *src)
 {
 	return aux_toXcase(s, S_FALSE, src, fsc_tolower);
@@ -1452,6 +1683,7 @@ srt_string *ss_cpy_printf(srt_string **s, size_t size, const char *fmt, ...)
 {
 	va_list ap;
 	RETURN_IF(!s, ss_void);
+	ss_cow(s, NULL, S_FALSE);
 	RETURN_IF((!size || !fmt) && ss_reset(*s), *s);
 	if (*s) {
 		ss_reserve(s, size);
@@ -1467,6 +1699,7 @@ srt_string *ss_cpy_printf_va(srt_string **s, size_t size, const char *fmt,
 			     va_list ap)
 {
 	RETURN_IF(!s, ss_void);
+	ss_cow(s, NULL, S_FALSE);
 	RETURN_IF((!size || !fmt) && ss_reset(*s), *s);
 	if (*s) {
 		ss_reserve(s, size);
@@ -1478,6 +1711,7 @@ srt_string *ss_cpy_printf_va(srt_string **s, size_t size, const char *fmt,
 srt_string *ss_cpy_char(srt_string **s, int c)
 {
 	RETURN_IF(!s, ss_void);
+	ss_cow(s, NULL, S_FALSE);
 	ss_clear(*s);
 	if (ss_reserve(s, SSU8_MAX_SIZE) >= SSU8_MAX_SIZE)
 		return ss_cat_char(s, c);
@@ -1544,6 +1778,7 @@ srt_string *ss_cat_substr(srt_string **s, const srt_string *src, size_t sub_off,
 	sub_size = sub_size0 == S_NPOS || (sub_off + sub_size0) > srcs
 			   ? (srcs - sub_off)
 			   : sub_size0;
+	src = ss_cow(s, src, S_TRUE);
 	src_off = get_str_off(src) + sub_off;
 	if (*s == src && !(*s)->d.f.ext_buffer) {
 		/* Aliasing case: make grow the buffer in order
@@ -1566,6 +1801,7 @@ srt_string *ss_cat_substr_u(srt_string **s, const srt_string *src,
 	size_t ssrc, off_size, actual_n, copy_size;
 	ASSERT_RETURN_IF(!s, ss_void);
 	if (src) {
+		src = ss_cow(s, src, S_TRUE);
 		psrc = ss_get_buffer_r(src);
 		ssrc = ss_size(src);
 		off_size = sc_unicode_count_to_utf8_size(psrc, 0, ssrc,
@@ -1635,7 +1871,7 @@ srt_string *ss_cat_wn(srt_string **s, const wchar_t *src, size_t src_size)
 				uc32 = (int32_t)src[i];
 			}
 			l = sc_wc_to_utf8(uc32, utf8, 0, SSU8_MAX_SIZE);
-			memcpy(ss_get_buffer(*s) + ss_size(*s), utf8, l);
+			memcpy(get_buffer_rw(*s) + ss_size(*s), utf8, l);
 			inc_size(*s, l);
 			char_count++;
 		}
@@ -1657,6 +1893,11 @@ srt_string *ss_cat_int(srt_string **s, int64_t num)
 	return aux_toint(s, S_TRUE, num);
 }
 
+srt_string *ss_cat_double(srt_string **s, double num)
+{
+	return aux_todouble(s, S_TRUE, num);
+}
+
 srt_string *ss_cat_tolower(srt_string **s, const srt_string *src)
 {
 	return aux_toXcase(s, S_TRUE, src, fsc_tolower);
@@ -1735,7 +1976,7 @@ srt_string *ss_cat_printf_va(srt_string **s, size_t size, const char *fmt,
 	if (size > 0 && fmt) {
 		off = *s ? ss_size(*s) : 0;
 		if (ss_grow(s, size)) {
-			p = ss_get_buffer(*s) + off;
+			p = get_buffer_rw(*s) + off;
 			sz = vsnprintf(p, size, fmt, ap);
 			if (sz >= 0)
 				inc_size(*s, (size_t)sz);
@@ -1756,6 +1997,161 @@ srt_string *ss_cat_char(srt_string **s, int c)
 	return ss_cat_cn(s, tmp, sc_wc_to_utf8(c, tmp, 0, sizeof(tmp)));
 }
 
+/* String source for bulk concatenation items ('s0': *s before growing) */
+S_INLINE const srt_string *aux_ci_src(const srt_string_cat_item *ci,
+				      const srt_string *s0, const srt_string *s)
+{
+	if (ci->type == SS_CI_CN || ci->type == SS_CI_INT
+	    || ci->type == SS_CI_CHAR || !ci->p)
+		return ss_void;
+	return ci->p == s0 ? s : (const srt_string *)ci->p;
+}
+
+/*
+ * Bulk concatenation item output. If 'o' is NULL, it returns the output
+ * size, updating the Unicode size accumulator ('usize', S_NPOS: unknown)
+ */
+static size_t aux_ci_write(const srt_string_cat_item *ci, const srt_string *src,
+			   char *o, size_t known_size, size_t *usize)
+{
+	char tmp[SNUM_I64_MAX_SIZE];
+	size_t l = 0, ss = ss_size(src);
+	const uint8_t *b = (const uint8_t *)ss_get_buffer_r(src);
+	uint8_t *o8 = (uint8_t *)o;
+	switch (ci->type) {
+	case SS_CI_SS:
+		if (o)
+			memcpy(o, b, ss);
+		else if (*usize != S_NPOS && is_unicode_size_cached(src))
+			*usize += get_unicode_size(src);
+		else
+			*usize = S_NPOS;
+		return ss;
+	case SS_CI_CN:
+		if (o && ci->p)
+			memcpy(o, ci->p, ci->n);
+		else
+			*usize = S_NPOS;
+		return ci->p ? ci->n : 0;
+	case SS_CI_INT:
+	case SS_CI_CHAR:
+		l = ci->type == SS_CI_INT
+			    ? snum_i64_to_c(tmp, ci->i)
+			    : sc_wc_to_utf8((int)ci->i, tmp, 0, sizeof(tmp));
+		if (o)
+			memcpy(o, tmp, l);
+		else if (*usize != S_NPOS)
+			*usize += ci->type == SS_CI_INT ? l : 1;
+		return l;
+	case SS_CI_ENC_B64:
+		l = senc_b64(b, ss, o8);
+		break;
+	case SS_CI_ENC_HEX:
+		l = senc_hex(b, ss, o8);
+		break;
+	case SS_CI_ENC_HEXU:
+		l = senc_HEX(b, ss, o8);
+		break;
+	case SS_CI_ENC_ESC_XML:
+		return senc_esc_xml(b, ss, o8, known_size);
+	case SS_CI_ENC_ESC_JSON:
+		return senc_esc_json(b, ss, o8, known_size);
+	case SS_CI_ENC_ESC_URL:
+		return senc_esc_url(b, ss, o8, known_size);
+	case SS_CI_ENC_ESC_DQUOTE:
+		return senc_esc_dquote(b, ss, o8, known_size);
+	case SS_CI_ENC_ESC_SQUOTE:
+		return senc_esc_squote(b, ss, o8, known_size);
+	default:
+		S_ASSERT(S_FALSE);
+		return 0;
+	}
+	if (!o && *usize != S_NPOS) /* ASCII output */
+		*usize += l;
+	return l;
+}
+
+srt_string *ss_cat_list(srt_string **s, const srt_string_cat_item *items,
+			size_t nitems)
+{
+	char *o;
+	const srt_string *s0;
+	size_t i, ss0, extra_size, usize, pstack[SS_CCAT_STACK], *sizes,
+		*pheap = NULL;
+	ASSERT_RETURN_IF(!s, ss_void);
+	RETURN_IF(!items || !nitems, ss_check(s));
+	if (nitems <= SS_CCAT_STACK) {
+		sizes = pstack;
+	} else {
+		pheap = (size_t *)s_malloc(sizeof(size_t) * nitems);
+		if (!pheap) {
+			if (*s)
+				ss_set_alloc_errors(*s);
+			return ss_check(s);
+		}
+		sizes = pheap;
+	}
+	/*
+	 * First pass: compute the exact output size, so only one allocation
+	 * is required. Aliasing is supported, e.g. ss_ci_ss(*s) items.
+	 */
+	s0 = *s;
+	ss0 = *s ? ss_size(*s) : 0;
+	extra_size = usize = 0;
+	for (i = 0; i < nitems; i++) {
+		sizes[i] = aux_ci_write(&items[i], aux_ci_src(&items[i], s0, s0),
+					NULL, 0, &usize);
+		if (s_size_t_overflow(extra_size, sizes[i])) {
+			extra_size = S_NPOS;
+			break;
+		}
+		extra_size += sizes[i];
+	}
+	if (extra_size > 0 && extra_size != S_NPOS
+	    && ss_grow(s, extra_size) >= extra_size) {
+		/* Second pass: write everything */
+		o = get_buffer_rw(*s) + ss0;
+		for (i = 0; i < nitems; i++) {
+			if (!sizes[i])
+				continue;
+			o += aux_ci_write(&items[i],
+					  aux_ci_src(&items[i], s0, *s), o,
+					  sizes[i], &usize);
+		}
+		ss_set_size(*s, ss0 + extra_size);
+		if (usize != S_NPOS && is_unicode_size_cached(*s))
+			inc_unicode_size(*s, usize);
+		else
+			set_unicode_size_cached(*s, S_FALSE);
+	} else if (extra_size > 0 && *s) {
+		ss_set_alloc_errors(*s);
+	}
+	if (pheap)
+		s_free(pheap);
+	return ss_check(s);
+}
+
+srt_string *ss_cpy_list(srt_string **s, const srt_string_cat_item *items,
+			size_t nitems)
+{
+	size_t i;
+	srt_string *tmp = NULL;
+	ASSERT_RETURN_IF(!s, ss_void);
+	for (i = 0; i < nitems && items; i++)
+		if (*s && aux_ci_src(&items[i], NULL, NULL) == *s)
+			break;
+	if (items && i < nitems) { /* aliasing: use a temporary string */
+		ss_cat_list(&tmp, items, nitems);
+		ss_cpy(s, tmp);
+		if (tmp != ss_void)
+			ss_free(&tmp);
+		return ss_check(s);
+	}
+	ss_cow(s, NULL, S_FALSE);
+	ss_clear(*s);
+	return ss_cat_list(s, items, nitems);
+}
+
 srt_string *ss_cat_read(srt_string **s, FILE *handle, size_t max_bytes)
 {
 	aux_read(s, S_TRUE, handle, max_bytes);
@@ -1790,6 +2186,15 @@ srt_bool ss_set_turkish_mode(srt_bool enable_turkish_mode)
 
 void ss_clear(srt_string *s)
 {
+	if (get_shared(s)) {
+		/*
+		 * BEHAVIOR: not modified if there are other references (no
+		 * error flag set: the header is shared, too)
+		 */
+		if (!ss_shared_ro(s))
+			ss_unshare(&s, S_FALSE);
+		return;
+	}
 	ss_reset(s);
 }
 
@@ -1811,14 +2216,23 @@ srt_string *ss_check(srt_string **s)
 	return *s;
 }
 
+/* Automatic shrink (SD_GROW_SHRINK policy), except shared and references */
+static srt_string *ss_shrink_chk(srt_string **s, srt_string *r)
+{
+	if (s && *s == r && !ss_is_ref(r) && !get_shared(r)
+	    && sd_auto_shrink((srt_data **)s, 1))
+		r = *s;
+	return r;
+}
+
 srt_string *ss_erase(srt_string **s, size_t off, size_t n)
 {
-	return aux_erase(s, S_FALSE, *s, off, n);
+	return ss_shrink_chk(s, aux_erase(s, S_FALSE, *s, off, n));
 }
 
 srt_string *ss_erase_u(srt_string **s, size_t char_off, size_t n)
 {
-	return aux_erase_u(s, S_FALSE, *s, char_off, n);
+	return ss_shrink_chk(s, aux_erase_u(s, S_FALSE, *s, char_off, n));
 }
 
 srt_string *ss_replace(srt_string **s, size_t off, const srt_string *s1,
@@ -1829,12 +2243,13 @@ srt_string *ss_replace(srt_string **s, size_t off, const srt_string *s1,
 
 srt_string *ss_resize(srt_string **s, size_t n, char fill_byte)
 {
-	return aux_resize(s, S_FALSE, *s, n, fill_byte);
+	return ss_shrink_chk(s, aux_resize(s, S_FALSE, *s, n, fill_byte));
 }
 
 srt_string *ss_resize_u(srt_string **s, size_t u_chars, int fill_char)
 {
-	return aux_resize_u(s, S_FALSE, *s, u_chars, fill_char);
+	return ss_shrink_chk(s, aux_resize_u(s, S_FALSE, *s, u_chars,
+					     fill_char));
 }
 
 srt_string *ss_trim(srt_string **s)
@@ -1883,10 +2298,33 @@ const char *ss_to_c(const srt_string *s)
 	 */
 	buf = (char *)ss_get_buffer_r(s);
 	size = ss_size(s);
-	buf[size] = 0; /* C string terminator */
+	if (!ss_shared_ro(s)) /* shared strings are already terminated */
+		buf[size] = 0; /* C string terminator */
 	return buf;
 }
 
+int64_t ss_to_int(const srt_string *s, size_t off, size_t *end_off)
+{
+	int64_t r = 0;
+	size_t ss = ss_size(s), consumed = 0;
+	if (off < ss)
+		r = snum_c_to_i64(ss_get_buffer_r(s) + off, ss - off, &consumed);
+	if (end_off)
+		*end_off = off + consumed;
+	return r;
+}
+
+double ss_to_double(const srt_string *s, size_t off, size_t *end_off)
+{
+	double r = 0;
+	size_t ss = ss_size(s), consumed = 0;
+	if (off < ss)
+		r = snum_c_to_f64(ss_get_buffer_r(s) + off, ss - off, &consumed);
+	if (end_off)
+		*end_off = off + consumed;
+	return r;
+}
+
 const wchar_t *ss_to_w(const srt_string *s, wchar_t *o, size_t nmax, size_t *n)
 {
 	int32_t c;
@@ -2041,30 +2479,94 @@ size_t ss_findr_cn(const srt_string *s, size_t off, size_t max_off,
 	return ss_find_csum_fast(ss_get_buffer_r(s), off, ss, t, ts);
 }
 
-size_t ss_split(const srt_string *src, const srt_string *separator,
-		srt_string_ref out_substrings[], size_t max_refs)
+static size_t ss_split_find(const srt_string_split *it, const char *p,
+			    size_t off, size_t size)
 {
-	const char *p;
-	size_t i, nelems = 0, off, sz, src_size = ss_size(src),
-		  sep_size = ss_size(separator);
-	if (src_size > 0 && sep_size > 0) {
-		p = ss_get_buffer_r(src);
-		for (i = 0; i < src_size;) {
-			off = ss_find(src, i, separator);
-			sz = (off != S_NPOS ? off : src_size) - i;
-			if (nelems < max_refs) {
-				ss_ref_buf(&out_substrings[nelems], p + i, sz);
-				nelems++;
-			} else {
-				/* BEHAVOIR: out of reference space */
-				break;
-			}
-			if (off == S_NPOS) { /* no more separators found */
-				break;
+	const char *q;
+	uint8_t c;
+	if (it->sep)
+		return ss_find(it->src, off, it->sep);
+	if (it->sep_byte >= 0) { /* libc memchr() is usually vectorized */
+		q = (const char *)memchr(p + off, it->sep_byte, size - off);
+		return q ? (size_t)(q - p) : S_NPOS;
+	}
+	for (; off < size; off++) {
+		c = (uint8_t)p[off];
+		if (it->sep_set[c >> 3] & (1 << (c & 7)))
+			return off;
+	}
+	return S_NPOS;
+}
+
+void ss_split_init(srt_string_split *it, const srt_string *src,
+		   const srt_string *separator)
+{
+	size_t sep_size = ss_size(separator);
+	if (sep_size == 1) {
+		ss_split_init_set(it, src, ss_get_buffer_r(separator), 1);
+		return;
+	}
+	if (it) {
+		memset(it, 0, sizeof(*it));
+		it->src = src;
+		it->sep = separator;
+		it->sep_byte = -1;
+		/* BEHAVIOR: no output if no separator */
+		it->off = ss_size(src) > 0 && sep_size > 0 ? 0 : S_NPOS;
+	}
+}
+
+void ss_split_init_set(srt_string_split *it, const srt_string *src,
+		       const char *separators, size_t num_separators)
+{
+	size_t i;
+	uint8_t c;
+	if (it) {
+		memset(it, 0, sizeof(*it));
+		it->src = src;
+		it->sep_byte = -1;
+		if (num_separators == 1 && separators) {
+			it->sep_byte = (uint8_t)separators[0];
+		} else {
+			for (i = 0; i < num_separators && separators; i++) {
+				c = (uint8_t)separators[i];
+				it->sep_set[c >> 3] |= (uint8_t)(1 << (c & 7));
 			}
-			i = off + sep_size;
 		}
+		it->off = ss_size(src) > 0 ? 0 : S_NPOS;
+	}
+}
+
+const srt_string *ss_split_next(srt_string_split *it, srt_string_ref *out)
+{
+	const char *p;
+	size_t i, off, src_size;
+	RETURN_IF(!it || it->off == S_NPOS, NULL);
+	p = ss_get_buffer_r(it->src);
+	src_size = ss_size(it->src);
+	i = it->off;
+	off = ss_split_find(it, p, i, src_size);
+	if (off == S_NPOS) { /* no more separators found */
+		off = src_size;
+		it->off = S_NPOS;
+	} else {
+		it->off = off + (it->sep ? ss_size(it->sep) : 1);
+		if (it->off >= src_size) /* BEHAVIOR: no trailing empty field */
+			it->off = S_NPOS;
 	}
+	return ss_ref_buf(out, p + i, off - i);
+}
+
+size_t ss_split(const srt_string *src, const srt_string *separator,
+		srt_string_ref out_substrings[], size_t max_refs)
+{
+	size_t nelems = 0;
+	srt_string_split it;
+	ss_split_init(&it, src, separator);
+	/* BEHAVOIR: stop when out of reference space */
+	for (; nelems < max_refs; nelems++)
+		if (!ss_split_next(&it, &out_substrings[nelems]))
+			break;
 	return nelems;
 }
 
@@ -2190,8 +2692,9 @@ int ss_popchar(srt_string **s)
 	size_t off;
 	char *s_str;
 	RETURN_IF(!s || !*s || ss_size(*s) == 0, EOF);
+	ss_cow(s, NULL, S_TRUE);
 	off = ss_size(*s) - 1;
-	s_str = ss_get_buffer(*s);
+	s_str = get_buffer_rw(*s);
 	for (; off != S_SIZET_MAX; off--) {
 		if (SSU8_VALID_START(s_str[off])) {
 			int u_char = EOF;
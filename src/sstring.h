@@ -41,6 +41,8 @@ extern "C" {
  *	flag2: string has UTF-8 encoding errors (e.g. after some operation)
  *	flag3: string reference (built using ss_cref[a]() or ss_ref[a]())
  *	flag4: string reference with C terminator (built using ss_cref[a]())
+ * - Shared strings (see ss_share()) use the full header, with sub_type set to
+ *   SS_ST_SHARED, and the reference counter placed after the string header.
  */
 
 struct SString {
@@ -53,6 +55,45 @@ struct SStringRef {
 	const char *cstr;
 };
 
+struct SStringShared {
+	struct SString s;
+	srt_atomic refs;
+};
+
+struct SStringSplit {
+	const struct SString *src;
+	const struct SString *sep; /* multi-byte separator (NULL: byte mode) */
+	size_t off;		   /* next field offset (S_NPOS: done) */
+	int sep_byte;		   /* single-byte separator (< 0: byte set) */
+	uint8_t sep_set[32];	   /* separator byte set (bitmap) */
+};
+
+/*
+ * Bulk concatenation items (see ss_cat_list())
+ */
+
+enum eSSCatItem {
+	SS_CI_SS,	      /* string (p) */
+	SS_CI_CN,	      /* raw buffer (p, n) */
+	SS_CI_INT,	      /* integer (i) */
+	SS_CI_CHAR,	      /* Unicode character (i) */
+	SS_CI_ENC_B64,	      /* string (p), base64 encoded */
+	SS_CI_ENC_HEX,	      /* string (p), hex (lowercase) encoded */
+	SS_CI_ENC_HEXU,	      /* string (p), hex (uppercase) encoded */
+	SS_CI_ENC_ESC_XML,    /* string (p), XML escaped */
+	SS_CI_ENC_ESC_JSON,   /* string (p), JSON escaped */
+	SS_CI_ENC_ESC_URL,    /* string (p), URL escaped */
+	SS_CI_ENC_ESC_DQUOTE, /* string (p), " escaped as "" */
+	SS_CI_ENC_ESC_SQUOTE  /* string (p), ' escaped as '' */
+};
+
+struct SStringCatItem {
+	int type;
+	const void *p;
+	size_t n;
+	int64_t i;
+};
+
 struct SStringRefRW {
 	struct SString s;
 	char *str;
@@ -61,6 +102,7 @@ struct SStringRefRW {
 #define SS_RANGE \
 	(((size_t)-1) - S_MAX(sizeof(struct SString),	\
 			      sizeof(struct SStringRef)))
+#define SS_ST_SHARED 1
 #define EMPTY_SS                                                               \
 	{                                                                      \
 		EMPTY_SDataFull, 0                                             \
@@ -73,6 +115,8 @@ struct SStringRefRW {
 /* Opaque structures (accessors are provided) */
 typedef struct SString srt_string;
 typedef struct SStringRef srt_string_ref;
+typedef struct SStringSplit srt_string_split;
+typedef struct SStringCatItem srt_string_cat_item;
 
 /*
  * Aux
@@ -104,11 +148,40 @@ extern srt_string *ss_void;
  * Generated from template
  */
 
-SD_BUILDFUNCS_DYN(ss, srt_string, 1)
+SD_BUILDFUNCS_DYN_ST(ss, srt_string, 1)
+
+/* Shared string with other references (i.e. not writable in-place) */
+S_INLINE srt_bool ss_shared_ro(const srt_string *s)
+{
+	struct SStringShared *sh;
+	if (!s || !sdx_full_st(&s->d) || s->d.sub_type != SS_ST_SHARED)
+		return S_FALSE;
+	sh = (struct SStringShared *)s;
+	return S_ATOMIC_LOAD(&sh->refs) > 1 ? S_TRUE : S_FALSE;
+}
+
+S_INLINE void ss_set_size(srt_string *s, size_t size)
+{
+	/*
+	 * BEHAVIOR: shared strings are not modified (see ss_share()), and
+	 * the error flag is not set either (the header is shared, too)
+	 */
+	if (ss_shared_ro(s))
+		return;
+	sdx_set_size((srt_data *)s, size);
+}
+
+void ss_free_aux(srt_string **s, ...);
 
 size_t ss_grow(srt_string **c, size_t extra_elems);
 size_t ss_reserve(srt_string **c, size_t max_elems);
 
+/* #API: |Set growth policy (SD_GROW_DEFAULT, SD_GROW_EXACT, SD_GROW_DOUBLE, SD_GROW_HALF, SD_GROW_LINEAR, optionally combined with SD_GROW_PAGE, SD_GROW_SHRINK, and/or SD_GROW_SPILL -for stack-allocated strings with full header, see ss_alloca_spill()-)|string;growth policy|S_TRUE: OK, S_FALSE: not enough memory|O(1)|1;2| */
+srt_bool ss_set_grow_policy(srt_string **s, int policy);
+
+/* #API: |Get growth policy|string|growth policy|O(1)|1;2| */
+int ss_grow_policy(const srt_string *s);
+
 /*
 #API: |Free one or more strings (heap)|string;more strings (optional)|-|O(1)|1;2|
 void ss_free(srt_string **s, ...)
@@ -125,7 +198,7 @@ srt_string *ss_shrink(srt_string **s)
 #API: |Get string size|string|string bytes used in UTF8 format|O(1)|1;2|
 size_t ss_size(const srt_string *s)
 
-#NOTAPI: |Set string size (bytes used in UTF8 format)|string;new size|-|O(1)|1;2|
+#NOTAPI: |Set string size (bytes used in UTF8 format). Shared strings with more than one reference are not modified (use e.g. ss_reserve() first for getting a private copy)|string;new size|-|O(1)|1;2|
 void ss_set_size(srt_string *s, size_t s)
 
 #API: |Equivalent to ss_size|string|Number of bytes (UTF-8 string length)|O(1)|1;2|
@@ -140,7 +213,7 @@ size_t ss_capacity_left(const srt_string *s);
 #API: |Tells if a string is empty (zero elements)|string|S_TRUE: empty string; S_FALSE: not empty|O(1)|1;2|
 srt_bool ss_empty(const srt_string *s)
 
-#API: |Get string buffer access|string|pointer to the insternal string buffer (UTF-8 or raw data)|O(1)|1;2|
+#API: |Get string buffer access (it returns NULL for a non-NULL string if it is shared with more than one reference, so check the result: use e.g. ss_reserve() first for getting a private copy, or ss_get_buffer_r() for reading)|string|pointer to the internal string buffer (UTF-8 or raw data), or NULL (shared string with more than one reference)|O(1)|1;2|
 char *ss_get_buffer(srt_string *s);
 
 #API: |Get string buffer access (read-only)|string|pointer to the internal string buffer (UTF-8 or raw data)|O(1)|1;2|
@@ -157,6 +230,9 @@ size_t ss_get_buffer_size(const srt_string *v);
 /* #API: |Allocate string (heap)|space preallocated to store n elements|allocated string|O(1)|1;2| */
 srt_string *ss_alloc(size_t initial_heap_reserve);
 
+/* #API: |Allocate string (heap) using the given allocator|allocator (NULL: global allocator); space preallocated to store n elements|allocated string|O(1)|1;2| */
+srt_string *ss_alloc_a(const srt_allocator *a, size_t initial_heap_reserve);
+
 /*
 #API: |Allocate string (stack)|space preallocated to store n elements|allocated string|O(1)|1;2|
 srt_string *ss_alloca(size_t max_size)
@@ -172,6 +248,20 @@ srt_string *ss_alloca(size_t max_size)
 
 srt_string *ss_alloc_into_ext_buf(void *buf, size_t max_size);
 
+/*
+#API: |Allocate string (stack), moved to the heap when growing beyond the stack space (SD_GROW_SPILL policy). It has to be released with ss_free()|space preallocated to store n elements|allocated string|O(1)|1;2|
+srt_string *ss_alloca_spill(size_t max_size)
+ */
+#define ss_alloca_spill(max_size)                                              \
+	ss_alloc_into_ext_buf_spill(                                           \
+		s_alloca(sd_alloc_size_raw(sizeof(srt_string), 1, max_size,    \
+					   S_FALSE)                            \
+			 + 1),                                                 \
+		max_size)
+
+/* #API: |Allocate string into external buffer, moved to the heap when growing beyond the buffer space (SD_GROW_SPILL policy). It has to be released with ss_free()|buffer (sd_alloc_size_raw(sizeof(srt_string), 1, max_size, S_FALSE) + 1 bytes); space preallocated to store n elements|allocated string|O(1)|1;2| */
+srt_string *ss_alloc_into_ext_buf_spill(void *buf, size_t max_size);
+
 /* #API: |Create a reference from C string. This is intended for avoid duplicating C strings when working with srt_string functions|string reference to be built (can be on heap or stack, it is a small structure); input C string (0 terminated ASCII or UTF-8 string)|srt_string string derived from srt_string_ref|O(1)|1;2| */
 const srt_string *ss_cref(srt_string_ref *s_ref, const char *c_str);
 
@@ -208,7 +298,7 @@ int ss_at(const srt_string *s, size_t off);
 /* #API: |String length (Unicode)|string|number of Unicode characters|O(1) if cached, O(n) if not previously computed|1;2| */
 size_t ss_len_u(const srt_string *s);
 
-/* #API: |Get the maximum possible string size|string|max string size (bytes)|O(1)|1;2| */
+/* #API: |Get the maximum possible string size (strings into an external buffer are limited to the buffer size, unless using the SD_GROW_SPILL policy)|string|max string size (bytes)|O(1)|1;2| */
 size_t ss_max(const srt_string *s);
 
 /* #NOTAPI: |Normalize offset: cut offset if bigger than string size|string; offset|Normalized offset (range: 0..string size)|O(1)|1;2|
@@ -229,9 +319,22 @@ void ss_clear_errors(srt_string *s);
  * Allocation from other sources: "dup"
  */
 
-/* #API: |Duplicate string|string|Output result|O(n)|1;2| */
+/* #API: |Duplicate string (shared strings are not copied, but referenced)|string|Output result|O(n)|1;2| */
 srt_string *ss_dup(const srt_string *src);
 
+/*
+ * Shared strings (reference counted, copy-on-write)
+ */
+
+/* #API: |Get a shared reference to the string (the first call converts the string into a shared one, and next calls just increment the reference counter; any write operation taking a srt_string ** on a shared string will make a private copy first: copy-on-write; in-place mutators taking a srt_string * -ss_clear(), ss_set_size(), ss_get_buffer()- refuse shared strings with more than one reference: no-op, or NULL for ss_get_buffer())|string|new string reference (to be released with ss_free())|O(1) (O(n) the first time)|1;2| */
+srt_string *ss_share(srt_string **s);
+
+/* #API: |Check if string is shared|string|S_TRUE: shared string, S_FALSE: regular string|O(1)|1;2| */
+srt_bool ss_is_shared(const srt_string *s);
+
+/* #API: |Number of references to the string data|string|reference count (1 for non-shared strings)|O(1)|1;2| */
+size_t ss_refcount(const srt_string *s);
+
 /* #API: |Duplicate from substring|string;byte offset;number of bytes|output result|O(n)|1;2| */
 srt_string *ss_dup_substr(const srt_string *src, size_t off, size_t n);
 
@@ -253,6 +356,9 @@ srt_string *ss_dup_w(const wchar_t *src);
 /* #API: |Duplicate from integer|integer|output result|O(1)|1;2| */
 srt_string *ss_dup_int(int64_t num);
 
+/* #API: |Duplicate from double (shortest round-trip representation, e.g. 0.1 -> "0.1")|double|output result|O(1)|1;2| */
+srt_string *ss_dup_double(double num);
+
 /* #API: |Duplicate string with lowercase conversion|string|output result|O(n)|1;2| */
 srt_string *ss_dup_tolower(const srt_string *src);
 
@@ -353,9 +459,12 @@ srt_string *ss_dup_read(FILE *handle, size_t max_bytes);
  * Assignment
  */
 
-/* #API: |Overwrite string with a string copy|output string; input string|output string reference (optional usage)|O(n)|1;2| */
+/* #API: |Overwrite string with a string copy (shared strings are not copied, but referenced)|output string; input string|output string reference (optional usage)|O(n)|1;2| */
 srt_string *ss_cpy(srt_string **s, const srt_string *src);
 
+/* #API: |Overwrite string with multiple items of mixed types (see ss_cat_list())|output string; items (built with ss_ci_*() functions); number of items|output string reference (optional usage)|O(n)|1;2| */
+srt_string *ss_cpy_list(srt_string **s, const srt_string_cat_item *items, size_t nitems);
+
 /* #API: |Overwrite string with a substring copy (byte mode)|output string; input string; input string start offset (bytes); number of bytes to be copied|output string reference (optional usage)|O(n)|1;2| */
 srt_string *ss_cpy_substr(srt_string **s, const srt_string *src, size_t off, size_t n);
 
@@ -377,6 +486,9 @@ srt_string *ss_cpy_wn(srt_string **s, const wchar_t *src, size_t src_size);
 /* #API: |Overwrite string with integer to string copy|output string; integer (any signed integer size)|output string reference (optional usage)|O(n)|1;2| */
 srt_string *ss_cpy_int(srt_string **s, int64_t num);
 
+/* #API: |Overwrite string with double to string copy (shortest round-trip representation)|output string; double|output string reference (optional usage)|O(1)|1;2| */
+srt_string *ss_cpy_double(srt_string **s, double num);
+
 /* #API: |Overwrite string with input string lowercase conversion copy|output string; input string|output string reference (optional usage)|O(n)|1;2| */
 srt_string *ss_cpy_tolower(srt_string **s, const srt_string *src);
 
@@ -489,6 +601,9 @@ srt_string *ss_cat(srt_string **s, const srt_string *s1, ...)
 */
 srt_string *ss_cat_aux(srt_string **s, const srt_string *s1, ...);
 
+/* #API: |Concatenate multiple items of mixed types (strings, C strings, integers, characters, encodings), computing the output size first, so only one allocation is required|output string; items (built with ss_ci_*() functions); number of items|output string reference (optional usage)|O(n)|1;2| */
+srt_string *ss_cat_list(srt_string **s, const srt_string_cat_item *items, size_t nitems);
+
 /* #API: |Concatenate substring (byte/UTF-8 mode)|output string; input string; input string substring byte offset; input string substring size (bytes)|output string reference (optional usage)|O(n)|1;2| */
 srt_string *ss_cat_substr(srt_string **s, const srt_string *src, size_t off, size_t n);
 
@@ -516,6 +631,9 @@ srt_string *ss_cat_wn(srt_string **s, const wchar_t *src, size_t src_size);
 /* #API: |Concatenate integer|output string; integer (any signed integer size)|output string reference (optional usage)|O(n)|1;2| */
 srt_string *ss_cat_int(srt_string **s, int64_t num);
 
+/* #API: |Concatenate double (shortest round-trip representation)|output string; double|output string reference (optional usage)|O(1)|1;2| */
+srt_string *ss_cat_double(srt_string **s, double num);
+
 /* #API: |Concatenate "lowercased" string|output string; input string|output string reference (optional usage)|O(n)|1;2| */
 srt_string *ss_cat_tolower(srt_string **s, const srt_string *src);
 
@@ -679,7 +797,7 @@ srt_string *ss_dec_esc_squote(srt_string **s, const srt_string *src);
 /* #API: |Set Turkish mode locale (related to case conversion)|S_TRUE: enable turkish mode, S_FALSE: disable|S_TRUE: conversion functions OK, S_FALSE: error (missing functions)|O(1)|1;2| */
 srt_bool ss_set_turkish_mode(srt_bool enable_turkish_mode);
 
-/* #API: |Clear string|output string|output string reference (optional usage)|O(n)|1;2| */
+/* #API: |Clear string (shared strings with more than one reference are not modified: use ss_cpy_c(&s, "") instead)|output string|output string reference (optional usage)|O(n)|1;2| */
 void ss_clear(srt_string *s);
 
 /* #API: |Check and fix string (if input string is NULL, replaces it with a empty valid string)|output string|output string reference (optional usage)|O(n)|1;2| */
@@ -719,6 +837,12 @@ const char *ss_to_c(const srt_string *s);
 /* #API: |Give a C-compatible zero-ended string reference ("wide char" Unicode mode) (UTF-16 for 16-bit wchar_t, and UTF-32 for 32-bit wchar_t)|input string; output string buffer; output string max characters; output string size|Zero'ended C compatible string reference ("wide char" Unicode mode)|O(n)|1;2| */
 const wchar_t *ss_to_w(const srt_string *s, wchar_t *o, size_t nmax, size_t *n);
 
+/* #API: |Parse integer (leading blanks are skipped; out of range values are saturated)|input string; byte offset; output offset after the number, or the input offset if no number was found (optional: NULL)|integer (0 if not a number)|O(n)|1;2| */
+int64_t ss_to_int(const srt_string *s, size_t off, size_t *end_off);
+
+/* #API: |Parse double (leading blanks are skipped)|input string; byte offset; output offset after the number, or the input offset if no number was found (optional: NULL)|double (0 if not a number)|O(n)|1;2| */
+double ss_to_double(const srt_string *s, size_t off, size_t *end_off);
+
 /*
  * Search
  */
@@ -768,6 +892,15 @@ size_t ss_findr_cn(const srt_string *s, size_t off, size_t max_off, const char *
 /* #API: |Split/tokenize: break string by separators|input string; separator; output substring references; number of output substrings|Number of elements|O(n)|1;2| */
 size_t ss_split(const srt_string *src, const srt_string *separator, srt_string_ref out_substrings[], size_t max_refs);
 
+/* #API: |Split iterator initialization (resumable split, with no limit on the number of substrings)|split iterator; input string; separator|-|O(1)|1;2| */
+void ss_split_init(srt_string_split *it, const srt_string *src, const srt_string *separator);
+
+/* #API: |Split iterator initialization, using any byte of a set as separator (e.g. ",;" or "\t")|split iterator; input string; separator bytes; number of separator bytes|-|O(n)|1;2| */
+void ss_split_init_set(srt_string_split *it, const srt_string *src, const char *separators, size_t num_separators);
+
+/* #API: |Get next substring from the split iterator (zero-copy)|split iterator; substring reference to be built|substring (NULL if no more substrings)|O(n)|1;2| */
+const srt_string *ss_split_next(srt_string_split *it, srt_string_ref *out);
+
 /*
  * Compare
  */
@@ -864,6 +997,8 @@ S_INLINE srt_bool ss_is_cref(const srt_string *s)
 
 S_INLINE char *ss_get_buffer(srt_string *s)
 {
+	/* BEHAVIOR: shared strings are not writable (see ss_share()) */
+	RETURN_IF(ss_shared_ro(s), NULL);
 	/*
 	 * Constness breaking will be addressed once the ss_to_c gets fixed.
 	 */
@@ -878,6 +1013,53 @@ S_INLINE const char *ss_get_buffer_r(const srt_string *s)
 		: (const char *)sdx_get_buffer_r((const srt_data *)s);
 }
 
+S_INLINE srt_string_cat_item ss_ci_aux(int type, const void *p, size_t n,
+				       int64_t i)
+{
+	srt_string_cat_item ci;
+	ci.type = type;
+	ci.p = p;
+	ci.n = n;
+	ci.i = i;
+	return ci;
+}
+
+/* #API: |Bulk concatenation item: string|string|item|O(1)|1;2| */
+S_INLINE srt_string_cat_item ss_ci_ss(const srt_string *s)
+{
+	return ss_ci_aux(SS_CI_SS, s, 0, 0);
+}
+
+/* #API: |Bulk concatenation item: C string|C string|item|O(n)|1;2| */
+S_INLINE srt_string_cat_item ss_ci_c(const char *c)
+{
+	return ss_ci_aux(SS_CI_CN, c, c ? strlen(c) : 0, 0);
+}
+
+/* #API: |Bulk concatenation item: raw buffer|buffer; buffer size (bytes)|item|O(1)|1;2| */
+S_INLINE srt_string_cat_item ss_ci_cn(const char *c, size_t n)
+{
+	return ss_ci_aux(SS_CI_CN, c, n, 0);
+}
+
+/* #API: |Bulk concatenation item: integer|integer|item|O(1)|1;2| */
+S_INLINE srt_string_cat_item ss_ci_int(int64_t num)
+{
+	return ss_ci_aux(SS_CI_INT, NULL, 0, num);
+}
+
+/* #API: |Bulk concatenation item: Unicode character|Unicode character|item|O(1)|1;2| */
+S_INLINE srt_string_cat_item ss_ci_char(int c)
+{
+	return ss_ci_aux(SS_CI_CHAR, NULL, 0, c);
+}
+
+/* #API: |Bulk concatenation item: encoded string|encoding (SS_CI_ENC_B64, SS_CI_ENC_HEX, SS_CI_ENC_HEXU, SS_CI_ENC_ESC_XML, SS_CI_ENC_ESC_JSON, SS_CI_ENC_ESC_URL, SS_CI_ENC_ESC_DQUOTE, SS_CI_ENC_ESC_SQUOTE); string|item|O(1)|1;2| */
+S_INLINE srt_string_cat_item ss_ci_enc(int enc_type, const srt_string *s)
+{
+	return ss_ci_aux(enc_type, s, 0, 0);
+}
+
 	/*
 	 * Aux
 	 */
@@ -9,7 +9,9 @@
 
 #include "svector.h"
 #include "saux/scommon.h"
+#include "saux/sdimage.h"
 #include "saux/ssort.h"
+#include "sstats.h"
 
 #ifndef SV_DEFAULT_SIGNED_VAL
 #define SV_DEFAULT_SIGNED_VAL 0
@@ -94,15 +96,24 @@ static srt_vector_cmp svt_cmpf[SV_LAST_NUM + 1] = {
 	__sv_cmp_i8,  __sv_cmp_u8,  __sv_cmp_i16, __sv_cmp_u16, __sv_cmp_i32,
 	__sv_cmp_u32, __sv_cmp_i64, __sv_cmp_u64, __sv_cmp_f,   __sv_cmp_d};
 
-static srt_vector *sv_alloc_base(enum eSV_Type t, size_t elem_size,
-				 size_t init_size, const srt_vector_cmp f)
+static srt_vector *sv_alloc_base(const srt_allocator *a, enum eSV_Type t,
+				 size_t elem_size, size_t init_size,
+				 const srt_vector_cmp f)
 {
 	size_t alloc_size = sd_alloc_size_raw(sizeof(srt_vector), elem_size,
 					      init_size, S_FALSE);
-	void *buf = s_malloc(alloc_size);
-	srt_vector *v = sv_alloc_raw(t, S_FALSE, buf, elem_size, init_size, f);
-	if (!v || v == sv_void)
-		s_free(buf);
+	int id = sd_allocator_id(a);
+	void *buf;
+	srt_vector *v;
+	RETURN_IF(id < 0, sv_void);
+	buf = sd_mem_alloc((uint8_t)id, alloc_size);
+	v = sv_alloc_raw(t, S_FALSE, buf, elem_size, init_size, f);
+	if (!v || v == sv_void) {
+		sd_mem_free((uint8_t)id, buf);
+	} else {
+		v->d.alloc_id = (uint8_t)id;
+		sst_on_alloc((srt_data *)v);
+	}
 	return v;
 }
 
@@ -134,6 +145,54 @@ void sv_clear(srt_vector *v)
 		sv_set_size(v, 0);
 }
 
+/*
+ * Persistence
+ */
+
+static srt_bool sv_image_chk(srt_vector *v)
+{
+	int t = v->d.sub_type;
+	RETURN_IF(t > SV_GEN || v->d.header_size != sizeof(srt_vector),
+		  S_FALSE);
+	RETURN_IF(t <= SV_LAST_NUM
+			  && v->d.elem_size != sv_elem_size((enum eSV_Type)t),
+		  S_FALSE);
+	/* BEHAVIOR: the compare function is not stored */
+	v->vx.cmpf = t <= SV_LAST_NUM ? svt_cmpf[t] : NULL;
+	return S_TRUE;
+}
+
+srt_bool sv_save(FILE *f, const srt_vector *v)
+{
+	RETURN_IF(!v, S_FALSE);
+	return sd_image_save(f, (const srt_data *)v, SD_IMAGE_VECTOR,
+			     sizeof(srt_vector));
+}
+
+srt_vector *sv_load(FILE *f)
+{
+	srt_vector *v = (srt_vector *)sd_image_load(f, SD_IMAGE_VECTOR,
+						    sizeof(srt_vector));
+	/* BEHAVIOR: invalid image: raw release (no type-specific free) */
+	if (v && !sv_image_chk(v))
+		sd_free((srt_data **)&v);
+	return v;
+}
+
+srt_vector *sv_map(const char *path)
+{
+	srt_vector *v = (srt_vector *)sd_image_map(path, SD_IMAGE_VECTOR,
+						   sizeof(srt_vector));
+	if (v && !sv_image_chk(v))
+		sv_unmap(&v);
+	return v;
+}
+
+void sv_unmap(srt_vector **v)
+{
+	sd_image_unmap((srt_data **)v);
+}
+
 static srt_vector *aux_dup(const srt_vector *src, size_t n_elems)
 {
 	size_t ss = sv_size(src), size = n_elems < ss ? n_elems : ss;
@@ -313,6 +372,7 @@ srt_vector *sv_alloc_raw(enum eSV_Type t, srt_bool ext_buf, void *buffer,
 	v = (srt_vector *)buffer;
 	sd_reset((srt_data *)v, sizeof(srt_vector), elem_size, max_size,
 		 ext_buf, S_FALSE);
+	sd_set_ctype((srt_data *)v, SD_CT_VECTOR);
 	v->d.sub_type = (uint8_t)t;
 	v->vx.cmpf = t <= SV_LAST_NUM ? svt_cmpf[t] : f;
 	return v;
@@ -321,12 +381,28 @@ srt_vector *sv_alloc_raw(enum eSV_Type t, srt_bool ext_buf, void *buffer,
 srt_vector *sv_alloc(size_t elem_size, size_t initial_num_elems_reserve,
 		     const srt_vector_cmp f)
 {
-	return sv_alloc_base(SV_GEN, elem_size, initial_num_elems_reserve, f);
+	return sv_alloc_base(NULL, SV_GEN, elem_size, initial_num_elems_reserve,
+			     f);
 }
 
 srt_vector *sv_alloc_t(enum eSV_Type t, size_t initial_num_elems_reserve)
 {
-	return sv_alloc_base(t, sv_elem_size(t), initial_num_elems_reserve, 0);
+	return sv_alloc_base(NULL, t, sv_elem_size(t),
+			     initial_num_elems_reserve, 0);
+}
+
+srt_vector *sv_alloc_a(const srt_allocator *a, size_t elem_size,
+		       size_t initial_num_elems_reserve, const srt_vector_cmp f)
+{
+	return sv_alloc_base(a, SV_GEN, elem_size, initial_num_elems_reserve,
+			     f);
+}
+
+srt_vector *sv_alloc_t_a(const srt_allocator *a, enum eSV_Type t,
+			 size_t initial_num_elems_reserve)
+{
+	return sv_alloc_base(a, t, sv_elem_size(t), initial_num_elems_reserve,
+			     0);
 }
 
 /*
@@ -412,14 +488,22 @@ srt_vector *sv_cat_resize(srt_vector **v, const srt_vector *src, size_t n)
  * Transformation
  */
 
+/* Automatic shrink (SD_GROW_SHRINK policy) */
+static srt_vector *sv_shrink_chk(srt_vector **v, srt_vector *r)
+{
+	if (v && *v == r && sd_auto_shrink((srt_data **)v, 0))
+		r = *v;
+	return r;
+}
+
 srt_vector *sv_erase(srt_vector **v, size_t off, size_t n)
 {
-	return aux_erase(v, S_FALSE, (v ? *v : NULL), off, n);
+	return sv_shrink_chk(v, aux_erase(v, S_FALSE, (v ? *v : NULL), off, n));
 }
 
 srt_vector *sv_resize(srt_vector **v, size_t n)
 {
-	return aux_resize(v, S_FALSE, (v ? *v : NULL), n);
+	return sv_shrink_chk(v, aux_resize(v, S_FALSE, (v ? *v : NULL), n));
 }
 
 srt_vector *sv_sort(srt_vector *v)
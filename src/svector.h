@@ -119,6 +119,12 @@ srt_vector *sv_alloc(size_t elem_size, size_t initial_num_elems_reserve, const s
 /* #API: |Allocate typed vector (heap)|Vector type; space preallocated to store n elements|vector|O(1)|1;2| */
 srt_vector *sv_alloc_t(enum eSV_Type t, size_t initial_num_elems_reserve);
 
+/* #API: |Allocate SV_GEN vector (heap) using the given allocator|allocator (NULL: global allocator); element size; space preallocated to store n elements; compare function (used for sorting, pass NULL for none)|vector|O(1)|1;2| */
+srt_vector *sv_alloc_a(const srt_allocator *a, size_t elem_size, size_t initial_num_elems_reserve, const srt_vector_cmp f);
+
+/* #API: |Allocate typed vector (heap) using the given allocator|allocator (NULL: global allocator); vector type; space preallocated to store n elements|vector|O(1)|1;2| */
+srt_vector *sv_alloc_t_a(const srt_allocator *a, enum eSV_Type t, size_t initial_num_elems_reserve);
+
 SD_BUILDFUNCS_FULL(sv, srt_vector, 0)
 
 /*
@@ -140,6 +146,12 @@ size_t sv_reserve(srt_vector **v, size_t max_elems)
 #API: |Free unused space|vector|same vector (optional usage)|O(1)|1;2|
 srt_vector *sv_shrink(srt_vector **v)
 
+#API: |Set growth policy (SD_GROW_DEFAULT, SD_GROW_EXACT, SD_GROW_DOUBLE, SD_GROW_HALF, SD_GROW_LINEAR, optionally combined with SD_GROW_PAGE, SD_GROW_SHRINK, and/or SD_GROW_SPILL -for stack-allocated ones-)|vector;growth policy|-|O(1)|1;2|
+void sv_set_grow_policy(srt_vector *v, int policy)
+
+#API: |Get growth policy|vector|growth policy|O(1)|1;2|
+int sv_grow_policy(const srt_vector *v)
+
 #API: |Get vector size|vector|vector number of elements|O(1)|1;2|
 size_t sv_size(const srt_vector *v)
 
@@ -191,6 +203,22 @@ srt_vector *sv_dup_resize(const srt_vector *src, size_t n);
 /* #API: |Reset/clean vector (keeping vector type)|vector|-|O(1)|1;2| */
 void sv_clear(srt_vector *v);
 
+/*
+ * Persistence (store/restore)
+ */
+
+/* #API: |Save vector image to file (numeric and SV_GEN vectors); SV_GEN vectors must not store pointers, and the compare function is not stored (NULL after load)|file handle; vector|S_TRUE: OK; S_FALSE: I/O error or unsupported vector type|O(n): WARNING: involves external file I/O|1;2| */
+srt_bool sv_save(FILE *f, const srt_vector *v);
+
+/* #API: |Load vector image from file|file handle|vector (NULL: I/O error, not enough memory, or invalid/incompatible image)|O(n): WARNING: involves external file I/O|1;2| */
+srt_vector *sv_load(FILE *f);
+
+/* #API: |Open vector image file using memory mapping (no deserialization: the mapped file is used as fixed-size vector; changes are not written back to the file)|file path|vector (NULL: I/O error, invalid/incompatible image, or system without mmap() support)|O(1)|1;2| */
+srt_vector *sv_map(const char *path);
+
+/* #API: |Release vector opened with sv_map()|vector|-|O(1)|1;2| */
+void sv_unmap(srt_vector **v);
+
 /*
  * Assignment
  */
@@ -0,0 +1,221 @@
+/*
+ * svmem.c
+ *
+ * Virtual memory (mmap) backed allocator.
+ *
+ * Observations:
+ * - Every block starts with a header with its size and backing mode (heap
+ *   or mapped), so resize and release know how to handle it.
+ * - Mapped sizes are rounded to the page size.
+ *
+ * Copyright (c) 2015-2020 F. Aragon. All rights reserved.
+ * Released under the BSD 3-Clause License (see the doc/LICENSE)
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* mremap() */
+#endif
+
+#include "svmem.h"
+#include "saux/scommon.h"
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(S_MINIMAL)         \
+	&& !defined(SVM_DISABLE_MMAP)
+#include <sys/mman.h>
+#include <unistd.h>
+#define SVM_MMAP
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#if defined(__linux__) && defined(MREMAP_MAYMOVE)
+#define SVM_MREMAP
+#endif
+#endif
+
+/*
+ * Internal functions
+ */
+
+struct SVMemHdr {
+	size_t size;   /* block size, including the header */
+	size_t mapped; /* 0: heap, 1: mapped */
+};
+
+static int svm_huge_tag;
+
+#define SVM_HDR sizeof(struct SVMemHdr)
+
+S_INLINE struct SVMemHdr *svm_hdr(void *p)
+{
+	return (struct SVMemHdr *)p - 1;
+}
+
+#ifdef SVM_MMAP
+
+static size_t svm_page_size()
+{
+	static size_t ps;
+	long r;
+	if (!ps) {
+		r = sysconf(_SC_PAGESIZE);
+		ps = r > 0 ? (size_t)r : 4096;
+	}
+	return ps;
+}
+
+/* Size rounded to the page size (0: overflow) */
+static size_t svm_page_round(size_t size)
+{
+	size_t ps = svm_page_size(), rs = (size + ps - 1) & ~(ps - 1);
+	return rs < size ? 0 : rs;
+}
+
+static void svm_advise(void *p, size_t size, void *context)
+{
+#ifdef MADV_HUGEPAGE
+	if (context == &svm_huge_tag)
+		madvise(p, size, MADV_HUGEPAGE);
+#else
+	(void)p;
+	(void)size;
+	(void)context;
+#endif
+}
+
+static struct SVMemHdr *svm_map(size_t size, void *context)
+{
+	void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	RETURN_IF(p == MAP_FAILED, NULL);
+	svm_advise(p, size, context);
+	return (struct SVMemHdr *)p;
+}
+
+static void *svm_realloc_mapped(void *context, struct SVMemHdr *h,
+				size_t size)
+{
+	struct SVMemHdr *h2;
+	RETURN_IF(size == h->size, h + 1);
+#ifdef SVM_MREMAP
+	h2 = (struct SVMemHdr *)mremap(h, h->size, size, MREMAP_MAYMOVE);
+	RETURN_IF(h2 == MAP_FAILED, NULL);
+	svm_advise(h2, size, context);
+#else
+	if (size < h->size) {
+		munmap((char *)h + size, h->size - size);
+		h->size = size;
+		return h + 1;
+	}
+	h2 = svm_map(size, context);
+	RETURN_IF(!h2, NULL);
+	memcpy(h2, h, h->size);
+	munmap(h, h->size);
+#endif
+	h2->size = size;
+	return h2 + 1;
+}
+
+#endif /* #ifdef SVM_MMAP */
+
+static void *svm_f_alloc(void *context, size_t size)
+{
+	struct SVMemHdr *h;
+	RETURN_IF(s_size_t_overflow(size, SVM_HDR), NULL);
+	size += SVM_HDR;
+#ifdef SVM_MMAP
+	if (size >= SVM_MMAP_THRESHOLD) {
+		size = svm_page_round(size);
+		RETURN_IF(!size, NULL);
+		h = svm_map(size, context);
+		RETURN_IF(!h, NULL);
+		h->size = size;
+		h->mapped = 1;
+		return h + 1;
+	}
+#else
+	(void)context;
+#endif
+	h = (struct SVMemHdr *)s_malloc(size);
+	RETURN_IF(!h, NULL);
+	h->size = size;
+	h->mapped = 0;
+	return h + 1;
+}
+
+static void svm_f_free(void *context, void *ptr)
+{
+	struct SVMemHdr *h;
+	(void)context;
+	if (!ptr)
+		return;
+	h = svm_hdr(ptr);
+#ifdef SVM_MMAP
+	if (h->mapped) {
+		munmap(h, h->size);
+		return;
+	}
+#endif
+	s_free(h);
+}
+
+static void *svm_f_realloc(void *context, void *ptr, size_t size)
+{
+	struct SVMemHdr *h, *h2;
+	void *p2;
+	RETURN_IF(!ptr, svm_f_alloc(context, size));
+	RETURN_IF(s_size_t_overflow(size, SVM_HDR), NULL);
+	h = svm_hdr(ptr);
+	size += SVM_HDR;
+#ifdef SVM_MMAP
+	if (h->mapped) {
+		size = svm_page_round(size);
+		RETURN_IF(!size, NULL);
+		return svm_realloc_mapped(context, h, size);
+	}
+	if (size >= SVM_MMAP_THRESHOLD) { /* from heap to mapped memory */
+		p2 = svm_f_alloc(context, size - SVM_HDR);
+		RETURN_IF(!p2, NULL);
+		memcpy(p2, ptr, h->size - SVM_HDR);
+		s_free(h);
+		return p2;
+	}
+#else
+	(void)p2;
+#endif
+	h2 = (struct SVMemHdr *)s_realloc(h, size);
+	RETURN_IF(!h2, NULL);
+	h2->size = size;
+	return h2 + 1;
+}
+
+static const srt_allocator svm_a = {svm_f_alloc, svm_f_realloc, svm_f_free,
+				    NULL};
+static const srt_allocator svm_ah = {svm_f_alloc, svm_f_realloc, svm_f_free,
+				     &svm_huge_tag};
+
+/*
+ * Allocator
+ */
+
+const srt_allocator *svm_allocator(srt_bool huge_pages)
+{
+	return huge_pages ? &svm_ah : &svm_a;
+}
+
+srt_bool svm_mmap_support()
+{
+#ifdef SVM_MMAP
+	return S_TRUE;
+#else
+	return S_FALSE;
+#endif
+}
+
+srt_bool svm_mremap_support()
+{
+#ifdef SVM_MREMAP
+	return S_TRUE;
+#else
+	return S_FALSE;
+#endif
+}
@@ -0,0 +1,49 @@
+#ifndef SVMEM_H
+#define SVMEM_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * svmem.h
+ *
+ * #SHORTDOC virtual memory (mmap) backed allocator for very large containers
+ *
+ * #DOC Allocator for very large containers (e.g. hundreds of MB or more),
+ * #DOC using the allocator interface, e.g.:
+ * #DOC shm_alloc_a(svm_allocator(S_FALSE), SHM_II, n). Blocks below
+ * #DOC SVM_MMAP_THRESHOLD bytes use the heap. Bigger blocks are mapped
+ * #DOC directly (anonymous mmap), and resized with mremap() on Linux, so
+ * #DOC growing moves page table entries instead of copying memory. On other
+ * #DOC POSIX systems, growing maps a new block and copies the old one, and
+ * #DOC shrinking unmaps the tail. On systems without mmap() support, all
+ * #DOC blocks use the heap.
+ * #DOC
+ * #DOC The huge pages variant advises the kernel to use transparent huge
+ * #DOC pages (MADV_HUGEPAGE), reducing TLB misses on random access (e.g.
+ * #DOC hash map lookups).
+ *
+ * Copyright (c) 2015-2020 F. Aragon. All rights reserved.
+ * Released under the BSD 3-Clause License (see the doc/LICENSE)
+ */
+
+#include "saux/sdata.h"
+
+#ifndef SVM_MMAP_THRESHOLD
+#define SVM_MMAP_THRESHOLD (256 * 1024) /* smaller blocks use the heap */
+#endif
+
+/* #API: |Get mmap-backed allocator|use transparent huge pages (S_TRUE/S_FALSE)|allocator|O(1)|1;2| */
+const srt_allocator *svm_allocator(srt_bool huge_pages);
+
+/* #API: |Check if mmap-backed storage is supported (otherwise, the allocator uses the heap)||S_TRUE: mmap() support; S_FALSE: heap only|O(1)|1;2| */
+srt_bool svm_mmap_support(void);
+
+/* #API: |Check if in-place resize is supported (mremap)||S_TRUE: resize without copy; S_FALSE: resize requires copy|O(1)|1;2| */
+srt_bool svm_mremap_support(void);
+
+#ifdef __cplusplus
+} /* extern "C" { */
+#endif
+
+#endif /* #ifndef SVMEM_H */
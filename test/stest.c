@@ -10,6 +10,7 @@
 #include "../src/libsrt.h"
 #include "../src/saux/schar.h"
 #include "../src/saux/sdbg.h"
+#include "../src/saux/sdimage.h"
 #include "utf8_examples.h"
 #include <locale.h>
 
@@ -491,6 +492,81 @@ static int test_ss_dup()
 	return res;
 }
 
+static int test_ss_share()
+{
+	srt_string *a = ss_dup_c("hello"), *b, *c = NULL, *d;
+	int res = !a ? 1 : 0;
+	b = ss_share(&a);
+	res |= res ? 0
+		   : (b == a && ss_is_shared(a) && ss_refcount(a) == 2) ? 0 : 2;
+	d = ss_dup(a);
+	ss_cpy(&c, b);
+	res |= res ? 0 : (d == a && c == a && ss_refcount(a) == 4) ? 0 : 4;
+	/*
+	 * In-place mutators refuse shared strings with other references,
+	 * without writing the shared header (no error flag)
+	 */
+	ss_set_size(a, 3);
+	res |= res ? 0
+		   : (!ss_alloc_errors(a) && ss_size(b) == 5
+		      && !ss_get_buffer(a) && !ss_alloc_errors(a)
+		      && ss_refcount(a) == 4)
+			     ? 0
+			     : 64;
+	ss_clear(b);
+	res |= res ? 0
+		   : (!ss_alloc_errors(b) && !strcmp(ss_to_c(a), "hello")
+		      && !strcmp(ss_to_c(c), "hello"))
+			     ? 0
+			     : 128;
+	/* Copy-on-write: the other references keep the original content */
+	ss_cat_c(&b, " world");
+	res |= res ? 0
+		   : (b != a && !ss_is_shared(b) && ss_refcount(a) == 3
+		      && !strcmp(ss_to_c(a), "hello")
+		      && !strcmp(ss_to_c(b), "hello world"))
+			     ? 0
+			     : 8;
+	ss_cat(&c, c);
+	ss_toupper(&d);
+	res |= res ? 0
+		   : (ss_refcount(a) == 1 && !strcmp(ss_to_c(a), "hello")
+		      && !strcmp(ss_to_c(c), "hellohello")
+		      && !strcmp(ss_to_c(d), "HELLO"))
+			     ? 0
+			     : 16;
+	/* Last reference: writable, and converted in-place */
+	ss_set_size(a, 4);
+	if (ss_get_buffer(a))
+		ss_get_buffer(a)[0] = 'H';
+	res |= res ? 0
+		   : (ss_is_shared(a) && !ss_alloc_errors(a)
+		      && !strcmp(ss_to_c(a), "Hell"))
+			     ? 0
+			     : 256;
+	ss_cat_c(&a, "!");
+	res |= res ? 0
+		   : (!ss_is_shared(a) && !strcmp(ss_to_c(a), "Hell!")) ? 0
+									: 32;
+	ss_free(&b);
+	b = ss_share(&a);
+	ss_free(&b);
+	ss_clear(a);
+	res |= res ? 0
+		   : (!ss_is_shared(a) && !ss_alloc_errors(a) && !ss_size(a))
+			     ? 0
+			     : 512;
+#ifdef S_USE_VA_ARGS
+	ss_free(&a, &b, &c, &d);
+#else
+	ss_free(&a);
+	ss_free(&b);
+	ss_free(&c);
+	ss_free(&d);
+#endif
+	return res;
+}
+
 static int test_ss_dup_substr()
 {
 	const srt_string *crefa_hello = ss_crefa("hello");
@@ -575,6 +651,35 @@ static int test_ss_dup_int(int64_t num, const char *expected)
 	return res;
 }
 
+static int test_ss_dup_double(double num, const char *expected)
+{
+	size_t end = 0;
+	srt_string *a = ss_dup_double(num);
+	int res = !a ? 1 : (!strcmp(ss_to_c(a), expected) ? 0 : 2);
+	res |= res ? 0
+		   : (ss_to_double(a, 0, &end) == num && end == ss_size(a)) ? 0
+									    : 4;
+	ss_free(&a);
+	return res;
+}
+
+static int test_ss_to_num()
+{
+	size_t end = 0;
+	const srt_string *a = ss_crefa(" -123,45.5e1,x,99999999999999999999");
+	int res = ss_to_int(a, 0, &end) == -123 && end == 5 ? 0 : 1;
+	res |= ss_to_double(a, 6, &end) == 455.0 && end == 12 ? 0 : 2;
+	res |= ss_to_int(a, 13, &end) == 0 && end == 13 ? 0 : 4;
+	res |= ss_to_int(a, 15, &end) == 9223372036854775807LL ? 0 : 8;
+	res |= ss_to_double(a, 15, NULL) == 1e20 ? 0 : 16;
+	res |= ss_to_double(ss_crefa("0.1"), 0, NULL) == 0.1 ? 0 : 32;
+	res |= ss_to_double(ss_crefa("1.7976931348623157e308"), 0, NULL)
+			       == 1.7976931348623157e308
+		       ? 0
+		       : 64;
+	return res;
+}
+
 static int test_ss_dup_tolower(const srt_string *a, const srt_string *b)
 {
 	srt_string *sa = ss_dup(a), *sb = ss_dup_tolower(sa),
@@ -1319,6 +1424,38 @@ static int test_ss_cat(const char *a, const char *b)
 	return res;
 }
 
+static int test_ss_cat_list()
+{
+	srt_string *a = ss_dup_c("k="), *b = ss_dup_c("<a&b>"), *c = NULL;
+	srt_string_cat_item ci[7];
+	int res = !a || !b ? 1 : 0;
+	ci[0] = ss_ci_ss(a);
+	ci[1] = ss_ci_int(-12345);
+	ci[2] = ss_ci_c(" x=");
+	ci[3] = ss_ci_enc(SS_CI_ENC_ESC_XML, b);
+	ci[4] = ss_ci_char(' ');
+	ci[5] = ss_ci_enc(SS_CI_ENC_HEX, a);
+	ci[6] = ss_ci_cn("yz", 1);
+	res |= res ? 0 : (ss_cpy_list(&c, ci, 7) ? 0 : 2);
+	res |= res ? 0
+		   : !strcmp(ss_to_c(c), "k=-12345 x=&lt;a&amp;b&gt; 6b3dy")
+			     ? 0
+			     : 4;
+	ss_cat_list(&a, ci, 2); /* aliasing */
+	res |= res ? 0 : !strcmp(ss_to_c(a), "k=k=-12345") ? 0 : 8;
+	ci[0] = ss_ci_ss(a);
+	ss_cpy_list(&a, ci, 1); /* aliasing */
+	res |= res ? 0 : !strcmp(ss_to_c(a), "k=k=-12345") ? 0 : 16;
+#ifdef S_USE_VA_ARGS
+	ss_free(&a, &b, &c);
+#else
+	ss_free(&a);
+	ss_free(&b);
+	ss_free(&c);
+#endif
+	return res;
+}
+
 static int test_ss_cat_substr()
 {
 	srt_string *a = ss_dup_c("how are you"), *b = ss_dup_c(" "),
@@ -1686,7 +1823,7 @@ static int test_ss_to_w(const char *in)
 		       sb2 = sb2i >= 0 ? (size_t)sb2i : 0;
 		res |= (sb1 == sb2 ? 0 : 8) | (!memcmp(b1, b2, sb1) ? 0 : 16);
 	}
-	free(out);
+	s_free(out);
 	ss_free(&a);
 	return res;
 }
@@ -1757,6 +1894,23 @@ static int test_ss_split()
 			}
 		}
 	}
+	if (!res) {
+		const srt_string *csv = ss_crefa("a,b;;c"), *f;
+		const char *exp[] = {"a", "b", "", "c"};
+		srt_string_split it;
+		srt_string_ref r;
+		size_t i = 0;
+		ss_split_init_set(&it, csv, ",;", 2);
+		for (; (f = ss_split_next(&it, &r)) != NULL; i++)
+			if (i >= 4 || ss_size(f) != strlen(exp[i])
+			    || memcmp(ss_get_buffer_r(f), exp[i], ss_size(f)))
+				res |= 8;
+		res |= i == 4 ? 0 : 16;
+		ss_split_init(&it, a, sep1);
+		for (i = 0; ss_split_next(&it, &r); i++)
+			;
+		res |= i == 3 && !ss_split_next(&it, &r) ? 0 : 32;
+	}
 #ifdef S_USE_VA_ARGS
 	ss_free(&a, &sep1);
 #else
@@ -4616,6 +4770,970 @@ static int test_sm_double_rotation()
 	return res;
 }
 
+static int aux_sm_btree_cmp(const srt_map *a, const srt_map *b)
+{
+	int res = 0;
+	size_t i;
+	srt_vector *ka = NULL, *va = NULL, *kb = NULL, *vb = NULL;
+	if (sm_sort_to_vectors(a, &ka, &va) != (ssize_t)sm_size(a)
+	    && sm_is_btree(a))
+		res = 1;
+	sm_sort_to_vectors(b, &kb, &vb);
+	if (sm_size(a) != sm_size(b) || sv_size(ka) != sm_size(a)
+	    || sv_size(kb) != sm_size(b))
+		res = 1;
+	for (i = 0; i < sv_size(ka) && !res; i++)
+		if (sv_at_i64(ka, i) != sv_at_i64(kb, i)
+		    || sv_at_i64(va, i) != sv_at_i64(vb, i))
+			res = 1;
+#ifdef S_USE_VA_ARGS
+	sv_free(&ka, &va, &kb, &vb);
+#else
+	sv_free(&ka);
+	sv_free(&va);
+	sv_free(&kb);
+	sv_free(&vb);
+#endif
+	return res;
+}
+
+static int test_sm_btree()
+{
+	size_t i, n = 4000;
+	uint32_t seed = 1;
+	int64_t k;
+	srt_map *b = sm_alloc_btree(SM_II, 0), *r = sm_alloc(SM_II, 0),
+		*b2 = sm_alloc_btree(SM_II, 0), *r2 = sm_alloc(SM_II, 0),
+		*d = NULL, *ss = sm_alloc_btree(SM_SS, 0);
+	srt_set *s = sms_alloc_btree(SMS_I32, 0), *sr = sms_alloc(SMS_I32, 0);
+	int res = b && r && b2 && r2 && ss && s && sr ? 0 : 1;
+	res |= sm_is_btree(b) && sm_is_btree(s) && !sm_is_btree(r)
+			       && !sm_is_btree(ss)
+		       ? 0
+		       : 2;
+	/*
+	 * Random insert/delete (first growing, then shrinking, so both
+	 * node splits and index rebuilds are covered)
+	 */
+	for (i = 0; i < 6 * n && !res; i++) {
+		seed = seed * 1103515245 + 12345;
+		k = (int64_t)((seed >> 8) % n) - (int64_t)n / 2;
+		if ((seed >> 4) % 4 < (i < 2 * n ? 1U : 3U)) {
+			if (sm_delete_i(b, k) != sm_delete_i(r, k)
+			    || sms_delete_i32(s, (int32_t)k)
+				       != sms_delete_i32(sr, (int32_t)k))
+				res |= 4;
+		} else {
+			sm_inc_ii(&b, k, (int64_t)i);
+			sm_inc_ii(&r, k, (int64_t)i);
+			sms_insert_i32(&s, (int32_t)k);
+			sms_insert_i32(&sr, (int32_t)k);
+		}
+		if (i % 500 == 0
+		    && (!sbt_assert(b->bt) || aux_sm_btree_cmp(b, r)
+			|| sms_size(s) != sms_size(sr)))
+			res |= 8;
+	}
+	res |= sm_is_btree(b) && !aux_sm_btree_cmp(b, r) ? 0 : 16;
+	for (k = -(int64_t)n / 2 - 1; k < (int64_t)n / 2 + 1 && !res; k++)
+		if (sm_at_ii(b, k) != sm_at_ii(r, k)
+		    || sm_count_i(b, k) != sm_count_i(r, k)
+		    || sms_count_i32(s, (int32_t)k)
+			       != sms_count_i32(sr, (int32_t)k))
+			res |= 32;
+	res |= sm_itr_ii(b, -100, 100, NULL, NULL)
+				       == sm_itr_ii(r, -100, 100, NULL, NULL)
+			       && sms_itr_i32(s, -50, 500, NULL, NULL)
+					  == sms_itr_i32(sr, -50, 500, NULL,
+							 NULL)
+		       ? 0
+		       : 64;
+	/* Copy: output map backend is kept, new maps take the source one */
+	sm_cpy(&b2, r);
+	sm_cpy(&r2, b);
+	d = sm_dup(b);
+	res |= sm_is_btree(b2) && !sm_is_btree(r2) && sm_is_btree(d)
+			       && sbt_assert(b2->bt) && st_assert(r2)
+			       && !aux_sm_btree_cmp(b2, r)
+			       && !aux_sm_btree_cmp(r2, r)
+			       && !aux_sm_btree_cmp(d, r)
+		       ? 0
+		       : 128;
+	/* B+tree maps can not be stored */
+	res |= !sm_save(NULL, b) ? 0 : 256;
+	/* Full removal */
+	for (k = -(int64_t)n / 2; k < (int64_t)n / 2; k++)
+		sm_delete_i(d, k);
+	res |= sm_size(d) == 0 && sbt_size(d->bt) == 0 && sm_at_ii(d, 1) == 0
+		       ? 0
+		       : 512;
+#ifdef S_USE_VA_ARGS
+	sm_free(&b, &r, &b2, &r2, &d, &ss);
+	sms_free(&s, &sr);
+#else
+	sm_free(&b);
+	sm_free(&r);
+	sm_free(&b2);
+	sm_free(&r2);
+	sm_free(&d);
+	sm_free(&ss);
+	sms_free(&s);
+	sms_free(&sr);
+#endif
+	return res;
+}
+
+static int test_sm_from_sorted_vectors()
+{
+	size_t i, n;
+	int32_t j, k;
+	srt_map *m, *m2;
+	srt_set *s;
+	srt_vector *kv = sv_alloc_t(SV_I32, 0), *vv = sv_alloc_t(SV_I32, 0),
+		   *dv = sv_alloc_t(SV_D, 0), *kv2 = NULL, *vv2 = NULL;
+	int res = kv && vv && dv ? 0 : 1;
+	/* Sorted input: balanced tree for every size */
+	for (n = 0; n < 70 && !res; n++) {
+		sv_set_size(kv, 0);
+		sv_set_size(vv, 0);
+		for (i = 0; i < n; i++) {
+			sv_push_i32(&kv, (int32_t)i * 2);
+			sv_push_i32(&vv, -(int32_t)i);
+		}
+		m = sm_from_sorted_vectors(SM_II32, kv, vv);
+		res |= m && sm_size(m) == n && (!n || st_assert(m)) ? 0 : 2;
+		for (i = 0; i < n && !res; i++) {
+			j = (int32_t)i;
+			res |= sm_at_ii32(m, j * 2) == -j
+					       && !sm_count_i32(m, j * 2 + 1)
+				       ? 0
+				       : 4;
+		}
+		/* The map is a regular one */
+		sm_insert_ii32(&m, -1, 1);
+		sm_delete_i32(m, 0);
+		res |= sm_size(m) == n + (n ? 0 : 1) && st_assert(m) ? 0 : 8;
+		sm_free(&m);
+	}
+	/* Unsorted input, with duplicated keys (last value kept) */
+	sv_set_size(kv, 0);
+	sv_set_size(vv, 0);
+	for (i = 0; i < 1000; i++) {
+		j = (int32_t)((i * 7919) % 331);
+		sv_push_i32(&kv, j);
+		sv_push_i32(&vv, (int32_t)i);
+	}
+	m = sm_from_sorted_vectors(SM_II32, kv, vv);
+	res |= m && sm_size(m) == 331 && st_assert(m) ? 0 : 16;
+	for (i = 0; i < 1000 && !res; i++) {
+		j = (int32_t)((i * 7919) % 331);
+		k = sm_at_ii32(m, j); /* last value: in the last 331 */
+		res |= k >= (int32_t)i && k + 331 >= 1000
+				       && (k * 7919) % 331 == j
+			       ? 0
+			       : 32;
+	}
+	/* Round trip */
+	sm_sort_to_vectors(m, &kv2, &vv2);
+	m2 = sm_from_sorted_vectors(SM_II32, kv2, vv2);
+	res |= m2 && sm_size(m2) == sm_size(m) && st_assert(m2) ? 0 : 64;
+	for (j = 0; j < 331 && !res; j++)
+		res |= sm_at_ii32(m, j) == sm_at_ii32(m2, j) ? 0 : 128;
+	/* Sets */
+	for (i = 0; i < 100; i++)
+		sv_push_d(&dv, (double)((i * 37) % 50) / 4);
+	s = sms_from_sorted_vector(SMS_D, dv);
+	res |= s && sms_size(s) == 50 && st_assert(s)
+			       && sms_count_d(s, 12.25) && !sms_count_d(s, 12.3)
+		       ? 0
+		       : 256;
+	/* Unsupported types, vector type or size mismatch */
+	res |= !sm_from_sorted_vectors(SM_SS, kv, vv)
+			       && !sm_from_sorted_vectors(SM_II, kv, vv)
+			       && !sm_from_sorted_vectors(SM_II32, kv, NULL)
+			       && !sm_from_sorted_vectors(SM_II32, kv, vv2)
+			       && !sms_from_sorted_vector(SMS_I, kv)
+		       ? 0
+		       : 512;
+#ifdef S_USE_VA_ARGS
+	sm_free(&m, &m2);
+	sv_free(&kv, &vv, &dv, &kv2, &vv2);
+#else
+	sm_free(&m);
+	sm_free(&m2);
+	sv_free(&kv);
+	sv_free(&vv);
+	sv_free(&dv);
+	sv_free(&kv2);
+	sv_free(&vv2);
+#endif
+	sms_free(&s);
+	return res;
+}
+
+struct AuxKtOrder {
+	const srt_tnode *prev;
+	srt_bool ok;
+};
+
+static int aux_sms_kt_order(struct STraverseParams *tp)
+{
+	struct AuxKtOrder *o = (struct AuxKtOrder *)tp->context;
+	const srt_tnode *cn = get_node_r(tp->t, tp->c);
+	if (cn) {
+		if (o->prev && tp->t->cmp_f(o->prev, cn) >= 0)
+			o->ok = S_FALSE;
+		o->prev = cn;
+	}
+	return 0;
+}
+
+static srt_bool aux_sms_kt_op(srt_set **s, int op, int64_t v)
+{
+	switch ((*s)->d.sub_type) {
+	case SMS_I32:
+		return op == 0 ? sms_insert_i32(s, (int32_t)v)
+		       : op == 1 ? sms_delete_i32(*s, (int32_t)v)
+				 : sms_count_i32(*s, (int32_t)v) > 0;
+	case SMS_U32:
+		return op == 0 ? sms_insert_u32(s, (uint32_t)v)
+		       : op == 1 ? sms_delete_u32(*s, (uint32_t)v)
+				 : sms_count_u32(*s, (uint32_t)v) > 0;
+	case SMS_I:
+		return op == 0 ? sms_insert_i(s, v * 1000000007)
+		       : op == 1 ? sms_delete_i(*s, v * 1000000007)
+				 : sms_count_i(*s, v * 1000000007) > 0;
+	case SMS_F:
+		return op == 0 ? sms_insert_f(s, (float)v / 4)
+		       : op == 1 ? sms_delete_f(*s, (float)v / 4)
+				 : sms_count_f(*s, (float)v / 4) > 0;
+	case SMS_D:
+		return op == 0 ? sms_insert_d(s, (double)v / 4)
+		       : op == 1 ? sms_delete_d(*s, (double)v / 4)
+				 : sms_count_d(*s, (double)v / 4) > 0;
+	default:
+		break;
+	}
+	return S_FALSE;
+}
+
+/*
+ * Numeric key sets use the specialized (inline key comparison) tree paths:
+ * check them against the ordering given by the compare function
+ */
+static int test_st_kt()
+{
+	int res = 0;
+	size_t i, j, nk = 2003, distinct;
+	int64_t v;
+	char seen[2003];
+	struct AuxKtOrder o;
+	srt_set *s;
+	enum eSMS_Type ts[] = {SMS_I32, SMS_U32, SMS_I, SMS_F, SMS_D};
+	for (j = 0; j < sizeof(ts) / sizeof(ts[0]); j++) {
+		s = sms_alloc(ts[j], 0);
+		memset(seen, 0, sizeof(seen));
+		distinct = 0;
+		for (i = 0; i < 3000; i++) {
+			v = (int64_t)((i * 7919) % nk) - 1000;
+			if (!seen[v + 1000]) {
+				seen[v + 1000] = 1;
+				distinct++;
+			}
+			if (!aux_sms_kt_op(&s, 0, v))
+				res |= 1 << (j * 4);
+		}
+		o.prev = NULL;
+		o.ok = S_TRUE;
+		st_traverse_inorder(s, aux_sms_kt_order, &o);
+		if (sms_size(s) != distinct || !st_assert(s) || !o.ok)
+			res |= 2 << (j * 4);
+		for (i = 0; i < nk; i += 3) {
+			v = (int64_t)i - 1000;
+			if (aux_sms_kt_op(&s, 1, v) != (srt_bool)seen[i])
+				res |= 4 << (j * 4);
+			if (seen[i]) {
+				seen[i] = 0;
+				distinct--;
+			}
+		}
+		o.prev = NULL;
+		o.ok = S_TRUE;
+		st_traverse_inorder(s, aux_sms_kt_order, &o);
+		if (sms_size(s) != distinct || !st_assert(s) || !o.ok)
+			res |= 8 << (j * 4);
+		for (i = 0; i < nk; i++)
+			if (aux_sms_kt_op(&s, 2, (int64_t)i - 1000)
+			    != (srt_bool)seen[i])
+				res |= 8 << (j * 4);
+		sms_free(&s);
+	}
+	return res;
+}
+
+/*
+ * Cursor check against a key presence table (keys 0 to nk - 1): bounds for
+ * every key, previous element from each bound, and full scans both ways
+ */
+static int aux_sm_cursor_chk(const srt_map *m, const char *has, int64_t nk)
+{
+	int64_t k, e, cnt;
+	srt_tndx x;
+	srt_map_cursor c;
+	for (k = -1; k <= nk; k++) {
+		for (e = k < 0 ? 0 : k; e < nk && !has[e]; e++)
+			;
+		x = sm_lower_bound_i(m, k, &c);
+		if ((e >= nk) != (x == ST_NIL)
+		    || (x != ST_NIL && sm_it_i_k(m, x) != e)
+		    || sm_cursor_node(&c) != x)
+			return 1;
+		for (e = k < 0 ? 0 : k + 1; e < nk && !has[e]; e++)
+			;
+		x = sm_upper_bound_i(m, k, &c);
+		if ((e >= nk) != (x == ST_NIL)
+		    || (x != ST_NIL && sm_it_i_k(m, x) != e))
+			return 2;
+		if (x == ST_NIL)
+			continue;
+		for (e = sm_it_i_k(m, x) - 1; e >= 0 && !has[e]; e--)
+			;
+		x = sm_cursor_prev(&c);
+		if ((e < 0) != (x == ST_NIL)
+		    || (x != ST_NIL && sm_it_i_k(m, x) != e))
+			return 4;
+	}
+	for (cnt = 0, e = -1, x = sm_cursor_first(m, &c); x != ST_NIL;
+	     x = sm_cursor_next(&c), cnt++) {
+		if (sm_it_i_k(m, x) <= e || !has[sm_it_i_k(m, x)])
+			return 8;
+		e = sm_it_i_k(m, x);
+	}
+	if (cnt != (int64_t)sm_size(m) || sm_cursor_next(&c) != ST_NIL)
+		return 16;
+	for (cnt = 0, e = nk, x = sm_cursor_last(m, &c); x != ST_NIL;
+	     x = sm_cursor_prev(&c), cnt++) {
+		if (sm_it_i_k(m, x) >= e || !has[sm_it_i_k(m, x)])
+			return 32;
+		e = sm_it_i_k(m, x);
+	}
+	return cnt != (int64_t)sm_size(m) ? 64 : 0;
+}
+
+static int test_sm_cursor()
+{
+	int res = 0;
+	int64_t i, n = 3000, nk = 3 * 3000;
+	char *has = (char *)calloc((size_t)nk, 1);
+	srt_map_cursor c;
+	srt_string *s = ss_alloca(32);
+	srt_map *mr = sm_alloc(SM_II, 0), *mb = sm_alloc_btree(SM_II, 0),
+		*ms = sm_alloc(SM_SI, 0);
+	if (!has || sm_cursor_first(mr, &c) != ST_NIL
+	    || sm_lower_bound_i(mb, 0, &c) != ST_NIL
+	    || sm_lower_bound_i32(mr, 0, &c) != ST_NIL /* wrong type */
+	    || sm_cursor_next(&c) != ST_NIL || sm_cursor_prev(NULL) != ST_NIL)
+		res |= 1;
+	for (i = 0; i < n && has; i++) {
+		has[i * 3] = 1;
+		sm_insert_ii(&mr, i * 3, i);
+		sm_insert_ii(&mb, (n - 1 - i) * 3, i);
+	}
+	/* Hole: B+tree leaves emptied by the lazy deletion */
+	for (i = 300; i < 900 && has; i += 3) {
+		has[i] = 0;
+		sm_delete_i(mr, i);
+		sm_delete_i(mb, i);
+	}
+	if (has) {
+		res |= aux_sm_cursor_chk(mr, has, nk) << 1;
+		res |= aux_sm_cursor_chk(mb, has, nk) << 8;
+	}
+	/* String keys */
+	for (i = 0; i < 100; i += 2) {
+		ss_printf(&s, 32, "k%03i", (int)i);
+		sm_insert_si(&ms, s, i);
+	}
+	ss_cpy_c(&s, "k0505");
+	if (sm_lower_bound_s(ms, s, &c) == ST_NIL
+	    || sm_it_si_v(ms, sm_cursor_node(&c)) != 52
+	    || sm_it_si_v(ms, sm_cursor_prev(&c)) != 50
+	    || sm_upper_bound_s(ms, ss_crefa("k098"), &c) != ST_NIL
+	    || sm_it_si_v(ms, sm_cursor_last(ms, &c)) != 98
+	    || sm_it_si_v(ms, sm_lower_bound_s(ms, ss_crefa("k04"), &c)) != 40
+	    || sm_it_si_v(ms, sm_upper_bound_s(ms, ss_crefa("k004"), &c))
+		       != 6)
+		res |= 1 << 15;
+	free(has);
+#ifdef S_USE_VA_ARGS
+	sm_free(&mr, &mb, &ms);
+#else
+	sm_free(&mr);
+	sm_free(&mb);
+	sm_free(&ms);
+#endif
+	return res;
+}
+
+/* Select/rank check for every element, against an in-order scan */
+static int aux_sm_rank_chk(const srt_map *m)
+{
+	size_t i;
+	int64_t k;
+	srt_tndx x;
+	srt_map_cursor c;
+	for (i = 0, x = sm_cursor_first(m, &c); x != ST_NIL;
+	     x = sm_cursor_next(&c), i++) {
+		k = sm_it_i_k(m, x);
+		if (sm_select(m, i) != x || sm_rank_i(m, k) != i
+		    || sm_rank_i(m, k + 1) != i + 1)
+			return 1;
+	}
+	return i != sm_size(m) || sm_select(m, i) != ST_NIL ? 1 : 0;
+}
+
+static int test_sm_rank()
+{
+	int res = 0;
+	size_t i, n = 4000;
+	int64_t k;
+	uint32_t seed = 1;
+	srt_string *s = ss_alloca(32);
+	srt_map *m = sm_alloc_ranked(SM_II, 0), *mr = sm_alloc(SM_II, 0),
+		*mb = sm_alloc_btree(SM_II, 0), *m2 = NULL;
+	srt_set *ss = sms_alloc_ranked(SMS_S, 0),
+		*sd = sms_alloc_ranked(SMS_D, 0);
+	if (!sm_is_ranked(m) || sm_is_ranked(mr) || sm_is_ranked(mb)
+	    || sm_select(m, 0) != ST_NIL || sm_rank_i(m, 0) != 0
+	    || sm_rank_i32(m, 0) != 0 /* wrong type */)
+		res |= 1;
+	/* Random insert/delete (keys * 2, for gaps), checking periodically */
+	for (i = 0; i < 3 * n; i++) {
+		seed = seed * 1103515245 + 12345;
+		k = (int64_t)((seed >> 8) % n) * 2;
+		if (i % 3 == 2) {
+			sm_delete_i(m, k);
+			sm_delete_i(mr, k);
+			sm_delete_i(mb, k);
+		} else {
+			sm_insert_ii(&m, k, (int64_t)i);
+			sm_insert_ii(&mr, k, (int64_t)i);
+			sm_insert_ii(&mb, k, (int64_t)i);
+		}
+		if (i % 1000 == 999 && (aux_sm_rank_chk(m) || !st_assert(m)))
+			res |= 2;
+	}
+	if (sm_size(m) != sm_size(mr) || aux_sm_rank_chk(mr)
+	    || aux_sm_rank_chk(mb))
+		res |= 4;
+	for (i = 0; i < sm_size(m); i++)
+		if (sm_it_i_k(m, sm_select(m, i))
+		    != sm_it_i_k(mr, sm_select(mr, i)))
+			res |= 8;
+	/* Copies keep the order statistics */
+	m2 = sm_dup(m);
+	if (!sm_is_ranked(m2) || aux_sm_rank_chk(m2))
+		res |= 16;
+	sm_cpy(&m2, mb);
+	if (!sm_is_ranked(m2) || aux_sm_rank_chk(m2))
+		res |= 32;
+	/* Delete everything */
+	for (k = 0; k < (int64_t)n * 2; k++)
+		sm_delete_i(m, k);
+	if (sm_size(m) || sm_select(m, 0) != ST_NIL)
+		res |= 64;
+	/* Sets */
+	for (i = 0; i < 100; i++) {
+		ss_printf(&s, 32, "%03i", (int)(99 - i));
+		sms_insert_s(&ss, s);
+		sms_insert_d(&sd, (double)i / 8);
+	}
+	ss_cpy_c(&s, "0505");
+	if (sms_rank_s(ss, s) != 51 || sms_rank_s(ss, ss_crefa("1")) != 100
+	    || strcmp(ss_to_c(sms_it_s(ss, sms_select(ss, 42))), "042")
+	    || sms_rank_d(sd, 2.0) != 16 || sms_rank_d(sd, 2.01) != 17
+	    || sms_it_d(sd, sms_select(sd, 99)) != 99.0 / 8)
+		res |= 128;
+#ifdef S_USE_VA_ARGS
+	sm_free(&m, &mr, &mb, &m2);
+	sms_free(&ss, &sd);
+#else
+	sm_free(&m);
+	sm_free(&mr);
+	sm_free(&mb);
+	sm_free(&m2);
+	sms_free(&ss);
+	sms_free(&sd);
+#endif
+	return res;
+}
+
+struct AuxPartCtx {
+	int64_t prev, sum;
+	size_t cnt;
+	srt_bool ordered;
+};
+
+static srt_bool aux_sm_part_f(const srt_map *m, srt_tndx n, void *context)
+{
+	struct AuxPartCtx *c = (struct AuxPartCtx *)context;
+	int64_t k = sm_it_i_k(m, n);
+	if (c->cnt && k <= c->prev)
+		c->ordered = S_FALSE;
+	c->prev = k;
+	c->sum += k;
+	c->cnt++;
+	return S_TRUE;
+}
+
+/*
+ * Split and scan partitions (sequentially, as if they were processed by
+ * separate workers), reducing the per-partition contexts
+ */
+static int aux_sm_part_chk(const srt_map *m, srt_tndx first, srt_tndx end,
+			   size_t k, size_t exp_cnt, int64_t exp_sum,
+			   size_t *np)
+{
+	size_t i, cnt = 0;
+	int64_t sum = 0, prev = 0;
+	srt_map_part p[64];
+	struct AuxPartCtx c;
+	*np = sm_part_split(m, first, end, p, k);
+	if (*np > k || (exp_cnt && !*np))
+		return 1;
+	for (i = 0; i < *np; i++) {
+		memset(&c, 0, sizeof(c));
+		c.ordered = S_TRUE;
+		if (sm_part_scan(&p[i], aux_sm_part_f, &c) != c.cnt || !c.cnt
+		    || !c.ordered)
+			return 2;
+		if (i > 0 && sm_it_i_k(m, p[i].first) <= prev)
+			return 4;
+		prev = c.prev;
+		cnt += c.cnt;
+		sum += c.sum;
+	}
+	return cnt == exp_cnt && sum == exp_sum ? 0 : 8;
+}
+
+static int test_sm_part()
+{
+	int res = 0;
+	size_t i, j, np, n = 10000;
+	int64_t k, sum = 0;
+	srt_tndx lo, hi;
+	srt_map_cursor c;
+	srt_map_part p[2], pm[4];
+	struct AuxPartCtx pc;
+	const size_t kp[] = {1, 2, 3, 7, 16, 64};
+	srt_map *m[3];
+	m[0] = sm_alloc(SM_II, n);
+	m[1] = sm_alloc_ranked(SM_II, n);
+	m[2] = sm_alloc_btree(SM_II, n);
+	if (sm_part_split(m[0], sm_cursor_first(m[0], &c), ST_NIL, p, 2))
+		res |= 1; /* empty map */
+	for (k = 0; k < (int64_t)n; k++) {
+		int64_t x = (k * 7919) % (int64_t)n;
+		for (j = 0; j < 3; j++)
+			sm_insert_ii(&m[j], x, x);
+		sum += k;
+	}
+	for (j = 0; j < 3; j++) {
+		for (i = 0; i < sizeof(kp) / sizeof(kp[0]); i++) {
+			/* Whole map */
+			if (aux_sm_part_chk(m[j], sm_cursor_first(m[j], &c),
+					    ST_NIL, kp[i], n, sum, &np)
+			    || np != kp[i])
+				res |= 2 << j;
+			/* Key range [1000, 1999] */
+			lo = sm_lower_bound_i(m[j], 1000, &c);
+			hi = sm_upper_bound_i(m[j], 1999, &c);
+			if (aux_sm_part_chk(m[j], lo, hi, kp[i], 1000,
+					    (1000 + 1999) * 1000 / 2, &np))
+				res |= 16 << j;
+		}
+	}
+	/* Balance (exact with order statistics) */
+	np = sm_part_split(m[1], sm_cursor_first(m[1], &c), ST_NIL, p, 2);
+	if (np != 2 || sm_it_i_k(m[1], p[1].first) != (int64_t)n / 2)
+		res |= 128;
+	/* Small maps and ranges: fewer partitions */
+	lo = sm_lower_bound_i(m[0], 10, &c);
+	hi = sm_lower_bound_i(m[0], 13, &c);
+	if (aux_sm_part_chk(m[0], lo, hi, 16, 3, 33, &np) || np > 3
+	    || sm_part_split(m[0], lo, lo, p, 2) != 0)
+		res |= 256;
+	sm_free(&m[0]);
+	sm_free(&m[1]);
+	sm_free(&m[2]);
+	/* Multimap: equal keys split across partitions are scanned once */
+	m[0] = sm_alloc_multi(SM_II, 0);
+	for (i = 0; i < 100; i++)
+		sm_insert_ii(&m[0], (int64_t)(i % 3), (int64_t)i);
+	np = sm_part_split(m[0], sm_cursor_first(m[0], &c), ST_NIL, pm, 4);
+	memset(&pc, 0, sizeof(pc));
+	for (i = 0; i < np; i++)
+		sm_part_scan(&pm[i], aux_sm_part_f, &pc);
+	if (np < 2 || pc.cnt != 100 || pc.sum != 99)
+		res |= 512;
+	sm_free(&m[0]);
+	return res;
+}
+
+/* Same content as the reference map, and nodes in key order if requested */
+static int aux_sm_compact_chk(const srt_map *m, const srt_map *ref,
+			      srt_bool inorder)
+{
+	srt_tndx i;
+	if (sm_size(m) != sm_size(ref) || (!m->bt && !st_assert(m))
+	    || (sm_is_ranked(m) && aux_sm_rank_chk(m)))
+		return 1;
+	for (i = 0; i < (srt_tndx)sm_size(ref); i++)
+		if (sm_at_ii(m, sm_it_i_k(ref, i)) != sm_it_ii_v(ref, i))
+			return 2;
+	for (i = 1; inorder && i < (srt_tndx)sm_size(m); i++)
+		if (sm_it_i_k(m, i - 1) >= sm_it_i_k(m, i))
+			return 4;
+	return 0;
+}
+
+static int test_sm_compact()
+{
+	int res = 0;
+	size_t i, j, pos, steps, n = 3000;
+	int64_t k;
+	uint32_t seed = 1;
+	srt_map *m[3], *m2 = NULL, *ms = sm_alloc(SM_SS, 0);
+	srt_string *s = ss_alloca(32);
+	m[0] = sm_alloc(SM_II, 0);
+	m[1] = sm_alloc_ranked(SM_II, 0);
+	m[2] = sm_alloc_btree(SM_II, 0);
+	pos = 0;
+	if (!sm_compact(m[0], SM_LAYOUT_VEB) || !sm_compact_step(m[0], &pos, 1))
+		res |= 1; /* empty map */
+	/* Insert/delete churn */
+	for (i = 0; i < 3 * n; i++) {
+		seed = seed * 1103515245 + 12345;
+		k = (int64_t)((seed >> 8) % n);
+		for (j = 0; j < 3; j++) {
+			if (i % 3 == 2)
+				sm_delete_i(m[j], k);
+			else
+				sm_insert_ii(&m[j], k, (int64_t)i);
+		}
+	}
+	for (j = 0; j < 3; j++) {
+		sm_free(&m2); /* same backend as the source (copies keep it) */
+		sm_cpy(&m2, m[j]);
+		if (sm_is_ranked(m2) != sm_is_ranked(m[j])
+		    || !m2->bt != !m[j]->bt)
+			res |= 1;
+		if (!sm_compact(m2, SM_LAYOUT_INORDER)
+		    || aux_sm_compact_chk(m2, m[j], S_TRUE))
+			res |= 2 << j;
+		sm_cpy(&m2, m[j]);
+		if (!sm_compact(m2, SM_LAYOUT_BFS)
+		    || aux_sm_compact_chk(m2, m[j], m2->bt ? S_TRUE : S_FALSE)
+		    || (!m2->bt && m2->root != 0))
+			res |= 16 << j;
+		sm_cpy(&m2, m[j]);
+		if (!sm_compact(m2, SM_LAYOUT_VEB)
+		    || aux_sm_compact_chk(m2, m[j], m2->bt ? S_TRUE : S_FALSE)
+		    || (!m2->bt && m2->root != 0))
+			res |= 128 << j;
+		/* Incremental, with a modification in the middle */
+		sm_cpy(&m2, m[j]);
+		for (pos = steps = 0; !sm_compact_step(m2, &pos, 100); steps++)
+			if (steps == 5) {
+				k = sm_it_i_k(m2, (srt_tndx)pos);
+				sm_delete_i(m2, k);
+				sm_insert_ii(&m2, k, sm_at_ii(m[j], k));
+			}
+		if (aux_sm_compact_chk(m2, m[j], S_FALSE))
+			res |= 1024 << j;
+		for (pos = 0; !sm_compact_step(m2, &pos, 1000);)
+			;
+		if (aux_sm_compact_chk(m2, m[j], S_TRUE))
+			res |= 1024 << j;
+	}
+	/* B+tree: compact, delete (shrinking below the first slots), compact */
+	for (j = 0; j < 2; j++) {
+		sm_free(&m2);
+		m2 = sm_alloc_btree(SM_II, 0);
+		for (k = 40; k > 0; k--)
+			sm_insert_ii(&m2, k, -k);
+		if (j == 0)
+			sm_compact(m2, SM_LAYOUT_INORDER);
+		else
+			for (pos = 0; !sm_compact_step(m2, &pos, 7);)
+				;
+		for (k = 1; k <= 35; k++)
+			sm_delete_i(m2, k);
+		if (!sm_compact(m2, SM_LAYOUT_INORDER) || sm_size(m2) != 5
+		    || sm_it_i_k(m2, 0) != 36 || sm_it_i_k(m2, 4) != 40
+		    || sm_at_ii(m2, 38) != -38)
+			res |= 32768;
+	}
+	/* String keys and values */
+	for (i = 0; i < 200; i++) {
+		ss_printf(&s, 32, "%03i-with-a-long-key", (int)(199 - i));
+		sm_insert_ss(&ms, s, s);
+		if (i % 3 == 0)
+			sm_delete_s(ms, s);
+	}
+	if (!sm_compact(ms, SM_LAYOUT_INORDER) || sm_size(ms) != 133
+	    || !st_assert(ms))
+		res |= 8192;
+	for (i = 1; i < sm_size(ms); i++)
+		if (ss_cmp(sm_it_s_k(ms, (srt_tndx)i - 1),
+			   sm_it_s_k(ms, (srt_tndx)i)) >= 0
+		    || ss_cmp(sm_it_s_k(ms, (srt_tndx)i),
+			      sm_it_ss_v(ms, (srt_tndx)i)))
+			res |= 16384;
+#ifdef S_USE_VA_ARGS
+	sm_free(&m[0], &m[1], &m[2], &m2, &ms);
+#else
+	sm_free(&m[0]);
+	sm_free(&m[1]);
+	sm_free(&m[2]);
+	sm_free(&m2);
+	sm_free(&ms);
+#endif
+	return res;
+}
+
+/* Equal range check: count, keys, insertion order and adjacency */
+static int aux_sm_multi_chk(const srt_map *m, const size_t *cnt, size_t nk,
+			    srt_bool adjacent)
+{
+	int res = 0;
+	int64_t k, v;
+	size_t c;
+	srt_tndx x, y, end;
+	srt_map_cursor cur;
+	if (!st_assert(m))
+		res |= 1;
+	for (k = 0; k < (int64_t)nk; k++) {
+		end = sm_upper_bound_i(m, k, &cur);
+		x = sm_lower_bound_i(m, k, &cur);
+		for (c = 0, v = -1; x != ST_NIL && x != end; c++) {
+			if (sm_it_i_k(m, x) != k || sm_it_ii_v(m, x) <= v)
+				res |= 2;
+			v = sm_it_ii_v(m, x);
+			y = sm_cursor_next(&cur);
+			if (adjacent && y != end && y != x + 1)
+				res |= 4;
+			x = y;
+		}
+		if (c != cnt[k] || sm_count_i(m, k) != cnt[k])
+			res |= 8;
+	}
+	return res;
+}
+
+static int test_sm_multi()
+{
+	int res = 0;
+	size_t i, sz = 0, pos, cnt[100], nk = 100;
+	int64_t k;
+	uint32_t seed = 1;
+	srt_map *m = sm_alloc_multi(SM_II, 0), *m2 = NULL,
+		*m3 = sm_alloc_btree(SM_II, 0);
+	srt_set *s = sms_alloc_multi(SMS_S, 0);
+	const srt_string *a = ss_crefa("a"), *b = ss_crefa("b");
+	if (!sm_is_multi(m) || sm_is_ranked(m) || sm_is_btree(m)
+	    || st_rank_enable(m))
+		res |= 1;
+	memset(cnt, 0, sizeof(cnt));
+	/* Insert/delete churn, with insertion order as value */
+	for (i = 0; i < 5000; i++) {
+		seed = seed * 1103515245 + 12345;
+		k = (int64_t)((seed >> 8) % nk);
+		if (i % 4 == 3) {
+			if (sm_delete_i(m, k) != (cnt[k] > 0))
+				res |= 2;
+			if (cnt[k] > 0) {
+				cnt[k]--;
+				sz--;
+			}
+		} else {
+			if (!sm_insert_ii(&m, k, (int64_t)i))
+				res |= 2;
+			cnt[k]++;
+			sz++;
+		}
+	}
+	if (sm_size(m) != sz)
+		res |= 4;
+	res |= aux_sm_multi_chk(m, cnt, nk, S_FALSE) << 3;
+	/* Adjacent duplicates after the in-order layout */
+	sm_cpy(&m2, m);
+	if (!sm_is_multi(m2) || !sm_compact(m2, SM_LAYOUT_INORDER))
+		res |= 1 << 7;
+	res |= aux_sm_multi_chk(m2, cnt, nk, S_TRUE) << 8;
+	sm_cpy(&m2, m);
+	for (pos = 0; !sm_compact_step(m2, &pos, 50);)
+		;
+	res |= aux_sm_multi_chk(m2, cnt, nk, S_TRUE) << 12;
+	/* The copy keeps the duplicates (red-black tree) */
+	sm_cpy(&m3, m);
+	if (sm_is_btree(m3) || !sm_is_multi(m3) || sm_size(m3) != sz)
+		res |= 1 << 16;
+	res |= aux_sm_multi_chk(m3, cnt, nk, S_FALSE) << 17;
+	/* sm_inc_*() adds elements, too */
+	sm_inc_ii(&m3, 0, 1);
+	if (sm_count_i(m3, 0) != cnt[0] + 1)
+		res |= 1 << 21;
+	/* Multiset */
+	sms_insert_s(&s, a);
+	sms_insert_s(&s, b);
+	sms_insert_s(&s, a);
+	sms_insert_s(&s, a);
+	if (sms_size(s) != 4 || sms_count_s(s, a) != 3 || sms_count_s(s, b) != 1
+	    || !sms_delete_s(s, a) || sms_count_s(s, a) != 2
+	    || !sms_delete_s(s, b) || sms_delete_s(s, b)
+	    || sms_count_s(s, b) != 0 || sms_size(s) != 2)
+		res |= 1 << 22;
+#ifdef S_USE_VA_ARGS
+	sm_free(&m, &m2, &m3);
+#else
+	sm_free(&m);
+	sm_free(&m2);
+	sm_free(&m3);
+#endif
+	sms_free(&s);
+	return res;
+}
+
+/* Keys in [lo, hi), in order, with value k * 10 */
+static int aux_sm_split_chk(const srt_map *m, int64_t lo, int64_t hi,
+			    size_t n)
+{
+	int res = 0;
+	size_t c = 0;
+	int64_t k, prev = lo - 1;
+	srt_tndx x;
+	srt_map_cursor cur;
+	if (!m->bt && n > 1 && !st_assert(m))
+		res |= 1;
+	for (x = sm_cursor_first(m, &cur); x != ST_NIL;
+	     x = sm_cursor_next(&cur), c++) {
+		k = sm_it_i_k(m, x);
+		if (k <= prev || k >= hi || sm_it_ii_v(m, x) != k * 10)
+			res |= 2;
+		prev = k;
+	}
+	if (c != n || sm_size(m) != n
+	    || (n && sm_it_i_k(m, sm_select(m, n - 1)) != prev))
+		res |= 4;
+	return res;
+}
+
+static int test_sm_split_join()
+{
+	int res = 0;
+	size_t i, j, nl, n = 1000, cnt[10];
+	int64_t k, sp;
+	srt_map *m[3], *m2 = NULL, *r = NULL, *rs = NULL;
+	srt_map *a = sm_alloc(SM_II, 0), *b = sm_alloc_btree(SM_II, 0),
+		*mm = sm_alloc_multi(SM_II, 0), *ms = sm_alloc(SM_SS, 0);
+	srt_set *s = sms_alloc(SMS_I, 0), *s2 = NULL;
+	srt_map_cursor c;
+	srt_string *ks = ss_alloca(32);
+	m[0] = sm_alloc(SM_II, 0);
+	m[1] = sm_alloc_ranked(SM_II, 0);
+	m[2] = sm_alloc_btree(SM_II, 0);
+	for (i = 0; i < n; i++) {
+		k = (int64_t)((i * 7919) % n) * 2; /* even keys, shuffled */
+		for (j = 0; j < 3; j++)
+			sm_insert_ii(&m[j], k, k * 10);
+	}
+	/* Split at every few keys (between keys, too), and join again */
+	for (j = 0; j < 3; j++)
+		for (sp = -1; sp <= (int64_t)(2 * n + 1); sp += 37) {
+			sm_free(&m2); /* same backend as the source */
+			sm_cpy(&m2, m[j]);
+			nl = sp <= 0 ? 0 : S_MIN(n, (size_t)(sp + 1) / 2);
+			if (!sm_split(m2, sm_lower_bound_i(m2, sp, &c), &r)
+			    || !r->bt != !m2->bt || sm_is_ranked(r) != (j == 1))
+				res |= 1;
+			res |= aux_sm_split_chk(m2, 0, sp, nl) << 1;
+			res |= aux_sm_split_chk(r, sp, 2 * (int64_t)n, n - nl)
+			       << 4;
+			if (!sm_join(&m2, r) || sm_size(r))
+				res |= 1 << 7;
+			res |= aux_sm_split_chk(m2, 0, 2 * (int64_t)n, n) << 8;
+		}
+	/* Join, with different sizes (tree heights) and backends */
+	for (k = 0; k < 100; k++)
+		sm_insert_ii(&a, k, k * 10);
+	for (k = 100; k < 1100; k++)
+		sm_insert_ii(&b, k, k * 10);
+	sm_cpy(&m2, a);
+	if (sm_join(&b, m2) || sm_size(b) != 1000 || sm_size(m2) != 100)
+		res |= 1 << 11; /* overlapping keys */
+	if (!sm_join(&m2, b) || sm_size(b))
+		res |= 1 << 12;
+	res |= aux_sm_split_chk(m2, 0, 1100, 1100) << 13;
+	sm_split(m2, sm_lower_bound_i(m2, 1099, &c), &r);
+	if (sm_join(&r, a) || !sm_join(&a, r)
+	    || aux_sm_split_chk(a, 0, 1100, 101))
+		res |= 1 << 16;
+	if (sm_join(&m2, a) || sm_size(a) != 101 || sm_size(m2) != 1099)
+		res |= 1 << 17; /* overlapping keys */
+	/* Multimap: the elements with the same key go together */
+	memset(cnt, 0, sizeof(cnt));
+	for (i = 0; i < 100; i++) {
+		sm_insert_ii(&mm, (int64_t)(i % 10), (int64_t)i);
+		cnt[i % 10]++;
+	}
+	if (!sm_split(mm, sm_lower_bound_i(mm, 5, &c), &r) || !sm_is_multi(r)
+	    || sm_size(mm) != 50 || sm_size(r) != 50 || sm_count_i(mm, 5)
+	    || sm_count_i(r, 5) != 10 || sm_count_i(r, 4))
+		res |= 1 << 18;
+	if (sm_join(&m2, r) || !sm_join(&mm, r))
+		res |= 1 << 19; /* multimap into map: not allowed */
+	res |= aux_sm_multi_chk(mm, cnt, 10, S_FALSE) << 20;
+	/* String keys and values (moved, not copied) */
+	for (i = 0; i < 200; i++) {
+		ss_printf(&ks, 32, "%03i-with-a-long-key", (int)i);
+		sm_insert_ss(&ms, ks, ks);
+	}
+	ss_cpy_c(&ks, "050");
+	if (!sm_split(ms, sm_lower_bound_s(ms, ks, &c), &rs)
+	    || sm_size(ms) != 50 || sm_size(rs) != 150 || !st_assert(ms)
+	    || !st_assert(rs)
+	    || ss_cmp(sm_it_s_k(rs, sm_cursor_first(rs, &c)),
+		      sm_it_ss_v(rs, sm_cursor_first(rs, &c)))
+	    || !sm_join(&ms, rs) || sm_size(ms) != 200 || !st_assert(ms))
+		res |= 1 << 24;
+	/* Set */
+	for (k = 0; k < 10; k++)
+		sms_insert_i(&s, k);
+	if (!sms_split(s, sm_lower_bound_i(s, 3, &c), &s2) || sms_size(s) != 3
+	    || sms_size(s2) != 7 || !sms_join(&s, s2) || sms_size(s) != 10
+	    || sms_size(s2))
+		res |= 1 << 25;
+#ifdef S_USE_VA_ARGS
+	sm_free(&m[0], &m[1], &m[2], &m2, &r, &a, &b, &mm, &ms, &rs);
+	sms_free(&s, &s2);
+#else
+	sm_free(&m[0]);
+	sm_free(&m[1]);
+	sm_free(&m[2]);
+	sm_free(&m2);
+	sm_free(&r);
+	sm_free(&a);
+	sm_free(&b);
+	sm_free(&mm);
+	sm_free(&ms);
+	sm_free(&rs);
+	sms_free(&s);
+	sms_free(&s2);
+#endif
+	return res;
+}
+
 static int test_sms()
 {
 	int i, res = 0;
@@ -4785,7 +5903,105 @@ static int test_sms()
 	return res;
 }
 
-static int test_shs()
+static srt_bool aux_so_expect(srt_bool in_a, srt_bool in_b, int op)
+{
+	return op == SM_SO_UNION ? in_a || in_b
+	       : op == SM_SO_INTERSECT ? in_a && in_b
+				       : in_a && !in_b;
+}
+
+/* Check the set operation output for keys in [0, kmax) */
+static int aux_sms_set_op_chk(const srt_set *o, const srt_set *a,
+			      const srt_set *b, int op, int64_t kmax)
+{
+	int64_t k;
+	size_t cnt = 0;
+	srt_bool e;
+	if (!o || !st_assert(o))
+		return 1;
+	for (k = 0; k < kmax; k++) {
+		e = aux_so_expect(sms_count_i(a, k), sms_count_i(b, k), op);
+		if (e != (sms_count_i(o, k) ? S_TRUE : S_FALSE))
+			return 2;
+		cnt += e ? 1 : 0;
+	}
+	return cnt == sms_size(o) ? 0 : 4;
+}
+
+static int test_sms_set_op()
+{
+	int op, res = 0;
+	int64_t k;
+	size_t i;
+	srt_set *a = sms_alloc(SMS_I, 0), *b = sms_alloc_btree(SMS_I, 0),
+		*c = sms_alloc(SMS_I, 0), *o = NULL, *sa = sms_alloc(SMS_S, 0),
+		*sb = sms_alloc(SMS_S, 0), *so = sms_alloc(SMS_D, 0);
+	srt_vector *v = NULL;
+	srt_string *s = ss_alloca(32);
+	for (k = 0; k < 3000; k++) {
+		if (k % 2 == 0 && k < 2000)
+			sms_insert_i(&a, k);
+		if (k % 3 == 0)
+			sms_insert_i(&b, k);
+	}
+	sms_insert_i(&c, 3);
+	sms_insert_i(&c, 4);
+	sms_insert_i(&c, 5000);
+	/* Merge (including B+tree input) and small set probe */
+	for (op = SM_SO_UNION; op <= SM_SO_DIFF; op++) {
+		if (aux_sms_set_op_chk(sm_set_op(&o, a, b, op), a, b, op, 3000)
+		    || aux_sms_set_op_chk(sm_set_op(&o, b, a, op), b, a, op,
+					  3000))
+			res |= 1 << op;
+		if (aux_sms_set_op_chk(sm_set_op(&o, c, b, op), c, b, op, 6000)
+		    || aux_sms_set_op_chk(sm_set_op(&o, b, c, op), b, c, op,
+					  6000))
+			res |= 8 << op;
+		sm_set_op_to_vector(&v, a, b, op);
+		for (i = 1; i < sv_size(v); i++)
+			if (sv_at_i64(v, i - 1) >= sv_at_i64(v, i))
+				res |= 64;
+		if (sv_size(v) != sms_size(sm_set_op(&o, a, b, op)))
+			res |= 64;
+	}
+	if (sms_size(sms_intersect(&o, c, b)) != 1
+	    || sms_it_i(o, sms_select(o, 0)) != 3
+	    || sms_size(sms_diff(&o, c, b)) != 2)
+		res |= 128;
+	/* Type mismatch */
+	if (sms_union(&so, a, sa) || sms_intersect_to_vector(&v, sa, sb))
+		res |= 256;
+	/* Strings, in place */
+	for (i = 0; i < 200; i++) {
+		ss_printf(&s, 32, "k%03i", (int)i);
+		if (i < 150)
+			sms_insert_s(&sa, s);
+		if (i >= 100)
+			sms_insert_s(&sb, s);
+	}
+	if (!sms_intersect(&sa, sa, sb) || sms_size(sa) != 50
+	    || !st_assert(sa) || !sms_count_s(sa, ss_crefa("k100"))
+	    || sms_count_s(sa, ss_crefa("k099"))
+	    || !sms_union(&sb, sa, sb) || sms_size(sb) != 100
+	    || !sms_diff(&sb, sb, sa) || sms_size(sb) != 50
+	    || !sms_count_s(sb, ss_crefa("k199")))
+		res |= 512;
+#ifdef S_USE_VA_ARGS
+	sms_free(&a, &b, &c, &o, &sa, &sb, &so);
+#else
+	sms_free(&a);
+	sms_free(&b);
+	sms_free(&c);
+	sms_free(&o);
+	sms_free(&sa);
+	sms_free(&sb);
+	sms_free(&so);
+#endif
+	sv_free(&v);
+	return res;
+}
+
+static int test_shs()
 {
 	int res = 0;
 	size_t i, tcount = 3, cnt_i32 = 0, cnt_u32 = 0, cnt_i = 0, cnt_f = 0,
@@ -4952,6 +6168,990 @@ static int test_shs()
 	return res;
 }
 
+static int test_shs_set_op()
+{
+	int op, res = 0;
+	int64_t k;
+	size_t cnt;
+	srt_bool e;
+	srt_hset *a = shs_alloc(SHS_I, 0), *b = shs_alloc(SHS_I, 0),
+		 *o = NULL, *x = NULL, *sa = shs_alloc(SHS_S, 0),
+		 *sb = shs_alloc(SHS_S, 0);
+	srt_string *s = ss_alloca(32);
+	for (k = 0; k < 3000; k++) {
+		if (k % 2 == 0 && k < 2000)
+			shs_insert_i(&a, k);
+		if (k % 3 == 0)
+			shs_insert_i(&b, k);
+	}
+	for (op = SHM_SO_UNION; op <= SHM_SO_DIFF; op++) {
+		/* Output set, and in place (a copy of the first input) */
+		shm_set_op(&o, a, b, op);
+		shs_cpy(&x, a);
+		shm_set_op(&x, x, b, op);
+		for (k = 0, cnt = 0; k < 3000; k++) {
+			e = aux_so_expect(shs_count_i(a, k), shs_count_i(b, k),
+					  op);
+			if (e != shs_count_i(o, k) || e != shs_count_i(x, k))
+				res |= 1 << op;
+			cnt += e ? 1 : 0;
+		}
+		if (shs_size(o) != cnt || shs_size(x) != cnt)
+			res |= 8;
+		shm_set_op(&o, b, a, op);
+		for (k = 0, cnt = 0; k < 3000; k++) {
+			e = aux_so_expect(shs_count_i(b, k), shs_count_i(a, k),
+					  op);
+			if (e != shs_count_i(o, k))
+				res |= 16 << op;
+			cnt += e ? 1 : 0;
+		}
+		if (shs_size(o) != cnt)
+			res |= 128;
+	}
+	/* Type mismatch */
+	if (shs_union(&o, a, sa))
+		res |= 256;
+	/* Strings */
+	for (k = 0; k < 200; k++) {
+		ss_printf(&s, 32, "k%03i", (int)k);
+		if (k < 150)
+			shs_insert_s(&sa, s);
+		if (k >= 100)
+			shs_insert_s(&sb, s);
+	}
+	if (shs_size(shs_intersect(&o, sa, sb)) != 50
+	    || !shs_count_s(o, ss_crefa("k100"))
+	    || shs_count_s(o, ss_crefa("k099"))
+	    || shs_size(shs_union(&o, sa, sb)) != 200
+	    || shs_size(shs_diff(&sb, sb, sa)) != 50
+	    || !shs_count_s(sb, ss_crefa("k150")))
+		res |= 512;
+#ifdef S_USE_VA_ARGS
+	shs_free(&a, &b, &o, &x, &sa, &sb);
+#else
+	shs_free(&a);
+	shs_free(&b);
+	shs_free(&o);
+	shs_free(&x);
+	shs_free(&sa);
+	shs_free(&sb);
+#endif
+	return res;
+}
+
+static srt_bool test_sr_cb_count(const srt_string *chunk, void *context)
+{
+	*(size_t *)context += ss_size(chunk);
+	return S_TRUE;
+}
+
+static int test_sr()
+{
+	int res = 0;
+	uint32_t seed = 1;
+	size_t i, j, off, n, cnt, len;
+	srt_string *ref = ss_alloc(0), *aux = NULL, *ins = ss_alloc(0),
+		   *out = NULL;
+	srt_rope *r = sr_alloc(0), *r2 = NULL, *r3 = NULL;
+	if (!r || !ref || !ins)
+		res |= 1;
+	for (i = 0; i < 400 && !res; i++) {
+		seed = seed * 1103515245 + 12345;
+		len = ss_size(ref);
+		off = (seed >> 8) % (len + 1);
+		if ((seed >> 4) % 3 == 0 && len > 0) {
+			n = (seed >> 12) % (len < 10000 ? len + 1 : 10000);
+			ss_erase(&ref, off, n);
+			if (!sr_erase(&r, off, n))
+				res |= 2;
+		} else {
+			n = (seed >> 16) % 7 == 0 ? (seed >> 4) % 20000
+						  : (seed >> 20) % 64;
+			ss_clear(ins);
+			for (j = 0; j < n; j++)
+				ss_cat_char(&ins, 'a' + (int)((i + j) % 26));
+			ss_cpy_substr(&aux, ref, 0, off);
+			ss_cat(&aux, ins);
+			ss_cat_substr(&aux, ref, off, S_NPOS);
+			ss_cpy(&ref, aux);
+			if (!sr_insert(&r, off, ins))
+				res |= 4;
+		}
+		if (sr_len(r) != ss_size(ref))
+			res |= 8;
+	}
+	sr_to_ss(&out, r);
+	if (!res && ss_cmp(out, ref))
+		res |= 0x10;
+	len = ss_size(ref);
+	if (!res && len > 100) {
+		for (i = 0; i < len; i += 97)
+			if (sr_at(r, i) != (unsigned char)ss_get_buffer_r(ref)[i])
+				res |= 0x20;
+		if (sr_at(r, len) != EOF)
+			res |= 0x40;
+		off = len / 3;
+		n = len / 2;
+		sr_substr_to_ss(&out, r, off, n);
+		ss_cpy_substr(&aux, ref, off, n);
+		if (ss_cmp(out, aux))
+			res |= 0x80;
+		r2 = sr_dup_substr(r, off, n);
+		sr_to_ss(&out, r2);
+		if (ss_cmp(out, aux))
+			res |= 0x100;
+		cnt = 0;
+		if (sr_itr(r, 0, S_NPOS, test_sr_cb_count, &cnt)
+			    != sr_nchunks(r)
+		    || cnt != len)
+			res |= 0x200;
+		r3 = sr_dup(r);
+		sr_free(&r);
+		sr_to_ss(&out, r3);
+		if (ss_cmp(out, ref))
+			res |= 0x400;
+		sr_clear(r3);
+		if (sr_len(r3) || sr_nchunks(r3) || !sr_cat(&r3, ref)
+		    || !sr_to_ss(&out, r3) || ss_cmp(out, ref))
+			res |= 0x800;
+	}
+	/* In-place erase ending exactly at a chunk end */
+	sr_free(&r);
+	ss_clear(aux);
+	for (i = 0; i < 20 * SR_CHUNK_MAX; i++)
+		ss_cat_char(&aux, 'a' + (int)(i % 26));
+	r = sr_dup_ss(aux);
+	for (i = 19; i > 0 && !res; i--) {
+		off = i * SR_CHUNK_MAX - 10;
+		ss_erase(&aux, off, 10);
+		if (!sr_erase(&r, off, 10) || sr_len(r) != ss_size(aux))
+			res |= 0x1000;
+	}
+	len = ss_size(aux);
+	for (i = 0; i < len && !res; i += 13)
+		if (sr_at(r, i) != (unsigned char)ss_get_buffer_r(aux)[i])
+			res |= 0x2000;
+	sr_erase(&r, len - 5, 5);
+	ss_erase(&aux, len - 5, 5);
+	sr_to_ss(&out, r);
+	if (!res && ss_cmp(out, aux))
+		res |= 0x4000;
+#ifdef S_USE_VA_ARGS
+	ss_free(&ref, &aux, &ins, &out);
+	sr_free(&r, &r2, &r3);
+#else
+	ss_free(&ref);
+	ss_free(&aux);
+	ss_free(&ins);
+	ss_free(&out);
+	sr_free(&r);
+	sr_free(&r2);
+	sr_free(&r3);
+#endif
+	return res;
+}
+
+struct TestAllocCnt {
+	size_t allocs, reallocs, frees;
+};
+
+static void *test_alloc_cnt_alloc(void *context, size_t size)
+{
+	((struct TestAllocCnt *)context)->allocs++;
+	return malloc(size);
+}
+
+static void *test_alloc_cnt_realloc(void *context, void *ptr, size_t size)
+{
+	((struct TestAllocCnt *)context)->reallocs++;
+	return realloc(ptr, size);
+}
+
+static void test_alloc_cnt_free(void *context, void *ptr)
+{
+	((struct TestAllocCnt *)context)->frees++;
+	free(ptr);
+}
+
+static int test_allocator()
+{
+	size_t i, n = 1000;
+	struct TestAllocCnt c = {0, 0, 0}, cg = {0, 0, 0};
+	srt_allocator a = {test_alloc_cnt_alloc, test_alloc_cnt_realloc,
+			   test_alloc_cnt_free, NULL},
+		      ag = {test_alloc_cnt_alloc, test_alloc_cnt_realloc,
+			    test_alloc_cnt_free, NULL};
+	srt_string *s, *s2, *s3;
+	srt_vector *v;
+	srt_map *m;
+	srt_hmap *hm;
+	int res = 0;
+	a.context = &c;
+	ag.context = &cg;
+	s = ss_alloc_a(&a, 10);
+	v = sv_alloc_t_a(&a, SV_U32, 10);
+	m = sm_alloc_a(&a, SM_II, 10);
+	hm = shm_alloc_a(&a, SHM_II, 10);
+	res |= c.allocs == 4 ? 0 : 1;
+	for (i = 0; i < n; i++) {
+		ss_cat_char(&s, 'a');
+		sv_push_u32(&v, (uint32_t)i);
+		sm_insert_ii(&m, (int64_t)i, (int64_t)i);
+		shm_insert_ii(&hm, (int64_t)i, (int64_t)i);
+	}
+	res |= c.reallocs > 0 ? 0 : 2;
+	res |= ss_size(s) == n && sv_at_u32(v, n - 1) == n - 1
+			       && sm_at_ii(m, 500) == 500
+			       && shm_at_ii(hm, 999) == 999
+		       ? 0
+		       : 4;
+	/* Sharing and unsharing keep the allocator */
+	s2 = ss_share(&s);
+	ss_cat_char(&s2, 'b');
+	res |= ss_size(s) == n && ss_size(s2) == n + 1 ? 0 : 8;
+	s3 = ss_dup(s2);
+	ss_shrink(&s3);
+	ss_free(&s3);
+	ss_free(&s2);
+	ss_free(&s);
+	sv_free(&v);
+	sm_free(&m);
+	shm_free(&hm);
+	res |= c.allocs == c.frees && !cg.allocs ? 0 : 16;
+	/* Global allocator */
+	sd_set_allocator(&ag);
+	s = ss_dup_c("hello");
+	v = sv_alloc_t(SV_U32, 0);
+	sv_push_u32(&v, 1);
+	res |= cg.allocs == 2 && !strcmp(ss_to_c(s), "hello") ? 0 : 32;
+	ss_free(&s);
+	sv_free(&v);
+	sd_set_allocator(NULL);
+	res |= cg.allocs == cg.frees && cg.reallocs > 0 ? 0 : 64;
+	return res;
+}
+
+/* Allocator failing after a given number of allocations */
+static void *test_alloc_fail_alloc(void *context, size_t size)
+{
+	size_t *left = (size_t *)context;
+	RETURN_IF(!*left, NULL);
+	(*left)--;
+	return malloc(size);
+}
+
+static void *test_alloc_fail_realloc(void *context, void *ptr, size_t size)
+{
+	size_t *left = (size_t *)context;
+	RETURN_IF(!*left, NULL);
+	(*left)--;
+	return realloc(ptr, size);
+}
+
+static void test_alloc_fail_free(void *context, void *ptr)
+{
+	(void)context;
+	free(ptr);
+}
+
+static int test_sr_oom()
+{
+	size_t left = 100, i;
+	srt_allocator a = {test_alloc_fail_alloc, test_alloc_fail_realloc,
+			   test_alloc_fail_free, NULL};
+	srt_string *ref = ss_alloc(3 * SR_CHUNK_MAX), *ins = NULL,
+		   *out = NULL;
+	srt_rope *r;
+	int res;
+	a.context = &left;
+	r = sr_alloc_a(&a, 16);
+	res = !r || !ref ? 1 : 0;
+	for (i = 0; i < 3 * SR_CHUNK_MAX; i++)
+		ss_cat_char(&ref, 'a' + (int)(i % 26));
+	ins = ss_dup_substr(ref, 0, SR_CHUNK_MAX);
+	res |= res ? 0 : sr_cat(&r, ref) && sr_nchunks(r) == 3 ? 0 : 2;
+	/* Insert: chunk split failing after copying the inserted data */
+	left = 1;
+	res |= res ? 0 : !sr_insert(&r, SR_CHUNK_MAX + 7, ins) ? 0 : 4;
+	/* Erase: first and second chunk split failing */
+	left = 0;
+	res |= res ? 0 : !sr_erase(&r, 7, SR_CHUNK_MAX) ? 0 : 8;
+	left = 1;
+	res |= res ? 0 : !sr_erase(&r, 7, 2 * SR_CHUNK_MAX) ? 0 : 16;
+	left = 100;
+	sr_to_ss(&out, r);
+	res |= res ? 0
+		   : sr_len(r) == ss_size(ref) && !ss_cmp(out, ref)
+			     && sd_alloc_errors((srt_data *)r)
+			     ? 0
+			     : 32;
+	/* Operations work once there is memory available */
+	sd_reset_alloc_errors((srt_data *)r);
+	res |= res ? 0
+		   : sr_erase(&r, 7, 2 * SR_CHUNK_MAX)
+			     && sr_len(r) == SR_CHUNK_MAX
+			     && sr_at(r, 7) == ss_at(ref, 2 * SR_CHUNK_MAX + 7)
+			     ? 0
+			     : 64;
+#ifdef S_USE_VA_ARGS
+	ss_free(&ref, &ins, &out);
+#else
+	ss_free(&ref);
+	ss_free(&ins);
+	ss_free(&out);
+#endif
+	sr_free(&r);
+	return res;
+}
+
+static int test_shm_string_pool()
+{
+	size_t i, n = 1000, na, ps;
+	struct TestAllocCnt c = {0, 0, 0};
+	srt_allocator a = {test_alloc_cnt_alloc, test_alloc_cnt_realloc,
+			   test_alloc_cnt_free, NULL};
+	srt_alloc_stats st;
+	srt_string *k = NULL, *v = NULL;
+	srt_hmap *hm, *hp, *hp2 = NULL, *hi;
+	srt_hset *hs;
+	int res = 0;
+	a.context = &c;
+	hm = shm_alloc_a(&a, SHM_SS, 0);
+	hp = shm_alloc_a(&a, SHM_SS, 0);
+	hi = shm_alloc_a(&a, SHM_II, 0);
+	hs = shs_alloc_a(&a, SHS_S, 0);
+	res |= !shm_set_string_pool(hi, S_TRUE) ? 0 : 1;
+#ifdef S_ENABLE_SM_STRING_OPTIMIZATION
+	res |= shm_set_string_pool(hp, S_TRUE)
+			       && shs_set_string_pool(hs, S_TRUE)
+		       ? 0
+		       : 2;
+#endif
+	/* Strings too long for the node */
+	sst_reset();
+	for (i = 0; i < n; i++) {
+		ss_printf(&k, 128, "key %i, long enough for not fitting "
+				   "into the node",
+			  (int)i);
+		ss_printf(&v, 128, "value %i, long enough for not fitting "
+				   "into the node",
+			  (int)i);
+		shm_insert_ss(&hm, k, v);
+	}
+	sst_get(SD_CT_STRING, &st);
+	na = st.allocs;
+	for (i = 0; i < n; i++) {
+		ss_printf(&k, 128, "key %i, long enough for not fitting "
+				   "into the node",
+			  (int)i);
+		ss_printf(&v, 128, "value %i, long enough for not fitting "
+				   "into the node",
+			  (int)i);
+		shm_insert_ss(&hp, k, v);
+		shs_insert_s(&hs, k);
+	}
+#ifdef S_ENABLE_SM_STRING_OPTIMIZATION
+	/* Pooled strings: no per-string heap allocation */
+	sst_get(SD_CT_STRING, &st);
+	res |= na >= 2 * n && st.allocs - na < n / 10 ? 0 : 4;
+	res |= shm_string_pool_size(hp) > 0 && !shm_string_pool_size(hm)
+		       ? 0
+		       : 8;
+#endif
+	res |= shm_size(hp) == n && shs_size(hs) == n
+			       && !strcmp(ss_to_c(shm_at_ss(hp, k)),
+					  ss_to_c(v))
+			       && shs_count_s(hs, k)
+		       ? 0
+		       : 16;
+	/* Overwrite, delete, copy */
+	shm_insert_ss(&hp, k, ss_crefa("short"));
+	shm_delete_s(hp, ss_crefa("key 0, long enough for not fitting "
+				  "into the node"));
+	hp2 = shm_dup(hp);
+	res |= shm_size(hp2) == n - 1
+			       && !strcmp(ss_to_c(shm_at_ss(hp2, k)), "short")
+			       && !shm_count_s(hp2,
+					       ss_crefa("key 0, long enough for "
+							"not fitting into the "
+							"node"))
+		       ? 0
+		       : 32;
+#ifdef S_ENABLE_SM_STRING_OPTIMIZATION
+	res |= shm_string_pool_size(hp2) > 0 ? 0 : 64;
+#endif
+	/* Shrink, disable, clear */
+	ps = shm_string_pool_size(hp);
+	shm_shrink_string_pool(hp);
+	res |= shm_string_pool_size(hp) <= ps ? 0 : 128;
+	res |= shm_set_string_pool(hp2, S_FALSE)
+			       && !shm_string_pool_size(hp2)
+			       && !strcmp(ss_to_c(shm_at_ss(hp2, k)), "short")
+		       ? 0
+		       : 256;
+	shm_clear(hp);
+	shm_insert_ss(&hp, k, v);
+	res |= shm_size(hp) == 1
+			       && !strcmp(ss_to_c(shm_at_ss(hp, k)), ss_to_c(v))
+		       ? 0
+		       : 512;
+	ss_free(&k);
+	ss_free(&v);
+#ifdef S_USE_VA_ARGS
+	shm_free(&hm, &hp, &hp2, &hi, &hs);
+#else
+	shm_free(&hm);
+	shm_free(&hp);
+	shm_free(&hp2);
+	shm_free(&hi);
+	shs_free(&hs);
+#endif
+	res |= c.allocs && c.allocs == c.frees ? 0 : 1024;
+	return res;
+}
+
+static int test_grow_policy()
+{
+	size_t i, as;
+	srt_vector *v = sv_alloc_t(SV_I32, 0), *v2 = sv_alloc_t(SV_I32, 0),
+		   *v3 = sv_alloc_t(SV_I32, 0);
+	srt_string *s = ss_dup_c("a" U8_S_N_TILDE_F1);
+	srt_hmap *hm = shm_alloc(SHM_II, 0);
+	int res = 0;
+	sv_set_grow_policy(v, SD_GROW_EXACT);
+	sv_set_grow_policy(v2, SD_GROW_DOUBLE);
+	sv_set_grow_policy(v3, SD_GROW_HALF | SD_GROW_PAGE);
+	shm_set_grow_policy(hm, SD_GROW_EXACT);
+	res |= sv_grow_policy(v2) == SD_GROW_DOUBLE ? 0 : 1;
+	res |= sv_grow_policy(v3) == (SD_GROW_HALF | SD_GROW_PAGE) ? 0 : 1;
+	res |= ss_grow_policy(s) == SD_GROW_DEFAULT ? 0 : 1;
+	/* Small-mode string: switched to full mode, keeping its contents */
+	res |= ss_set_grow_policy(&s, SD_GROW_EXACT)
+			       && ss_grow_policy(s) == SD_GROW_EXACT
+			       && ss_len_u(s) == 2
+			       && !strcmp(ss_to_c(s), "a" U8_S_N_TILDE_F1)
+		       ? 0
+		       : 2;
+	for (i = 0; i < 1000; i++) {
+		sv_push_i32(&v, (int32_t)i);
+		sv_push_i32(&v2, (int32_t)i);
+		sv_push_i32(&v3, (int32_t)i);
+		ss_cat_char(&s, 'a');
+		shm_insert_ii(&hm, (int64_t)i, (int64_t)i);
+	}
+	res |= sv_capacity(v) == 1000 && ss_capacity(s) == ss_size(s) ? 0 : 4;
+	res |= sv_capacity(v2) == 1022 ? 0 : 8;
+	as = sv_alloc_size(v3) % SD_PAGE_SIZE;
+	res |= !as || SD_PAGE_SIZE - as < sizeof(int32_t) ? 0 : 16;
+	res |= sv_at_i32(v3, 999) == 999 && ss_len_u(s) == 1002 ? 0 : 32;
+	res |= shm_size(hm) == 1000 && shm_at_ii(hm, 999) == 999 ? 0 : 32;
+#ifdef S_USE_VA_ARGS
+	sv_free(&v, &v2, &v3);
+#else
+	sv_free(&v);
+	sv_free(&v2);
+	sv_free(&v3);
+#endif
+	ss_free(&s);
+	shm_free(&hm);
+	return res;
+}
+
+static int test_auto_shrink()
+{
+	size_t i, n = 100000, hb;
+	srt_vector *v = sv_alloc_t(SV_I32, 0), *v2 = sv_alloc_t(SV_I32, 0);
+	srt_string *s = ss_alloc(0);
+	srt_hmap *hm = shm_alloc(SHM_II, 0);
+	int res = 0;
+	sv_set_grow_policy(v, SD_GROW_DEFAULT | SD_GROW_SHRINK);
+	res |= ss_set_grow_policy(&s, SD_GROW_DOUBLE | SD_GROW_SHRINK) ? 0 : 1;
+	shm_set_grow_policy(hm, SD_GROW_SHRINK);
+	for (i = 0; i < n; i++) {
+		sv_push_i32(&v, (int32_t)i);
+		sv_push_i32(&v2, (int32_t)i);
+		ss_cat_char(&s, 'a' + (int)(i % 26));
+		shm_insert_ii(&hm, (int64_t)i, (int64_t)i);
+	}
+	/* Vector and string: shrink below 1/4 usage, to 1/2 usage */
+	sv_resize(&v, n / 2);
+	sv_resize(&v2, 100);
+	res |= sv_capacity(v) >= n && sv_capacity(v2) >= n ? 0 : 2;
+	sv_erase(&v, 100, n / 2 - 100);
+	sv_resize(&v2, 100);
+	res |= sv_size(v) == 100 && sv_capacity(v) == 200
+			       && sv_at_i32(v, 99) == 99 && sv_capacity(v2) >= n
+		       ? 0
+		       : 4;
+	ss_resize(&s, 10, 0);
+	res |= ss_size(s) == 10 && ss_capacity(s) < 100
+			       && !strcmp(ss_to_c(s), "abcdefghij")
+		       ? 0
+		       : 8;
+	/* Hash map: bucket array halving on delete, data on next insert */
+	hb = hm->hbits;
+	for (i = 100; i < n; i++)
+		shm_delete_i(hm, (int64_t)i);
+	res |= hm->hbits < hb && shm_size(hm) == 100 ? 0 : 16;
+	shm_insert_ii(&hm, -1, -1);
+	res |= shm_max_size(hm) < 1000 && shm_at_ii(hm, 99) == 99
+			       && shm_at_ii(hm, -1) == -1
+			       && !shm_count_i(hm, 100)
+		       ? 0
+		       : 32;
+	for (i = 0; i < 100; i++)
+		res |= shm_at_ii(hm, (int64_t)i) == (int64_t)i ? 0 : 64;
+#ifdef S_USE_VA_ARGS
+	sv_free(&v, &v2);
+#else
+	sv_free(&v);
+	sv_free(&v2);
+#endif
+	ss_free(&s);
+	shm_free(&hm);
+	return res;
+}
+
+static int test_spill()
+{
+	int32_t j;
+	size_t i, n = 16;
+	srt_alloc_stats st;
+	srt_vector *v = sv_alloca_t(SV_I32, 16);
+	srt_string *s = ss_alloca_spill(16), *s2 = ss_alloca(16);
+	srt_hmap *hm = shm_alloca(SHM_II32, 32); /* rehash before full */
+	srt_map *m = sm_alloca(SM_II32, 16);
+	FILE *f;
+	int res = 0;
+	sv_set_grow_policy(v, SD_GROW_SPILL);
+	shm_set_grow_policy(hm, SD_GROW_SPILL);
+	sm_set_grow_policy(m, SD_GROW_SPILL);
+	/* Small strings have no room for the policy */
+	res |= !ss_set_grow_policy(&s2, SD_GROW_SPILL) ? 0 : 1;
+	sst_reset();
+	/* Fill the stack space: no heap allocation */
+	for (i = 0; i < n; i++) {
+		sv_push_i32(&v, (int32_t)i);
+		ss_cat_char(&s, 'a' + (int)i);
+		shm_insert_ii32(&hm, (int32_t)i, (int32_t)i);
+		sm_insert_ii32(&m, (int32_t)i, (int32_t)i);
+	}
+	sst_get_all(&st);
+	res |= !st.allocs && v->d.f.ext_buffer && s->d.f.ext_buffer
+			       && hm->d.f.ext_buffer && m->d.f.ext_buffer
+		       ? 0
+		       : 2;
+	/* Overflow: moved to the heap, without errors */
+	for (i = n; i < 10 * n; i++) {
+		sv_push_i32(&v, (int32_t)i);
+		ss_cat_char(&s, 'a' + (int)(i % 26));
+		shm_insert_ii32(&hm, (int32_t)i, (int32_t)i);
+		sm_insert_ii32(&m, (int32_t)i, (int32_t)i);
+	}
+	sst_get_all(&st);
+	res |= st.allocs == 4 && !v->d.f.ext_buffer && !s->d.f.ext_buffer
+			       && !hm->d.f.ext_buffer && !m->d.f.ext_buffer
+		       ? 0
+		       : 4;
+	res |= !sv_alloc_errors(v) && !ss_alloc_errors(s)
+			       && !shm_alloc_errors(hm) && !sm_alloc_errors(m)
+		       ? 0
+		       : 8;
+	res |= sv_size(v) == 10 * n && ss_size(s) == 10 * n
+			       && shm_size(hm) == 10 * n && sm_size(m) == 10 * n
+			       && !strncmp(ss_to_c(s), "abcdefghijklmnopqrstuvwxyz",
+					   26)
+		       ? 0
+		       : 16;
+	for (i = 0; i < 10 * n; i++) {
+		j = (int32_t)i;
+		res |= sv_at_i32(v, i) == j && shm_at_ii32(hm, j) == j
+				       && sm_at_ii32(m, j) == j
+			       ? 0
+			       : 32;
+	}
+	/* Spilled containers are released as heap containers */
+	sv_free(&v);
+	ss_free(&s);
+	shm_free(&hm);
+	sm_free(&m);
+	sst_get_all(&st);
+	res |= st.frees == 4 ? 0 : 64;
+	/* Spill strings are not limited to the buffer size */
+	s = ss_alloca_spill(16);
+	res |= ss_max(s) > ss_capacity(s) && ss_max(s2) == ss_capacity(s2)
+		       ? 0
+		       : 128;
+	f = fopen(STEST_FILE, S_FOPEN_BINARY_RW_TRUNC);
+	if (f) {
+		ss_write(f, ss_crefa("once upon a time, there was a spill"),
+			 0, S_NPOS);
+		ss_cat_c(&s, "read: ");
+		fseek(f, 0, SEEK_SET);
+		ss_cat_read(&s, f, 100);
+		res |= !s->d.f.ext_buffer && !ss_alloc_errors(s)
+				       && !strcmp(ss_to_c(s),
+						  "read: once upon a time, "
+						  "there was a spill")
+			       ? 0
+			       : 256;
+		fclose(f);
+		res |= !remove(STEST_FILE) ? 0 : 512;
+	}
+	ss_free(&s);
+	return res;
+}
+
+static int test_alloc_cache()
+{
+	size_t i;
+	char *p, *p2;
+	int res = 0;
+	p = (char *)s_malloc(20);
+	if (!p)
+		return 1;
+	memcpy(p, "0123456789012345678", 20);
+	p2 = (char *)s_realloc(p, 30);
+#ifdef S_ALLOC_CACHE
+	res |= p2 == p ? 0 : 2; /* same size class: in place */
+#endif
+	p = p2 ? p2 : p;
+	p2 = (char *)s_realloc(p, 2000);
+	res |= p2 && !strcmp(p2, "0123456789012345678") ? 0 : 4;
+	p = p2 ? p2 : p;
+	s_free(p);
+	for (i = 0; i < 1000; i++) {
+		p = (char *)s_malloc(i);
+		p2 = (char *)s_calloc(1, i + 1);
+		if (!p || !p2 || p2[i]) {
+			res |= 8;
+			break;
+		}
+		memset(p, 1, i);
+		s_free(p);
+		s_free(p2);
+	}
+#ifdef S_ALLOC_CACHE
+	p = (char *)s_malloc(100);
+	s_free(p);
+	p2 = (char *)s_malloc(120); /* reused from the cache */
+	res |= p2 == p ? 0 : 16;
+	s_free(p2);
+#endif
+	s_alloc_cache_flush();
+	return res;
+}
+
+static int test_sa()
+{
+	size_t i, n = 1000;
+	srt_arena *a = sa_alloc(1024);
+	const srt_allocator *al = sa_allocator(a);
+	srt_string *s, *s2;
+	const srt_string *s0;
+	srt_vector *v;
+	srt_hmap *hm;
+	void *p;
+	int res = a && al ? 0 : 1;
+	s = ss_alloc_a(al, 8);
+	s2 = ss_alloc_a(al, 8);
+	ss_cpy_c(&s2, "abc");
+	s0 = s2;
+	ss_cat_c(&s2, "defghijklmnopqrstuvwxyz"); /* top: in-place growth */
+	res |= s0 == s2 && !strcmp(ss_to_c(s2), "abcdefghijklmnopqrstuvwxyz")
+		       ? 0
+		       : 2;
+	v = sv_alloc_t_a(al, SV_U32, 0);
+	hm = shm_alloc_a(al, SHM_II, 0);
+	for (i = 0; i < n; i++) {
+		ss_cat_char(&s, 'a' + (i % 26));
+		sv_push_u32(&v, (uint32_t)i);
+		shm_insert_ii(&hm, (int64_t)i, (int64_t)i * 2);
+	}
+	res |= ss_size(s) == n && ss_at(s, 27) == 'b' && ss_size(s2) == 26
+			       && sv_size(v) == n && sv_at_u32(v, 999) == 999
+			       && shm_at_ii(hm, 998) == 1996
+		       ? 0
+		       : 4;
+	res |= sa_nchunks(a) > 1 && sa_alloc_size(a) > 1024 ? 0 : 8;
+	/* Big blocks are released on free */
+	i = sa_nchunks(a);
+	sv_free(&v);
+	res |= sa_nchunks(a) == i - 1 ? 0 : 16;
+	/* Raw memory */
+	p = sa_malloc(a, 10);
+	memcpy(p, "123456789", 10);
+	p = sa_realloc(a, p, 100);
+	res |= p && !strcmp((char *)p, "123456789") ? 0 : 32;
+	sa_free_ptr(a, p);
+	/* Bulk release */
+	sa_reset(a);
+	res |= sa_nchunks(a) == 1 ? 0 : 64;
+	s = ss_dup_c("x");
+	s2 = ss_alloc_a(al, 0);
+	ss_cpy(&s2, s);
+	res |= !ss_cmp(s, s2) ? 0 : 128;
+#ifdef S_USE_VA_ARGS
+	ss_free(&s, &s2);
+#else
+	ss_free(&s);
+	ss_free(&s2);
+#endif
+	sa_free(&a);
+	res |= !a ? 0 : 256;
+	return res;
+}
+
+static int test_sst()
+{
+	size_t i, n = 1000;
+	srt_alloc_stats st, all;
+	srt_vector *v;
+	srt_hmap *hm;
+	srt_string *s;
+	int res = 0;
+	sst_reset();
+	sst_get_all(&all);
+	res |= !all.allocs && !all.alloc_bytes ? 0 : 1;
+	v = sv_alloc_t(SV_I32, 0);
+	hm = shm_alloc(SHM_II, 0);
+	s = ss_alloc(0);
+	for (i = 0; i < n; i++) {
+		sv_push_i32(&v, (int32_t)i);
+		shm_insert_ii(&hm, (int64_t)i, (int64_t)i);
+		ss_cat_char(&s, 'a');
+	}
+	sv_reserve(&v, 2 * n);
+	sv_shrink(&v);
+	res |= sst_get(SD_CT_VECTOR, &st) && st.allocs == 1 && st.grows > 0
+			       && st.shrinks == 1
+			       && st.grow_bytes >= st.grow_req_bytes
+		       ? 0
+		       : 2;
+	res |= sst_get(SD_CT_HMAP, &st) && st.allocs == 1 && st.rehashes > 0
+			       && st.reallocs >= st.rehashes
+		       ? 0
+		       : 4;
+	res |= sst_get(SD_CT_STRING, &st) && st.allocs == 1 && st.grows > 0
+		       ? 0
+		       : 8;
+	res |= !sst_get(SD_CT_NumTypes, &st) && !sst_get(SD_CT_MAP, NULL)
+		       ? 0
+		       : 16;
+	sv_free(&v);
+	shm_free(&hm);
+	ss_free(&s);
+	sst_get_all(&all);
+	res |= all.allocs == 3 && all.frees == 3
+			       && all.alloc_bytes == all.free_bytes
+		       ? 0
+		       : 32;
+	sst_reset();
+	sst_get_all(&all);
+	res |= !all.allocs && !all.frees ? 0 : 64;
+	return res;
+}
+
+/* Overwrite image file bytes (e.g. for corrupting a stored image) */
+static srt_bool aux_image_patch(size_t off, const void *p, size_t size)
+{
+	srt_bool r;
+	FILE *f = fopen(STEST_FILE, "r+b");
+	RETURN_IF(!f, S_FALSE);
+	r = !fseek(f, (long)off, SEEK_SET) && fwrite(p, 1, size, f) == size
+		    ? S_TRUE
+		    : S_FALSE;
+	fclose(f);
+	return r;
+}
+
+/* Save the map with a string type in both the image and container headers */
+static srt_bool aux_image_sub_type(const srt_hmap *hm, const srt_map *m,
+				   uint8_t t)
+{
+	srt_bool r;
+	size_t hs = sizeof(struct SDImageHdr);
+	FILE *f = fopen(STEST_FILE, S_FOPEN_BINARY_RW_TRUNC);
+	RETURN_IF(!f, S_FALSE);
+	r = hm ? shm_save(f, hm) : sm_save(f, m);
+	fclose(f);
+	return r && aux_image_patch(offsetof(struct SDImageHdr, sub_type),
+				    &t, 1)
+		       && aux_image_patch(hs + offsetof(struct SDataFull,
+							sub_type),
+					  &t, 1);
+}
+
+static int test_image()
+{
+	FILE *f;
+	size_t i, n = 1000;
+	srt_hmap *hm = shm_alloc(SHM_II, 0), *hm2 = NULL;
+	srt_map *m = sm_alloc(SM_II32, 0), *m2 = NULL, *ms = sm_alloc(SM_SI, 0);
+	srt_vector *v = sv_alloc_t(SV_U32, 0), *v2 = NULL;
+	srt_bitset *b = sb_alloc(n), *b2 = NULL;
+	srt_arena *pool;
+	uint32_t hbits;
+	int res = 0;
+	for (i = 0; i < n; i++) {
+		shm_insert_ii(&hm, (int64_t)i, (int64_t)i * 2);
+		sm_insert_ii32(&m, (int32_t)i, -(int32_t)i);
+		sv_push_u32(&v, (uint32_t)i * 3);
+		if (i % 3 == 0)
+			sb_set(&b, i);
+	}
+	shm_delete_i(hm, 10); /* hole filled with the tail element */
+	sm_insert_si(&ms, ss_crefa("a"), 1);
+	/* Save/load: several images in the same file */
+	f = fopen(STEST_FILE, S_FOPEN_BINARY_RW_TRUNC);
+	if (!f)
+		return 1;
+	res |= shm_save(f, hm) && sm_save(f, m) && sv_save(f, v) && sb_save(f, b)
+		       ? 0
+		       : 2;
+	res |= !sm_save(f, ms) && !sv_save(f, NULL) ? 0 : 4; /* unsupported */
+	res |= !fseek(f, 0, SEEK_SET) ? 0 : 8;
+	hm2 = shm_load(f);
+	m2 = sm_load(f);
+	v2 = sv_load(f);
+	b2 = sb_load(f);
+	res |= !shm_load(f) ? 0 : 16; /* EOF */
+	fclose(f);
+	res |= hm2 && shm_size(hm2) == n - 1 && shm_at_ii(hm2, 999) == 1998
+			       && !shm_count_i(hm2, 10)
+		       ? 0
+		       : 32;
+	res |= m2 && sm_size(m2) == n && sm_at_ii32(m2, 500) == -500 ? 0 : 64;
+	res |= v2 && sv_size(v2) == n && sv_at_u32(v2, 999) == 2997 ? 0 : 128;
+	res |= b2 && sb_popcount(b2) == sb_popcount(b) && sb_test(b2, 999)
+			       && !sb_test(b2, 998)
+		       ? 0
+		       : 256;
+	/* Loaded containers are dynamic */
+	res |= shm_insert_ii(&hm2, 5000, 1) && sm_insert_ii32(&m2, 5000, 1)
+			       && sv_push_u32(&v2, 1) && shm_at_ii(hm2, 3) == 6
+			       && sm_at_ii32(m2, 3) == -3
+		       ? 0
+		       : 512;
+#ifdef S_USE_VA_ARGS
+	shm_free(&hm2);
+	sm_free(&m2, &ms);
+	sv_free(&v2);
+#else
+	shm_free(&hm2);
+	sm_free(&m2);
+	sm_free(&ms);
+	sv_free(&v2);
+#endif
+	sb_free(&b2);
+	/* Corrupted images: rejected, without type-specific release */
+	f = fopen(STEST_FILE, S_FOPEN_BINARY_RW_TRUNC);
+	res |= f && shm_save(f, hm) ? 0 : 65536;
+	if (f)
+		fclose(f);
+	hbits = 0;
+	pool = (srt_arena *)(uintptr_t)0x10;
+	res |= aux_image_patch(sizeof(struct SDImageHdr)
+					       + offsetof(srt_hmap, hbits),
+			       &hbits, sizeof(hbits))
+			       && aux_image_patch(sizeof(struct SDImageHdr)
+							  + offsetof(srt_hmap,
+								     pool),
+						  &pool, sizeof(pool))
+		       ? 0
+		       : 65536;
+	f = fopen(STEST_FILE, "rb");
+	res |= f && !shm_load(f) ? 0 : 131072;
+	if (f)
+		fclose(f);
+	res |= aux_image_sub_type(hm, NULL, SHM_SS) ? 0 : 65536;
+	f = fopen(STEST_FILE, "rb");
+	res |= f && !shm_load(f) ? 0 : 131072;
+	if (f)
+		fclose(f);
+	res |= aux_image_sub_type(NULL, m, SM_SS) ? 0 : 65536;
+	f = fopen(STEST_FILE, "rb");
+	res |= f && !sm_load(f) ? 0 : 131072;
+	if (f)
+		fclose(f);
+	/* Memory-mapped images */
+	if (svm_mmap_support()) {
+		f = fopen(STEST_FILE, S_FOPEN_BINARY_RW_TRUNC);
+		res |= f && shm_save(f, hm) ? 0 : 1024;
+		if (f)
+			fclose(f);
+		hm2 = shm_map(STEST_FILE);
+		res |= hm2 && shm_size(hm2) == n - 1
+				       && shm_at_ii(hm2, 500) == 1000
+				       && !shm_insert_ii(&hm2, 5000, 1)
+				       && shm_size(hm2) == n - 1
+			       ? 0
+			       : 2048;
+		shm_unmap(&hm2);
+		f = fopen(STEST_FILE, S_FOPEN_BINARY_RW_TRUNC);
+		res |= f && sm_save(f, m) ? 0 : 4096;
+		if (f)
+			fclose(f);
+		m2 = sm_map(STEST_FILE);
+		res |= m2 && sm_size(m2) == n && sm_at_ii32(m2, 999) == -999
+			       ? 0
+			       : 8192;
+		sm_unmap(&m2);
+		res |= !sv_map(STEST_FILE) && !m2 && !hm2 ? 0 : 16384;
+	}
+	res |= !remove(STEST_FILE) ? 0 : 32768;
+	shm_free(&hm);
+	sm_free(&m);
+	sv_free(&v);
+	sb_free(&b);
+	return res;
+}
+
+static int test_svm()
+{
+	size_t i, n = 1000000;
+	const srt_allocator *al = svm_allocator(S_FALSE),
+			    *alh = svm_allocator(S_TRUE);
+	srt_string *s = ss_alloc_a(al, 0);
+	srt_vector *v = sv_alloc_t_a(alh, SV_U32, 0);
+	srt_hmap *hm = shm_alloc_a(al, SHM_II, 0);
+	int res = al && alh && al != alh && s && v && hm ? 0 : 1;
+	res |= sd_alloc_id((const srt_data *)v) != 0 ? 0 : 2;
+	for (i = 0; i < n; i++) {
+		ss_cat_char(&s, 'a' + (int)(i % 26));
+		sv_push_u32(&v, (uint32_t)i);
+		if (i < n / 10)
+			shm_insert_ii(&hm, (int64_t)i, (int64_t)i * 2);
+	}
+	res |= ss_size(s) == n && ss_at(s, n - 1) == 'a' + (int)((n - 1) % 26)
+		       ? 0
+		       : 4;
+	res |= sv_size(v) == n && sv_at_u32(v, 0) == 0
+			       && sv_at_u32(v, n - 1) == n - 1
+		       ? 0
+		       : 8;
+	res |= shm_size(hm) == n / 10
+			       && shm_at_ii(hm, (int64_t)(n / 10 - 1))
+					  == (int64_t)(n / 5 - 2)
+		       ? 0
+		       : 16;
+	/* Shrink (mapped blocks stay mapped) */
+	sv_resize(&v, 10);
+	sv_shrink(&v);
+	ss_resize(&s, 10, ' ');
+	ss_shrink(&s);
+	res |= sv_size(v) == 10 && sv_at_u32(v, 9) == 9 && ss_size(s) == 10
+			       && ss_at(s, 9) == 'j'
+		       ? 0
+		       : 32;
+	sv_free(&v);
+	ss_free(&s);
+	shm_free(&hm);
+	res |= svm_mremap_support() ? (svm_mmap_support() ? 0 : 64) : 0;
+	return res;
+}
+
 #define TEST_SHM_ALLOC_DONOTHING(a)
 #define TEST_SHM_ALLOC_X(fn, shm_alloc_X, type, insert, at, shm_free_X)        \
 	static int fn()                                                        \
@@ -6385,6 +8585,7 @@ int main()
 	STEST_ASSERT(test_ss_len_left());
 	STEST_ASSERT(test_ss_max());
 	STEST_ASSERT(test_ss_dup());
+	STEST_ASSERT(test_ss_share());
 	STEST_ASSERT(test_ss_dup_substr());
 	STEST_ASSERT(test_ss_dup_substr_u());
 	STEST_ASSERT(test_ss_dup_cn());
@@ -6400,6 +8601,15 @@ int main()
 		test_ss_dup_int(9223372036854775807LL, "9223372036854775807"));
 	STEST_ASSERT(test_ss_dup_int(-9223372036854775807LL,
 				     "-9223372036854775807"));
+	STEST_ASSERT(test_ss_dup_double(0, "0"));
+	STEST_ASSERT(test_ss_dup_double(0.1, "0.1"));
+	STEST_ASSERT(test_ss_dup_double(-1.5, "-1.5"));
+	STEST_ASSERT(test_ss_dup_double(1e21, "1e21"));
+	STEST_ASSERT(test_ss_dup_double(1e-7, "1e-7"));
+	STEST_ASSERT(test_ss_dup_double(0.001234, "0.001234"));
+	STEST_ASSERT(test_ss_dup_double(123456789, "123456789"));
+	STEST_ASSERT(test_ss_dup_double(5e-324, "5e-324"));
+	STEST_ASSERT(test_ss_to_num());
 	stmp = ss_alloca(128);
 #define MK_TEST_SS_DUP_CPY_CAT(encc, decc, a, b)                               \
 	{                                                                      \
@@ -6498,6 +8708,7 @@ int main()
 	STEST_ASSERT(test_ss_cpy_char('a', "a"));
 	STEST_ASSERT(test_ss_cpy_char(0x24b62, U8_HAN_24B62));
 	STEST_ASSERT(test_ss_cat("hello", "all"));
+	STEST_ASSERT(test_ss_cat_list());
 	STEST_ASSERT(test_ss_cat_substr());
 	STEST_ASSERT(test_ss_cat_substr_u());
 	STEST_ASSERT(test_ss_cat_cn());
@@ -6718,10 +8929,20 @@ int main()
 	STEST_ASSERT(test_sm_itr());
 	STEST_ASSERT(test_sm_sort_to_vectors());
 	STEST_ASSERT(test_sm_double_rotation());
+	STEST_ASSERT(test_sm_btree());
+	STEST_ASSERT(test_sm_from_sorted_vectors());
+	STEST_ASSERT(test_st_kt());
+	STEST_ASSERT(test_sm_cursor());
+	STEST_ASSERT(test_sm_rank());
+	STEST_ASSERT(test_sm_part());
+	STEST_ASSERT(test_sm_compact());
+	STEST_ASSERT(test_sm_multi());
+	STEST_ASSERT(test_sm_split_join());
 	/*
 	 * Set
 	 */
 	STEST_ASSERT(test_sms());
+	STEST_ASSERT(test_sms_set_op());
 	/*
 	 * Hash map
 	 */
@@ -6753,6 +8974,25 @@ int main()
 	 * Hash set
 	 */
 	STEST_ASSERT(test_shs());
+	STEST_ASSERT(test_shs_set_op());
+	STEST_ASSERT(test_shm_string_pool());
+	/*
+	 * Rope
+	 */
+	STEST_ASSERT(test_sr());
+	/*
+	 * Allocator interface
+	 */
+	STEST_ASSERT(test_allocator());
+	STEST_ASSERT(test_sr_oom());
+	STEST_ASSERT(test_grow_policy());
+	STEST_ASSERT(test_auto_shrink());
+	STEST_ASSERT(test_spill());
+	STEST_ASSERT(test_alloc_cache());
+	STEST_ASSERT(test_sa());
+	STEST_ASSERT(test_svm());
+	STEST_ASSERT(test_image());
+	STEST_ASSERT(test_sst());
 	/*
 	 * Low level stuff
 	 */